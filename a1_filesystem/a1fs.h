@@ -44,6 +44,52 @@ typedef uint32_t a1fs_ino_t;
 /** Magic value that can be used to identify an a1fs image. */
 #define A1FS_MAGIC 0xC5C369A1C5C369A1ul
 
+/** Number of blocks in a 2 MB huge page. */
+#define A1FS_HUGE_BLOCKS ((2u << 20) / A1FS_BLOCK_SIZE)
+
+/**
+ * Superblock feature flag: the inode table, extent blocks and the data region
+ * start on 2 MB (A1FS_HUGE_BLOCKS) boundaries, so that data block numbers
+ * that are multiples of A1FS_HUGE_BLOCKS are 2 MB aligned in the image.
+ */
+#define A1FS_FEATURE_ALIGN 0x1
+
+/**
+ * Superblock feature flag: the image has a block reference count table (see
+ * start_refcount), so that files can share data blocks (clones).
+ */
+#define A1FS_FEATURE_REFLINK 0x2
+
+/**
+ * Superblock feature flag: the image has a metadata checksum table (see
+ * start_csum), so that corrupted metadata blocks can be detected.
+ */
+#define A1FS_FEATURE_CSUM 0x4
+
+/**
+ * Superblock feature flag: the inode table and extent blocks are initialized
+ * lazily (see inodes_init), so that formatting doesn't have to write them.
+ */
+#define A1FS_FEATURE_LAZY_INIT 0x8
+
+/**
+ * Superblock feature flag: the image is the first member of a striped volume,
+ * and the data region is spread over several image files (see stripe_count).
+ */
+#define A1FS_FEATURE_STRIPE 0x10
+
+/** Largest number of image files in a striped volume. */
+#define A1FS_STRIPE_MAX 16
+
+/** Magic value in the header of the other members of a striped volume. */
+#define A1FS_STRIPE_MAGIC 0xC5C369A1C5C3695Eul
+
+/**
+ * Metadata checksum table entry of a block that has no checksum yet. A block
+ * whose CRC32C is A1FS_CSUM_NONE is stored as 1 instead.
+ */
+#define A1FS_CSUM_NONE 0
+
 typedef struct bitmap {
 	unsigned char map[4096];
 } bitmap;
@@ -65,6 +111,43 @@ typedef struct a1fs_superblock {
 	unsigned int   blocks_count;      /* Blocks count */
 	unsigned int   free_blocks_count; /* Free blocks count */
 	unsigned int   free_inodes_count; /* Free inodes count */
+	unsigned int   flags;             /* Feature flags (A1FS_FEATURE_*) */
+	/**
+	 * Block reference count table (A1FS_FEATURE_REFLINK only): a uint16_t per
+	 * data block holding the number of extra references to the block, i.e. 0
+	 * for a block used by a single file.
+	 */
+	int start_refcount;
+	/**
+	 * Metadata checksum table (A1FS_FEATURE_CSUM only): a uint32_t per block
+	 * before start_data holding the CRC32C of the block, or A1FS_CSUM_NONE
+	 * (always for the blocks of the table itself, and for inode table and
+	 * extent blocks that were never written).
+	 */
+	int start_csum;
+	/**
+	 * Number of inodes whose inode table entries and extent blocks have been
+	 * initialized (A1FS_FEATURE_LAZY_INIT only). Those of the inodes from this
+	 * number on may still hold whatever the image contained before it was
+	 * formatted; they are zeroed when one of these inodes is first allocated.
+	 */
+	unsigned int inodes_init;
+	/**
+	 * Largest blocks_count that the data bitmap (and the reference count
+	 * table) have room for, i.e. how far the file system can be grown in
+	 * place (see a1fs-resize); 0 if it can't be grown.
+	 */
+	unsigned int blocks_max;
+	/**
+	 * Striped volume geometry (A1FS_FEATURE_STRIPE only). The data region is
+	 * split into chunks of stripe_blocks blocks, and chunk i is stored in
+	 * member i % stripe_count of the volume, where the image holding this
+	 * superblock is member 0 (see a1fs_stripe_start()).
+	 */
+	unsigned int stripe_count;
+	unsigned int stripe_blocks;
+	/** Random number that identifies the members of a striped volume. */
+	uint64_t volume_id;
 } a1fs_superblock;
 
 
@@ -72,16 +155,80 @@ typedef struct a1fs_superblock {
 static_assert(sizeof(a1fs_superblock) <= A1FS_BLOCK_SIZE,
               "superblock is too large");
 
+/** Header in the first block of the members of a striped volume but the first. */
+typedef struct a1fs_stripe_header {
+	/** Must match A1FS_STRIPE_MAGIC. */
+	uint64_t magic;
+	/** Must match volume_id in the superblock. */
+	uint64_t volume_id;
+	/** Position of the member in the volume (from 1). */
+	unsigned int index;
+	/** Number of members in the volume. */
+	unsigned int stripe_count;
+
+} a1fs_stripe_header;
+
+/**
+ * Get the block of a member image of a striped volume where its chunks start.
+ *
+ * They are stored one after another in the order of their number, from the
+ * start of the data region in member 0, and after the header (or at the first
+ * 2 MB boundary with A1FS_FEATURE_ALIGN) in the others.
+ */
+static inline a1fs_blk_t a1fs_stripe_start(const a1fs_superblock *sb,
+                                           unsigned int member)
+{
+	if (member == 0) {
+		return sb->start_data;
+	}
+	return (sb->flags & A1FS_FEATURE_ALIGN) ? A1FS_HUGE_BLOCKS : 1;
+}
 
-/** Extent - a contiguous range of blocks. */
+
+/** Number of file blocks in a compressed cluster. */
+#define A1FS_CLUSTER_BLOCKS 16
+/** Size of a compressed cluster in bytes before compression. */
+#define A1FS_CLUSTER_SIZE (A1FS_CLUSTER_BLOCKS * A1FS_BLOCK_SIZE)
+
+/**
+ * Extent - a run of consecutive file blocks.
+ *
+ * The extents of a file are kept in file block order and cover the file from
+ * its first block without gaps, so the position of an extent in the file is
+ * the sum of the counts of the extents before it. A run of file blocks that
+ * has no data blocks (a hole) is an extent whose start is A1FS_EXTENT_HOLE.
+ * Blocks past the end of the last extent are a hole as well.
+ *
+ * A compressed extent (zblocks != 0) holds exactly one cluster: its count is
+ * A1FS_CLUSTER_BLOCKS, and the cluster is stored in the zblocks data blocks
+ * starting at start as a uint32_t compressed length followed by the data
+ * compressed with lz_compress() (see lz.h).
+ */
 typedef struct a1fs_extent {
-	/** Starting block of the extent. */
+	/** Starting block of the extent; A1FS_EXTENT_HOLE for a hole. */
 	a1fs_blk_t start;
-	/** Number of blocks in the extent. */
-	a1fs_blk_t count;
+	/** Number of blocks in the extent (at most A1FS_EXTENT_MAX). */
+	a1fs_blk_t count : 27;
+	/** Number of data blocks of a compressed extent; 0 if not compressed. */
+	a1fs_blk_t zblocks : 4;
+	/**
+	 * Blocks are allocated but were never written (e.g. by fallocate());
+	 * they read as zeros regardless of their contents.
+	 */
+	a1fs_blk_t unwritten : 1;
 
 } a1fs_extent;
 
+/** Start block of an extent that is a hole. */
+#define A1FS_EXTENT_HOLE ((a1fs_blk_t)-1)
+/** Largest number of blocks in an extent. */
+#define A1FS_EXTENT_MAX ((1u << 27) - 1)
+
+// A compressed cluster is only stored if it takes fewer blocks than plain data
+static_assert(A1FS_CLUSTER_BLOCKS - 1 < (1 << 4), "zblocks is too narrow");
+
+static_assert(sizeof(a1fs_extent) == 8, "invalid extent size");
+
 typedef struct a1fs_extent_block{
 	a1fs_extent extent_array[512];
 } a1fs_extent_block;
@@ -0,0 +1,493 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - In-process file system benchmark.
+ *
+ * Formats a scratch image, mounts it through the a1fs core library (no FUSE
+ * or kernel involved) and runs fio-style workloads against it: sequential and
+ * random 4 KiB reads and writes of a large file, storms of small file
+ * creates, stats and unlinks, and lookups of a deep path. Reports the
+ * throughput and the latency percentiles of the operations of each workload.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "format.h"
+#include "fs_ops.h"
+#include "map.h"
+
+
+/** Command line options. */
+typedef struct bench_opts {
+	/** Image file path. */
+	const char *img_path;
+	/** Image size in MiB. */
+	unsigned int img_size;
+	/** Storage backend, as in the backend= mount option. */
+	const char *backend;
+	/** Size of the file of the I/O workloads in MiB. */
+	unsigned int file_size;
+	/** Number of operations of the random I/O and lookup workloads. */
+	unsigned int ops;
+	/** Number of files of the create/stat/unlink workloads. */
+	unsigned int files;
+	/** Directory depth of the lookup workload. */
+	unsigned int depth;
+	/** Comma-separated workloads to run; NULL for all of them. */
+	const char *workloads;
+
+} bench_opts;
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, "Usage: %s [options] image\n\
+\n\
+Format a scratch image file and benchmark a1fs on it in-process.\n\
+\n\
+    -s size      image size in MiB (default 256)\n\
+    -b backend   storage backend: mmap (default), cache or uring\n\
+    -f size      file size in MiB for the I/O workloads (default 64)\n\
+    -n ops       number of random I/O and lookup operations (default 20000)\n\
+    -F files     number of files for the metadata workloads (default 1000)\n\
+    -d depth     directory depth for the lookup workload (default 32)\n\
+    -w list      workloads to run (default all): seq-write, seq-read,\n\
+                 rand-write, rand-read, create, stat, unlink, lookup\n\
+    -h           print help and exit\n\
+", progname);
+}
+
+static bool parse_args(int argc, char *argv[], bench_opts *opts)
+{
+	char o;
+	while ((o = getopt(argc, argv, "s:b:f:n:F:d:w:h")) != -1) {
+		switch (o) {
+			case 's': opts->img_size = strtoul(optarg, NULL, 10); break;
+			case 'b': opts->backend = optarg; break;
+			case 'f': opts->file_size = strtoul(optarg, NULL, 10); break;
+			case 'n': opts->ops = strtoul(optarg, NULL, 10); break;
+			case 'F': opts->files = strtoul(optarg, NULL, 10); break;
+			case 'd': opts->depth = strtoul(optarg, NULL, 10); break;
+			case 'w': opts->workloads = optarg; break;
+			case 'h': print_help(stdout, argv[0]); exit(0);
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "Missing image path\n");
+		return false;
+	}
+	opts->img_path = argv[optind];
+	if (opts->img_size == 0 || opts->file_size == 0 || opts->ops == 0 ||
+	    opts->files == 0 || opts->depth == 0)
+	{
+		fprintf(stderr, "Invalid size or count\n");
+		return false;
+	}
+	if ((size_t)opts->file_size >= opts->img_size) {
+		fprintf(stderr, "The file doesn't fit in the image\n");
+		return false;
+	}
+	if (opts->backend && strcmp(opts->backend, "mmap") != 0 &&
+	    strcmp(opts->backend, "cache") != 0 &&
+	    strcmp(opts->backend, "uring") != 0)
+	{
+		fprintf(stderr, "Invalid backend: %s\n", opts->backend);
+		return false;
+	}
+	return true;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** Latencies of the operations of a workload run. */
+typedef struct lat_log {
+	/** Latency of each operation in ns. */
+	uint64_t *ns;
+	/** Number of operations recorded. */
+	size_t n;
+	/** Capacity of the ns array. */
+	size_t cap;
+
+} lat_log;
+
+/** Record the latency of an operation that started at start (now_ns()). */
+static void lat_record(lat_log *log, uint64_t start)
+{
+	uint64_t ns = now_ns() - start;
+	if (log->n == log->cap) {
+		size_t cap = log->cap ? log->cap * 2 : 4096;
+		uint64_t *p = realloc(log->ns, cap * sizeof(*p));
+		if (!p) {
+			return;// keep the latencies recorded so far
+		}
+		log->ns = p;
+		log->cap = cap;
+	}
+	log->ns[log->n++] = ns;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+/** Get the p-th percentile (0 < p <= 100) of sorted latencies in us. */
+static double percentile(const lat_log *log, double p)
+{
+	size_t i = (size_t)(p / 100 * log->n + 0.5);
+	i = (i == 0) ? 0 : i - 1;
+	return log->ns[i < log->n ? i : log->n - 1] / 1e3;
+}
+
+/** Print the results of a workload run. */
+static void report(const char *name, lat_log *log, uint64_t elapsed,
+                   uint64_t bytes)
+{
+	printf("%-10s %8zu", name, log->n);
+	if (log->n == 0) {
+		printf("\n");
+		return;
+	}
+	qsort(log->ns, log->n, sizeof(*log->ns), cmp_u64);
+	double secs = elapsed / 1e9;
+	printf(" %10.0f", log->n / secs);
+	if (bytes > 0) {
+		printf(" %8.1f", bytes / secs / 1e6);
+	} else {
+		printf(" %8s", "-");
+	}
+	printf(" %8.1f %8.1f %8.1f %8.1f %9.1f\n", percentile(log, 50),
+	       percentile(log, 90), percentile(log, 99), percentile(log, 99.9),
+	       log->ns[log->n - 1] / 1e3);
+}
+
+/** Create the image file and format it into a1fs. */
+static bool make_image(const bench_opts *opts, size_t n_inodes)
+{
+	int fd = open(opts->img_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(opts->img_path);
+		return false;
+	}
+	int ret = ftruncate(fd, (off_t)opts->img_size << 20);
+	close(fd);
+	if (ret < 0) {
+		perror("ftruncate");
+		return false;
+	}
+
+	format_opts fopts = { .n_inodes = n_inodes };
+	map_opts mopts = { .meta_size = format_meta_size, .arg = &fopts };
+	size_t size;
+	void *image = map_file(opts->img_path, A1FS_BLOCK_SIZE, &size, &mopts);
+	if (!image) {
+		return false;
+	}
+	bool ok = format_image(image, size, &fopts);
+	munmap(image, size);
+	return ok;
+}
+
+/** Workload kinds. */
+enum workload {
+	SEQ_WRITE, SEQ_READ, RAND_WRITE, RAND_READ, CREATE, STAT, UNLINK, LOOKUP,
+	NUM_WORKLOADS
+};
+
+static const char *workload_names[NUM_WORKLOADS] = {
+	"seq-write", "seq-read", "rand-write", "rand-read", "create", "stat",
+	"unlink", "lookup",
+};
+
+/** Benchmark state shared by the workloads. */
+typedef struct bench {
+	const bench_opts *opts;
+	fs_ctx fs;
+	/** Number of blocks of the I/O workload file. */
+	size_t nblocks;
+	/** One block of incompressible data to write. */
+	char buf[A1FS_BLOCK_SIZE];
+	/** Path of the file at the bottom of the deep directory tree. */
+	char deep_path[A1FS_PATH_MAX];
+
+} bench;
+
+#define IO_FILE "/io"
+#define FILES_DIR "/files"
+
+/** Block number of the i-th random access; a fixed permutation. */
+static size_t random_blk(size_t i, size_t nblocks)
+{
+	// Multiplying by a prime that doesn't divide nblocks permutes the blocks
+	return (i * 2654435761u) % nblocks;
+}
+
+/** Write the whole I/O file sequentially; the seq-write workload. */
+static int write_file(bench *b, lat_log *log)
+{
+	uint64_t fh;
+	int ret = fs_create(&b->fs, IO_FILE, S_IFREG | 0644, &fh);
+	if (ret < 0) {
+		return ret;
+	}
+	for (size_t i = 0; i < b->nblocks && ret >= 0; i++) {
+		uint64_t start = now_ns();
+		ret = fs_write(&b->fs, IO_FILE, b->buf, A1FS_BLOCK_SIZE,
+		               i * A1FS_BLOCK_SIZE);
+		lat_record(log, start);
+	}
+	fs_release(&b->fs, IO_FILE, fh);
+	return ret < 0 ? ret : fs_fsync(&b->fs, IO_FILE, 0);
+}
+
+/** Create the files of the metadata workloads; the create workload. */
+static int create_files(bench *b, lat_log *log)
+{
+	int ret = fs_mkdir(&b->fs, FILES_DIR, 0755);
+	for (unsigned int i = 0; i < b->opts->files && ret >= 0; i++) {
+		char path[64];
+		snprintf(path, sizeof(path), FILES_DIR "/f%u", i);
+		uint64_t fh;
+		uint64_t start = now_ns();
+		ret = fs_create(&b->fs, path, S_IFREG | 0644, &fh);
+		if (ret == 0) {
+			ret = fs_release(&b->fs, path, fh);
+		}
+		lat_record(log, start);
+	}
+	return ret;
+}
+
+/**
+ * Run one workload.
+ *
+ * Workloads that need files created by an earlier one create them first if
+ * it wasn't run (without recording that).
+ *
+ * @param b      benchmark state.
+ * @param w      workload to run.
+ * @param log    receives the latencies of the operations.
+ * @param bytes  receives the number of bytes read or written.
+ * @return       0 on success; -errno on error.
+ */
+static int run(bench *b, enum workload w, lat_log *log, uint64_t *bytes)
+{
+	fs_ctx *fs = &b->fs;
+	lat_log setup = {0};
+	int ret = 0;
+	uint64_t fh;
+	*bytes = 0;
+
+	bool has_file = fs_lookup(fs, IO_FILE) >= 0;
+	bool has_files = fs_lookup(fs, FILES_DIR) >= 0;
+	if ((w == SEQ_READ || w == RAND_WRITE || w == RAND_READ) && !has_file) {
+		ret = write_file(b, &setup);
+	}
+	if ((w == STAT || w == UNLINK) && !has_files) {
+		ret = create_files(b, &setup);
+	}
+	free(setup.ns);
+	if (ret < 0) {
+		return ret;
+	}
+
+	switch (w) {
+	case SEQ_WRITE:
+		if (has_file) {
+			return -EEXIST;
+		}
+		*bytes = b->nblocks * A1FS_BLOCK_SIZE;
+		return write_file(b, log);
+
+	case SEQ_READ:
+	case RAND_READ: {
+		ret = fs_open(fs, IO_FILE, &fh);
+		size_t n = (w == SEQ_READ) ? b->nblocks : b->opts->ops;
+		char data[A1FS_BLOCK_SIZE];
+		for (size_t i = 0; i < n && ret >= 0; i++) {
+			size_t blk = (w == SEQ_READ) ? i : random_blk(i, b->nblocks);
+			uint64_t start = now_ns();
+			ret = fs_read(fs, IO_FILE, data, A1FS_BLOCK_SIZE,
+			              blk * A1FS_BLOCK_SIZE, fh);
+			lat_record(log, start);
+		}
+		fs_release(fs, IO_FILE, fh);
+		*bytes = n * A1FS_BLOCK_SIZE;
+		return ret;
+	}
+	case RAND_WRITE:
+		ret = fs_open(fs, IO_FILE, &fh);
+		for (size_t i = 0; i < b->opts->ops && ret >= 0; i++) {
+			uint64_t start = now_ns();
+			ret = fs_write(fs, IO_FILE, b->buf, A1FS_BLOCK_SIZE,
+			               random_blk(i, b->nblocks) * A1FS_BLOCK_SIZE);
+			lat_record(log, start);
+		}
+		fs_release(fs, IO_FILE, fh);
+		*bytes = (uint64_t)b->opts->ops * A1FS_BLOCK_SIZE;
+		return ret < 0 ? ret : fs_fsync(fs, IO_FILE, 0);
+
+	case CREATE:
+		if (has_files) {
+			return -EEXIST;
+		}
+		return create_files(b, log);
+
+	case STAT:
+	case UNLINK:
+		for (unsigned int i = 0; i < b->opts->files && ret >= 0; i++) {
+			char path[64];
+			snprintf(path, sizeof(path), FILES_DIR "/f%u", i);
+			struct stat st;
+			uint64_t start = now_ns();
+			ret = (w == STAT) ? fs_getattr(fs, path, &st)
+			                  : fs_unlink(fs, path);
+			lat_record(log, start);
+		}
+		return ret;
+
+	case LOOKUP: {
+		if (fs_lookup(fs, b->deep_path) < 0) {
+			// Build the tree: /d/d/.../d/file
+			char *end = b->deep_path;
+			for (unsigned int i = 0; i < b->opts->depth && ret >= 0; i++) {
+				end += sprintf(end, "/d");
+				ret = fs_mkdir(fs, b->deep_path, 0755);
+			}
+			strcpy(end, "/file");
+			if (ret >= 0) {
+				ret = fs_create(fs, b->deep_path, S_IFREG | 0644, &fh);
+			}
+			if (ret >= 0) {
+				ret = fs_release(fs, b->deep_path, fh);
+			}
+		}
+		for (size_t i = 0; i < b->opts->ops && ret >= 0; i++) {
+			struct stat st;
+			uint64_t start = now_ns();
+			ret = fs_getattr(fs, b->deep_path, &st);
+			lat_record(log, start);
+		}
+		return ret;
+	}
+	default:
+		assert(false);
+		return -EINVAL;
+	}
+}
+
+/** Check if a workload is in a comma-separated list. */
+static bool selected(const char *list, const char *name)
+{
+	if (!list) {
+		return true;
+	}
+	size_t len = strlen(name);
+	for (const char *p = list; p; p = strchr(p, ',')) {
+		if (*p == ',') {
+			p++;
+		}
+		if (strncmp(p, name, len) == 0 && (p[len] == ',' || p[len] == '\0')) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	bench_opts opts = {
+		.img_size  = 256,
+		.file_size = 64,
+		.ops       = 20000,
+		.files     = 1000,
+		.depth     = 32,
+	};
+	if (!parse_args(argc, argv, &opts)) {
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+
+	// Room for the files, the deep tree and their directories
+	if (!make_image(&opts, opts.files + opts.depth + 16)) {
+		fprintf(stderr, "Failed to create the image\n");
+		return 1;
+	}
+	a1fs_opts mopts = {
+		.img_path = opts.img_path,
+		.backend  = opts.backend,
+	};
+	a1fs_opt_defaults(&mopts);
+	bench *b = calloc(1, sizeof(*b));
+	if (!b) {
+		perror("calloc");
+		return 1;
+	}
+	b->opts = &opts;
+	b->nblocks = ((size_t)opts.file_size << 20) / A1FS_BLOCK_SIZE;
+	srand(369);
+	for (size_t i = 0; i < sizeof(b->buf); i++) {
+		b->buf[i] = rand();
+	}
+	if (!fs_mount(&b->fs, &mopts)) {
+		fprintf(stderr, "Failed to mount the image\n");
+		free(b);
+		return 1;
+	}
+	fs_start(&b->fs);
+
+	int ret = 0;
+	printf("%-10s %8s %10s %8s %8s %8s %8s %8s %9s\n", "workload", "ops",
+	       "ops/s", "MB/s", "p50 us", "p90 us", "p99 us", "p99.9 us",
+	       "max us");
+	for (int w = 0; w < NUM_WORKLOADS; w++) {
+		if (!selected(opts.workloads, workload_names[w])) {
+			continue;
+		}
+		lat_log log = {0};
+		uint64_t bytes;
+		uint64_t start = now_ns();
+		int err = run(b, w, &log, &bytes);
+		uint64_t elapsed = now_ns() - start;
+		if (err < 0) {
+			fprintf(stderr, "%s: %s\n", workload_names[w], strerror(-err));
+			ret = 1;
+		} else {
+			report(workload_names[w], &log, elapsed, bytes);
+		}
+		free(log.ns);
+	}
+
+	fs_unmount(&b->fs);
+	free(b);
+	return ret;
+}
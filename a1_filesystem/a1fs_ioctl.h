@@ -0,0 +1,194 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - a1fs ioctl interface header file.
+ *
+ * Requests that a1fs supports through ioctl() on files opened in a mounted
+ * a1fs. This header is shared by the file system and the programs that use
+ * these requests.
+ */
+
+#pragma once
+
+#include <limits.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// Only defined by <unistd.h> with _GNU_SOURCE; the values are fixed by Linux
+#ifndef SEEK_DATA
+#define SEEK_DATA 3
+#define SEEK_HOLE 4
+#endif
+
+
+/** Argument of A1FS_IOC_SEEK. */
+typedef struct a1fs_seek {
+	/** In: offset to search from; out: offset found. */
+	int64_t offset;
+	/** SEEK_DATA or SEEK_HOLE. */
+	int32_t whence;
+	/** Unused; must be 0. */
+	int32_t pad;
+
+} a1fs_seek;
+
+/**
+ * Find the next data or hole in a file, like lseek() with SEEK_DATA or
+ * SEEK_HOLE.
+ *
+ * FUSE 2.9 doesn't pass lseek() through to the file system, so sparse-aware
+ * programs use this request instead. Unwritten (preallocated) ranges count as
+ * holes since they read as zeros. Fails with ENXIO if the offset is at or past
+ * the end of file, or if there is no data after it (SEEK_DATA).
+ */
+#define A1FS_IOC_SEEK _IOWR('a', 1, a1fs_seek)
+
+/** Argument of A1FS_IOC_CLONE_RANGE. */
+typedef struct a1fs_clone_range {
+	/** Offset of the range in the source file. */
+	int64_t src_offset;
+	/** Length of the range; 0 to clone up to the end of the source file. */
+	int64_t length;
+	/** Offset of the range in the destination file. */
+	int64_t dest_offset;
+	/** Absolute path of the source file within the file system. */
+	char src_path[PATH_MAX];
+
+} a1fs_clone_range;
+
+/**
+ * Make a range of the file share the data of a range of another file (or of
+ * the same file), like the FICLONERANGE ioctl or copy_file_range().
+ *
+ * No data is copied, so cloning takes time proportional to the number of
+ * blocks rather than bytes; the files diverge block by block as either of
+ * them is written (copy-on-write). Offsets and the length must be multiples
+ * of the block size, except that a range that ends at the end of the source
+ * file may end in a partial block if it also ends at or past the end of the
+ * destination file. Requires an image formatted with mkfs.a1fs -r. FUSE 2.9
+ * doesn't pass copy_file_range() or the source file descriptor through, hence
+ * the source path.
+ *
+ * Errors: EINVAL (invalid range, or overlapping ranges in the same file),
+ * EISDIR (source is a directory), EOPNOTSUPP (clones not enabled), ENOSPC (too
+ * many extents), EMLINK (a block has too many references).
+ */
+#define A1FS_IOC_CLONE_RANGE _IOW('a', 2, a1fs_clone_range)
+
+/** A1FS_IOC_DEFRAG flag: only report the fragmentation of the file. */
+#define A1FS_DEFRAG_DRY_RUN 0x1
+
+/** Argument of A1FS_IOC_DEFRAG. */
+typedef struct a1fs_defrag {
+	/** A1FS_DEFRAG_* flags. */
+	uint32_t flags;
+	/** Unused; must be 0. */
+	uint32_t pad;
+	/** Out: number of extents before defragmenting. */
+	uint32_t extents_before;
+	/** Out: number of extents after defragmenting. */
+	uint32_t extents_after;
+	/** Out: number of contiguous runs of data blocks before defragmenting. */
+	uint32_t runs_before;
+	/** Out: number of contiguous runs of data blocks after defragmenting. */
+	uint32_t runs_after;
+
+} a1fs_defrag;
+
+/**
+ * Move the data blocks of a file into one contiguous run.
+ *
+ * The data is copied into a newly allocated run and written to the image
+ * before the extents of the file are switched over to it, so the file keeps
+ * its old blocks if anything fails. Holes and unwritten (preallocated)
+ * extents are kept. Extents only split at holes and unwritten ranges
+ * afterwards, so a file is fully defragmented when runs_after is 1.
+ *
+ * Errors: EBUSY (the file shares blocks with other files), ENOSPC (no free run
+ * large enough for the whole file).
+ */
+#define A1FS_IOC_DEFRAG _IOWR('a', 3, a1fs_defrag)
+
+/** A1FS_IOC_DEDUP flag: only count the blocks that could be shared. */
+#define A1FS_DEDUP_DRY_RUN 0x1
+
+/** Argument of A1FS_IOC_DEDUP. */
+typedef struct a1fs_dedup {
+	/** A1FS_DEDUP_* flags. */
+	uint32_t flags;
+	/** Unused; must be 0. */
+	uint32_t pad;
+	/** Out: number of data blocks of the file that were looked up. */
+	uint64_t scanned;
+	/** Out: number of them that now share an identical block (with
+	 *  A1FS_DEDUP_DRY_RUN, that could share one). */
+	uint64_t shared;
+	/** Out: number of entries in the dedup index. */
+	uint64_t index_entries;
+	/** Out: capacity of the dedup index in entries. */
+	uint64_t index_capacity;
+	/** Out: memory used by the dedup index in bytes. */
+	uint64_t index_memory;
+
+} a1fs_dedup;
+
+/**
+ * Make the data blocks of a file share identical blocks of the files
+ * deduplicated before it (and of itself), and remember its blocks for the
+ * files deduplicated after it.
+ *
+ * Blocks are found through the dedup index, an in-memory table of block
+ * fingerprints that lasts until the file system is unmounted and whose size
+ * is set with the dedup_index mount option; identical blocks are only found
+ * while both are in the index. The contents are compared before a block is
+ * shared, and shared blocks are copied again when either file writes them
+ * (copy-on-write). Compressed clusters are left alone. Requires an image
+ * formatted with mkfs.a1fs -r.
+ *
+ * Errors: EISDIR (the file is a directory), EOPNOTSUPP (block sharing not
+ * enabled), ENOMEM (no memory for the index), ENOSPC (too many extents).
+ */
+#define A1FS_IOC_DEDUP _IOWR('a', 4, a1fs_dedup)
+
+/** Argument of A1FS_IOC_RESIZE. */
+typedef struct a1fs_resize {
+	/** In: new image size in bytes (rounded down to a whole block), or 0 to
+	 *  leave it as it is; out: image size. */
+	uint64_t size;
+	/** Out: largest size the image can be grown to. */
+	uint64_t max_size;
+	/** Out: number of data blocks. */
+	uint64_t blocks;
+	/** Out: number of free data blocks. */
+	uint64_t free_blocks;
+
+} a1fs_resize;
+
+/**
+ * Grow the file system, extending the image file.
+ *
+ * The data blocks are added at the end of the image; only the superblock and
+ * the parts of the data bitmap and of the reference count table that cover the
+ * new blocks are updated, so growing takes time proportional to the metadata
+ * rather than to the data. The image can grow as far as mkfs.a1fs -g made
+ * room for. Works on any file or directory of the file system. Shrinking is
+ * not supported.
+ *
+ * Errors: EINVAL (smaller than the file system), EFBIG (larger than max_size),
+ * ENOMEM (no memory for the dedup index), EIO (the image file can't be
+ * extended).
+ */
+#define A1FS_IOC_RESIZE _IOWR('a', 5, a1fs_resize)
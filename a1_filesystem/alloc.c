@@ -0,0 +1,321 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Data block and inode allocator implementation.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "bitmap.h"
+
+
+/** Mark the bitmap bytes covering count blocks starting at start dirty. */
+static void dirty_range(fs_ctx *fs, a1fs_blk_t start, a1fs_blk_t count)
+{
+	fs_dirty(fs, fs->data_map + start / 8, (start + count - 1) / 8 - start / 8 + 1);
+}
+
+/** Length of the free run starting at blk, capped at max. */
+static a1fs_blk_t free_run(fs_ctx *fs, a1fs_blk_t blk, a1fs_blk_t max)
+{
+	size_t end = fs->sb->blocks_count;
+	if (end - blk > max) {
+		end = blk + max;
+	}
+	return bitmap_find_one(fs->data_map, blk, end) - blk;
+}
+
+/**
+ * Get the boundary that large runs are placed at, in blocks; 0 if none.
+ *
+ * That is a 2 MB huge page with A1FS_FEATURE_ALIGN, and a chunk on striped
+ * volumes, so that a run covers whole chunks and is spread evenly over the
+ * members (both are powers of 2, so the larger one is a multiple of both).
+ */
+static a1fs_blk_t alloc_align(const a1fs_superblock *sb)
+{
+	a1fs_blk_t align = 0;
+	if (sb->flags & A1FS_FEATURE_ALIGN) {
+		align = A1FS_HUGE_BLOCKS;
+	}
+	if ((sb->flags & A1FS_FEATURE_STRIPE) && sb->stripe_blocks > align) {
+		align = sb->stripe_blocks;
+	}
+	return align;
+}
+
+/** Find a free run of at least want blocks that starts at an align boundary. */
+static bool find_aligned(fs_ctx *fs, a1fs_blk_t align, a1fs_blk_t want,
+                         a1fs_blk_t *start)
+{
+	for (size_t b = 0; b < fs->sb->blocks_count; b += align) {
+		if (free_run(fs, b, want) == want) {
+			*start = b;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Find the first free run of count blocks at or after from.
+ *
+ * @param best   receives the start of the longest free run seen.
+ * @param best_len  receives the length of the longest free run seen.
+ */
+static bool find_fit(fs_ctx *fs, a1fs_blk_t from, a1fs_blk_t count,
+                     a1fs_blk_t *start, a1fs_blk_t *best, a1fs_blk_t *best_len)
+{
+	size_t n = fs->sb->blocks_count;
+	size_t b = bitmap_find_zero(fs->data_map, from, n);
+	while (b < n) {
+		a1fs_blk_t len = free_run(fs, b, count);
+		if (len == count) {
+			*start = b;
+			return true;
+		}
+		if (len > *best_len) {
+			*best = b;
+			*best_len = len;
+		}
+		b = bitmap_find_zero(fs->data_map, b + len, n);
+	}
+	return false;
+}
+
+a1fs_blk_t alloc_blocks(fs_ctx *fs, a1fs_blk_t goal, a1fs_blk_t count,
+                        a1fs_blk_t *start)
+{
+	assert(count > 0);
+	a1fs_superblock *sb = fs->sb;
+	// Blocks reserved for buffered file data are not up for grabs
+	a1fs_blk_t avail = fs_avail_blocks(fs);
+	if (avail == 0) {
+		return 0;
+	}
+	if (count > avail) {
+		count = avail;
+	}
+
+	a1fs_blk_t len = 0;
+	if (goal < sb->blocks_count) {
+		len = free_run(fs, goal, count);
+		*start = goal;
+	}
+
+	a1fs_blk_t align = alloc_align(sb);
+	if (len == 0 && align > 0 && count >= align &&
+	    find_aligned(fs, align, align, start))
+	{
+		len = free_run(fs, *start, count);
+	}
+
+	if (len == 0) {
+		// Next-fit from the cursor, then wrap around to the beginning
+		a1fs_blk_t best = 0, best_len = 0;
+		a1fs_blk_t cursor = fs->alloc_cursor < sb->blocks_count
+		                  ? fs->alloc_cursor : 0;
+		if (find_fit(fs, cursor, count, start, &best, &best_len) ||
+		    find_fit(fs, 0, count, start, &best, &best_len))
+		{
+			len = count;
+		} else {
+			*start = best;
+			len = best_len;
+		}
+	}
+	if (len == 0) {
+		return 0;
+	}
+
+	bitmap_set_range(fs->data_map, *start, len);
+	dirty_range(fs, *start, len);
+	sb->free_blocks_count -= len;
+	fs_dirty(fs, sb, sizeof(*sb));
+	fs->alloc_cursor = *start + len;
+	stats_add(&fs->stats.blocks_allocated, len);
+	return len;
+}
+
+/** Mark a run of data blocks free. */
+static void release_blocks(fs_ctx *fs, a1fs_blk_t start, a1fs_blk_t count)
+{
+	bitmap_clear_range(fs->data_map, start, count);
+	dirty_range(fs, start, count);
+	fs->sb->free_blocks_count += count;
+	fs_dirty(fs, fs->sb, sizeof(*fs->sb));
+	// The blocks may be reused for other data
+	zcache_invalidate(&fs->zc, start, count);
+	dd_invalidate(&fs->dd, start, count);
+
+	if (fs->discard && dq_add(&fs->dq, start, count) &&
+	    fs->dq.blocks >= DQ_BATCH_BLOCKS)
+	{
+		pthread_cond_signal(&fs->discard_cond);
+	}
+}
+
+void free_blocks(fs_ctx *fs, a1fs_blk_t start, a1fs_blk_t count)
+{
+	assert(start + count <= fs->sb->blocks_count);
+	if (!fs->refcount) {
+		release_blocks(fs, start, count);
+		return;
+	}
+
+	// Split the run into shared blocks, which lose a reference, and the rest
+	uint16_t *ref = fs->refcount;
+	a1fs_blk_t end = start + count;
+	for (a1fs_blk_t b = start, e; b < end; b = e) {
+		e = b;
+		if (ref[b] > 0) {
+			while (e < end && ref[e] > 0) {
+				ref[e++]--;
+			}
+			fs_dirty(fs, &ref[b], (e - b) * sizeof(*ref));
+		} else {
+			while (e < end && ref[e] == 0) {
+				e++;
+			}
+			release_blocks(fs, b, e - b);
+		}
+	}
+}
+
+int share_blocks(fs_ctx *fs, a1fs_blk_t start, a1fs_blk_t count)
+{
+	assert(fs->refcount && start + count <= fs->sb->blocks_count);
+	uint16_t *ref = fs->refcount;
+	for (a1fs_blk_t b = start; b < start + count; b++) {
+		if (ref[b] == UINT16_MAX) {
+			return -EMLINK;
+		}
+	}
+	for (a1fs_blk_t b = start; b < start + count; b++) {
+		ref[b]++;
+	}
+	fs_dirty(fs, &ref[start], count * sizeof(*ref));
+	return 0;
+}
+
+/** Number of inodes in an inode table block. */
+#define INODES_PER_BLOCK (A1FS_BLOCK_SIZE / sizeof(a1fs_inode))
+
+/** Refill the free inode numbers at hand from the inode bitmap. */
+static void refill_inodes(fs_ctx *fs)
+{
+	// Continue from where the last refill stopped, then wrap around
+	size_t count = fs->sb->inodes_count;
+	size_t start = fs->inode_cursor < count ? fs->inode_cursor : 0;
+	size_t ino = start, end = count;
+	while (fs->nfree_inodes < FREE_INODES_MAX) {
+		ino = bitmap_find_zero(fs->inode_map, ino, end);
+		if (ino < end) {
+			fs->free_inodes[fs->nfree_inodes++] = ino++;
+		} else if (end == count && start > 0) {
+			ino = 0;
+			end = start;
+		} else {
+			break;
+		}
+	}
+	fs->inode_cursor = ino;
+}
+
+/** Take a free inode number at hand; -1 if there are none. */
+static int take_inode(fs_ctx *fs)
+{
+	for (int pass = 0; pass < 2; pass++) {
+		while (fs->nfree_inodes > 0) {
+			a1fs_ino_t ino = fs->free_inodes[--fs->nfree_inodes];
+			// It may have been allocated near a directory since
+			if (!bitmap_test(fs->inode_map, ino)) {
+				return ino;
+			}
+		}
+		refill_inodes(fs);
+	}
+	return -1;
+}
+
+/**
+ * Initialize the inode table entries and extent blocks of the inodes up to ino
+ * on an image formatted with A1FS_FEATURE_LAZY_INIT.
+ *
+ * Inodes are mostly allocated in increasing order, so this usually zeroes just
+ * the entry and the extent block of ino itself.
+ */
+static void init_inodes(fs_ctx *fs, a1fs_ino_t ino)
+{
+	a1fs_superblock *sb = fs->sb;
+	if (!(sb->flags & A1FS_FEATURE_LAZY_INIT) || ino < sb->inodes_init) {
+		return;
+	}
+
+	size_t n = ino + 1 - sb->inodes_init;
+	a1fs_inode *inodes = (a1fs_inode*)(fs->image + (size_t)sb->start_inode *
+	                                   A1FS_BLOCK_SIZE) + sb->inodes_init;
+	memset(inodes, 0, n * sizeof(a1fs_inode));
+	fs_dirty(fs, inodes, n * sizeof(a1fs_inode));
+	unsigned char *extents = fs->image + (size_t)(sb->start_extent +
+	                                     sb->inodes_init) * A1FS_BLOCK_SIZE;
+	memset(extents, 0, n * A1FS_BLOCK_SIZE);
+	fs_dirty(fs, extents, n * A1FS_BLOCK_SIZE);
+
+	sb->inodes_init = ino + 1;
+	// The superblock is marked dirty by the caller
+}
+
+int alloc_inode(fs_ctx *fs, a1fs_ino_t goal)
+{
+	a1fs_superblock *sb = fs->sb;
+	if (sb->free_inodes_count == 0) {
+		return -ENOSPC;
+	}
+
+	size_t first = goal - goal % INODES_PER_BLOCK;
+	size_t end = first + INODES_PER_BLOCK;
+	if (end > sb->inodes_count) {
+		end = sb->inodes_count;
+	}
+	int ino = first < end ? (int)bitmap_find_zero(fs->inode_map, first, end)
+	                      : (int)end;
+	if ((size_t)ino == end) {
+		ino = take_inode(fs);
+		if (ino < 0) {
+			return -ENOSPC;
+		}
+	}
+
+	init_inodes(fs, ino);
+	bitmap_set(fs->inode_map, ino);
+	fs_dirty(fs, fs->inode_map + ino / 8, 1);
+	sb->free_inodes_count--;
+	fs_dirty(fs, sb, sizeof(*sb));
+	return ino;
+}
+
+void free_inode(fs_ctx *fs, a1fs_ino_t ino)
+{
+	bitmap_clear(fs->inode_map, ino);
+	fs_dirty(fs, fs->inode_map + ino / 8, 1);
+	fs->sb->free_inodes_count++;
+	fs_dirty(fs, fs->sb, sizeof(*fs->sb));
+	if (fs->nfree_inodes < FREE_INODES_MAX) {
+		fs->free_inodes[fs->nfree_inodes++] = ino;
+	}
+}
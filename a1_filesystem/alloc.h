@@ -0,0 +1,104 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Data block and inode allocator header file.
+ *
+ * Block numbers are relative to the start of the data region (sb->start_data).
+ */
+
+#pragma once
+
+#include "a1fs.h"
+#include "fs_ctx.h"
+
+
+/** "No preference" value for the goal argument of alloc_blocks(). */
+#define A1FS_BLK_NONE ((a1fs_blk_t)-1)
+
+/**
+ * Allocate a run of contiguous free data blocks.
+ *
+ * Allocates between 1 and count blocks. The run starts at goal if that block
+ * is free, so that files can be extended in place. Otherwise, on images with
+ * A1FS_FEATURE_ALIGN, requests of at least A1FS_HUGE_BLOCKS blocks are placed
+ * at a 2 MB aligned free run if there is one; likewise, on striped volumes,
+ * requests of at least a chunk are placed at a chunk boundary. The remaining
+ * requests take the first free run that fits the whole request, or the longest
+ * free run if none does.
+ *
+ * @param fs     file system context.
+ * @param goal   preferred first block of the run, or A1FS_BLK_NONE.
+ * @param count  number of blocks requested; must be > 0.
+ * @param start  pointer to the variable that receives the first block.
+ * @return       number of blocks allocated; 0 if there are no free blocks.
+ */
+a1fs_blk_t alloc_blocks(fs_ctx *fs, a1fs_blk_t goal, a1fs_blk_t count,
+                        a1fs_blk_t *start);
+
+/**
+ * Free a run of data blocks.
+ *
+ * Blocks shared with other files (see share_blocks()) only lose a reference;
+ * the rest are freed. With online discard enabled, the freed blocks are also
+ * queued for discarding.
+ *
+ * @param fs     file system context.
+ * @param start  first block of the run.
+ * @param count  number of blocks.
+ */
+void free_blocks(fs_ctx *fs, a1fs_blk_t start, a1fs_blk_t count);
+
+/**
+ * Add a reference to each block of a run of data blocks, so that they can be
+ * used by one more file. Requires A1FS_FEATURE_REFLINK.
+ *
+ * @param fs     file system context.
+ * @param start  first block of the run.
+ * @param count  number of blocks.
+ * @return       0 on success; -EMLINK if a block has too many references
+ *               (nothing is changed).
+ */
+int share_blocks(fs_ctx *fs, a1fs_blk_t start, a1fs_blk_t count);
+
+/** Check if a data block is used by more than one file. */
+static inline bool blk_shared(fs_ctx *fs, a1fs_blk_t blk)
+{
+	return fs->refcount && fs->refcount[blk] > 0;
+}
+
+/**
+ * Allocate an inode.
+ *
+ * Takes a free inode in the same inode table block as goal if there is one,
+ * so that the inodes of a directory and its entries are read and written
+ * together. Otherwise takes one from the batch of free inode numbers kept in
+ * the context, which is refilled from the inode bitmap, 64 bits at a time,
+ * when it runs out. Marks the inode used and updates the free inode count. On
+ * images with A1FS_FEATURE_LAZY_INIT, zeroes the inode table entry and the
+ * extent block of an inode that was never initialized.
+ *
+ * @param fs    file system context.
+ * @param goal  inode number to allocate near (e.g. of the parent directory).
+ * @return      inode number on success; -ENOSPC if there are no free inodes.
+ */
+int alloc_inode(fs_ctx *fs, a1fs_ino_t goal);
+
+/**
+ * Free an inode.
+ *
+ * Marks the inode free, updates the free inode count and keeps the inode
+ * number at hand for the next allocation.
+ */
+void free_inode(fs_ctx *fs, a1fs_ino_t ino);
@@ -0,0 +1,95 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - On-disk bitmap helpers implementation.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "bitmap.h"
+
+
+void bitmap_set_range(unsigned char *map, size_t start, size_t count)
+{
+	size_t end = start + count;
+	for (; start < end && start % 8 != 0; start++) {
+		bitmap_set(map, start);
+	}
+	if (end - start >= 8) {
+		memset(map + start / 8, 0xff, (end - start) / 8);
+		start += (end - start) & ~(size_t)7;
+	}
+	for (; start < end; start++) {
+		bitmap_set(map, start);
+	}
+}
+
+void bitmap_clear_range(unsigned char *map, size_t start, size_t count)
+{
+	size_t end = start + count;
+	for (; start < end && start % 8 != 0; start++) {
+		bitmap_clear(map, start);
+	}
+	if (end - start >= 8) {
+		memset(map + start / 8, 0, (end - start) / 8);
+		start += (end - start) & ~(size_t)7;
+	}
+	for (; start < end; start++) {
+		bitmap_clear(map, start);
+	}
+}
+
+/**
+ * Find the first bit in [start, end) that differs from skip.
+ *
+ * @param skip  byte value (0x00 or 0xff) of the bits being skipped.
+ */
+static size_t find_bit(const unsigned char *map, size_t start, size_t end,
+                       unsigned char skip)
+{
+	uint64_t skip_word = skip ? UINT64_MAX : 0;
+	size_t i = start;
+	while (i < end) {
+		// Skip whole words and bytes when aligned
+		if (i % 64 == 0 && end - i >= 64) {
+			uint64_t w;
+			memcpy(&w, map + i / 8, sizeof(w));
+			if (w == skip_word) {
+				i += 64;
+				continue;
+			}
+		}
+		if (i % 8 == 0 && end - i >= 8 && map[i / 8] == skip) {
+			i += 8;
+			continue;
+		}
+		if (bitmap_test(map, i) != (skip != 0)) {
+			return i;
+		}
+		i++;
+	}
+	return end;
+}
+
+size_t bitmap_find_zero(const unsigned char *map, size_t start, size_t end)
+{
+	return find_bit(map, start, end, 0xff);
+}
+
+size_t bitmap_find_one(const unsigned char *map, size_t start, size_t end)
+{
+	return find_bit(map, start, end, 0x00);
+}
@@ -0,0 +1,65 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - On-disk bitmap helpers header file.
+ *
+ * Bit i of a bitmap is stored in byte i / 8, most significant bit first.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/** Check if bit i is set. */
+static inline bool bitmap_test(const unsigned char *map, size_t i)
+{
+	return map[i / 8] & (0x80 >> (i % 8));
+}
+
+/** Set bit i. */
+static inline void bitmap_set(unsigned char *map, size_t i)
+{
+	map[i / 8] |= 0x80 >> (i % 8);
+}
+
+/** Clear bit i. */
+static inline void bitmap_clear(unsigned char *map, size_t i)
+{
+	map[i / 8] &= ~(0x80 >> (i % 8));
+}
+
+/** Set bits [start, start + count). */
+void bitmap_set_range(unsigned char *map, size_t start, size_t count);
+
+/** Clear bits [start, start + count). */
+void bitmap_clear_range(unsigned char *map, size_t start, size_t count);
+
+/**
+ * Find the first clear bit in [start, end).
+ *
+ * Whole 64-bit words of set bits are skipped at once.
+ *
+ * @return  index of the bit; end if all bits in the range are set.
+ */
+size_t bitmap_find_zero(const unsigned char *map, size_t start, size_t end);
+
+/**
+ * Find the first set bit in [start, end).
+ *
+ * @return  index of the bit; end if all bits in the range are clear.
+ */
+size_t bitmap_find_one(const unsigned char *map, size_t start, size_t end);
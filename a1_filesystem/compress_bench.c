@@ -0,0 +1,215 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Cluster compression benchmark.
+ *
+ * Measures what the compress mount option costs and saves on given files:
+ * each file is cut into clusters the way a1fs stores them, and every cluster
+ * is compressed and decompressed with the in-tree codec. Reports the data
+ * blocks a1fs would use with and without compression, and the compression
+ * and decompression throughput.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "a1fs.h"
+#include "lz.h"
+
+
+/** Command line options. */
+typedef struct bench_opts {
+	/** Number of times each file is compressed and decompressed. */
+	unsigned int rounds;
+
+} bench_opts;
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, "Usage: %s [options] file...\n\
+\n\
+Measure cluster compression ratio and throughput on sample files.\n\
+\n\
+    -r rounds    number of passes over each file (default 10)\n\
+    -h           print help and exit\n\
+", progname);
+}
+
+static bool parse_args(int argc, char *argv[], bench_opts *opts)
+{
+	char o;
+	while ((o = getopt(argc, argv, "r:h")) != -1) {
+		switch (o) {
+			case 'r': opts->rounds = strtoul(optarg, NULL, 10); break;
+			case 'h': print_help(stdout, argv[0]); exit(0);
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "Missing file path\n");
+		return false;
+	}
+	if (opts->rounds == 0) {
+		fprintf(stderr, "Invalid number of rounds\n");
+		return false;
+	}
+	return true;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Read a whole file, padded with zeros to a multiple of the cluster size. */
+static unsigned char *read_file(const char *path, size_t *size)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return NULL;
+	}
+	unsigned char *data = NULL;
+	size_t len = 0, cap = 0;
+	for (;;) {
+		if (len == cap) {
+			cap = cap ? cap * 2 : A1FS_CLUSTER_SIZE;
+			unsigned char *p = realloc(data, cap);
+			if (!p) {
+				perror("realloc");
+				free(data);
+				fclose(f);
+				return NULL;
+			}
+			data = p;
+		}
+		size_t n = fread(data + len, 1, cap - len, f);
+		if (n == 0) {
+			break;
+		}
+		len += n;
+	}
+	fclose(f);
+	// cap is a multiple of the cluster size
+	memset(data + len, 0, cap - len);
+	*size = len;
+	return data;
+}
+
+/** Benchmark one file; prints a line of results. */
+static bool bench_file(const char *path, const bench_opts *opts)
+{
+	size_t size;
+	unsigned char *data = read_file(path, &size);
+	if (!data) {
+		return false;
+	}
+	size_t nclusters = (size + A1FS_CLUSTER_SIZE - 1) / A1FS_CLUSTER_SIZE;
+	// Like a1fs, leave a partial last cluster uncompressed
+	size_t ncompress = size / A1FS_CLUSTER_SIZE;
+	const size_t cap = (A1FS_CLUSTER_BLOCKS - 1) * A1FS_BLOCK_SIZE - sizeof(uint32_t);
+	unsigned char *packed = malloc(nclusters * cap);
+	size_t *lens = calloc(nclusters, sizeof(*lens));
+	unsigned char plain[A1FS_CLUSTER_SIZE];
+	if (!packed || !lens) {
+		perror("malloc");
+		free(packed);
+		free(lens);
+		free(data);
+		return false;
+	}
+
+	double start = now();
+	for (unsigned int r = 0; r < opts->rounds; r++) {
+		for (size_t c = 0; c < ncompress; c++) {
+			lens[c] = lz_compress(data + c * A1FS_CLUSTER_SIZE, A1FS_CLUSTER_SIZE,
+			                      packed + c * cap, cap);
+		}
+	}
+	double compress_time = now() - start;
+
+	bool ok = true;
+	size_t ndecompressed = 0;
+	start = now();
+	for (unsigned int r = 0; r < opts->rounds && ok; r++) {
+		for (size_t c = 0; c < nclusters && ok; c++) {
+			if (lens[c] == 0) {
+				continue;// stored uncompressed
+			}
+			ndecompressed++;
+			ok = lz_decompress(packed + c * cap, lens[c], plain, sizeof(plain))
+			     == A1FS_CLUSTER_SIZE &&
+			     memcmp(plain, data + c * A1FS_CLUSTER_SIZE, sizeof(plain)) == 0;
+		}
+	}
+	double decompress_time = now() - start;
+	if (!ok) {
+		fprintf(stderr, "%s: decompressed data doesn't match\n", path);
+	}
+
+	// Data blocks the file takes with and without compression
+	size_t plain_blocks = (size + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE;
+	size_t stored_blocks = 0, compressed = 0;
+	for (size_t c = 0; c < nclusters; c++) {
+		size_t blocks = c < ncompress ? A1FS_CLUSTER_BLOCKS
+		                              : plain_blocks - c * A1FS_CLUSTER_BLOCKS;
+		if (lens[c] != 0) {
+			blocks = (sizeof(uint32_t) + lens[c] + A1FS_BLOCK_SIZE - 1)
+			       / A1FS_BLOCK_SIZE;
+			compressed++;
+		}
+		stored_blocks += blocks;
+	}
+	double mb = (double)nclusters * A1FS_CLUSTER_SIZE * opts->rounds / 1e6;
+	double decompressed_mb = (double)ndecompressed * A1FS_CLUSTER_SIZE / 1e6;
+	printf("%-24s %8zu %8zu %7.2f %6zu/%-6zu %10.1f %10.1f\n", path,
+	       plain_blocks, stored_blocks,
+	       stored_blocks ? (double)plain_blocks / stored_blocks : 1.0,
+	       compressed, nclusters, mb / compress_time,
+	       ndecompressed ? decompressed_mb / decompress_time : 0.0);
+
+	free(lens);
+	free(packed);
+	free(data);
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	bench_opts opts = { .rounds = 10 };
+	if (!parse_args(argc, argv, &opts)) {
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+
+	printf("%-24s %8s %8s %7s %13s %10s %10s\n", "file", "blocks", "stored",
+	       "ratio", "clusters", "comp MB/s", "decomp MB/s");
+	bool ok = true;
+	for (int i = optind; i < argc; i++) {
+		ok = bench_file(argv[i], &opts) && ok;
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - CRC32C (Castagnoli) checksum implementation.
+ *
+ * The crc32 instruction has a latency of 3 cycles but can start one every
+ * cycle, so large buffers are checksummed as three interleaved streams whose
+ * CRCs are combined at the end: the CRC of a stream followed by n more bytes
+ * is a linear function of its CRC (shifting it through n zero bytes) XORed
+ * with the CRC of those bytes. The shift for the fixed stream length is done
+ * with a table.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+
+/** CRC32C polynomial, bit-reflected. */
+#define POLY 0x82f63b78u
+
+/** Length of each of the three interleaved streams in bytes. */
+#define STREAM_LEN 1360
+
+/** Slicing-by-8 tables; table[0] is the classic byte-at-a-time table. */
+static uint32_t table[8][256];
+/** Shift of a CRC through STREAM_LEN zero bytes, a byte of the CRC at a time. */
+static uint32_t shift_table[4][256];
+/** The CPU has the crc32 instruction. */
+static bool hw;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+/** Update a (non-inverted) CRC with one byte. */
+static uint32_t update_byte(uint32_t crc, unsigned char b)
+{
+	return table[0][(crc ^ b) & 0xff] ^ (crc >> 8);
+}
+
+static void init_tables(void)
+{
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (int k = 0; k < 8; k++) {
+			c = (c >> 1) ^ (c & 1 ? POLY : 0);
+		}
+		table[0][i] = c;
+	}
+	for (uint32_t i = 0; i < 256; i++) {
+		for (int t = 1; t < 8; t++) {
+			table[t][i] = (table[t - 1][i] >> 8) ^
+			              table[0][table[t - 1][i] & 0xff];
+		}
+	}
+
+	// The shift is linear, so it is the XOR of the shifts of the bits set
+	uint32_t bit_shift[32];
+	for (int bit = 0; bit < 32; bit++) {
+		uint32_t c = 1u << bit;
+		for (int n = 0; n < STREAM_LEN; n++) {
+			c = update_byte(c, 0);
+		}
+		bit_shift[bit] = c;
+	}
+	for (int t = 0; t < 4; t++) {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = 0;
+			for (int k = 0; k < 8; k++) {
+				if (i & (1u << k)) {
+					c ^= bit_shift[t * 8 + k];
+				}
+			}
+			shift_table[t][i] = c;
+		}
+	}
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static void init(void)
+{
+	pthread_once(&init_once, init_tables);
+}
+
+/** Shift a (non-inverted) CRC through STREAM_LEN zero bytes. */
+static uint32_t shift(uint32_t crc)
+{
+	return shift_table[0][crc & 0xff] ^ shift_table[1][(crc >> 8) & 0xff] ^
+	       shift_table[2][(crc >> 16) & 0xff] ^ shift_table[3][crc >> 24];
+}
+
+/** Slicing-by-8 update of a (non-inverted) CRC. */
+static uint32_t update_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+	for (; len >= 8; p += 8, len -= 8) {
+		uint32_t lo, hi;
+		memcpy(&lo, p, sizeof(lo));
+		memcpy(&hi, p + 4, sizeof(hi));
+		lo ^= crc;
+		crc = table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff] ^
+		      table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24] ^
+		      table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff] ^
+		      table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24];
+	}
+	while (len-- > 0) {
+		crc = update_byte(crc, *p++);
+	}
+	return crc;
+}
+
+#if defined(__x86_64__)
+
+/** crc32 instruction update of a (non-inverted) CRC. */
+__attribute__((target("sse4.2")))
+static uint32_t update_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+	uint64_t c0 = crc;
+	for (; len >= 3 * STREAM_LEN; p += 3 * STREAM_LEN, len -= 3 * STREAM_LEN) {
+		uint64_t c1 = 0, c2 = 0;
+		for (size_t i = 0; i < STREAM_LEN; i += 8) {
+			uint64_t v0, v1, v2;
+			memcpy(&v0, p + i, sizeof(v0));
+			memcpy(&v1, p + STREAM_LEN + i, sizeof(v1));
+			memcpy(&v2, p + 2 * STREAM_LEN + i, sizeof(v2));
+			c0 = _mm_crc32_u64(c0, v0);
+			c1 = _mm_crc32_u64(c1, v1);
+			c2 = _mm_crc32_u64(c2, v2);
+		}
+		c0 = shift(shift((uint32_t)c0) ^ (uint32_t)c1) ^ (uint32_t)c2;
+	}
+	for (; len >= 8; p += 8, len -= 8) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		c0 = _mm_crc32_u64(c0, v);
+	}
+	uint32_t c = (uint32_t)c0;
+	while (len-- > 0) {
+		c = _mm_crc32_u8(c, *p++);
+	}
+	return c;
+}
+
+#endif
+
+// STREAM_LEN must be a multiple of the 8 bytes consumed per instruction
+_Static_assert(STREAM_LEN % 8 == 0, "invalid stream length");
+
+
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+	init();
+	return ~update_sw(~crc, buf, len);
+}
+
+uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len)
+{
+	init();
+#if defined(__x86_64__)
+	return ~update_hw(~crc, buf, len);
+#else
+	return crc32c_sw(crc, buf, len);
+#endif
+}
+
+bool crc32c_hw_available(void)
+{
+	init();
+	return hw;
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	init();
+	return hw ? crc32c_hw(crc, buf, len) : crc32c_sw(crc, buf, len);
+}
@@ -0,0 +1,49 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - CRC32C (Castagnoli) checksum header file.
+ *
+ * Uses the SSE4.2 crc32 instruction when the CPU has it, and a slicing-by-8
+ * table implementation otherwise.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * Compute the CRC32C of a buffer.
+ *
+ * @param crc  CRC32C of the data before buf (to checksum data in pieces), or
+ *             0 to start.
+ * @param buf  buffer.
+ * @param len  buffer size in bytes.
+ * @return     CRC32C of the data up to the end of buf.
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+/** crc32c() using the slicing-by-8 implementation only. */
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len);
+
+/**
+ * crc32c() using the crc32 instruction only. Must only be called if
+ * crc32c_hw_available() returns true.
+ */
+uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len);
+
+/** Check if the CPU has the crc32 instruction (SSE4.2). */
+bool crc32c_hw_available(void);
@@ -0,0 +1,172 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - Metadata block checksums implementation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "crc32c.h"
+#include "csum.h"
+#include "log.h"
+
+
+/** Checksum of a metadata block as stored in the table (never NONE). */
+static uint32_t block_sum(const csum_table *ct, size_t blk)
+{
+	uint32_t crc = crc32c(0, ct->meta + blk * A1FS_BLOCK_SIZE, A1FS_BLOCK_SIZE);
+	return (crc == A1FS_CSUM_NONE) ? 1 : crc;
+}
+
+bool csum_init(csum_table *ct, void *meta, const a1fs_superblock *sb,
+               bool verify)
+{
+	*ct = (csum_table){0};
+	if (!(sb->flags & A1FS_FEATURE_CSUM)) {
+		return true;
+	}
+
+	ct->meta = meta;
+	ct->nblocks = sb->start_data;
+	ct->verify = verify;
+
+	size_t map_size = (ct->nblocks + 7) / 8;
+	ct->checked = calloc(map_size, 1);
+	ct->bad = calloc(map_size, 1);
+	ct->stale = calloc(map_size, 1);
+	if (!ct->checked || !ct->bad || !ct->stale) {
+		perror("calloc");
+		csum_destroy(ct);
+		return false;
+	}
+	ct->sums = (uint32_t*)((unsigned char*)meta +
+	                       (size_t)sb->start_csum * A1FS_BLOCK_SIZE);
+	return true;
+}
+
+void csum_destroy(csum_table *ct)
+{
+	free(ct->checked);
+	free(ct->bad);
+	free(ct->stale);
+	*ct = (csum_table){0};
+}
+
+/** Check if a block holds (part of) the checksum table itself. */
+static bool is_table_block(const csum_table *ct, size_t blk)
+{
+	const unsigned char *blk_start = ct->meta + blk * A1FS_BLOCK_SIZE;
+	const unsigned char *table = (const unsigned char*)ct->sums;
+	return (blk_start >= table) &&
+	       (blk_start < table + ct->nblocks * sizeof(uint32_t));
+}
+
+bool csum_verify(csum_table *ct, size_t blk)
+{
+	if (blk >= ct->nblocks) {
+		return true;
+	}
+	if (bitmap_test(ct->bad, blk)) {
+		ct->failures++;
+		return false;
+	}
+	bitmap_set(ct->checked, blk);
+
+	// A modified block is checked against its contents when it is recomputed
+	if (!ct->verify || bitmap_test(ct->stale, blk) ||
+	    (ct->sums[blk] == A1FS_CSUM_NONE))
+	{
+		return true;
+	}
+
+	ct->verified++;
+	uint32_t sum = block_sum(ct, blk);
+	if (sum == ct->sums[blk]) {
+		return true;
+	}
+
+	bitmap_set(ct->bad, blk);
+	ct->errors++;
+	ct->failures++;
+	log_error("Metadata block %zu is corrupted (checksum %08x, expected "
+	          "%08x); the file system is now read-only\n", blk, sum,
+	          ct->sums[blk]);
+	return false;
+}
+
+bool csum_check_range(csum_table *ct, size_t start, size_t count)
+{
+	bool ok = true;
+	for (size_t blk = start; blk < start + count; blk++) {
+		// Keep going so that all corrupted blocks are reported
+		ok &= csum_check(ct, blk);
+	}
+	return ok;
+}
+
+void csum_mark(csum_table *ct, size_t offset, size_t len)
+{
+	if (len == 0) {
+		return;
+	}
+	size_t first = offset / A1FS_BLOCK_SIZE;
+	size_t last = (offset + len - 1) / A1FS_BLOCK_SIZE;
+	for (size_t blk = first; (blk <= last) && (blk < ct->nblocks); blk++) {
+		if (bitmap_test(ct->stale, blk) || bitmap_test(ct->bad, blk) ||
+		    is_table_block(ct, blk))
+		{
+			continue;
+		}
+		bitmap_set(ct->stale, blk);
+		ct->nstale++;
+	}
+}
+
+/** Store the checksum of a block and record the table modification. */
+static void store_sum(csum_table *ct, storage *st, size_t blk)
+{
+	ct->sums[blk] = block_sum(ct, blk);
+	storage_meta_dirty(st, &ct->sums[blk], sizeof(ct->sums[blk]));
+	ct->updated++;
+}
+
+void csum_update(csum_table *ct, storage *st)
+{
+	if (!ct->sums || (ct->nstale == 0)) {
+		return;
+	}
+	for (size_t blk = bitmap_find_one(ct->stale, 0, ct->nblocks);
+	     blk < ct->nblocks; blk = bitmap_find_one(ct->stale, blk + 1, ct->nblocks))
+	{
+		bitmap_clear(ct->stale, blk);
+		store_sum(ct, st, blk);
+	}
+	ct->nstale = 0;
+}
+
+void csum_rebuild(csum_table *ct, storage *st)
+{
+	if (!ct->sums) {
+		return;
+	}
+	for (size_t blk = 0; blk < ct->nblocks; blk++) {
+		if (!is_table_block(ct, blk)) {
+			store_sum(ct, st, blk);
+		}
+	}
+	bitmap_clear_range(ct->stale, 0, ct->nblocks);
+	bitmap_clear_range(ct->bad, 0, ct->nblocks);
+	ct->nstale = 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - Metadata block checksums header file.
+ *
+ * On images with A1FS_FEATURE_CSUM, every block of the metadata region has a
+ * CRC32C in the checksum table (see a1fs_superblock.start_csum). A block is
+ * verified the first time it is used after mounting (csum_check()), so that
+ * mounting doesn't have to read the whole inode table and all extent blocks.
+ * A modified block is only marked stale (csum_dirty()); the checksums of the
+ * stale blocks are recomputed together by csum_update() before the image is
+ * synced, so a block modified many times in between is checksummed once.
+ *
+ * Without a journal, the image is only consistent after a sync: if the file
+ * system crashes, blocks modified since the last sync may fail verification
+ * even if they were written out whole.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "a1fs.h"
+#include "bitmap.h"
+#include "storage.h"
+
+
+/** Metadata checksum state. */
+typedef struct csum_table {
+	/** Checksum table; NULL without A1FS_FEATURE_CSUM. */
+	uint32_t *sums;
+	/** Metadata region. */
+	const unsigned char *meta;
+	/** Number of blocks in the metadata region. */
+	size_t nblocks;
+	/** Verify blocks on first use; otherwise only keep the checksums current. */
+	bool verify;
+	/** Bit per block: verified (or found corrupted) since mounting. */
+	unsigned char *checked;
+	/** Bit per block: the block doesn't match its checksum. */
+	unsigned char *bad;
+	/** Bit per block: modified since its checksum was last computed. */
+	unsigned char *stale;
+	/** Number of stale blocks. */
+	size_t nstale;
+
+	/** Blocks verified. */
+	uint64_t verified;
+	/** Checksums recomputed. */
+	uint64_t updated;
+	/** Corrupted blocks found. */
+	uint64_t errors;
+	/** Uses of corrupted blocks, the first one included. */
+	uint64_t failures;
+
+} csum_table;
+
+/**
+ * Initialize the metadata checksum state.
+ *
+ * Does nothing (and leaves ct->sums NULL) if the image doesn't have
+ * A1FS_FEATURE_CSUM.
+ *
+ * @param ct      metadata checksum state.
+ * @param meta    metadata region of the image.
+ * @param sb      superblock of the image.
+ * @param verify  verify blocks on first use.
+ * @return        true on success; false if out of memory.
+ */
+bool csum_init(csum_table *ct, void *meta, const a1fs_superblock *sb,
+               bool verify);
+
+/** Release the memory of the metadata checksum state. */
+void csum_destroy(csum_table *ct);
+
+/**
+ * Verify a metadata block that wasn't verified yet; see csum_check().
+ *
+ * Blocks that have no checksum, or were modified since mounting, pass.
+ */
+bool csum_verify(csum_table *ct, size_t blk);
+
+/**
+ * Check a metadata block before it is used.
+ *
+ * Only the first check of a block after mounting computes its checksum. A
+ * corrupted block is reported once and fails every check.
+ *
+ * @param ct   metadata checksum state.
+ * @param blk  block number in the image.
+ * @return     true if the block is intact; false if it is corrupted.
+ */
+static inline bool csum_check(csum_table *ct, size_t blk)
+{
+	if (!ct->sums || (bitmap_test(ct->checked, blk) && !bitmap_test(ct->bad, blk))) {
+		return true;
+	}
+	return csum_verify(ct, blk);
+}
+
+/** Check count metadata blocks starting at start; see csum_check(). */
+bool csum_check_range(csum_table *ct, size_t start, size_t count);
+
+/** Mark the blocks of a range of the metadata region stale; see csum_dirty(). */
+void csum_mark(csum_table *ct, size_t offset, size_t len);
+
+/**
+ * Record a modification of len bytes at offset in the metadata region.
+ *
+ * Corrupted blocks keep their checksum, so that they stay corrupted.
+ */
+static inline void csum_dirty(csum_table *ct, size_t offset, size_t len)
+{
+	if (ct->sums) {
+		csum_mark(ct, offset, len);
+	}
+}
+
+/**
+ * Recompute the checksums of the stale blocks.
+ *
+ * @param ct  metadata checksum state.
+ * @param st  storage backend, told about the modified checksum table entries.
+ */
+void csum_update(csum_table *ct, storage *st);
+
+/**
+ * Recompute the checksums of all metadata blocks, trusting their contents.
+ *
+ * For an image whose checksums are known to be out of date, e.g. after a
+ * crash that left it consistent otherwise.
+ */
+void csum_rebuild(csum_table *ct, storage *st);
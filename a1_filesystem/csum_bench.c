@@ -0,0 +1,166 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - Metadata checksum benchmark.
+ *
+ * Measures what metadata checksums cost per block: the CRC32C of a buffer of
+ * 4 KiB blocks is computed with the crc32 instruction (three interleaved
+ * streams) and with the slicing-by-8 table implementation. Copying the same
+ * blocks with memcpy() is reported as a baseline for memory bandwidth.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "a1fs.h"
+#include "crc32c.h"
+
+
+/** Command line options. */
+typedef struct bench_opts {
+	/** Number of blocks in the buffer. */
+	size_t blocks;
+	/** Number of passes over the buffer. */
+	unsigned int rounds;
+
+} bench_opts;
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, "Usage: %s [options]\n\
+\n\
+Measure CRC32C throughput on metadata-sized blocks.\n\
+\n\
+    -b blocks    number of 4 KiB blocks in the buffer (default 256)\n\
+    -r rounds    number of passes over the buffer (default 1000)\n\
+    -h           print help and exit\n\
+", progname);
+}
+
+static bool parse_args(int argc, char *argv[], bench_opts *opts)
+{
+	char o;
+	while ((o = getopt(argc, argv, "b:r:h")) != -1) {
+		switch (o) {
+			case 'b': opts->blocks = strtoul(optarg, NULL, 10); break;
+			case 'r': opts->rounds = strtoul(optarg, NULL, 10); break;
+			case 'h': print_help(stdout, argv[0]); exit(0);
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+	if (opts->blocks == 0 || opts->rounds == 0) {
+		fprintf(stderr, "Invalid number of blocks or rounds\n");
+		return false;
+	}
+	return true;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef uint32_t (*crc_fn)(uint32_t crc, const void *buf, size_t len);
+
+/** Checksum every block of the buffer; returns the time taken in seconds. */
+static double bench_crc(crc_fn fn, const unsigned char *buf,
+                        const bench_opts *opts, uint32_t *result)
+{
+	uint32_t acc = 0;
+	double start = now();
+	for (unsigned int r = 0; r < opts->rounds; r++) {
+		for (size_t b = 0; b < opts->blocks; b++) {
+			acc ^= fn(0, buf + b * A1FS_BLOCK_SIZE, A1FS_BLOCK_SIZE);
+		}
+	}
+	double time = now() - start;
+	*result = acc;
+	return time;
+}
+
+/** Copy every block of the buffer; returns the time taken in seconds. */
+static double bench_copy(unsigned char *dst, const unsigned char *buf,
+                         const bench_opts *opts)
+{
+	double start = now();
+	for (unsigned int r = 0; r < opts->rounds; r++) {
+		for (size_t b = 0; b < opts->blocks; b++) {
+			memcpy(dst + b * A1FS_BLOCK_SIZE, buf + b * A1FS_BLOCK_SIZE,
+			       A1FS_BLOCK_SIZE);
+		}
+		// Keep the compiler from dropping all but the last round
+		__asm__ volatile("" : : "r"(dst) : "memory");
+	}
+	return now() - start;
+}
+
+static void report(const char *name, double time, const bench_opts *opts)
+{
+	double nblocks = (double)opts->blocks * opts->rounds;
+	printf("%-22s %10.1f MB/s %8.1f ns/block\n", name,
+	       nblocks * A1FS_BLOCK_SIZE / 1e6 / time, time * 1e9 / nblocks);
+}
+
+int main(int argc, char *argv[])
+{
+	bench_opts opts = { .blocks = 256, .rounds = 1000 };
+	if (!parse_args(argc, argv, &opts)) {
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+
+	size_t size = opts.blocks * A1FS_BLOCK_SIZE;
+	unsigned char *buf = malloc(size);
+	unsigned char *copy = malloc(size);
+	if (!buf || !copy) {
+		perror("malloc");
+		free(buf);
+		free(copy);
+		return 1;
+	}
+	srand(369);
+	for (size_t i = 0; i < size; i++) {
+		buf[i] = rand();
+	}
+
+	int ret = 0;
+	uint32_t sw_result, hw_result;
+	double sw_time = bench_crc(crc32c_sw, buf, &opts, &sw_result);
+	if (crc32c_hw_available()) {
+		double hw_time = bench_crc(crc32c_hw, buf, &opts, &hw_result);
+		report("crc32c (sse4.2, 3-way)", hw_time, &opts);
+		if (hw_result != sw_result) {
+			fprintf(stderr, "Checksums don't match: %08x != %08x\n",
+			        hw_result, sw_result);
+			ret = 1;
+		}
+	} else {
+		printf("crc32c (sse4.2)        not supported by this CPU\n");
+	}
+	report("crc32c (slicing-by-8)", sw_time, &opts);
+	report("memcpy", bench_copy(copy, buf, &opts), &opts);
+
+	free(copy);
+	free(buf);
+	return ret;
+}
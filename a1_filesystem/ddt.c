@@ -0,0 +1,204 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - Block deduplication index implementation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+#include "ddt.h"
+
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+/** MurmurHash3 finalization mix: make every input bit affect every output bit. */
+static uint64_t fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+void dd_hash(const void *data, size_t len, dd_fp *fp)
+{
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	const unsigned char *p = data;
+	uint64_t h1 = 0, h2 = 0;
+
+	size_t nblocks = len / 16;
+	for (size_t i = 0; i < nblocks; i++) {
+		uint64_t k1, k2;
+		memcpy(&k1, p + i * 16, sizeof(k1));
+		memcpy(&k2, p + i * 16 + 8, sizeof(k2));
+
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	// The last 0-15 bytes, assembled little-endian
+	const unsigned char *tail = p + nblocks * 16;
+	uint64_t k1 = 0, k2 = 0;
+	for (size_t i = len % 16; i > 8; i--) {
+		k2 = (k2 << 8) | tail[i - 1];
+	}
+	for (size_t i = len % 16 < 8 ? len % 16 : 8; i > 0; i--) {
+		k1 = (k1 << 8) | tail[i - 1];
+	}
+	if (len % 16 > 8) {
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+	}
+	if (len % 16 > 0) {
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= len; h2 ^= len;
+	h1 += h2; h2 += h1;
+	h1 = fmix64(h1); h2 = fmix64(h2);
+	h1 += h2; h2 += h1;
+	fp->lo = h1;
+	fp->hi = h2;
+}
+
+
+bool dd_init(dd_index *dd, size_t budget, a1fs_blk_t nblocks)
+{
+	size_t capacity = DD_PROBE;
+	while (capacity * 2 * sizeof(dd_entry) <= budget) {
+		capacity *= 2;
+	}
+	dd->table = malloc(capacity * sizeof(dd_entry));
+	dd->indexed = calloc((nblocks + 7) / 8, 1);
+	if (!dd->table || !dd->indexed) {
+		perror("malloc");
+		dd_destroy(dd);
+		return false;
+	}
+	for (size_t i = 0; i < capacity; i++) {
+		dd->table[i].blk = DD_NONE;
+	}
+	dd->capacity = capacity;
+	dd->entries = 0;
+	dd->nblocks = nblocks;
+	dd->clock = 0;
+	dd->lookups = 0;
+	dd->hits = 0;
+	dd->replaced = 0;
+	return true;
+}
+
+void dd_destroy(dd_index *dd)
+{
+	free(dd->table);
+	free(dd->indexed);
+	dd->table = NULL;
+	dd->indexed = NULL;
+}
+
+bool dd_grow(dd_index *dd, a1fs_blk_t nblocks)
+{
+	size_t old_len = (dd->nblocks + 7) / 8;
+	size_t len = (nblocks + 7) / 8;
+	unsigned char *indexed = realloc(dd->indexed, len);
+	if (!indexed) {
+		perror("realloc");
+		return false;
+	}
+	memset(indexed + old_len, 0, len - old_len);
+	// The bits past the old last block in its byte are already clear
+	dd->indexed = indexed;
+	dd->nblocks = nblocks;
+	return true;
+}
+
+/** Check if a slot holds a block that is still indexed. */
+static bool slot_live(const dd_index *dd, const dd_entry *e)
+{
+	return e->blk != DD_NONE && bitmap_test(dd->indexed, e->blk);
+}
+
+a1fs_blk_t dd_lookup(dd_index *dd, const dd_fp *fp)
+{
+	dd->lookups++;
+	size_t home = fp->lo & (dd->capacity - 1);
+	for (size_t i = 0; i < DD_PROBE; i++) {
+		dd_entry *e = &dd->table[(home + i) & (dd->capacity - 1)];
+		if (e->fp.lo == fp->lo && e->fp.hi == fp->hi && slot_live(dd, e)) {
+			dd->hits++;
+			return e->blk;
+		}
+	}
+	return DD_NONE;
+}
+
+void dd_insert(dd_index *dd, const dd_fp *fp, a1fs_blk_t blk)
+{
+	// Take the slot with the same fingerprint, else the first free slot, else
+	// the oldest one
+	size_t home = fp->lo & (dd->capacity - 1);
+	dd_entry *victim = NULL;
+	for (size_t i = 0; i < DD_PROBE; i++) {
+		dd_entry *e = &dd->table[(home + i) & (dd->capacity - 1)];
+		if (e->fp.lo == fp->lo && e->fp.hi == fp->hi && e->blk != DD_NONE) {
+			victim = e;
+			break;
+		}
+		if (!slot_live(dd, e)) {
+			if (!victim || slot_live(dd, victim)) {
+				victim = e;
+			}
+		} else if (!victim || (slot_live(dd, victim) &&
+		                       dd->clock - e->added > dd->clock - victim->added))
+		{
+			victim = e;
+		}
+	}
+
+	if (victim->blk == DD_NONE) {
+		dd->entries++;
+	} else if (slot_live(dd, victim)) {
+		if (victim->fp.lo != fp->lo || victim->fp.hi != fp->hi) {
+			dd->replaced++;
+		}
+		bitmap_clear(dd->indexed, victim->blk);
+	}
+	*victim = (dd_entry){ .fp = *fp, .blk = blk, .added = dd->clock++ };
+	bitmap_set(dd->indexed, blk);
+}
+
+void dd_invalidate(dd_index *dd, a1fs_blk_t start, a1fs_blk_t count)
+{
+	if (dd->indexed) {
+		bitmap_clear_range(dd->indexed, start, count);
+	}
+}
+
+size_t dd_memory(const dd_index *dd)
+{
+	if (!dd->table) {
+		return 0;
+	}
+	return dd->capacity * sizeof(dd_entry) + (dd->nblocks + 7) / 8;
+}
@@ -0,0 +1,138 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - Block deduplication index header file.
+ *
+ * The dedup index maps the fingerprints (128-bit hashes of the contents) of
+ * data blocks of regular files to the blocks, so that a block with the same
+ * contents can share the existing one instead of taking space of its own.
+ *
+ * The index lives in memory only, in a fixed-size open-addressed table: when
+ * all the slots a fingerprint can go to are taken, the oldest of them is
+ * replaced, so a smaller table just finds fewer duplicates. The index is
+ * never trusted on its own. Blocks drop out of it when they are freed (see
+ * dd_invalidate()), and a block found in it may have been modified in place
+ * since it was added, so callers must compare the contents before sharing it.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "a1fs.h"
+
+
+/** Fingerprint of a data block. */
+typedef struct dd_fp {
+	uint64_t lo;
+	uint64_t hi;
+
+} dd_fp;
+
+/** Dedup index entry. */
+typedef struct dd_entry {
+	/** Fingerprint of the block contents. */
+	dd_fp fp;
+	/** Data block number; DD_NONE if the slot is empty. */
+	a1fs_blk_t blk;
+	/** Value of dd_index.clock when the entry was added. */
+	uint32_t added;
+
+} dd_entry;
+
+/** Empty slot, or no block found. */
+#define DD_NONE ((a1fs_blk_t)-1)
+
+/** Number of slots a fingerprint can be stored in, starting at its home. */
+#define DD_PROBE 8
+
+/** Dedup index. */
+typedef struct dd_index {
+	/** Hash table; NULL until dd_init() is called. */
+	dd_entry *table;
+	/** Number of slots; a power of 2. */
+	size_t capacity;
+	/** Number of non-empty slots, including the ones whose block was freed. */
+	size_t entries;
+	/** Bit per data block, set while the block has an entry in the table;
+	 *  entries of blocks without the bit are stale. */
+	unsigned char *indexed;
+	/** Number of data blocks. */
+	a1fs_blk_t nblocks;
+	/** Incremented on every insertion, for replacing the oldest entry. */
+	uint32_t clock;
+
+	/** Lookups of a fingerprint. */
+	uint64_t lookups;
+	/** Lookups that found a block. */
+	uint64_t hits;
+	/** Entries replaced to make room for new ones. */
+	uint64_t replaced;
+
+} dd_index;
+
+/**
+ * Compute the fingerprint of a buffer (MurmurHash3, x64 128-bit variant).
+ *
+ * @param data  buffer.
+ * @param len   buffer size in bytes.
+ * @param fp    receives the fingerprint.
+ */
+void dd_hash(const void *data, size_t len, dd_fp *fp);
+
+/**
+ * Allocate the table of a dedup index.
+ *
+ * @param dd       dedup index.
+ * @param budget   memory budget for the table in bytes; the table gets the
+ *                 largest power of 2 slots that fit (at least DD_PROBE).
+ * @param nblocks  number of data blocks in the file system.
+ * @return         true on success; false if out of memory.
+ */
+bool dd_init(dd_index *dd, size_t budget, a1fs_blk_t nblocks);
+
+/**
+ * Make room in an initialized dedup index for the blocks added by growing the
+ * file system.
+ *
+ * @param dd       dedup index.
+ * @param nblocks  new number of data blocks; not less than the current one.
+ * @return         true on success; false if out of memory.
+ */
+bool dd_grow(dd_index *dd, a1fs_blk_t nblocks);
+
+/** Release the memory of a dedup index. Safe to call if never initialized. */
+void dd_destroy(dd_index *dd);
+
+/**
+ * Find a block by fingerprint.
+ *
+ * @return  data block that had these contents when it was added; DD_NONE if
+ *          none is known.
+ */
+a1fs_blk_t dd_lookup(dd_index *dd, const dd_fp *fp);
+
+/**
+ * Add a block to the index, replacing the block previously indexed with the
+ * same fingerprint, if any.
+ */
+void dd_insert(dd_index *dd, const dd_fp *fp, a1fs_blk_t blk);
+
+/** Drop the blocks in a run of data blocks from the index. */
+void dd_invalidate(dd_index *dd, a1fs_blk_t start, a1fs_blk_t count);
+
+/** Memory used by the index in bytes. */
+size_t dd_memory(const dd_index *dd);
@@ -0,0 +1,183 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - a1fs deduplication tool.
+ *
+ * Makes identical data blocks of the files in a mounted a1fs share storage
+ * with the A1FS_IOC_DEDUP request, and reports how much space that saves and
+ * how much memory the dedup index of the file system takes.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "a1fs_ioctl.h"
+
+
+/** Command line options. */
+typedef struct dedup_opts {
+	/** Only count the blocks that could be shared. */
+	bool dry_run;
+	/** Report every file, not only the ones with duplicate blocks. */
+	bool verbose;
+
+	/** Print help and exit. */
+	bool help;
+
+} dedup_opts;
+
+static const char *help_str = "\
+Usage: %s options path...\n\
+\n\
+Deduplicate the data blocks of files in a mounted a1fs. Directories are\n\
+processed recursively, and blocks are shared both within and across the\n\
+files given. The image must have been formatted with mkfs.a1fs -r. Blocks\n\
+are found through an in-memory index whose size is set with the\n\
+dedup_index mount option; duplicates are missed once it is full.\n\
+\n\
+Options:\n\
+    -n      dry run - only count the blocks that could be shared\n\
+    -v      report all files, not only the ones with duplicate blocks\n\
+    -h      print help and exit\n\
+";
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, help_str, progname);
+}
+
+
+static bool parse_args(int argc, char *argv[], dedup_opts *opts)
+{
+	char o;
+	while ((o = getopt(argc, argv, "nvh")) != -1) {
+		switch (o) {
+			case 'n': opts->dry_run = true; break;
+			case 'v': opts->verbose = true; break;
+
+			case 'h': opts->help = true; return true;// skip other arguments
+
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "Missing path\n");
+		return false;
+	}
+	return true;
+}
+
+
+/** Options and totals shared by the nftw() callbacks. */
+static dedup_opts opts;
+static struct {
+	unsigned long files;
+	unsigned long failed;
+	unsigned long long scanned;
+	unsigned long long shared;
+	/** Dedup index state after the last file. */
+	a1fs_dedup last;
+} totals;
+
+/** Deduplicate one file; nftw() callback. */
+static int dedup_file(const char *path, const struct stat *st, int type,
+                      struct FTW *ftw)
+{
+	(void)ftw;// unused
+	if (type != FTW_F || !S_ISREG(st->st_mode)) {
+		return 0;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		totals.failed++;
+		return 0;
+	}
+	a1fs_dedup req = { .flags = opts.dry_run ? A1FS_DEDUP_DRY_RUN : 0 };
+	int ret = ioctl(fd, A1FS_IOC_DEDUP, &req);
+	int err = errno;
+	close(fd);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", path,
+		        err == ENOTTY ? "not in an a1fs file system" : strerror(err));
+		totals.failed++;
+		// Nothing else under this path is on a1fs (or can be deduplicated)
+		return err == ENOTTY || err == EOPNOTSUPP ? 1 : 0;
+	}
+
+	totals.files++;
+	totals.scanned += req.scanned;
+	totals.shared += req.shared;
+	totals.last = req;
+	if (req.shared > 0 || opts.verbose) {
+		printf("%s: %lu of %lu blocks %s\n", path, (unsigned long)req.shared,
+		       (unsigned long)req.scanned,
+		       opts.dry_run ? "duplicate" : "shared");
+	}
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	if (!parse_args(argc, argv, &opts)) {
+		// Invalid arguments, print help to stderr
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+	if (opts.help) {
+		// Help requested, print it to stdout
+		print_help(stdout, argv[0]);
+		return 0;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		if (nftw(argv[i], dedup_file, 16, FTW_PHYS | FTW_MOUNT) < 0) {
+			perror(argv[i]);
+			totals.failed++;
+		}
+	}
+
+	// Dedup ratio: blocks the data took before / blocks it takes after
+	unsigned long long unique = totals.scanned - totals.shared;
+	printf("%s %llu of %llu blocks in %lu files (dedup ratio %.2f)\n",
+	       opts.dry_run ? "Duplicate:" : "Shared", totals.shared,
+	       totals.scanned, totals.files,
+	       unique > 0 ? (double)totals.scanned / unique : 1.0);
+	if (totals.files > 0) {
+		const a1fs_dedup *last = &totals.last;
+		printf("Index: %lu of %lu entries, %.1f MiB",
+		       (unsigned long)last->index_entries,
+		       (unsigned long)last->index_capacity,
+		       last->index_memory / 1048576.0);
+		if (totals.shared > 0) {
+			printf(" (%.1f KiB per block saved)",
+			       last->index_memory / 1024.0 / totals.shared);
+		}
+		printf("\n");
+	}
+	return totals.failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - a1fs defragmentation tool.
+ *
+ * Moves the data of fragmented files in a mounted a1fs into contiguous runs
+ * of blocks with the A1FS_IOC_DEFRAG request, and reports the number of
+ * extents of each file before and after.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "a1fs_ioctl.h"
+
+
+/** Command line options. */
+typedef struct defrag_opts {
+	/** Only report the fragmentation of the files. */
+	bool dry_run;
+	/** Report every file, not only the fragmented ones. */
+	bool verbose;
+
+	/** Print help and exit. */
+	bool help;
+
+} defrag_opts;
+
+static const char *help_str = "\
+Usage: %s options path...\n\
+\n\
+Defragment files in a mounted a1fs. Directories are processed recursively.\n\
+The file system must have enough free space for a contiguous copy of the\n\
+largest file.\n\
+\n\
+Options:\n\
+    -n      dry run - only report the fragmentation of the files\n\
+    -v      report all files, not only the fragmented ones\n\
+    -h      print help and exit\n\
+";
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, help_str, progname);
+}
+
+
+static bool parse_args(int argc, char *argv[], defrag_opts *opts)
+{
+	char o;
+	while ((o = getopt(argc, argv, "nvh")) != -1) {
+		switch (o) {
+			case 'n': opts->dry_run = true; break;
+			case 'v': opts->verbose = true; break;
+
+			case 'h': opts->help = true; return true;// skip other arguments
+
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "Missing path\n");
+		return false;
+	}
+	return true;
+}
+
+
+/** Options and totals shared by the nftw() callbacks. */
+static defrag_opts opts;
+static struct {
+	unsigned long files;
+	unsigned long fragmented;
+	unsigned long failed;
+	unsigned long extents_before;
+	unsigned long extents_after;
+} totals;
+
+/** Defragment one file; nftw() callback. */
+static int defrag_file(const char *path, const struct stat *st, int type,
+                       struct FTW *ftw)
+{
+	(void)ftw;// unused
+	if (type != FTW_F || !S_ISREG(st->st_mode)) {
+		return 0;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		totals.failed++;
+		return 0;
+	}
+	a1fs_defrag req = { .flags = opts.dry_run ? A1FS_DEFRAG_DRY_RUN : 0 };
+	int ret = ioctl(fd, A1FS_IOC_DEFRAG, &req);
+	int err = errno;
+	close(fd);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", path,
+		        err == ENOTTY ? "not in an a1fs file system" : strerror(err));
+		totals.failed++;
+		// Nothing else under this path is on a1fs either
+		return err == ENOTTY ? 1 : 0;
+	}
+
+	totals.files++;
+	totals.extents_before += req.extents_before;
+	totals.extents_after += req.extents_after;
+	if (req.runs_before > 1) {
+		totals.fragmented++;
+	}
+	if (req.runs_before > 1 || opts.verbose) {
+		printf("%s: %u extents (%u runs)", path, req.extents_before,
+		       req.runs_before);
+		if (!opts.dry_run) {
+			printf(" -> %u extents (%u runs)", req.extents_after,
+			       req.runs_after);
+		}
+		printf("\n");
+	}
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	if (!parse_args(argc, argv, &opts)) {
+		// Invalid arguments, print help to stderr
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+	if (opts.help) {
+		// Help requested, print it to stdout
+		print_help(stdout, argv[0]);
+		return 0;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		if (nftw(argv[i], defrag_file, 16, FTW_PHYS | FTW_MOUNT) < 0) {
+			perror(argv[i]);
+			totals.failed++;
+		}
+	}
+
+	printf("%s %lu of %lu files; extents: %lu -> %lu\n",
+	       opts.dry_run ? "Fragmented:" : "Defragmented", totals.fragmented,
+	       totals.files, totals.extents_before, totals.extents_after);
+	return totals.failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Delayed allocation buffers implementation.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "delalloc.h"
+
+
+void da_init(delalloc *da)
+{
+	memset(da, 0, sizeof(*da));
+}
+
+static void free_inode(da_inode *di)
+{
+	for (size_t i = 0; i < di->nblocks; i++) {
+		free(di->blocks[i].data);
+	}
+	free(di->blocks);
+	free(di);
+}
+
+void da_destroy(delalloc *da)
+{
+	for (size_t i = 0; i < da->ninodes; i++) {
+		free_inode(da->inodes[i]);
+	}
+	free(da->inodes);
+	memset(da, 0, sizeof(*da));
+}
+
+da_inode *da_find(delalloc *da, a1fs_ino_t ino, bool create)
+{
+	for (size_t i = 0; i < da->ninodes; i++) {
+		if (da->inodes[i]->ino == ino) {
+			return da->inodes[i];
+		}
+	}
+	if (!create) {
+		return NULL;
+	}
+
+	if (da->ninodes == da->cap) {
+		size_t cap = da->cap ? da->cap * 2 : 16;
+		da_inode **inodes = realloc(da->inodes, cap * sizeof(*inodes));
+		if (!inodes) {
+			return NULL;
+		}
+		da->inodes = inodes;
+		da->cap = cap;
+	}
+	da_inode *di = calloc(1, sizeof(*di));
+	if (!di) {
+		return NULL;
+	}
+	di->ino = ino;
+	di->since = time(NULL);
+	da->inodes[da->ninodes++] = di;
+	return di;
+}
+
+/** Index of the first buffered block at or after lblk. */
+static size_t lower_bound(const da_inode *di, a1fs_blk_t lblk)
+{
+	size_t lo = 0, hi = di->nblocks;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (di->blocks[mid].lblk < lblk) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+unsigned char *da_block_get(delalloc *da, da_inode *di, a1fs_blk_t lblk,
+                            bool create)
+{
+	size_t i = lower_bound(di, lblk);
+	if (i < di->nblocks && di->blocks[i].lblk == lblk) {
+		return di->blocks[i].data;
+	}
+	if (!create) {
+		return NULL;
+	}
+
+	if (di->nblocks == di->cap) {
+		size_t cap = di->cap ? di->cap * 2 : 16;
+		da_block *blocks = realloc(di->blocks, cap * sizeof(*blocks));
+		if (!blocks) {
+			return NULL;
+		}
+		di->blocks = blocks;
+		di->cap = cap;
+	}
+	unsigned char *data = calloc(1, A1FS_BLOCK_SIZE);
+	if (!data) {
+		return NULL;
+	}
+	memmove(&di->blocks[i + 1], &di->blocks[i],
+	        (di->nblocks - i) * sizeof(da_block));
+	di->blocks[i] = (da_block){ .lblk = lblk, .data = data };
+	di->nblocks++;
+	da->bytes += A1FS_BLOCK_SIZE;
+	return data;
+}
+
+bool da_reserve(delalloc *da, da_inode *di, a1fs_blk_t blocks, a1fs_blk_t avail)
+{
+	if (blocks > di->reserved && blocks - di->reserved > avail) {
+		return false;
+	}
+	da->reserved = da->reserved - di->reserved + blocks;
+	di->reserved = blocks;
+	return true;
+}
+
+void da_truncate(delalloc *da, da_inode *di, a1fs_blk_t lblk)
+{
+	size_t i = lower_bound(di, lblk);
+	for (size_t j = i; j < di->nblocks; j++) {
+		free(di->blocks[j].data);
+	}
+	da->bytes -= (di->nblocks - i) * A1FS_BLOCK_SIZE;
+	di->nblocks = i;
+}
+
+void da_remove(delalloc *da, da_inode *di)
+{
+	for (size_t i = 0; i < da->ninodes; i++) {
+		if (da->inodes[i] == di) {
+			da->inodes[i] = da->inodes[--da->ninodes];
+			break;
+		}
+	}
+	da->bytes -= di->nblocks * A1FS_BLOCK_SIZE;
+	da->reserved -= di->reserved;
+	free_inode(di);
+}
+
+da_inode *da_largest(delalloc *da)
+{
+	da_inode *best = NULL;
+	for (size_t i = 0; i < da->ninodes; i++) {
+		if (!best || da->inodes[i]->nblocks > best->nblocks) {
+			best = da->inodes[i];
+		}
+	}
+	return best;
+}
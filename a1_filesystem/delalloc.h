@@ -0,0 +1,126 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Delayed allocation buffers header file.
+ *
+ * Data written past the allocated blocks of a file is kept in memory, one
+ * buffer per file block, until the file is flushed. Only then are the data
+ * blocks allocated, all at once, so that the allocator knows the final size of
+ * the file and can place it in a single contiguous extent. The blocks that
+ * will be needed are reserved when the data is written, so that a flush never
+ * runs out of space.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "a1fs.h"
+
+
+/** A buffered file block. */
+typedef struct da_block {
+	/** File block number. */
+	a1fs_blk_t lblk;
+	/** Block contents, A1FS_BLOCK_SIZE bytes. */
+	unsigned char *data;
+
+} da_block;
+
+/** Buffered data of a file. */
+typedef struct da_inode {
+	/** Inode number. */
+	a1fs_ino_t ino;
+	/** Number of data blocks reserved for the file. */
+	a1fs_blk_t reserved;
+	/** Buffered blocks, sorted by file block number. */
+	da_block *blocks;
+	/** Number of buffered blocks. */
+	size_t nblocks;
+	/** Capacity of the blocks array. */
+	size_t cap;
+	/** Time when the file first got buffered data. */
+	time_t since;
+
+} da_inode;
+
+/** Delayed allocation state of the file system. */
+typedef struct delalloc {
+	/** Files with buffered data. */
+	da_inode **inodes;
+	/** Number of files with buffered data. */
+	size_t ninodes;
+	/** Capacity of the inodes array. */
+	size_t cap;
+	/** Total size of buffered data in bytes. */
+	size_t bytes;
+	/** Total number of reserved data blocks. */
+	a1fs_blk_t reserved;
+
+} delalloc;
+
+/** Initialize delayed allocation state. */
+void da_init(delalloc *da);
+
+/** Release all buffers without flushing them. */
+void da_destroy(delalloc *da);
+
+/**
+ * Find the buffered data of a file.
+ *
+ * @param da      delayed allocation state.
+ * @param ino     inode number.
+ * @param create  create an empty entry if the file has none.
+ * @return        buffered data of the file; NULL if none (or out of memory
+ *                when create is true).
+ */
+da_inode *da_find(delalloc *da, a1fs_ino_t ino, bool create);
+
+/**
+ * Find a buffered block of a file.
+ *
+ * @param da      delayed allocation state.
+ * @param di      buffered data of the file.
+ * @param lblk    file block number.
+ * @param create  create a zero-filled buffer if the block has none.
+ * @return        block buffer; NULL if none (or out of memory when create is
+ *                true).
+ */
+unsigned char *da_block_get(delalloc *da, da_inode *di, a1fs_blk_t lblk,
+                            bool create);
+
+/**
+ * Change the number of blocks reserved for a file.
+ *
+ * @param da      delayed allocation state.
+ * @param di      buffered data of the file.
+ * @param blocks  new number of reserved blocks.
+ * @param avail   number of data blocks that are neither allocated nor
+ *                reserved.
+ * @return        true on success; false if there is not enough space.
+ */
+bool da_reserve(delalloc *da, da_inode *di, a1fs_blk_t blocks, a1fs_blk_t avail);
+
+/** Drop the buffered blocks of a file at or after file block lblk. */
+void da_truncate(delalloc *da, da_inode *di, a1fs_blk_t lblk);
+
+/** Drop all buffered data of a file and its reservation. */
+void da_remove(delalloc *da, da_inode *di);
+
+/** Get the file with the most buffered data; NULL if there is none. */
+da_inode *da_largest(delalloc *da);
@@ -0,0 +1,89 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Discard queue implementation.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "discard.h"
+
+
+void dq_init(discard_queue *dq)
+{
+	memset(dq, 0, sizeof(*dq));
+}
+
+void dq_destroy(discard_queue *dq)
+{
+	free(dq->ranges);
+	memset(dq, 0, sizeof(*dq));
+}
+
+bool dq_add(discard_queue *dq, a1fs_blk_t start, a1fs_blk_t count)
+{
+	if (dq->n > 0) {
+		storage_range *last = &dq->ranges[dq->n - 1];
+		if (last->start + last->count == start) {
+			last->count += count;
+			dq->blocks += count;
+			return true;
+		}
+	}
+	if (dq->n == dq->cap) {
+		size_t cap = dq->cap ? dq->cap * 2 : 64;
+		storage_range *ranges = realloc(dq->ranges, cap * sizeof(*ranges));
+		if (!ranges) {
+			return false;
+		}
+		dq->ranges = ranges;
+		dq->cap = cap;
+	}
+	dq->ranges[dq->n++] = (storage_range){ .start = start, .count = count };
+	dq->blocks += count;
+	return true;
+}
+
+static int cmp_range(const void *a, const void *b)
+{
+	a1fs_blk_t x = ((const storage_range*)a)->start;
+	a1fs_blk_t y = ((const storage_range*)b)->start;
+	return (x > y) - (x < y);
+}
+
+size_t dq_take(discard_queue *dq, storage_range **ranges)
+{
+	storage_range *r = dq->ranges;
+	size_t n = 0;
+	if (dq->n > 0) {
+		qsort(r, dq->n, sizeof(*r), cmp_range);
+		n = 1;
+		for (size_t i = 1; i < dq->n; i++) {
+			storage_range *last = &r[n - 1];
+			if (r[i].start <= last->start + last->count) {
+				a1fs_blk_t end = r[i].start + r[i].count;
+				if (end > last->start + last->count) {
+					last->count = end - last->start;
+				}
+			} else {
+				r[n++] = r[i];
+			}
+		}
+	}
+	*ranges = r;
+	dq_init(dq);
+	return n;
+}
@@ -0,0 +1,72 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Discard queue header file.
+ *
+ * Data blocks freed by the file system are queued here, so that the image file
+ * space behind them can be released later in large batches (see
+ * storage_discard()) instead of one small request per freed extent.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "a1fs.h"
+#include "storage.h"
+
+
+/** Number of queued blocks at which the queue should be processed early. */
+#define DQ_BATCH_BLOCKS 4096
+
+/** Queue of freed data block runs waiting to be discarded. */
+typedef struct discard_queue {
+	/** Queued runs (data block numbers), in the order they were freed. */
+	storage_range *ranges;
+	/** Number of queued runs. */
+	size_t n;
+	/** Capacity of the ranges array. */
+	size_t cap;
+	/** Total number of queued blocks. */
+	size_t blocks;
+
+} discard_queue;
+
+/** Initialize an empty discard queue. */
+void dq_init(discard_queue *dq);
+
+/** Release all memory used by a discard queue. */
+void dq_destroy(discard_queue *dq);
+
+/**
+ * Queue a run of freed data blocks.
+ *
+ * A run that directly follows the last queued one is merged into it.
+ *
+ * @return  true on success; false if out of memory (the run is not queued,
+ *          which only means that its space is not released).
+ */
+bool dq_add(discard_queue *dq, a1fs_blk_t start, a1fs_blk_t count);
+
+/**
+ * Take all queued runs, sorted and with adjacent or overlapping runs merged.
+ *
+ * The queue is left empty.
+ *
+ * @param ranges  receives the runs; must be freed with free().
+ * @return        number of runs.
+ */
+size_t dq_take(discard_queue *dq, storage_range **ranges);
@@ -0,0 +1,119 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Extent list manipulation implementation.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include "extent.h"
+
+
+a1fs_blk_t ext_end(const a1fs_extent *ext, int n)
+{
+	a1fs_blk_t end = 0;
+	for (int i = 0; i < n; i++) {
+		end += ext[i].count;
+	}
+	return end;
+}
+
+a1fs_blk_t ext_allocated(const a1fs_extent *ext, int n)
+{
+	a1fs_blk_t blocks = 0;
+	for (int i = 0; i < n; i++) {
+		blocks += ext_blocks(&ext[i]);
+	}
+	return blocks;
+}
+
+int ext_find(const a1fs_extent *ext, int n, a1fs_blk_t lblk, a1fs_blk_t *off)
+{
+	for (int i = 0; i < n; i++) {
+		if (lblk < ext[i].count) {
+			*off = lblk;
+			return i;
+		}
+		lblk -= ext[i].count;
+	}
+	return -1;
+}
+
+int ext_insert(a1fs_extent *ext, int *n, int max, int i, a1fs_extent e)
+{
+	if (*n >= max) {
+		return -ENOSPC;
+	}
+	memmove(&ext[i + 1], &ext[i], (*n - i) * sizeof(a1fs_extent));
+	ext[i] = e;
+	(*n)++;
+	return 0;
+}
+
+/** Split extent i so that a new extent starts off blocks into it. */
+static int split(a1fs_extent *ext, int *n, int max, int i, a1fs_blk_t off)
+{
+	assert(ext[i].zblocks == 0);
+	a1fs_extent right = ext[i];
+	right.count -= off;
+	if (!ext_is_hole(&right)) {
+		right.start += off;
+	}
+	if (ext_insert(ext, n, max, i + 1, right) < 0) {
+		return -ENOSPC;
+	}
+	ext[i].count = off;
+	return 0;
+}
+
+int ext_isolate(a1fs_extent *ext, int *n, int max, a1fs_blk_t lblk,
+                a1fs_blk_t count)
+{
+	a1fs_blk_t off;
+	int first = ext_find(ext, *n, lblk, &off);
+	if (off > 0) {
+		if (split(ext, n, max, first, off) < 0) {
+			return -ENOSPC;
+		}
+		first++;
+	}
+	a1fs_blk_t end_off;
+	int last = ext_find(ext, *n, lblk + count - 1, &end_off);
+	if (end_off + 1 < ext[last].count && split(ext, n, max, last, end_off + 1) < 0) {
+		return -ENOSPC;
+	}
+	return first;
+}
+
+void ext_merge(a1fs_extent *ext, int *n)
+{
+	int out = 0;
+	for (int i = 0; i < *n; i++) {
+		if (ext[i].count == 0) {
+			continue;
+		}
+		if (out > 0 && ext_mergeable(&ext[out - 1], &ext[i])) {
+			ext[out - 1].count += ext[i].count;
+		} else {
+			ext[out++] = ext[i];
+		}
+	}
+	while (out > 0 && ext_is_hole(&ext[out - 1])) {
+		out--;
+	}
+	*n = out;
+}
@@ -0,0 +1,111 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Extent list manipulation header file.
+ *
+ * Helpers that work on the extent array of a file (see a1fs_extent) without
+ * touching the rest of the file system: looking up file blocks, splitting
+ * extents so that a range of file blocks gets extents of its own, and merging
+ * adjacent extents back together.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "a1fs.h"
+
+
+/** Check if an extent is a hole. */
+static inline bool ext_is_hole(const a1fs_extent *e)
+{
+	return e->start == A1FS_EXTENT_HOLE;
+}
+
+/** Number of data blocks an extent takes (0 for a hole). */
+static inline a1fs_blk_t ext_blocks(const a1fs_extent *e)
+{
+	if (ext_is_hole(e)) {
+		return 0;
+	}
+	return e->zblocks != 0 ? e->zblocks : e->count;
+}
+
+/**
+ * Check if two extents can be merged into one (a before b).
+ *
+ * Compressed extents are never merged since each holds a single cluster.
+ */
+static inline bool ext_mergeable(const a1fs_extent *a, const a1fs_extent *b)
+{
+	if ((uint64_t)a->count + b->count > A1FS_EXTENT_MAX ||
+	    a->zblocks != 0 || b->zblocks != 0)
+	{
+		return false;
+	}
+	if (ext_is_hole(a) || ext_is_hole(b)) {
+		return ext_is_hole(a) && ext_is_hole(b);
+	}
+	return a->unwritten == b->unwritten && a->start + a->count == b->start;
+}
+
+/** Number of file blocks covered by the extents. */
+a1fs_blk_t ext_end(const a1fs_extent *ext, int n);
+
+/** Number of data blocks allocated to the extents (see ext_blocks()). */
+a1fs_blk_t ext_allocated(const a1fs_extent *ext, int n);
+
+/**
+ * Find the extent that contains a file block.
+ *
+ * @param ext   extent array.
+ * @param n     number of extents.
+ * @param lblk  file block number.
+ * @param off   receives the offset of lblk within the extent.
+ * @return      index of the extent; -1 if lblk is past the last extent.
+ */
+int ext_find(const a1fs_extent *ext, int n, a1fs_blk_t lblk, a1fs_blk_t *off);
+
+/**
+ * Split extents so that file blocks [lblk, lblk + count) are covered by whole
+ * extents.
+ *
+ * The range must be within the extents (lblk + count <= ext_end()), and must
+ * not start or end inside a compressed extent.
+ *
+ * @param ext    extent array.
+ * @param n      pointer to the number of extents; updated.
+ * @param max    capacity of the extent array.
+ * @param lblk   first file block of the range.
+ * @param count  number of blocks in the range.
+ * @return       index of the first extent of the range; -ENOSPC if the array
+ *               is full (extents split so far are left split).
+ */
+int ext_isolate(a1fs_extent *ext, int *n, int max, a1fs_blk_t lblk,
+                a1fs_blk_t count);
+
+/**
+ * Insert an extent before position i.
+ *
+ * @return  0 on success; -ENOSPC if the array is full.
+ */
+int ext_insert(a1fs_extent *ext, int *n, int max, int i, a1fs_extent e);
+
+/**
+ * Merge all pairs of adjacent extents that can be merged, drop empty extents
+ * and drop the holes at the end of the array.
+ */
+void ext_merge(a1fs_extent *ext, int *n);
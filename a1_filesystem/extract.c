@@ -0,0 +1,1058 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - a1fs offline extraction tool.
+ *
+ * Reads an a1fs image without mounting it: walks the directory tree from the
+ * root directory and writes the files out to a host directory, or as a tar
+ * archive to standard output. The image is mapped read-only with map_file(),
+ * and is not trusted: inconsistent metadata is reported and skipped.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "a1fs.h"
+#include "bitmap.h"
+#include "lz.h"
+#include "map.h"
+
+
+/** Largest number of copying threads. */
+#define THREADS_MAX 64
+
+/** Largest piece of a file copied by one job, in blocks (8 MB). */
+#define JOB_BLOCKS 2048
+
+/** Number of jobs that can wait for a copying thread. */
+#define QUEUE_SIZE 256
+
+/** Number of extents in an extent block. */
+#define EXTENTS_MAX (A1FS_BLOCK_SIZE / sizeof(a1fs_extent))
+
+/** Size of a tar archive block. */
+#define TAR_BLOCK 512
+
+/** Command line options. */
+typedef struct extract_opts {
+	/** File system image file path. */
+	const char *img_path;
+	/** Host directory to extract into; NULL with -t. */
+	const char *out_dir;
+	/** Number of copying threads. */
+	size_t threads;
+
+	/** Print help and exit. */
+	bool help;
+	/** Write a tar archive to standard output. */
+	bool tar;
+	/** Print the path of each extracted file. */
+	bool verbose;
+
+	/** Image mapping tuning. */
+	map_opts map;
+
+} extract_opts;
+
+static const char *help_str = "\
+Usage: %s options image [dir]\n\
+\n\
+Copy the files of an a1fs image into a host directory (created if it\n\
+doesn't exist), or write them as a tar archive to standard output, without\n\
+mounting the image. The image must not be mounted read-write.\n\
+\n\
+Options:\n\
+    -t      write a tar archive to standard output instead of a directory\n\
+    -j num  number of threads that copy file data (default: one per CPU)\n\
+    -a mode data access pattern advice: normal, sequential or random\n\
+    -v      print the path of each file (to stderr)\n\
+    -h      print help and exit\n\
+";
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, help_str, progname);
+}
+
+
+static bool parse_args(int argc, char *argv[], extract_opts *opts)
+{
+	char o;
+	while ((o = getopt(argc, argv, "tj:a:vh")) != -1) {
+		switch (o) {
+			case 't': opts->tar = true; break;
+			case 'j': opts->threads = strtoul(optarg, NULL, 10); break;
+			case 'a':
+				if (!map_parse_advice(optarg, &opts->map.advice)) {
+					fprintf(stderr, "Invalid advice: %s\n", optarg);
+					return false;
+				}
+				break;
+			case 'v': opts->verbose = true; break;
+
+			case 'h': opts->help = true; return true;// skip other arguments
+
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "Missing image path\n");
+		return false;
+	}
+	opts->img_path = argv[optind++];
+	if (!opts->tar) {
+		if (optind >= argc) {
+			fprintf(stderr, "Missing output directory\n");
+			return false;
+		}
+		opts->out_dir = argv[optind];
+	}
+
+	if (opts->threads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		opts->threads = ncpus > 0 ? (size_t)ncpus : 1;
+	}
+	if (opts->threads > THREADS_MAX) {
+		opts->threads = THREADS_MAX;
+	}
+	return true;
+}
+
+
+/** A file being written by the copying threads. */
+typedef struct out_file {
+	/** Host file. */
+	int fd;
+	/** Host file path, for messages. */
+	char *path;
+	/** File mode to set once the data is written. */
+	mode_t mode;
+	/** Modification time to set once the data is written. */
+	struct timespec mtime;
+	/** Jobs not done yet, plus one while jobs are still being added. */
+	size_t refs;
+
+} out_file;
+
+/** A piece of a file to copy. */
+typedef struct copy_job {
+	/** File to write to. */
+	out_file *file;
+	/** Data in the image. */
+	const unsigned char *src;
+	/** Offset in the file. */
+	off_t offset;
+	/** Length in bytes; at most A1FS_CLUSTER_SIZE if zblocks != 0. */
+	size_t len;
+	/** Number of blocks of a compressed cluster at src; 0 if not compressed. */
+	a1fs_blk_t zblocks;
+
+} copy_job;
+
+/** Copying threads and the queue of jobs they take from. */
+typedef struct copy_pool {
+	pthread_mutex_t lock;
+	/** Signalled when a job is queued, or when there will be no more. */
+	pthread_cond_t queued;
+	/** Signalled when a job is taken from the queue. */
+	pthread_cond_t taken;
+	/** Circular queue of jobs. */
+	copy_job queue[QUEUE_SIZE];
+	size_t head;
+	size_t count;
+	/** No more jobs will be queued. */
+	bool done;
+	/** A job failed. */
+	bool failed;
+
+	pthread_t threads[THREADS_MAX];
+	size_t nthreads;
+
+} copy_pool;
+
+/** Attributes to set on an extracted directory once its files are written. */
+typedef struct dir_attr {
+	char *path;
+	mode_t mode;
+	struct timespec mtime;
+
+} dir_attr;
+
+/** Extraction state. */
+typedef struct extractor {
+	const extract_opts *opts;
+
+	/** Mapped image. */
+	const unsigned char *image;
+	/** Image size in bytes. */
+	size_t size;
+	/** Superblock of the image. */
+	const a1fs_superblock *sb;
+	/** Inode bitmap of the image. */
+	const unsigned char *inode_map;
+	/** Bit per inode: directory already extracted (guards against loops). */
+	unsigned char *visited;
+
+	/** Copying threads (directory output). */
+	copy_pool pool;
+	/** Directories to set the attributes of at the end (directory output). */
+	dir_attr *dirs;
+	size_t ndirs;
+	size_t dirs_cap;
+
+	/** Files extracted. */
+	size_t files;
+	/** Directories extracted, the root included. */
+	size_t ndirs_total;
+	/** File data bytes extracted. */
+	uint64_t bytes;
+	/** Entries skipped because the metadata was inconsistent. */
+	size_t skipped;
+
+} extractor;
+
+
+/** Report an inconsistency in the image and count it. */
+static void bad_entry(extractor *x, const char *path, const char *what)
+{
+	fprintf(stderr, "Skipping %s: %s\n", path, what);
+	x->skipped++;
+}
+
+/** Size of the metadata region of a mapped image; 0 if it's not a1fs. */
+static size_t image_meta_size(const void *image, size_t size, void *arg)
+{
+	(void)arg;// unused
+	const a1fs_superblock *sb = (const a1fs_superblock*)image;
+	if (sb->magic != A1FS_MAGIC || sb->start_data <= 0 ||
+	    (size_t)sb->start_data * A1FS_BLOCK_SIZE > size)
+	{
+		return 0;
+	}
+	return (size_t)sb->start_data * A1FS_BLOCK_SIZE;
+}
+
+/** Check that the superblock describes a layout that fits into the image. */
+static bool check_superblock(const a1fs_superblock *sb, size_t size)
+{
+	if (sb->magic != A1FS_MAGIC) {
+		fprintf(stderr, "Image doesn't contain a1fs\n");
+		return false;
+	}
+	if (sb->flags & A1FS_FEATURE_STRIPE) {
+		// Data block numbers are not offsets in the first image
+		fprintf(stderr, "Striped volumes are not supported\n");
+		return false;
+	}
+	if (sb->start_inode_map <= 0 || sb->start_inode <= 0 ||
+	    sb->start_extent <= 0 || sb->start_data <= 0 ||
+	    sb->start_inode_map >= sb->start_data_map ||
+	    (size_t)(sb->start_data_map - sb->start_inode_map) * A1FS_BLOCK_SIZE * 8
+	    < sb->inodes_count ||
+	    (size_t)sb->start_inode * (A1FS_BLOCK_SIZE / sizeof(a1fs_inode)) +
+	    sb->inodes_count > (size_t)sb->start_extent *
+	                       (A1FS_BLOCK_SIZE / sizeof(a1fs_inode)) ||
+	    (size_t)sb->start_extent + sb->inodes_count > (size_t)sb->start_data ||
+	    ((size_t)sb->start_data + sb->blocks_count) * A1FS_BLOCK_SIZE > size ||
+	    sb->inodes_count == 0)
+	{
+		fprintf(stderr, "Invalid a1fs superblock\n");
+		return false;
+	}
+	return true;
+}
+
+/** Get the inode table. */
+static const a1fs_inode *inode_table(extractor *x)
+{
+	return (const a1fs_inode*)(x->image + (size_t)x->sb->start_inode *
+	                           A1FS_BLOCK_SIZE);
+}
+
+/** Get an inode; NULL if it is out of range or not in use. */
+static const a1fs_inode *get_inode(extractor *x, a1fs_ino_t ino)
+{
+	if (ino >= x->sb->inodes_count || !bitmap_test(x->inode_map, ino)) {
+		return NULL;
+	}
+	return inode_table(x) + ino;
+}
+
+/** Get the extents of an inode; NULL if its extent count is invalid. */
+static const a1fs_extent *get_extents(extractor *x, const a1fs_inode *inode)
+{
+	if (inode->extent_count < 0 || (size_t)inode->extent_count > EXTENTS_MAX) {
+		return NULL;
+	}
+	// The inode number is where the inode is in the table; the ino_number
+	// field may be corrupted
+	size_t ino = inode - inode_table(x);
+	return (const a1fs_extent*)(x->image +
+	                            (x->sb->start_extent + ino) * A1FS_BLOCK_SIZE);
+}
+
+/** Check that an extent's data blocks are inside the data region. */
+static bool extent_valid(extractor *x, const a1fs_extent *e)
+{
+	if (e->start == A1FS_EXTENT_HOLE) {
+		return true;
+	}
+	a1fs_blk_t n = e->zblocks ? e->zblocks : e->count;
+	if (e->zblocks && e->count != A1FS_CLUSTER_BLOCKS) {
+		return false;
+	}
+	return e->start < x->sb->blocks_count &&
+	       n <= x->sb->blocks_count - e->start;
+}
+
+/** Get a pointer to the contents of a data block. */
+static const unsigned char *data_block(extractor *x, a1fs_blk_t blk)
+{
+	return x->image + ((size_t)x->sb->start_data + blk) * A1FS_BLOCK_SIZE;
+}
+
+/**
+ * Decompress a compressed cluster.
+ *
+ * @param src      the zblocks data blocks of the cluster.
+ * @param zblocks  number of data blocks.
+ * @param dst      buffer that receives A1FS_CLUSTER_SIZE bytes.
+ * @return         true on success; false if the cluster is corrupted.
+ */
+static bool unpack_cluster(const unsigned char *src, a1fs_blk_t zblocks,
+                           unsigned char *dst)
+{
+	uint32_t len;
+	memcpy(&len, src, sizeof(len));
+	return len <= zblocks * A1FS_BLOCK_SIZE - sizeof(len) &&
+	       lz_decompress(src + sizeof(len), len, dst, A1FS_CLUSTER_SIZE) ==
+	       A1FS_CLUSTER_SIZE;
+}
+
+
+/** Write a whole buffer at an offset of a file. */
+static bool write_full(int fd, const void *buf, size_t len, off_t offset)
+{
+	while (len > 0) {
+		ssize_t n = pwrite(fd, buf, len, offset);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		buf = (const char*)buf + n;
+		len -= n;
+		offset += n;
+	}
+	return true;
+}
+
+/** Release a reference to a file; the last one sets its attributes. */
+static void file_put(copy_pool *pool, out_file *f)
+{
+	pthread_mutex_lock(&pool->lock);
+	bool last = --f->refs == 0;
+	pthread_mutex_unlock(&pool->lock);
+	if (!last) {
+		return;
+	}
+	struct timespec times[2] = { f->mtime, f->mtime };
+	if (fchmod(f->fd, f->mode) < 0 || futimens(f->fd, times) < 0) {
+		perror(f->path);
+	}
+	close(f->fd);
+	free(f->path);
+	free(f);
+}
+
+/** Copy one piece of a file. */
+static bool run_job(const copy_job *job)
+{
+	if (job->zblocks == 0) {
+		return write_full(job->file->fd, job->src, job->len, job->offset);
+	}
+	unsigned char cluster[A1FS_CLUSTER_SIZE];
+	if (!unpack_cluster(job->src, job->zblocks, cluster)) {
+		fprintf(stderr, "%s: corrupted compressed cluster at offset %jd\n",
+		        job->file->path, (intmax_t)job->offset);
+		errno = EIO;
+		return false;
+	}
+	return write_full(job->file->fd, cluster, job->len, job->offset);
+}
+
+static void *copy_thread(void *arg)
+{
+	copy_pool *pool = (copy_pool*)arg;
+	pthread_mutex_lock(&pool->lock);
+	while (true) {
+		while (pool->count == 0 && !pool->done) {
+			pthread_cond_wait(&pool->queued, &pool->lock);
+		}
+		if (pool->count == 0) {
+			break;
+		}
+		copy_job job = pool->queue[pool->head];
+		pool->head = (pool->head + 1) % QUEUE_SIZE;
+		pool->count--;
+		pthread_cond_signal(&pool->taken);
+		pthread_mutex_unlock(&pool->lock);
+
+		if (!run_job(&job)) {
+			perror(job.file->path);
+			pthread_mutex_lock(&pool->lock);
+			pool->failed = true;
+			pthread_mutex_unlock(&pool->lock);
+		}
+		file_put(pool, job.file);
+		pthread_mutex_lock(&pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/** Start the copying threads; false if none could be started. */
+static bool pool_start(copy_pool *pool, size_t nthreads)
+{
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->queued, NULL);
+	pthread_cond_init(&pool->taken, NULL);
+	for (size_t i = 0; i < nthreads; i++) {
+		int ret = pthread_create(&pool->threads[i], NULL, copy_thread, pool);
+		if (ret != 0) {
+			fprintf(stderr, "pthread_create: %s\n", strerror(ret));
+			break;
+		}
+		pool->nthreads++;
+	}
+	return pool->nthreads > 0;
+}
+
+/** Queue a job, waiting for room in the queue. */
+static void pool_submit(copy_pool *pool, const copy_job *job)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (pool->count == QUEUE_SIZE) {
+		pthread_cond_wait(&pool->taken, &pool->lock);
+	}
+	pool->queue[(pool->head + pool->count) % QUEUE_SIZE] = *job;
+	pool->count++;
+	job->file->refs++;
+	pthread_cond_signal(&pool->queued);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Wait for all queued jobs and stop the copying threads.
+ *
+ * @return  true if all jobs succeeded.
+ */
+static bool pool_finish(copy_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->done = true;
+	pthread_cond_broadcast(&pool->queued);
+	pthread_mutex_unlock(&pool->lock);
+	for (size_t i = 0; i < pool->nthreads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+	pthread_cond_destroy(&pool->taken);
+	pthread_cond_destroy(&pool->queued);
+	pthread_mutex_destroy(&pool->lock);
+	return !pool->failed;
+}
+
+
+/**
+ * Callback that receives the data of a file in increasing offset order.
+ *
+ * Parts of the file that aren't passed (holes, unwritten extents and the end
+ * of the file past the last extent) read as zeros.
+ *
+ * @param x        extraction state.
+ * @param arg      callback argument.
+ * @param src      data in the image.
+ * @param offset   offset in the file.
+ * @param len      length in bytes.
+ * @param zblocks  number of blocks of a compressed cluster at src; 0 if the
+ *                 data is not compressed.
+ * @return         true on success; false to stop.
+ */
+typedef bool (*data_fn)(extractor *x, void *arg, const unsigned char *src,
+                        off_t offset, size_t len, a1fs_blk_t zblocks);
+
+/**
+ * Pass the data of a file to a callback, in pieces of at most JOB_BLOCKS
+ * blocks (or one compressed cluster).
+ *
+ * Invalid extents are reported, and end the data of the file early.
+ *
+ * @param size  size of the file; see file_size().
+ * @return      true on success; false if the callback failed.
+ */
+static bool file_data(extractor *x, const a1fs_inode *inode, uint64_t size,
+                      const char *path, data_fn fn, void *arg)
+{
+	const a1fs_extent *ext = get_extents(x, inode);
+	if (!ext) {
+		bad_entry(x, path, "invalid extent count");
+		return true;
+	}
+	uint64_t pos = 0;
+	for (int i = 0; i < inode->extent_count && pos < size; i++) {
+		const a1fs_extent *e = &ext[i];
+		uint64_t ext_len = (uint64_t)e->count * A1FS_BLOCK_SIZE;
+		if (!extent_valid(x, e)) {
+			// Keep what was extracted so far
+			bad_entry(x, path, "extent out of range");
+			return true;
+		}
+		if (e->start == A1FS_EXTENT_HOLE || e->unwritten) {
+			pos += ext_len;
+			continue;
+		}
+		if (e->zblocks != 0) {
+			size_t len = size - pos < ext_len ? size - pos : ext_len;
+			if (!fn(x, arg, data_block(x, e->start), pos, len, e->zblocks)) {
+				return false;
+			}
+			pos += ext_len;
+			continue;
+		}
+		for (a1fs_blk_t b = 0; b < e->count && pos < size;
+		     b += JOB_BLOCKS)
+		{
+			a1fs_blk_t n = e->count - b < JOB_BLOCKS ? e->count - b : JOB_BLOCKS;
+			uint64_t len = (uint64_t)n * A1FS_BLOCK_SIZE;
+			len = size - pos < len ? size - pos : len;
+			if (!fn(x, arg, data_block(x, e->start + b), pos, len, 0)) {
+				return false;
+			}
+			pos += (uint64_t)n * A1FS_BLOCK_SIZE;
+		}
+	}
+	return true;
+}
+
+
+/** Tar archive output state. */
+typedef struct tar_file {
+	/** Archive. */
+	FILE *out;
+	/** Bytes of the current file written so far. */
+	uint64_t pos;
+
+} tar_file;
+
+static const unsigned char zeros[A1FS_BLOCK_SIZE];
+
+/** Write len zero bytes to the archive. */
+static bool tar_zeros(FILE *out, uint64_t len)
+{
+	while (len > 0) {
+		size_t n = len < sizeof(zeros) ? len : sizeof(zeros);
+		if (fwrite(zeros, 1, n, out) != n) {
+			return false;
+		}
+		len -= n;
+	}
+	return true;
+}
+
+/** Write a pax extended header record ("<length> <key>=<value>\n"). */
+static size_t pax_record(char *buf, size_t cap, const char *key,
+                         const char *value)
+{
+	// The length includes its own digits
+	size_t len = strlen(key) + strlen(value) + 3;
+	size_t digits = snprintf(NULL, 0, "%zu", len);
+	if ((size_t)snprintf(NULL, 0, "%zu", len + digits) > digits) {
+		digits++;
+	}
+	return snprintf(buf, cap, "%zu %s=%s\n", len + digits, key, value);
+}
+
+/**
+ * Store a number in a tar header field as width - 1 octal digits followed by
+ * a NUL, clamped to the largest value that fits.
+ */
+static void tar_octal(unsigned char *field, size_t width, uintmax_t value)
+{
+	uintmax_t max = ((uintmax_t)1 << (3 * (width - 1))) - 1;
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%0*jo", (int)(width - 1),
+	         value < max ? value : max);
+	memcpy(field, buf, width);
+}
+
+/** Fill in a ustar header block. */
+static void tar_fill(unsigned char *h, const char *name, const char *prefix,
+                     char type, mode_t mode, uint64_t size, time_t mtime)
+{
+	memset(h, 0, TAR_BLOCK);
+	strncpy((char*)h, name, 100);
+	tar_octal(h + 100, 8, mode & 07777);
+	tar_octal(h + 108, 8, getuid());
+	tar_octal(h + 116, 8, getgid());
+	tar_octal(h + 124, 12, size);
+	tar_octal(h + 136, 12, mtime > 0 ? mtime : 0);
+	h[156] = type;
+	memcpy(h + 257, "ustar", 6);
+	memcpy(h + 263, "00", 2);
+	strncpy((char*)h + 345, prefix, 155);
+
+	// The checksum is computed with its own field filled with spaces
+	memset(h + 148, ' ', 8);
+	unsigned int sum = 0;
+	for (size_t i = 0; i < TAR_BLOCK; i++) {
+		sum += h[i];
+	}
+	tar_octal(h + 148, 7, sum);
+	h[155] = ' ';
+}
+
+/**
+ * Write the header of an archive member.
+ *
+ * Names that don't fit into the ustar name and prefix fields, and sizes of
+ * 8 GB and more, are stored in a pax extended header before it.
+ *
+ * @return  true on success; false on write error.
+ */
+static bool tar_header(FILE *out, const char *name, char type, mode_t mode,
+                       uint64_t size, time_t mtime)
+{
+	unsigned char h[TAR_BLOCK];
+	char pax[PATH_MAX + 64];
+	size_t pax_len = 0;
+
+	// Split a long name at a '/' into the prefix and the name fields
+	const char *base = name;
+	char prefix[156] = "";
+	size_t len = strlen(name);
+	if (len > 100) {
+		const char *slash = strchr(name + (len > 101 ? len - 101 : 0), '/');
+		if (slash && slash - name <= 155 && slash[1] != '\0') {
+			memcpy(prefix, name, slash - name);
+			prefix[slash - name] = '\0';
+			base = slash + 1;
+		} else {
+			pax_len += pax_record(pax + pax_len, sizeof(pax) - pax_len,
+			                      "path", name);
+		}
+	}
+	uint64_t hsize = size;
+	if (size > 077777777777ull) {
+		char num[32];
+		snprintf(num, sizeof(num), "%ju", (uintmax_t)size);
+		pax_len += pax_record(pax + pax_len, sizeof(pax) - pax_len, "size", num);
+		hsize = 0;
+	}
+
+	if (pax_len > 0) {
+		tar_fill(h, "././@PaxHeader", "", 'x', 0644, pax_len, mtime);
+		if (fwrite(h, 1, TAR_BLOCK, out) != TAR_BLOCK ||
+		    fwrite(pax, 1, pax_len, out) != pax_len ||
+		    !tar_zeros(out, (TAR_BLOCK - pax_len % TAR_BLOCK) % TAR_BLOCK))
+		{
+			return false;
+		}
+	}
+	tar_fill(h, base, prefix, type, mode, hsize, mtime);
+	return fwrite(h, 1, TAR_BLOCK, out) == TAR_BLOCK;
+}
+
+/** Write a piece of a file to the archive, preceded by zeros for any gap. */
+static bool tar_piece(extractor *x, void *arg, const unsigned char *src,
+                      off_t offset, size_t len, a1fs_blk_t zblocks)
+{
+	(void)x;// unused
+	tar_file *tf = (tar_file*)arg;
+	if (!tar_zeros(tf->out, offset - tf->pos)) {
+		return false;
+	}
+	unsigned char cluster[A1FS_CLUSTER_SIZE];
+	if (zblocks != 0) {
+		if (!unpack_cluster(src, zblocks, cluster)) {
+			// The size in the header is already written; keep it right
+			fprintf(stderr, "Corrupted compressed cluster, written as zeros\n");
+			x->skipped++;
+			memset(cluster, 0, sizeof(cluster));
+		}
+		src = cluster;
+	}
+	tf->pos = offset + len;
+	return fwrite(src, 1, len, tf->out) == len;
+}
+
+/** Queue a piece of a file for the copying threads. */
+static bool submit_piece(extractor *x, void *arg, const unsigned char *src,
+                         off_t offset, size_t len, a1fs_blk_t zblocks)
+{
+	copy_job job = { .file = (out_file*)arg, .src = src, .offset = offset,
+	                 .len = len, .zblocks = zblocks };
+	pool_submit(&x->pool, &job);
+	return true;
+}
+
+/**
+ * Get the size of a file to extract.
+ *
+ * A file may be larger than what its extents map (e.g. if it was grown with
+ * truncate()), but a size that is past both the end of the last extent with
+ * data blocks and the size of the whole image is taken to be corrupted: it is
+ * reported, and the file is cut at the end of its data.
+ */
+static uint64_t file_size(extractor *x, const a1fs_inode *inode,
+                          const char *path)
+{
+	uint64_t end = 0;
+	uint64_t pos = 0;
+	const a1fs_extent *ext = get_extents(x, inode);
+	for (int i = 0; ext && i < inode->extent_count; i++) {
+		if (!extent_valid(x, &ext[i])) {
+			// file_data() stops there too
+			break;
+		}
+		// Holes can be of any length and don't count
+		pos += (uint64_t)ext[i].count * A1FS_BLOCK_SIZE;
+		if (ext[i].start != A1FS_EXTENT_HOLE) {
+			end = pos;
+		}
+	}
+	if (inode->size <= end || inode->size <= x->size) {
+		return inode->size;
+	}
+	fprintf(stderr, "Truncating %s: file size out of range\n", path);
+	x->skipped++;
+	return end;
+}
+
+/**
+ * Extract a regular file.
+ *
+ * @param x      extraction state.
+ * @param inode  inode of the file.
+ * @param path   output path (archive member name with -t).
+ * @return       true on success; false on output error.
+ */
+static bool extract_file(extractor *x, const a1fs_inode *inode,
+                         const char *path)
+{
+	uint64_t size = file_size(x, inode, path);
+	x->files++;
+	x->bytes += size;
+	if (x->opts->tar) {
+		tar_file tf = { .out = stdout, .pos = 0 };
+		FILE *out = stdout;
+		return tar_header(out, path, '0', inode->mode, size,
+		                  inode->mtime.tv_sec) &&
+		       file_data(x, inode, size, path, tar_piece, &tf) &&
+		       tar_zeros(out, size - tf.pos) &&
+		       tar_zeros(out, (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK);
+	}
+
+	// Holes are left unwritten, so the host file is sparse there too
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600);
+	if (fd < 0 || ftruncate(fd, size) < 0) {
+		perror(path);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return false;
+	}
+	out_file *f = malloc(sizeof(*f));
+	char *name = strdup(path);
+	if (!f || !name) {
+		perror("malloc");
+		free(f);
+		free(name);
+		close(fd);
+		return false;
+	}
+	*f = (out_file){ .fd = fd, .path = name, .mode = inode->mode & 07777,
+	                 .mtime = inode->mtime, .refs = 1 };
+	bool ok = file_data(x, inode, size, path, submit_piece, f);
+	file_put(&x->pool, f);
+	return ok;
+}
+
+/** Create an extracted directory; its attributes are set at the end. */
+static bool make_dir(extractor *x, const a1fs_inode *inode, const char *path)
+{
+	x->ndirs_total++;
+	if (x->opts->tar) {
+		char name[PATH_MAX + 1];
+		snprintf(name, sizeof(name), "%s/", path);
+		return tar_header(stdout, name, '5', inode->mode, 0,
+		                  inode->mtime.tv_sec);
+	}
+
+	// Writable until its files are created
+	if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+		perror(path);
+		return false;
+	}
+	if (x->ndirs == x->dirs_cap) {
+		size_t cap = x->dirs_cap ? x->dirs_cap * 2 : 64;
+		dir_attr *dirs = realloc(x->dirs, cap * sizeof(dir_attr));
+		if (!dirs) {
+			perror("realloc");
+			return false;
+		}
+		x->dirs = dirs;
+		x->dirs_cap = cap;
+	}
+	char *name = strdup(path);
+	if (!name) {
+		perror("strdup");
+		return false;
+	}
+	x->dirs[x->ndirs++] = (dir_attr){ .path = name, .mode = inode->mode & 07777,
+	                                  .mtime = inode->mtime };
+	return true;
+}
+
+/**
+ * Extract the entries of a directory, recursively.
+ *
+ * @param x     extraction state.
+ * @param dir   inode of the directory.
+ * @param path  buffer of PATH_MAX bytes holding the output path of the
+ *              directory ("" for the root directory with -t); restored on
+ *              return.
+ * @return      true on success; false on output error.
+ */
+static bool extract_dir(extractor *x, const a1fs_inode *dir, char *path)
+{
+	const a1fs_extent *ext = get_extents(x, dir);
+	if (!ext) {
+		bad_entry(x, path, "invalid extent count");
+		return true;
+	}
+	size_t len = strlen(path);
+	uint64_t nentries = dir->size / sizeof(a1fs_dentry);
+	uint64_t pos = 0;
+	const size_t per_block = A1FS_BLOCK_SIZE / sizeof(a1fs_dentry);
+	for (int i = 0; i < dir->extent_count && pos < nentries; i++) {
+		const a1fs_extent *e = &ext[i];
+		if (!extent_valid(x, e) || e->start == A1FS_EXTENT_HOLE || e->zblocks) {
+			bad_entry(x, path, "invalid directory extent");
+			return true;
+		}
+		for (size_t n = 0; n < e->count * per_block && pos < nentries;
+		     n++, pos++)
+		{
+			const a1fs_dentry *d = (const a1fs_dentry*)data_block(x, e->start) + n;
+			if (!memchr(d->name, '\0', sizeof(d->name))) {
+				bad_entry(x, path, "unterminated entry name");
+				continue;
+			}
+			if (strcmp(d->name, ".") == 0 || strcmp(d->name, "..") == 0) {
+				continue;
+			}
+			size_t name_len = strlen(d->name);
+			if (len + 1 + name_len >= PATH_MAX) {
+				bad_entry(x, path, "path too long");
+				continue;
+			}
+			snprintf(path + len, PATH_MAX - len, "%s%s", len ? "/" : "",
+			         d->name);
+			if (name_len == 0 || strchr(d->name, '/')) {
+				bad_entry(x, path, "invalid entry name");
+				path[len] = '\0';
+				continue;
+			}
+
+			const a1fs_inode *inode = get_inode(x, d->ino);
+			bool ok = true;
+			if (!inode) {
+				bad_entry(x, path, "inode is not in use");
+			} else if (S_ISDIR(inode->mode)) {
+				if (bitmap_test(x->visited, d->ino)) {
+					bad_entry(x, path, "directory is linked more than once");
+				} else {
+					bitmap_set(x->visited, d->ino);
+					if (x->opts->verbose) {
+						fprintf(stderr, "%s/\n", path);
+					}
+					ok = make_dir(x, inode, path) && extract_dir(x, inode, path);
+				}
+			} else if (S_ISREG(inode->mode)) {
+				if (x->opts->verbose) {
+					fprintf(stderr, "%s\n", path);
+				}
+				ok = extract_file(x, inode, path);
+			} else {
+				bad_entry(x, path, "unsupported file type");
+			}
+			path[len] = '\0';
+			if (!ok) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/** Extract the tree into opts->out_dir with the copying threads. */
+static bool extract_to_dir(extractor *x, const a1fs_inode *root)
+{
+	const char *out_dir = x->opts->out_dir;
+	if (mkdir(out_dir, 0755) < 0 && errno != EEXIST) {
+		perror(out_dir);
+		return false;
+	}
+	if (strlen(out_dir) >= PATH_MAX) {
+		fprintf(stderr, "%s: File name too long\n", out_dir);
+		return false;
+	}
+	if (!pool_start(&x->pool, x->opts->threads)) {
+		return false;
+	}
+	char path[PATH_MAX];
+	strcpy(path, out_dir);
+	bool ok = extract_dir(x, root, path);
+	ok = pool_finish(&x->pool) && ok;
+
+	// Children first, so that setting their attributes doesn't change the
+	// parents' modification times
+	for (size_t i = x->ndirs; i-- > 0;) {
+		const dir_attr *d = &x->dirs[i];
+		struct timespec times[2] = { d->mtime, d->mtime };
+		if (chmod(d->path, d->mode) < 0 ||
+		    utimensat(AT_FDCWD, d->path, times, 0) < 0)
+		{
+			perror(d->path);
+			ok = false;
+		}
+		free(d->path);
+	}
+	free(x->dirs);
+	return ok;
+}
+
+/** Write the tree as a tar archive to standard output. */
+static bool extract_to_tar(extractor *x, const a1fs_inode *root)
+{
+	if (isatty(STDOUT_FILENO)) {
+		fprintf(stderr, "Refusing to write a tar archive to a terminal\n");
+		return false;
+	}
+	static char buf[1 << 20];
+	setvbuf(stdout, buf, _IOFBF, sizeof(buf));
+	char path[PATH_MAX] = "";
+	bool ok = extract_dir(x, root, path) &&
+	          tar_zeros(stdout, 2 * TAR_BLOCK) && fflush(stdout) == 0;
+	if (!ok) {
+		perror("write");
+	}
+	return ok;
+}
+
+
+int main(int argc, char *argv[])
+{
+	extract_opts opts = {0};// defaults are all 0
+	if (!parse_args(argc, argv, &opts)) {
+		// Invalid arguments, print help to stderr
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+	if (opts.help) {
+		// Help requested, print it to stdout
+		print_help(stdout, argv[0]);
+		return 0;
+	}
+
+	// A mounted image changes under the mapping; other readers are fine
+	int lock_fd = lock_file(opts.img_path, true);
+	if (lock_fd < 0) {
+		return 1;
+	}
+	opts.map.readonly = true;
+	opts.map.meta_size = image_meta_size;
+	size_t size;
+	void *image = map_file(opts.img_path, A1FS_BLOCK_SIZE, &size, &opts.map);
+	if (!image) {
+		close(lock_fd);
+		return 1;
+	}
+
+	int ret = 1;
+	extractor x = { .opts = &opts, .image = image, .size = size,
+	                .sb = (const a1fs_superblock*)image };
+	if (!check_superblock(x.sb, size)) {
+		goto end;
+	}
+	x.inode_map = x.image + (size_t)x.sb->start_inode_map * A1FS_BLOCK_SIZE;
+	x.visited = calloc(((size_t)x.sb->inodes_count + 7) / 8, 1);
+	if (!x.visited) {
+		perror("calloc");
+		goto end;
+	}
+	const a1fs_inode *root = get_inode(&x, 0);
+	if (!root || !S_ISDIR(root->mode)) {
+		fprintf(stderr, "Invalid root directory\n");
+		goto end;
+	}
+	bitmap_set(x.visited, 0);
+	x.ndirs_total = 1;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	bool ok = opts.tar ? extract_to_tar(&x, root) : extract_to_dir(&x, root);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (!ok) {
+		goto end;
+	}
+
+	double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	FILE *report = opts.tar ? stderr : stdout;
+	if (!opts.tar || opts.verbose) {
+		fprintf(report, "Extracted %zu files and %zu directories (%ju MiB) in "
+		        "%.2f s (%.0f MiB/s)\n", x.files, x.ndirs_total,
+		        (uintmax_t)(x.bytes >> 20), secs,
+		        secs > 0 ? x.bytes / secs / (1 << 20) : 0.0);
+	}
+	if (x.skipped > 0) {
+		fprintf(stderr, "%zu entries were skipped or truncated because of "
+		        "inconsistent metadata\n", x.skipped);
+		goto end;
+	}
+	ret = 0;
+end:
+	free(x.visited);
+	munmap(image, size);
+	close(lock_fd);
+	return ret;
+}
@@ -0,0 +1,262 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - a1fs formatting implementation.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "bitmap.h"
+#include "crc32c.h"
+#include "format.h"
+#include "util.h"
+
+
+/** Round block number up to a 2 MB boundary if aligned layout is requested. */
+static int layout_align(int blk, const format_opts *opts)
+{
+	return opts->align ? (int)align_up(blk, A1FS_HUGE_BLOCKS) : blk;
+}
+
+/**
+ * Compute the on-disk layout of the file system.
+ *
+ * Fills in the geometry fields of the superblock. With the aligned layout
+ * (-A), the inode table, the extent blocks and the data region each start on
+ * a 2 MB boundary. The checksum table (-c) has an entry for every block before
+ * the data region, itself included, so its size is found by iterating. The
+ * data bitmap and the reference count table (-r) are sized for the largest
+ * image the file system may be grown to (-g). A striped volume (-s) has as
+ * many data blocks as whole rows of chunks fit in its members, and can't grow.
+ *
+ * @param sb     pointer to the superblock that receives the result.
+ * @param size   image size in bytes.
+ * @param opts   format options.
+ * @return       true on success; false if the image is too small.
+ */
+static bool layout(a1fs_superblock *sb, size_t size, const format_opts *opts)
+{
+	size_t n_blocks = size / A1FS_BLOCK_SIZE;
+	bool striped = opts->stripe_count > 1;
+	size_t max_blocks = striped ? n_blocks * opts->stripe_count
+	                            : opts->max_size / A1FS_BLOCK_SIZE;
+	if (max_blocks < n_blocks) {
+		max_blocks = n_blocks;
+	}
+	if (max_blocks > UINT_MAX) {
+		max_blocks = UINT_MAX;
+	}
+	int inode_bit_size = opts->n_inodes / (4096*8) + 1;
+	int inode_size = opts->n_inodes / 64 + 1;   // number of blocks inodes take
+	int data_bit_size = max_blocks / (4096*8) + 1;
+	if (data_bit_size < 2) {
+		data_bit_size = 2;
+	}
+	int refcount_size = opts->reflink
+	                  ? (int)((max_blocks * sizeof(uint16_t) + A1FS_BLOCK_SIZE - 1) /
+	                          A1FS_BLOCK_SIZE)
+	                  : 0;
+
+	sb->magic = A1FS_MAGIC;
+	sb->size = size;
+	sb->flags = (opts->align ? A1FS_FEATURE_ALIGN : 0) |
+	            (opts->reflink ? A1FS_FEATURE_REFLINK : 0) |
+	            (opts->csum ? A1FS_FEATURE_CSUM : 0) |
+	            (opts->zeroed ? 0 : A1FS_FEATURE_LAZY_INIT) |
+	            (striped ? A1FS_FEATURE_STRIPE : 0);
+	sb->start_inode_map = 1;
+	sb->start_data_map = 1+inode_bit_size;
+	sb->start_refcount = opts->reflink ? sb->start_data_map + data_bit_size : 0;
+	sb->start_csum = opts->csum ? sb->start_data_map + data_bit_size +
+	                              refcount_size : 0;
+	int csum_size = 0;
+	while (true) {
+		sb->start_inode = layout_align(sb->start_data_map + data_bit_size +
+		                               refcount_size + csum_size, opts);
+		sb->start_extent = layout_align(sb->start_inode + inode_size, opts);
+		sb->start_data = layout_align(sb->start_extent + opts->n_inodes, opts);
+		if ((size_t)sb->start_data >= n_blocks) {
+			return false;
+		}
+		int needed = opts->csum
+		           ? (int)(((size_t)sb->start_data * sizeof(uint32_t) +
+		                    A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE)
+		           : 0;
+		if (needed <= csum_size) {
+			break;
+		}
+		csum_size = needed;
+	}
+	sb->inodes_count = opts->n_inodes;
+	sb->blocks_count = n_blocks - sb->start_data;
+	// Whatever room the last bitmap and reference count table blocks have
+	// left is usable for growing too
+	size_t blocks_max = (size_t)data_bit_size * A1FS_BLOCK_SIZE * 8;
+	if (opts->reflink) {
+		size_t refcounts = (size_t)refcount_size * A1FS_BLOCK_SIZE /
+		                   sizeof(uint16_t);
+		blocks_max = refcounts < blocks_max ? refcounts : blocks_max;
+	}
+	sb->blocks_max = blocks_max < UINT_MAX ? blocks_max : UINT_MAX;
+	if (striped) {
+		// Member 0 has the least room for chunks, after the metadata
+		size_t rows = (n_blocks - sb->start_data) / opts->stripe_blocks;
+		size_t blocks = rows * opts->stripe_blocks * opts->stripe_count;
+		if (blocks == 0 || blocks > sb->blocks_max) {
+			return false;
+		}
+		sb->size = ((size_t)sb->start_data + blocks) * A1FS_BLOCK_SIZE;
+		sb->blocks_count = blocks;
+		sb->blocks_max = blocks;
+		sb->stripe_count = opts->stripe_count;
+		sb->stripe_blocks = opts->stripe_blocks;
+		sb->volume_id = opts->volume_id;
+	}
+	sb->free_inodes_count = sb->inodes_count;
+	sb->free_blocks_count = sb->blocks_count;
+	return true;
+}
+
+size_t format_meta_size(const void *image, size_t size, void *arg)
+{
+	(void)image;// unused
+	a1fs_superblock sb = {0};
+	if (!layout(&sb, size, (const format_opts*)arg)) {
+		return 0;
+	}
+	return (size_t)sb.start_data * A1FS_BLOCK_SIZE;
+}
+
+
+void format_stripe_member(void *member, const void *image, unsigned int index)
+{
+	const a1fs_superblock *sb = (const a1fs_superblock*)image;
+	a1fs_stripe_header hdr = {
+		.magic        = A1FS_STRIPE_MAGIC,
+		.volume_id    = sb->volume_id,
+		.index        = index,
+		.stripe_count = sb->stripe_count,
+	};
+	memcpy(member, &hdr, sizeof(hdr));
+}
+
+/** Determine if any of count inodes starting at ino is in use. */
+static bool inodes_used(const unsigned char *inode_map,
+                        const a1fs_superblock *sb, size_t ino, size_t count)
+{
+	if (ino >= sb->inodes_count) {
+		return false;
+	}
+	size_t end = ino + count < sb->inodes_count ? ino + count
+	                                            : sb->inodes_count;
+	return bitmap_find_one(inode_map, ino, end) < end;
+}
+
+void format_csum(void *image)
+{
+	const a1fs_superblock *sb = (const a1fs_superblock*)image;
+	const unsigned char *inode_map = (unsigned char*)image +
+	                                 (size_t)sb->start_inode_map * A1FS_BLOCK_SIZE;
+	uint32_t *sums = (uint32_t*)((unsigned char*)image +
+	                             (size_t)sb->start_csum * A1FS_BLOCK_SIZE);
+	int table_end = sb->start_csum +
+	                (sb->start_data * sizeof(uint32_t) + A1FS_BLOCK_SIZE - 1) /
+	                A1FS_BLOCK_SIZE;
+	const size_t per_block = A1FS_BLOCK_SIZE / sizeof(a1fs_inode);
+	for (int blk = 0; blk < sb->start_data; blk++) {
+		// The blocks of the table itself never have a checksum, and inode
+		// table and extent blocks only once they are in use
+		bool written;
+		if (blk >= sb->start_extent) {
+			written = inodes_used(inode_map, sb, blk - sb->start_extent, 1);
+		} else if (blk >= sb->start_inode) {
+			written = inodes_used(inode_map, sb,
+			                      (blk - sb->start_inode) * per_block, per_block);
+		} else {
+			written = (blk < sb->start_csum) || (blk >= table_end);
+		}
+		if (!written) {
+			continue;
+		}
+		uint32_t crc = crc32c(0, (unsigned char*)image +
+		                         (size_t)blk * A1FS_BLOCK_SIZE, A1FS_BLOCK_SIZE);
+		sums[blk] = (crc == A1FS_CSUM_NONE) ? 1 : crc;
+	}
+}
+
+/**
+ * Zero a range of blocks of the image.
+ *
+ * If the image is a shared mapping of a file, the range is punched out of the
+ * file instead of being written, which for large images (e.g. the bitmaps and
+ * the reference count table of a multi-terabyte image) is much faster and
+ * leaves the range sparse.
+ */
+static void zero_blocks(void *image, size_t blk, size_t count)
+{
+	void *addr = (unsigned char*)image + blk * A1FS_BLOCK_SIZE;
+	size_t len = count * A1FS_BLOCK_SIZE;
+	if (madvise(addr, len, MADV_REMOVE) < 0) {
+		memset(addr, 0, len);
+	}
+}
+
+bool format_image(void *image, size_t size, const format_opts *opts)
+{
+	// initialize super block
+	a1fs_superblock sb = {0};
+	if (!layout(&sb, size, opts)) {
+		fprintf(stderr, "Image is too small for %zu inodes\n", opts->n_inodes);
+		return false;
+	}
+
+	// clear both bitmaps and the reference count table; inode numbers past inodes_count are never free
+	unsigned char *inode_map = image + (size_t)sb.start_inode_map * A1FS_BLOCK_SIZE;
+	unsigned char *data_map = image + (size_t)sb.start_data_map * A1FS_BLOCK_SIZE;
+	size_t inode_bits = (size_t)(sb.start_data_map - sb.start_inode_map) *
+	                    A1FS_BLOCK_SIZE * 8;
+	zero_blocks(image, sb.start_inode_map, sb.start_inode - sb.start_inode_map);
+	bitmap_set_range(inode_map, sb.inodes_count, inode_bits - sb.inodes_count);
+
+	// create empty root dir in inode 0 and data block 0
+	a1fs_inode root = {.mode =S_IFDIR | 0777, .links=2, .size=512, .ino_number = 0, .extent_count = 1};
+	clock_gettime(CLOCK_REALTIME, &root.mtime);
+	memcpy((image + (size_t)sb.start_inode * A1FS_BLOCK_SIZE), &root, sizeof(a1fs_inode));
+	bitmap_set(inode_map, 0);
+	bitmap_set(data_map, 0);
+
+	a1fs_extent root_extent = {.start = 0, .count = 1};
+	a1fs_dentry root_entry_self = {.ino = 0, .name = "."};
+	a1fs_dentry root_entry_parent = {.ino = 0, .name = ".."};
+	memcpy(image+(size_t)sb.start_data*A1FS_BLOCK_SIZE, &root_entry_self, sizeof(a1fs_dentry));
+	memcpy(image+(size_t)sb.start_data*A1FS_BLOCK_SIZE+256, &root_entry_parent, sizeof(a1fs_dentry));
+	if (!opts->zeroed) {
+		// the root directory is the only initialized inode
+		zero_blocks(image, sb.start_extent, 1);
+		sb.inodes_init = 1;
+	}
+	memcpy(image+(size_t)sb.start_extent*A1FS_BLOCK_SIZE, &root_extent, sizeof(root_extent));
+	sb.free_blocks_count = sb.free_blocks_count-1;
+	sb.free_inodes_count = sb.free_inodes_count-1;
+
+	memcpy(image, &sb, sizeof(a1fs_superblock));
+	if (opts->csum) {
+		format_csum(image);
+	}
+	return true;
+}
@@ -0,0 +1,109 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - a1fs formatting header file.
+ *
+ * Used by mkfs.a1fs, and by tools that create a fresh image in-process (e.g.
+ * a1fs_bench).
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "a1fs.h"
+
+
+/** Format options. */
+typedef struct format_opts {
+	/** Number of inodes. */
+	size_t n_inodes;
+	/** Align metadata regions and the data region to 2 MB. */
+	bool align;
+	/** Create a block reference count table so that files can be cloned. */
+	bool reflink;
+	/** Create a metadata checksum table. */
+	bool csum;
+	/**
+	 * The image is all zeros (e.g. mkfs.a1fs -z); otherwise the inode table
+	 * and extent blocks are left to be initialized lazily by the file system.
+	 */
+	bool zeroed;
+	/**
+	 * Size in bytes that the image may be grown to later (see a1fs-resize);
+	 * the data bitmap and the reference count table get room for it. If not
+	 * larger than the image, only the room left in their last blocks is
+	 * available for growing.
+	 */
+	size_t max_size;
+	/**
+	 * Number of image files in a striped volume (see A1FS_FEATURE_STRIPE),
+	 * all of the same size as the image; 0 or 1 for a single image.
+	 */
+	unsigned int stripe_count;
+	/** Stripe chunk size in blocks; a power of 2. */
+	size_t stripe_blocks;
+	/** Identifier of the striped volume. */
+	uint64_t volume_id;
+
+} format_opts;
+
+/**
+ * Get the size of the metadata region of the image format_image() creates.
+ *
+ * Can be used as map_opts.meta_size (with a pointer to format_opts as the
+ * argument) to map an image for formatting.
+ */
+size_t format_meta_size(const void *image, size_t size, void *arg);
+
+/**
+ * Format the image into a1fs.
+ *
+ * Only the superblock, the bitmaps, the reference count and checksum tables,
+ * and the root directory are initialized, so formatting takes about the same
+ * time regardless of the image size. Unless opts->zeroed is set, the image
+ * gets A1FS_FEATURE_LAZY_INIT, and the file system zeroes the inode table
+ * entries and extent blocks of inodes as they are first allocated. The rest
+ * of the image is never read before it is written.
+ *
+ * @param image  pointer to the start of the image.
+ * @param size   image size in bytes.
+ * @param opts   format options.
+ * @return       true on success;
+ *               false on error, e.g. options are invalid for given image size.
+ */
+bool format_image(void *image, size_t size, const format_opts *opts);
+
+/**
+ * Write the header of a member of a striped volume.
+ *
+ * @param member  pointer to the start of the member image.
+ * @param image   pointer to the start of the formatted first member.
+ * @param index   position of the member in the volume (from 1).
+ */
+void format_stripe_member(void *member, const void *image, unsigned int index);
+
+/**
+ * Compute the checksums of the metadata blocks of a formatted image.
+ *
+ * Called by format_image() on images with A1FS_FEATURE_CSUM, and again by
+ * tools that fill in the metadata of a fresh image directly (see import.h).
+ * Inode table and extent blocks of inodes that are not in use are left without
+ * a checksum: they may not be initialized, and get one when they are first
+ * written.
+ *
+ * @param image  pointer to the start of the image.
+ */
+void format_csum(void *image);
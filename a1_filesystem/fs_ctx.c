@@ -16,21 +16,85 @@
  * CSC369 Assignment 1 - File system runtime context implementation.
  */
 
+#include <time.h>
+
 #include "fs_ctx.h"
+#include "log.h"
 
 
-bool fs_ctx_init(fs_ctx *fs, void *image, size_t size)
+bool fs_ctx_init(fs_ctx *fs, storage *st)
 {
+	void *image = st->meta;
+	size_t size = st->size;
 	fs->image = image;
 	fs->size = size;
 
-	//TODO: check if the file system image is valid and can be mounted,
-	//      and initialize its runtime state
+	a1fs_superblock *sb = (a1fs_superblock*)image;
+	if (sb->magic != A1FS_MAGIC) {
+		log_error("Image doesn't contain a1fs\n");
+		return false;
+	}
+	if (sb->start_data <= 0 ||
+	    ((sb->flags & A1FS_FEATURE_REFLINK) && sb->start_refcount <= 0) ||
+	    ((sb->flags & A1FS_FEATURE_CSUM) && sb->start_csum <= 0) ||
+	    ((sb->flags & A1FS_FEATURE_LAZY_INIT) &&
+	     sb->inodes_init > sb->inodes_count) ||
+	    (sb->blocks_max != 0 && sb->blocks_max < sb->blocks_count) ||
+	    ((size_t)sb->start_data + sb->blocks_count) * A1FS_BLOCK_SIZE > size)
+	{
+		log_error("Invalid a1fs superblock\n");
+		return false;
+	}
+
+	if (!zcache_init(&fs->zc)) {
+		return false;
+	}
+	fs->st = st;
+	fs->sb = sb;
+	fs->inode_map = (unsigned char*)image + sb->start_inode_map * A1FS_BLOCK_SIZE;
+	fs->data_map = (unsigned char*)image + sb->start_data_map * A1FS_BLOCK_SIZE;
+	fs->refcount = (sb->flags & A1FS_FEATURE_REFLINK)
+	             ? (uint16_t*)((char*)image + sb->start_refcount * A1FS_BLOCK_SIZE)
+	             : NULL;
+	fs->alloc_cursor = 0;
+	fs->nfree_inodes = 0;
+	fs->inode_cursor = 0;
+	fs->nfrag_dirs = 0;
+	fs->zclusters = 0;
+	fs->zsaved = 0;
+	fs->dd.table = NULL;
+	fs->dd.indexed = NULL;
+	fs->dd_shared = 0;
+	fs->dd_mismatches = 0;
+	fs->csum = (csum_table){0};
+	stats_reset(&fs->stats);
+	trace_init(&fs->trace);
+	fs->last_op = time(NULL);
+	// Mounting counts as an operation, so that the first pass is made
+	fs->op_seq = 1;
+	fs->defrag_scanned = 0;
+	fs->defrag_pass_seq = 0;
+	fs->defrag_found = false;
+	fs->defrag_cursor = 0;
+	da_init(&fs->da);
+	dq_init(&fs->dq);
+	pthread_mutex_init(&fs->lock, NULL);
+	pthread_cond_init(&fs->flush_cond, NULL);
+	pthread_cond_init(&fs->discard_cond, NULL);
 	return true;
 }
 
 void fs_ctx_destroy(fs_ctx *fs)
 {
-	//TODO: cleanup any resources allocated in fs_ctx_init()
-	(void)fs;
+	da_destroy(&fs->da);
+	dq_destroy(&fs->dq);
+	zcache_destroy(&fs->zc);
+	dd_destroy(&fs->dd);
+	pthread_cond_destroy(&fs->discard_cond);
+	pthread_cond_destroy(&fs->flush_cond);
+	pthread_mutex_destroy(&fs->lock);
+	csum_update(&fs->csum, fs->st);
+	csum_destroy(&fs->csum);
+	storage_destroy(fs->st);
+	fs->st = NULL;
 }
@@ -18,34 +18,151 @@
 
 #pragma once
 
+#include <pthread.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 
+#include "a1fs.h"
+#include "csum.h"
+#include "ddt.h"
+#include "delalloc.h"
+#include "discard.h"
 #include "options.h"
+#include "stats.h"
+#include "storage.h"
+#include "trace.h"
+#include "zcache.h"
 
 
+/** Capacity of the queue of directories waiting to be compacted. */
+#define FRAG_DIRS_MAX 64
+
+/** Number of free inode numbers the inode allocator keeps at hand. */
+#define FREE_INODES_MAX 64
+
 /**
  * Mounted file system runtime state - "fs context".
  */
 typedef struct fs_ctx {
-	/** Pointer to the start of the image. */
+	/** Image storage backend. */
+	storage *st;
+	/** Pointer to the start of the image (the metadata region). */
 	void *image;
 	/** Image size in bytes. */
 	size_t size;
+	/** Image file descriptor that holds the lock on the image while it is
+	 *  mounted (see fs_mount()). */
+	int lock_fd;
+
+	/** Superblock (at the start of the image). */
+	a1fs_superblock *sb;
+	/** Inode bitmap. */
+	unsigned char *inode_map;
+	/** Data block bitmap. */
+	unsigned char *data_map;
+	/** Block reference count table; NULL without A1FS_FEATURE_REFLINK. */
+	uint16_t *refcount;
+	/** Data block to start the search for free blocks from (next-fit). */
+	a1fs_blk_t alloc_cursor;
+	/** Free inode numbers at hand for the inode allocator; some may have
+	 *  been allocated since they were taken (see alloc_inode()). */
+	a1fs_ino_t free_inodes[FREE_INODES_MAX];
+	/** Number of entries in free_inodes. */
+	size_t nfree_inodes;
+	/** Inode number the next refill of free_inodes scans the bitmap from. */
+	a1fs_ino_t inode_cursor;
+	/** File data buffered for delayed allocation. */
+	delalloc da;
+	/** Compress the data of regular files as it is written out. */
+	bool compress;
+	/** Recently decompressed clusters of compressed files. */
+	zcache zc;
+	/** Number of clusters written compressed. */
+	uint64_t zclusters;
+	/** Data blocks saved by writing clusters compressed. */
+	uint64_t zsaved;
+	/** Share identical data blocks of regular files as they are written out. */
+	bool dedup;
+	/** Memory budget for the dedup index in bytes. */
+	size_t dedup_index;
+	/** Fingerprints of data blocks for finding identical ones; the table is
+	 *  only allocated once dedup is used. */
+	dd_index dd;
+	/** Data blocks that were made to share an identical block. */
+	uint64_t dd_shared;
+	/** Index hits whose block turned out to have different contents. */
+	uint64_t dd_mismatches;
+	/** Metadata block checksums. */
+	csum_table csum;
+	/** Buffered data size (bytes) above which files are flushed right away. */
+	size_t dirty_max;
+	/** Operation counters and latencies; see A1FS_STATS_FILE. */
+	fs_stats stats;
+	/** Operation trace recorder. */
+	trace_log trace;
 
-	//TODO: useful runtime state of the mounted file system should be cached
-	// here (NOT in global variables in a1fs.c)
+	/**
+	 * Serializes file system operations with the background threads. FUSE
+	 * callbacks run one at a time (-s), so it is only ever contended by them.
+	 */
+	pthread_mutex_t lock;
+	/** Signalled to wake the background flusher up early (e.g. to exit). */
+	pthread_cond_t flush_cond;
+	/** Background flusher thread. */
+	pthread_t flusher;
+	/** Background flusher thread is running. */
+	bool flusher_running;
+	/** Background threads must exit. */
+	bool stopping;
+	/** Age in seconds after which buffered data is flushed; 0 to disable. */
+	unsigned int flush_interval;
+	/** Directories with more than one extent, compacted by the flusher. */
+	a1fs_ino_t frag_dirs[FRAG_DIRS_MAX];
+	/** Number of directories in frag_dirs. */
+	size_t nfrag_dirs;
+	/** Seconds without operations after which files are defragmented in the
+	 *  background; 0 to disable. */
+	unsigned int defrag_idle;
+	/** Time of the last file system operation. */
+	time_t last_op;
+	/** Number of file system operations so far. */
+	uint64_t op_seq;
+	/** Value of op_seq at the start of the last defrag pass over the inode
+	 *  table that found nothing to do. */
+	uint64_t defrag_scanned;
+	/** Value of op_seq at the start of the current defrag pass. */
+	uint64_t defrag_pass_seq;
+	/** Whether the current defrag pass has defragmented any files. */
+	bool defrag_found;
+	/** Inode number the background defrag scan resumes from. */
+	a1fs_ino_t defrag_cursor;
+
+	/** Release the image file space of freed data blocks (online discard). */
+	bool discard;
+	/** Freed data blocks waiting to be discarded. */
+	discard_queue dq;
+	/** Signalled when the discard queue should be processed early. */
+	pthread_cond_t discard_cond;
+	/** Background discard thread. */
+	pthread_t discarder;
+	/** Background discard thread is running. */
+	bool discarder_running;
+	/** Interval in seconds between discard queue runs. */
+	unsigned int discard_interval;
 
 } fs_ctx;
 
 /**
  * Initialize file system context.
  *
- * @param fs     pointer to the context to initialize.
- * @param image  pointer to the start of the image.
- * @param size   image size in bytes.
- * @return       true on success; false on failure (e.g. invalid superblock).
+ * The context takes ownership of the storage backend.
+ *
+ * @param fs  pointer to the context to initialize.
+ * @param st  image storage backend.
+ * @return    true on success; false on failure (e.g. invalid superblock).
  */
-bool fs_ctx_init(fs_ctx *fs, void *image, size_t size);
+bool fs_ctx_init(fs_ctx *fs, storage *st);
 
 /**
  * Destroy file system context.
@@ -53,3 +170,49 @@ bool fs_ctx_init(fs_ctx *fs, void *image, size_t size);
  * Must cleanup all the resources created in fs_ctx_init().
  */
 void fs_ctx_destroy(fs_ctx *fs);
+
+/**
+ * Get a pointer to the contents of a data block.
+ *
+ * The pointer is only valid until the next call; see storage_get().
+ *
+ * @param fs     file system context.
+ * @param blk    data block number (relative to the start of the data region).
+ * @param write  true if the caller will modify the block.
+ * @return       pointer to the block contents; NULL on I/O error.
+ */
+static inline void *fs_data(fs_ctx *fs, a1fs_blk_t blk, bool write)
+{
+	return storage_get(fs->st, fs->sb->start_data + blk, write);
+}
+
+/** Number of free data blocks not reserved for buffered data. */
+static inline a1fs_blk_t fs_avail_blocks(fs_ctx *fs)
+{
+	return fs->sb->free_blocks_count - fs->da.reserved;
+}
+
+/** Record a modification of len bytes of metadata at ptr. */
+static inline void fs_dirty(fs_ctx *fs, const void *ptr, size_t len)
+{
+	storage_meta_dirty(fs->st, ptr, len);
+	csum_dirty(&fs->csum, (const char*)ptr - (const char*)fs->image, len);
+}
+
+/**
+ * Check if the file system is read-only because corrupted metadata was found.
+ *
+ * Writing could spread the damage, e.g. by allocating blocks that a corrupted
+ * bitmap shows as free.
+ */
+static inline bool fs_readonly(const fs_ctx *fs)
+{
+	return fs->csum.errors > 0;
+}
+
+/** Update the metadata checksums and write all modified blocks back. */
+static inline int fs_sync(fs_ctx *fs)
+{
+	csum_update(&fs->csum, fs->st);
+	return storage_sync(fs->st);
+}
@@ -0,0 +1,3647 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - a1fs file system operations implementation.
+ *
+ * The file system logic, independent of FUSE: a1fs.c forwards the FUSE
+ * callbacks here, and other programs (e.g. a1fs_bench) can use the same
+ * operations on an image in-process.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "a1fs.h"
+#include "a1fs_ioctl.h"
+#include "alloc.h"
+#include "bitmap.h"
+#include "csum.h"
+#include "ddt.h"
+#include "extent.h"
+#include "fs_ctx.h"
+#include "fs_ops.h"
+#include "log.h"
+#include "lz.h"
+#include "map.h"
+#include "readahead.h"
+#include "storage.h"
+
+//NOTE: All path arguments are absolute paths within the a1fs file system and
+// start with a '/' that corresponds to the a1fs root directory.
+//
+// For example, if a1fs is mounted at "~/my_csc369_repo/a1b/mnt/", the path to a
+// file at "~/my_csc369_repo/a1b/mnt/dir/file" (as seen by the OS) will be
+// passed to FUSE callbacks as "/dir/file".
+//
+// Paths to directories (except for the root directory - "/") do not end in a
+// trailing '/'. For example, "~/my_csc369_repo/a1b/mnt/dir/" will be passed to
+// FUSE callbacks as "/dir".
+
+
+
+/**
+ * Get the largest number of data blocks that an a1fs image can be grown to.
+ *
+ * That is blocks_max, unless the data bitmap or the reference count table
+ * doesn't have room for it before the region that follows it (in a corrupted
+ * superblock).
+ */
+static size_t grow_limit(const a1fs_superblock *sb)
+{
+	bool reflink = sb->flags & A1FS_FEATURE_REFLINK;
+	bool csum = sb->flags & A1FS_FEATURE_CSUM;
+	int map_end = reflink ? sb->start_refcount
+	            : csum ? sb->start_csum : sb->start_inode;
+	int refcount_end = csum ? sb->start_csum : sb->start_inode;
+
+	size_t limit = sb->blocks_max;
+	size_t bits = map_end > sb->start_data_map
+	            ? (size_t)(map_end - sb->start_data_map) * A1FS_BLOCK_SIZE * 8
+	            : 0;
+	limit = bits < limit ? bits : limit;
+	if (reflink) {
+		size_t refcounts = refcount_end > sb->start_refcount
+		                 ? (size_t)(refcount_end - sb->start_refcount) *
+		                   A1FS_BLOCK_SIZE / sizeof(uint16_t)
+		                 : 0;
+		limit = refcounts < limit ? refcounts : limit;
+	}
+	return limit > sb->blocks_count ? limit : sb->blocks_count;
+}
+
+/**
+ * Get the size of the metadata region of an a1fs image.
+ *
+ * The metadata region covers the superblock, bitmaps, inode table and extent
+ * blocks, i.e. everything before the first data block.
+ */
+static size_t a1fs_meta_size(const void *image, size_t size, void *arg)
+{
+	(void)arg;// unused
+	const a1fs_superblock *sb = (const a1fs_superblock*)image;
+	if (sb->magic != A1FS_MAGIC || sb->start_data <= 0) {
+		return 0;
+	}
+	size_t meta = (size_t)sb->start_data * A1FS_BLOCK_SIZE;
+	return meta < size ? meta : size;
+}
+
+/**
+ * Get the size of the part of the metadata region of an a1fs image that the
+ * cache backend pins in memory: the superblock, bitmaps, reference count and
+ * checksum tables and the inode table. The extent blocks, one per inode,
+ * are read as they are used.
+ */
+static size_t a1fs_pin_size(const void *image, size_t meta, void *arg)
+{
+	(void)arg;// unused
+	const a1fs_superblock *sb = (const a1fs_superblock*)image;
+	if (sb->magic != A1FS_MAGIC || sb->start_extent <= 0) {
+		return meta;
+	}
+	size_t pinned = (size_t)sb->start_extent * A1FS_BLOCK_SIZE;
+	return pinned < meta ? pinned : meta;
+}
+
+/** Get the size in bytes that an a1fs image can be grown to; see map_opts. */
+static size_t a1fs_max_size(const void *image, size_t size, void *arg)
+{
+	(void)arg;// unused
+	const a1fs_superblock *sb = (const a1fs_superblock*)image;
+	if (sb->magic != A1FS_MAGIC || sb->start_data <= 0) {
+		return size;
+	}
+	return ((size_t)sb->start_data + grow_limit(sb)) * A1FS_BLOCK_SIZE;
+}
+
+/**
+ * Open a striped volume with the stripe backend.
+ *
+ * @param opts   mount options; img_path is the first image of the volume and
+ *               stripe lists the others.
+ * @param mopts  mapping tuning options.
+ * @return       storage backend on success; NULL on failure.
+ */
+static storage *open_stripe(const a1fs_opts *opts, const map_opts *mopts)
+{
+	char *list = strdup(opts->stripe);
+	if (!list) {
+		log_error("strdup: %s\n", strerror(errno));
+		return NULL;
+	}
+	const char *paths[A1FS_STRIPE_MAX];
+	size_t count = 0;
+	paths[count++] = opts->img_path;
+	char *save;
+	for (char *p = strtok_r(list, ":", &save); p;
+	     p = strtok_r(NULL, ":", &save))
+	{
+		if (count == A1FS_STRIPE_MAX) {
+			log_error("Too many images in the striped volume (max %d)\n",
+			          A1FS_STRIPE_MAX);
+			free(list);
+			return NULL;
+		}
+		paths[count++] = p;
+	}
+	storage *st = storage_stripe_open(paths, count, mopts);
+	free(list);
+	return st;
+}
+
+/**
+ * Lock the image, so that it is only mounted (and written to) by one process
+ * at a time.
+ *
+ * The lock is held by the open file, so it stays with the FUSE daemon when it
+ * forks, and is released when the last copy of the descriptor is closed.
+ *
+ * @return  image file descriptor holding the lock; -1 on failure.
+ */
+static int lock_image(const char *path)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		log_error("%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+		if (errno == EWOULDBLOCK) {
+			log_error("%s: the image is in use (already mounted?)\n", path);
+		} else {
+			log_error("%s: flock: %s\n", path, strerror(errno));
+		}
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/** Mount a locked image; see fs_mount(). */
+static bool mount_image(fs_ctx *fs, const a1fs_opts *opts)
+{
+	storage *st;
+	if (opts->backend && strcmp(opts->backend, "mmap") != 0) {
+		cache_opts copts = {
+			.budget    = (size_t)opts->cache_size << 20,
+			.direct    = opts->odirect,
+			.uring     = strcmp(opts->backend, "uring") == 0,
+			.meta_size = a1fs_meta_size,
+			.pin_size  = a1fs_pin_size,
+		};
+		st = storage_cache_open(opts->img_path, &copts);
+	} else {
+		map_opts mopts = {
+			.populate  = opts->populate,
+			.hugepage  = opts->hugepage,
+			.lock      = opts->mlock,
+			.advice    = MAP_ADVICE_NORMAL,
+			.meta_size = a1fs_meta_size,
+			.max_size  = a1fs_max_size,
+		};
+		if (opts->advice) {
+			map_parse_advice(opts->advice, &mopts.advice);
+		}
+		st = opts->stripe ? open_stripe(opts, &mopts)
+		                  : storage_mmap_open(opts->img_path, &mopts);
+	}
+	if (!st) {
+		return false;
+	}
+	// Only the first image of a striped volume would be accessible otherwise
+	const a1fs_superblock *sb = (const a1fs_superblock*)st->meta;
+	if (!opts->stripe && sb->magic == A1FS_MAGIC &&
+	    (sb->flags & A1FS_FEATURE_STRIPE))
+	{
+		log_error("Image is the first of a striped volume of %u images; "
+		          "mount with -o stripe=PATH[:PATH...]\n", sb->stripe_count);
+		storage_destroy(st);
+		return false;
+	}
+
+	if (!fs_ctx_init(fs, st)) {
+		storage_destroy(st);
+		return false;
+	}
+	bool rebuild = opts->csum && strcmp(opts->csum, "rebuild") == 0;
+	bool verify = !opts->csum || strcmp(opts->csum, "verify") == 0;
+	if (!csum_init(&fs->csum, fs->image, fs->sb, verify)) {
+		fs_ctx_destroy(fs);
+		return false;
+	}
+	if (rebuild) {
+		csum_rebuild(&fs->csum, fs->st);
+	} else if (!csum_check_range(&fs->csum, 0, fs->sb->start_inode)) {
+		// Everything up to the inode table is needed by any modification
+		log_error("Corrupted superblock or bitmaps; mount with "
+		          "-o csum=rebuild to accept them as they are\n");
+		fs_ctx_destroy(fs);
+		return false;
+	}
+	fs->dirty_max = (size_t)opts->dirty_max << 20;
+	fs->flush_interval = opts->flush_interval;
+	fs->discard = opts->discard;
+	fs->discard_interval = opts->discard_interval;
+	fs->defrag_idle = opts->defrag_idle;
+	fs->compress = opts->compress;
+	fs->dedup = opts->dedup;
+	fs->dedup_index = (size_t)opts->dedup_index << 20;
+	if (fs->dedup) {
+		if (!fs->refcount) {
+			log_error("dedup requires an image formatted with "
+			          "mkfs.a1fs -r\n");
+			fs_ctx_destroy(fs);
+			return false;
+		}
+		if (!dd_init(&fs->dd, fs->dedup_index, fs->sb->blocks_count)) {
+			fs_ctx_destroy(fs);
+			return false;
+		}
+	}
+	if (opts->trace && !trace_open(&fs->trace, opts->trace)) {
+		fs_ctx_destroy(fs);
+		return false;
+	}
+	return true;
+}
+
+bool fs_mount(fs_ctx *fs, const a1fs_opts *opts)
+{
+	int fd = lock_image(opts->img_path);
+	if (fd < 0) {
+		return false;
+	}
+	if (!mount_image(fs, opts)) {
+		close(fd);
+		return false;
+	}
+	fs->lock_fd = fd;
+	return true;
+}
+
+static void stop_flusher(fs_ctx *fs);
+static void stop_discarder(fs_ctx *fs);
+static void discard_queued(fs_ctx *fs);
+static void flush_all(fs_ctx *fs, time_t older_than);
+
+void fs_unmount(fs_ctx *fs)
+{
+	if (fs->st) {
+		stop_flusher(fs);
+		stop_discarder(fs);
+		if (fs_readonly(fs)) {
+			log_error("Corrupted metadata found; buffered data was "
+			          "not written out\n");
+		} else {
+			flush_all(fs, 0);
+		}
+		if (fs->discard) {
+			discard_queued(fs);
+		}
+
+		storage_stats stats;
+		storage_stats_get(fs->st, &stats);
+		uint64_t lookups = stats.hits + stats.misses;
+		if (lookups > 0) {
+			log_info("%s: %lu hits, %lu misses (%.1f%% hit rate), "
+			         "%lu prefetched, %lu evictions, %lu writebacks, "
+			         "%lu discarded\n",
+			         fs->st->ops->name, stats.hits, stats.misses,
+			         100.0 * stats.hits / lookups, stats.prefetched,
+			         stats.evictions, stats.writebacks, stats.discarded);
+		}
+		if (fs->zclusters > 0 || fs->zc.hits + fs->zc.misses > 0) {
+			log_info("compress: %lu clusters written, %lu blocks saved, "
+			         "%lu cluster cache hits, %lu misses\n", fs->zclusters,
+			         fs->zsaved, fs->zc.hits, fs->zc.misses);
+		}
+		if (fs->csum.sums) {
+			csum_update(&fs->csum, fs->st);
+			log_info("csum: %lu blocks verified, %lu updated, %lu "
+			         "corrupted\n", fs->csum.verified, fs->csum.updated,
+			         fs->csum.errors);
+		}
+		if (fs->dd.table) {
+			log_info("dedup: %lu blocks shared, %lu lookups, %lu hits, "
+			         "%lu mismatches; index: %zu of %zu entries (%zu KiB), "
+			         "%lu replaced\n", fs->dd_shared, fs->dd.lookups,
+			         fs->dd.hits, fs->dd_mismatches, fs->dd.entries,
+			         fs->dd.capacity, dd_memory(&fs->dd) >> 10, fs->dd.replaced);
+		}
+		trace_close(&fs->trace);
+		fs_ctx_destroy(fs);
+		// Only now that everything is written out
+		close(fs->lock_fd);
+	}
+}
+
+/** State of an open file, kept in its handle (see fs_open()). */
+typedef struct a1fs_file {
+	/** Sequential readahead state. */
+	readahead ra;
+	/** Statistics report snapshot if this is the statistics file; NULL
+	 *  otherwise. */
+	char *report;
+	/** Length of the report in bytes. */
+	size_t report_len;
+
+} a1fs_file;
+
+/** Allocate the open file state and store its handle in *fh. */
+static int file_open(fs_ctx *fs, uint64_t *fh)
+{
+	a1fs_file *file = malloc(sizeof(*file));
+	if (!file) {
+		return -ENOMEM;
+	}
+	ra_init(&file->ra, fs->st->prefetch_max);
+	file->report = NULL;
+	file->report_len = 0;
+	*fh = (uintptr_t)file;
+	return 0;
+}
+
+/** Get the open file state of a handle; NULL if none (0). */
+static a1fs_file *get_file(uint64_t fh)
+{
+	return (a1fs_file*)(uintptr_t)fh;
+}
+
+/** Free the open file state of a handle (may be 0). */
+static void file_close(uint64_t fh)
+{
+	a1fs_file *file = get_file(fh);
+	if (file) {
+		free(file->report);
+		free(file);
+	}
+}
+
+/** Check if a path is the virtual statistics file (A1FS_STATS_FILE). */
+static bool is_stats_file(const char *path)
+{
+	return strcmp(path, A1FS_STATS_FILE) == 0;
+}
+
+/** Get the attributes of the statistics file. */
+static void stats_file_getattr(fs_ctx *fs, struct stat *st)
+{
+	st->st_mode = S_IFREG | 0644;
+	st->st_nlink = 1;
+	// The report length doesn't depend on the values in it
+	st->st_size = stats_format(&fs->stats, NULL, 0);
+	clock_gettime(CLOCK_REALTIME, &st->st_mtim);
+}
+
+/** Open the statistics file, taking a snapshot of the report. */
+static int stats_file_open(fs_ctx *fs, uint64_t *fh)
+{
+	int ret = file_open(fs, fh);
+	if (ret < 0) {
+		return ret;
+	}
+	a1fs_file *file = get_file(*fh);
+	size_t len = stats_format(&fs->stats, NULL, 0);
+	file->report = malloc(len + 1);
+	if (!file->report) {
+		file_close(*fh);
+		return -ENOMEM;
+	}
+	file->report_len = stats_format(&fs->stats, file->report, len + 1);
+	return 0;
+}
+
+/** Read from the report snapshot of an open statistics file. */
+static int stats_file_read(fs_ctx *fs, char *buf, size_t size, off_t offset,
+                           uint64_t fh)
+{
+	// Without an open handle, read from a snapshot taken just for this call
+	uint64_t tmp = 0;
+	if (!fh) {
+		int ret = stats_file_open(fs, &tmp);
+		if (ret < 0) {
+			return ret;
+		}
+		fh = tmp;
+	}
+	a1fs_file *file = get_file(fh);
+	size_t len = 0;
+	if ((size_t)offset < file->report_len) {
+		len = file->report_len - offset;
+		len = len < size ? len : size;
+		memcpy(buf, file->report + offset, len);
+	}
+	file_close(tmp);
+	return len;
+}
+
+/**
+ * Get inode by inode number.
+ *
+ * The inode table block is verified against its checksum on first use; if it
+ * is corrupted, the current operation fails with EIO once it returns (see
+ * LOCKED_OP).
+ */
+static a1fs_inode *get_inode(fs_ctx *fs, int ino)
+{
+	csum_check(&fs->csum, fs->sb->start_inode +
+	                      ino * sizeof(a1fs_inode) / A1FS_BLOCK_SIZE);
+	return (a1fs_inode*)(fs->image + fs->sb->start_inode * A1FS_BLOCK_SIZE) + ino;
+}
+
+/** Get the extent array of an inode; verified like in get_inode(). */
+static a1fs_extent *get_extents(fs_ctx *fs, int ino)
+{
+	csum_check(&fs->csum, fs->sb->start_extent + ino);
+	a1fs_extent_block *e_block = (a1fs_extent_block*)
+		(fs->image + (size_t)(fs->sb->start_extent + ino) * A1FS_BLOCK_SIZE);
+	return e_block->extent_array;
+}
+
+/** Number of extents that fit in an extent block. */
+#define MAX_EXTENTS ((int)(sizeof(a1fs_extent_block) / sizeof(a1fs_extent)))
+
+/** Number of data blocks allocated to a file (unwritten ones included). */
+static a1fs_blk_t file_blocks(fs_ctx *fs, a1fs_inode *inode)
+{
+	return ext_allocated(get_extents(fs, inode->ino_number), inode->extent_count);
+}
+
+/** Number of file blocks covered by the extents of a file. */
+static a1fs_blk_t file_end(fs_ctx *fs, a1fs_inode *inode)
+{
+	return ext_end(get_extents(fs, inode->ino_number), inode->extent_count);
+}
+
+/**
+ * Map a file block to a data block.
+ *
+ * @return  data block number (for a block of a compressed cluster, the first
+ *          data block of the cluster); -1 if the file block has no data (it
+ *          is a hole, unwritten, or past the last extent).
+ */
+static long file_bmap(fs_ctx *fs, a1fs_inode *inode, a1fs_blk_t lblk)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	a1fs_blk_t off;
+	int i = ext_find(ext, inode->extent_count, lblk, &off);
+	if (i < 0 || ext_is_hole(&ext[i]) || ext[i].unwritten) {
+		return -1;
+	}
+	return ext[i].zblocks != 0 ? ext[i].start : ext[i].start + off;
+}
+
+/**
+ * Get the decompressed contents of a compressed extent.
+ *
+ * @return  pointer to A1FS_CLUSTER_SIZE bytes, valid until the next call;
+ *          NULL on I/O error or if the cluster is corrupted.
+ */
+static unsigned char *file_cluster(fs_ctx *fs, const a1fs_extent *e)
+{
+	unsigned char *data = zcache_lookup(&fs->zc, e->start);
+	if (data) {
+		return data;
+	}
+	unsigned char packed[(A1FS_CLUSTER_BLOCKS - 1) * A1FS_BLOCK_SIZE];
+	for (a1fs_blk_t b = 0; b < e->zblocks; b++) {
+		const void *src = fs_data(fs, e->start + b, false);
+		if (!src) {
+			return NULL;
+		}
+		memcpy(packed + b * A1FS_BLOCK_SIZE, src, A1FS_BLOCK_SIZE);
+	}
+	uint32_t len;
+	memcpy(&len, packed, sizeof(len));
+	data = zcache_insert(&fs->zc, e->start);
+	if (len > e->zblocks * A1FS_BLOCK_SIZE - sizeof(len) ||
+	    lz_decompress(packed + sizeof(len), len, data, A1FS_CLUSTER_SIZE)
+	    != A1FS_CLUSTER_SIZE)
+	{
+		log_error("Corrupted compressed cluster at block %u\n", e->start);
+		zcache_invalidate(&fs->zc, e->start, 1);
+		return NULL;
+	}
+	return data;
+}
+
+/**
+ * Get a pointer to the contents of a file block.
+ *
+ * The pointer is only valid until the next block access; see storage_get().
+ * Blocks of compressed clusters can only be read this way; use
+ * file_write_block() to modify them.
+ *
+ * @return  pointer to the block contents; NULL if the file block has no data
+ *          or on I/O error.
+ */
+static void *file_block(fs_ctx *fs, a1fs_inode *inode, a1fs_blk_t lblk,
+                        bool write)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	a1fs_blk_t off;
+	int i = ext_find(ext, inode->extent_count, lblk, &off);
+	if (i < 0 || ext_is_hole(&ext[i]) || ext[i].unwritten) {
+		return NULL;
+	}
+	if (ext[i].zblocks != 0) {
+		assert(!write);
+		unsigned char *cluster = file_cluster(fs, &ext[i]);
+		return cluster ? cluster + (size_t)off * A1FS_BLOCK_SIZE : NULL;
+	}
+	return fs_data(fs, ext[i].start + off, write);
+}
+
+/**
+ * Data block right after the last allocated extent before extent i.
+ *
+ * Used as the allocation goal so that a file grows contiguously.
+ */
+static a1fs_blk_t file_goal(fs_ctx *fs, a1fs_inode *inode, int i)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	while (--i >= 0) {
+		if (!ext_is_hole(&ext[i])) {
+			return ext[i].start + ext_blocks(&ext[i]);
+		}
+	}
+	return A1FS_BLK_NONE;
+}
+
+/**
+ * Merge the extents of a file after a change and mark them modified.
+ *
+ * The whole extent block is marked, since the extents past the new count
+ * (dropped by the merge or by the caller shrinking the file) were modified
+ * too, and the checksum of the block covers them.
+ */
+static void file_extents_changed(fs_ctx *fs, a1fs_inode *inode)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	ext_merge(ext, &inode->extent_count);
+	fs_dirty(fs, ext, A1FS_BLOCK_SIZE);
+	fs_dirty(fs, inode, sizeof(*inode));
+}
+
+/**
+ * Start reading count blocks of a file starting at lblk.
+ *
+ * All the extents covered by the range are handed to the storage backend in
+ * one request, so that it can have the reads in flight together. Holes and
+ * unwritten extents are skipped since they read as zeros.
+ */
+static void file_prefetch(fs_ctx *fs, a1fs_inode *inode, a1fs_blk_t lblk,
+                          a1fs_blk_t count)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	storage_range ranges[MAX_EXTENTS];
+	size_t n = 0;
+	for (int i = 0; i < inode->extent_count && count > 0; i++) {
+		if (lblk >= ext[i].count) {
+			lblk -= ext[i].count;
+			continue;
+		}
+		a1fs_blk_t len = ext[i].count - lblk;
+		if (len > count) {
+			len = count;
+		}
+		if (ext[i].zblocks != 0) {
+			// The whole cluster is needed to decompress any of its blocks
+			ranges[n].start = fs->sb->start_data + ext[i].start;
+			ranges[n].count = ext[i].zblocks;
+			n++;
+		} else if (!ext_is_hole(&ext[i]) && !ext[i].unwritten) {
+			ranges[n].start = fs->sb->start_data + ext[i].start + lblk;
+			ranges[n].count = len;
+			n++;
+		}
+		count -= len;
+		lblk = 0;
+	}
+	storage_prefetch(fs->st, ranges, n);
+}
+
+/** Number of blocks used by the entries of a directory. */
+static a1fs_blk_t dir_blocks(a1fs_inode *dir)
+{
+	return (dir->size + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE;
+}
+
+/** Fill count data blocks starting at blk with zeros. */
+static int zero_blocks(fs_ctx *fs, a1fs_blk_t blk, a1fs_blk_t count)
+{
+	for (a1fs_blk_t i = 0; i < count; i++) {
+		void *data = fs_data(fs, blk + i, true);
+		if (!data) {
+			return -EIO;
+		}
+		memset(data, 0, A1FS_BLOCK_SIZE);
+	}
+	return 0;
+}
+
+/** file_extend() flags. */
+/** Fill the new blocks with zeros. */
+#define EXTEND_ZERO      0x1
+/** Mark the new blocks unwritten. */
+#define EXTEND_UNWRITTEN 0x2
+
+/**
+ * Append newly allocated blocks to a file.
+ *
+ * New blocks are placed right after the last extent when possible so that
+ * the extent grows in place. Unless EXTEND_ZERO or EXTEND_UNWRITTEN is given,
+ * the caller must fill the new blocks.
+ *
+ * @param flags  EXTEND_* flags.
+ * @return       0 on success; -ENOSPC if out of space or extents (the blocks
+ *               allocated so far are kept); -EIO on I/O error.
+ */
+static int file_extend(fs_ctx *fs, a1fs_inode *inode, a1fs_blk_t count,
+                       int flags)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	while (count > 0) {
+		a1fs_blk_t start;
+		a1fs_blk_t n = alloc_blocks(fs, file_goal(fs, inode, inode->extent_count),
+		                            count < A1FS_EXTENT_MAX ? count : A1FS_EXTENT_MAX,
+		                            &start);
+		if (n == 0) {
+			return -ENOSPC;
+		}
+		a1fs_extent e = { .start = start, .count = n,
+		                  .unwritten = (flags & EXTEND_UNWRITTEN) != 0 };
+		a1fs_extent *last = inode->extent_count > 0
+		                  ? &ext[inode->extent_count - 1] : NULL;
+		if (last && ext_mergeable(last, &e)) {
+			last->count += n;
+			fs_dirty(fs, last, sizeof(*last));
+		} else if (ext_insert(ext, &inode->extent_count, MAX_EXTENTS,
+		                      inode->extent_count, e) == 0) {
+			fs_dirty(fs, &ext[inode->extent_count - 1], sizeof(*ext));
+			fs_dirty(fs, inode, sizeof(*inode));
+		} else {
+			free_blocks(fs, start, n);
+			return -ENOSPC;
+		}
+		if ((flags & EXTEND_ZERO) && zero_blocks(fs, start, n) < 0) {
+			return -EIO;
+		}
+		count -= n;
+	}
+	return 0;
+}
+
+/**
+ * Append a hole to a file.
+ *
+ * @return  0 on success; -ENOSPC if out of extents.
+ */
+static int file_append_hole(fs_ctx *fs, a1fs_inode *inode, a1fs_blk_t count)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	int n = inode->extent_count;
+	if (n > 0 && ext_is_hole(&ext[n - 1])) {
+		a1fs_blk_t len = A1FS_EXTENT_MAX - ext[n - 1].count;
+		if (len > count) {
+			len = count;
+		}
+		ext[n - 1].count += len;
+		fs_dirty(fs, &ext[n - 1], sizeof(*ext));
+		count -= len;
+	}
+	while (count > 0) {
+		a1fs_blk_t len = count < A1FS_EXTENT_MAX ? count : A1FS_EXTENT_MAX;
+		a1fs_extent hole = { .start = A1FS_EXTENT_HOLE, .count = len };
+		if (ext_insert(ext, &inode->extent_count, MAX_EXTENTS,
+		               inode->extent_count, hole) < 0)
+		{
+			return -ENOSPC;
+		}
+		fs_dirty(fs, &ext[inode->extent_count - 1], sizeof(*ext));
+		count -= len;
+	}
+	fs_dirty(fs, inode, sizeof(*inode));
+	return 0;
+}
+
+/**
+ * Release all blocks of a file past the first nblocks file blocks.
+ *
+ * A compressed cluster must not straddle nblocks (see file_split_clusters()).
+ */
+static void file_shrink(fs_ctx *fs, a1fs_inode *inode, a1fs_blk_t nblocks)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	a1fs_blk_t pos = 0;
+	int keep = 0;
+	for (int i = 0; i < inode->extent_count; i++) {
+		a1fs_blk_t count = ext[i].count;
+		if (pos + count <= nblocks) {
+			pos += count;
+			keep++;
+			continue;
+		}
+		a1fs_blk_t off = nblocks > pos ? nblocks - pos : 0;
+		if (ext[i].zblocks != 0) {
+			assert(off == 0);
+			free_blocks(fs, ext[i].start, ext[i].zblocks);
+		} else if (!ext_is_hole(&ext[i])) {
+			free_blocks(fs, ext[i].start + off, count - off);
+		}
+		ext[i].count = off;
+		if (off > 0) {
+			keep++;
+		}
+		pos += count;
+	}
+	inode->extent_count = keep;
+	file_extents_changed(fs, inode);
+}
+
+/**
+ * Turn a compressed extent back into plain data blocks.
+ *
+ * The cluster is decompressed into a newly allocated run of blocks. The
+ * extent keeps its index, and isn't merged with its neighbors until the
+ * caller calls file_extents_changed().
+ *
+ * @param i  index of the compressed extent.
+ * @return   0 on success; -ENOSPC if there is no free run for the cluster;
+ *           -EIO on I/O error.
+ */
+static int file_uncompress(fs_ctx *fs, a1fs_inode *inode, int i)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	if (A1FS_CLUSTER_BLOCKS > fs_avail_blocks(fs)) {
+		return -ENOSPC;
+	}
+	// Stays valid until the next cluster is decompressed
+	const unsigned char *cluster = file_cluster(fs, &ext[i]);
+	if (!cluster) {
+		return -EIO;
+	}
+	a1fs_blk_t start;
+	a1fs_blk_t got = alloc_blocks(fs, file_goal(fs, inode, i),
+	                              A1FS_CLUSTER_BLOCKS, &start);
+	if (got < A1FS_CLUSTER_BLOCKS) {
+		if (got > 0) {
+			free_blocks(fs, start, got);
+		}
+		return -ENOSPC;
+	}
+	for (a1fs_blk_t b = 0; b < A1FS_CLUSTER_BLOCKS; b++) {
+		void *dst = fs_data(fs, start + b, true);
+		if (!dst) {
+			free_blocks(fs, start, A1FS_CLUSTER_BLOCKS);
+			return -EIO;
+		}
+		memcpy(dst, cluster + b * A1FS_BLOCK_SIZE, A1FS_BLOCK_SIZE);
+	}
+	free_blocks(fs, ext[i].start, ext[i].zblocks);
+	ext[i] = (a1fs_extent){ .start = start, .count = A1FS_CLUSTER_BLOCKS };
+	fs_dirty(fs, &ext[i], sizeof(*ext));
+	return 0;
+}
+
+/**
+ * Uncompress the compressed clusters that straddle either end of file blocks
+ * [lblk, lblk + count), so that the extents can be split there.
+ *
+ * @return  0 on success; -ENOSPC or -EIO, see file_uncompress().
+ */
+static int file_split_clusters(fs_ctx *fs, a1fs_inode *inode, a1fs_blk_t lblk,
+                               a1fs_blk_t count)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	a1fs_blk_t end = lblk + count;
+	a1fs_blk_t pos = 0;
+	for (int i = 0; i < inode->extent_count && pos < end; pos += ext[i++].count) {
+		a1fs_blk_t ext_end = pos + ext[i].count;
+		if (ext[i].zblocks != 0 && ((pos < lblk && lblk < ext_end) ||
+		                            (pos < end && end < ext_end)))
+		{
+			int ret = file_uncompress(fs, inode, i);
+			if (ret < 0) {
+				return ret;
+			}
+		}
+	}
+	return 0;
+}
+
+/**
+ * Get a file block for writing, giving it a data block of its own if needed.
+ *
+ * A hole gets a newly allocated block and an unwritten block gets zeroed. A
+ * block shared with other files is copied to a newly allocated block first
+ * (copy-on-write), and a compressed cluster is uncompressed. Either way the
+ * block ends up in a written extent that only this file uses.
+ *
+ * @param data  receives the pointer to the block contents.
+ * @return      0 on success; -ENOSPC if out of space or extents; -EIO on I/O
+ *              error.
+ */
+static int file_write_block(fs_ctx *fs, a1fs_inode *inode, a1fs_blk_t lblk,
+                            unsigned char **data)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	a1fs_blk_t off;
+	int i = ext_find(ext, inode->extent_count, lblk, &off);
+	assert(i >= 0);
+	if (ext[i].zblocks != 0) {
+		int ret = file_uncompress(fs, inode, i);
+		if (ret < 0) {
+			return ret;
+		}
+		*data = fs_data(fs, ext[i].start + off, true);
+		file_extents_changed(fs, inode);
+		return *data ? 0 : -EIO;
+	}
+	bool hole = ext_is_hole(&ext[i]);
+	bool unwritten = ext[i].unwritten;
+	a1fs_blk_t old = ext[i].start + off;
+	bool shared = !hole && blk_shared(fs, old);
+	if (!hole && !unwritten && !shared) {
+		*data = fs_data(fs, old, true);
+		return *data ? 0 : -EIO;
+	}
+
+	bool alloc = hole || shared;
+	a1fs_blk_t blk = old;
+	if (alloc && alloc_blocks(fs, file_goal(fs, inode, i), 1, &blk) == 0) {
+		return -ENOSPC;
+	}
+	int j = ext_isolate(ext, &inode->extent_count, MAX_EXTENTS, lblk, 1);
+	if (j < 0) {
+		file_extents_changed(fs, inode);
+		if (alloc) {
+			free_blocks(fs, blk, 1);
+			return -ENOSPC;
+		}
+		// No room to split the unwritten extent; initialize all of it
+		i = ext_find(ext, inode->extent_count, lblk, &off);
+		if (zero_blocks(fs, ext[i].start, ext[i].count) < 0) {
+			return -EIO;
+		}
+		ext[i].unwritten = 0;
+	} else {
+		ext[j] = (a1fs_extent){ .start = blk, .count = 1 };
+		unsigned char copy[A1FS_BLOCK_SIZE];
+		if (shared && !unwritten) {
+			// Only one block pointer is valid at a time, so copy through a buffer
+			const void *src = fs_data(fs, old, false);
+			if (!src) {
+				return -EIO;
+			}
+			memcpy(copy, src, A1FS_BLOCK_SIZE);
+		}
+		*data = fs_data(fs, blk, true);
+		if (!*data) {
+			return -EIO;
+		}
+		if (shared && !unwritten) {
+			memcpy(*data, copy, A1FS_BLOCK_SIZE);
+		} else {
+			memset(*data, 0, A1FS_BLOCK_SIZE);
+		}
+		if (shared) {
+			free_blocks(fs, old, 1);
+		}
+	}
+	file_extents_changed(fs, inode);
+	*data = fs_data(fs, blk, true);
+	return *data ? 0 : -EIO;
+}
+
+/**
+ * Clear the part of the last block of a file past the end of file, so that
+ * growing the file doesn't expose stale data.
+ */
+static int file_zero_tail(fs_ctx *fs, a1fs_inode *inode)
+{
+	size_t off = inode->size % A1FS_BLOCK_SIZE;
+	if (off == 0) {
+		return 0;
+	}
+	a1fs_blk_t lblk = inode->size / A1FS_BLOCK_SIZE;
+	unsigned char *data;
+	if (file_bmap(fs, inode, lblk) >= 0) {
+		int ret = file_write_block(fs, inode, lblk, &data);
+		if (ret < 0) {
+			return ret;
+		}
+	} else {
+		// Holes and unwritten blocks read as zeros anyway
+		da_inode *di = da_find(&fs->da, inode->ino_number, false);
+		data = di ? da_block_get(&fs->da, di, lblk, false) : NULL;
+		if (!data) {
+			return 0;
+		}
+	}
+	memset(data + off, 0, A1FS_BLOCK_SIZE - off);
+	return 0;
+}
+
+/**
+ * Change the size of a file, releasing blocks as needed.
+ *
+ * Growing a file doesn't allocate anything: the range between the old and the
+ * new end of file is a hole and reads as zeros. The file must not have
+ * buffered data (see file_flush()).
+ */
+static int file_resize(fs_ctx *fs, a1fs_inode *inode, uint64_t size)
+{
+	if (size < inode->size) {
+		a1fs_blk_t nblocks = (size + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE;
+		int ret = file_split_clusters(fs, inode, nblocks, 0);
+		if (ret < 0) {
+			return ret;
+		}
+		file_shrink(fs, inode, nblocks);
+	} else if (size > inode->size) {
+		int ret = file_zero_tail(fs, inode);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	inode->size = size;
+	clock_gettime(CLOCK_REALTIME, &inode->mtime);
+	fs_dirty(fs, inode, sizeof(*inode));
+	return 0;
+}
+
+/** Number of blocks of file blocks [lblk, lblk + count) that have a data block. */
+static a1fs_blk_t file_mapped(fs_ctx *fs, a1fs_inode *inode, a1fs_blk_t lblk,
+                              a1fs_blk_t count)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	a1fs_blk_t pos = 0, mapped = 0;
+	for (int i = 0; i < inode->extent_count && pos < lblk + count; i++) {
+		a1fs_blk_t from = pos > lblk ? pos : lblk;
+		a1fs_blk_t to = pos + ext[i].count < lblk + count
+		              ? pos + ext[i].count : lblk + count;
+		if (from < to && !ext_is_hole(&ext[i])) {
+			mapped += to - from;
+		}
+		pos += ext[i].count;
+	}
+	return mapped;
+}
+
+/**
+ * Allocate unwritten blocks for the holes in file blocks [lblk, lblk + count).
+ *
+ * Only bitmaps and extents are updated; the blocks are not touched.
+ *
+ * @return  0 on success; -ENOSPC if out of space or extents.
+ */
+static int file_prealloc(fs_ctx *fs, a1fs_inode *inode, a1fs_blk_t lblk,
+                         a1fs_blk_t count)
+{
+	if (count - file_mapped(fs, inode, lblk, count) > fs_avail_blocks(fs)) {
+		return -ENOSPC;
+	}
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	a1fs_blk_t end = file_end(fs, inode);
+	a1fs_blk_t last = lblk + count;
+	a1fs_blk_t pos = lblk;
+	int ret = 0;
+
+	// Fill the holes between the existing extents
+	while (ret == 0 && pos < last && pos < end) {
+		a1fs_blk_t off;
+		int i = ext_find(ext, inode->extent_count, pos, &off);
+		a1fs_blk_t len = ext[i].count - off;
+		if (len > last - pos) {
+			len = last - pos;
+		}
+		if (!ext_is_hole(&ext[i])) {
+			pos += len;
+			continue;
+		}
+		i = ext_isolate(ext, &inode->extent_count, MAX_EXTENTS, pos, len);
+		while (i >= 0 && len > 0) {
+			a1fs_blk_t start;
+			a1fs_blk_t n = alloc_blocks(fs, file_goal(fs, inode, i), len, &start);
+			if (n == 0) {
+				break;
+			}
+			a1fs_extent rest = { .start = A1FS_EXTENT_HOLE, .count = len - n };
+			if (n < len && ext_insert(ext, &inode->extent_count, MAX_EXTENTS,
+			                          i + 1, rest) < 0)
+			{
+				free_blocks(fs, start, n);
+				break;
+			}
+			ext[i++] = (a1fs_extent){ .start = start, .count = n, .unwritten = 1 };
+			pos += n;
+			len -= n;
+		}
+		if (len > 0) {
+			ret = -ENOSPC;
+		}
+	}
+
+	// Allocate the rest past the last extent
+	if (ret == 0 && last > end) {
+		if (lblk > end) {
+			ret = file_append_hole(fs, inode, lblk - end);
+		}
+		if (ret == 0) {
+			ret = file_extend(fs, inode, last - (lblk > end ? lblk : end),
+			                  EXTEND_UNWRITTEN);
+		}
+	}
+	file_extents_changed(fs, inode);
+	return ret;
+}
+
+/** Zero len bytes at offset within a single file block, if it has data. */
+static int file_zero_range(fs_ctx *fs, a1fs_inode *inode, uint64_t offset,
+                           size_t len)
+{
+	if (file_bmap(fs, inode, offset / A1FS_BLOCK_SIZE) < 0) {
+		return 0;
+	}
+	unsigned char *data;
+	int ret = file_write_block(fs, inode, offset / A1FS_BLOCK_SIZE, &data);
+	if (ret < 0) {
+		return ret;
+	}
+	memset(data + offset % A1FS_BLOCK_SIZE, 0, len);
+	return 0;
+}
+
+/**
+ * Deallocate the byte range [offset, offset + length) of a file.
+ *
+ * Whole blocks in the range become a hole and their data blocks are freed;
+ * partial blocks at the edges are zeroed. The file size doesn't change.
+ *
+ * @return  0 on success; -ENOSPC if out of space or extents; -EIO on I/O
+ *          error.
+ */
+static int file_punch(fs_ctx *fs, a1fs_inode *inode, uint64_t offset,
+                      uint64_t length)
+{
+	uint64_t end = offset + length;
+	uint64_t mapped = (uint64_t)file_end(fs, inode) * A1FS_BLOCK_SIZE;
+	if (end > mapped) {
+		end = mapped;
+	}
+	if (offset >= end) {
+		return 0;
+	}
+	a1fs_blk_t first = (offset + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE;
+	a1fs_blk_t last = end / A1FS_BLOCK_SIZE;
+	if (first > last) {
+		// The range is inside a single block
+		return file_zero_range(fs, inode, offset, end - offset);
+	}
+	int ret = 0;
+	if (offset % A1FS_BLOCK_SIZE != 0) {
+		ret = file_zero_range(fs, inode, offset,
+		                      (uint64_t)first * A1FS_BLOCK_SIZE - offset);
+	}
+	if (ret == 0 && end % A1FS_BLOCK_SIZE != 0) {
+		ret = file_zero_range(fs, inode, (uint64_t)last * A1FS_BLOCK_SIZE,
+		                      end % A1FS_BLOCK_SIZE);
+	}
+	if (ret < 0 || first == last) {
+		return ret;
+	}
+
+	ret = file_split_clusters(fs, inode, first, last - first);
+	if (ret < 0) {
+		file_extents_changed(fs, inode);
+		return ret;
+	}
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	int i = ext_isolate(ext, &inode->extent_count, MAX_EXTENTS, first,
+	                    last - first);
+	if (i < 0) {
+		file_extents_changed(fs, inode);
+		return -ENOSPC;
+	}
+	for (a1fs_blk_t pos = first; pos < last; pos += ext[i++].count) {
+		if (!ext_is_hole(&ext[i])) {
+			free_blocks(fs, ext[i].start, ext_blocks(&ext[i]));
+		}
+		ext[i].start = A1FS_EXTENT_HOLE;
+		ext[i].zblocks = 0;
+		ext[i].unwritten = 0;
+	}
+	file_extents_changed(fs, inode);
+	return 0;
+}
+
+/**
+ * Make file blocks [dblk, dblk + count) of dst share the data blocks of file
+ * blocks [sblk, sblk + count) of src.
+ *
+ * Only extents and reference counts are updated, no data is copied; the files
+ * diverge block by block as they are written (see file_write_block()). The
+ * previous contents of the destination range are released, and dst grows if
+ * needed. Requires A1FS_FEATURE_REFLINK. Neither file may have buffered data.
+ *
+ * @return  0 on success; -EINVAL if the ranges overlap within the same file;
+ *          -ENOSPC if out of extents; -EMLINK if a block has too many
+ *          references.
+ */
+static int file_clone(fs_ctx *fs, a1fs_inode *src, a1fs_inode *dst,
+                      a1fs_blk_t sblk, a1fs_blk_t dblk, a1fs_blk_t count)
+{
+	if (src == dst && sblk < dblk + count && dblk < sblk + count) {
+		return -EINVAL;
+	}
+	// Compressed clusters can only be shared as a whole
+	int ret = file_split_clusters(fs, src, sblk, count);
+	if (ret == 0) {
+		ret = file_split_clusters(fs, dst, dblk, count);
+	}
+	file_extents_changed(fs, src);
+	file_extents_changed(fs, dst);
+	if (ret < 0) {
+		return ret;
+	}
+
+	// Collect the source extents first, src and dst may be the same file
+	a1fs_extent *sext = get_extents(fs, src->ino_number);
+	a1fs_extent pieces[MAX_EXTENTS + 1];
+	int npieces = 0;
+	a1fs_blk_t pos = 0, covered = 0;
+	for (int i = 0; i < src->extent_count && pos < sblk + count; i++) {
+		a1fs_blk_t from = pos > sblk ? pos : sblk;
+		a1fs_blk_t to = pos + sext[i].count < sblk + count
+		              ? pos + sext[i].count : sblk + count;
+		if (from < to) {
+			a1fs_extent e = sext[i];
+			if (!ext_is_hole(&e)) {
+				e.start += from - pos;
+			}
+			e.count = to - from;
+			pieces[npieces++] = e;
+			covered += e.count;
+		}
+		pos += sext[i].count;
+	}
+	if (covered < count) {
+		pieces[npieces++] = (a1fs_extent){ .start = A1FS_EXTENT_HOLE,
+		                                   .count = count - covered };
+	}
+
+	// Make sure that the destination extents will fit
+	a1fs_extent *dext = get_extents(fs, dst->ino_number);
+	a1fs_blk_t dend = file_end(fs, dst);
+	int need = npieces + (dblk > dend ? 1 : 0);
+	pos = 0;
+	for (int i = 0; i < dst->extent_count; i++) {
+		need += (pos < dblk) + (pos + dext[i].count > dblk + count);
+		pos += dext[i].count;
+	}
+	if (need > MAX_EXTENTS) {
+		return -ENOSPC;
+	}
+
+	if (dblk + count > dend) {
+		ret = file_append_hole(fs, dst, dblk + count - dend);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	int i = ext_isolate(dext, &dst->extent_count, MAX_EXTENTS, dblk, count);
+	if (i < 0) {
+		file_extents_changed(fs, dst);
+		return -ENOSPC;
+	}
+	for (int k = 0; k < npieces; k++) {
+		if (ext_is_hole(&pieces[k])) {
+			continue;
+		}
+		ret = share_blocks(fs, pieces[k].start, ext_blocks(&pieces[k]));
+		if (ret < 0) {
+			while (--k >= 0) {
+				if (!ext_is_hole(&pieces[k])) {
+					free_blocks(fs, pieces[k].start, ext_blocks(&pieces[k]));
+				}
+			}
+			file_extents_changed(fs, dst);
+			return ret;
+		}
+	}
+
+	// Replace the extents of the destination range with the source ones
+	int n = 0;
+	for (a1fs_blk_t len = 0; len < count; len += dext[i + n++].count) {
+		if (!ext_is_hole(&dext[i + n])) {
+			free_blocks(fs, dext[i + n].start, ext_blocks(&dext[i + n]));
+		}
+	}
+	memmove(&dext[i + npieces], &dext[i + n],
+	        (dst->extent_count - i - n) * sizeof(*dext));
+	memcpy(&dext[i], pieces, npieces * sizeof(*dext));
+	dst->extent_count += npieces - n;
+	file_extents_changed(fs, dst);
+	return 0;
+}
+
+/**
+ * Find the next data or hole in a file at or after offset.
+ *
+ * Holes and unwritten extents are holes; the end of file is an implicit hole.
+ * The file must not have buffered data (see file_flush()).
+ *
+ * @param whence  SEEK_DATA or SEEK_HOLE.
+ * @return        offset found; -ENXIO if offset is at or past the end of file,
+ *                or there is no data after it.
+ */
+static int64_t file_seek(fs_ctx *fs, a1fs_inode *inode, uint64_t offset,
+                         int whence)
+{
+	if (offset >= inode->size) {
+		return -ENXIO;
+	}
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	uint64_t pos = 0;
+	int i;
+	for (i = 0; i < inode->extent_count; i++) {
+		uint64_t end = pos + (uint64_t)ext[i].count * A1FS_BLOCK_SIZE;
+		bool data = !ext_is_hole(&ext[i]) && !ext[i].unwritten;
+		if (end > offset && data == (whence == SEEK_DATA)) {
+			break;
+		}
+		pos = end;
+	}
+	if (i == inode->extent_count && whence == SEEK_DATA) {
+		return -ENXIO;
+	}
+	if (pos < offset) {
+		pos = offset;
+	}
+	if (pos >= inode->size) {
+		// Extents may go past the end of file (see fallocate())
+		return whence == SEEK_DATA ? -ENXIO : (int64_t)inode->size;
+	}
+	return pos;
+}
+
+/**
+ * Append a cluster of buffered blocks to a regular file in compressed form.
+ *
+ * Only done with the compress mount option, for a whole cluster that is
+ * aligned to A1FS_CLUSTER_BLOCKS, doesn't end past the end of file (so that
+ * appending to the file doesn't have to uncompress it again), and compresses
+ * to fewer blocks than it has.
+ *
+ * @param blocks  buffered blocks to append; the first one is at the end of the
+ *                file, and they have consecutive file block numbers.
+ * @param n       number of blocks.
+ * @return        number of blocks appended: A1FS_CLUSTER_BLOCKS, or 0 if the
+ *                blocks should be appended uncompressed; -ENOSPC if out of
+ *                extents; -EIO on I/O error.
+ */
+static int file_append_cluster(fs_ctx *fs, a1fs_inode *inode,
+                               const da_block *blocks, size_t n)
+{
+	a1fs_blk_t lblk = blocks[0].lblk;
+	if (!fs->compress || !S_ISREG(inode->mode) || n < A1FS_CLUSTER_BLOCKS ||
+	    lblk % A1FS_CLUSTER_BLOCKS != 0 ||
+	    (uint64_t)(lblk + A1FS_CLUSTER_BLOCKS) * A1FS_BLOCK_SIZE > inode->size)
+	{
+		return 0;
+	}
+
+	unsigned char plain[A1FS_CLUSTER_SIZE];
+	for (size_t k = 0; k < A1FS_CLUSTER_BLOCKS; k++) {
+		memcpy(plain + k * A1FS_BLOCK_SIZE, blocks[k].data, A1FS_BLOCK_SIZE);
+	}
+	unsigned char packed[(A1FS_CLUSTER_BLOCKS - 1) * A1FS_BLOCK_SIZE];
+	uint32_t len = lz_compress(plain, sizeof(plain), packed + sizeof(len),
+	                           sizeof(packed) - sizeof(len));
+	if (len == 0) {
+		return 0;
+	}
+	memcpy(packed, &len, sizeof(len));
+	a1fs_blk_t zblocks = (sizeof(len) + len + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE;
+	memset(packed + sizeof(len) + len, 0,
+	       zblocks * A1FS_BLOCK_SIZE - sizeof(len) - len);
+
+	a1fs_blk_t start;
+	a1fs_blk_t got = alloc_blocks(fs, file_goal(fs, inode, inode->extent_count),
+	                              zblocks, &start);
+	if (got < zblocks) {
+		if (got > 0) {
+			free_blocks(fs, start, got);
+		}
+		return 0;
+	}
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	a1fs_extent e = { .start = start, .count = A1FS_CLUSTER_BLOCKS,
+	                  .zblocks = zblocks };
+	if (ext_insert(ext, &inode->extent_count, MAX_EXTENTS, inode->extent_count,
+	               e) < 0)
+	{
+		free_blocks(fs, start, zblocks);
+		return -ENOSPC;
+	}
+	fs_dirty(fs, &ext[inode->extent_count - 1], sizeof(*ext));
+	fs_dirty(fs, inode, sizeof(*inode));
+	for (a1fs_blk_t b = 0; b < zblocks; b++) {
+		void *dst = fs_data(fs, start + b, true);
+		if (!dst) {
+			return -EIO;
+		}
+		memcpy(dst, packed + b * A1FS_BLOCK_SIZE, A1FS_BLOCK_SIZE);
+	}
+	fs->zclusters++;
+	fs->zsaved += A1FS_CLUSTER_BLOCKS - zblocks;
+	return A1FS_CLUSTER_BLOCKS;
+}
+
+/**
+ * Extents of a file that dedup leaves for other uses. Shared blocks that are
+ * not contiguous take an extent each, so a file with many duplicate blocks
+ * would otherwise run out of extents.
+ */
+#define DEDUP_EXTENT_RESERVE (MAX_EXTENTS / 4)
+
+/**
+ * Find a data block with the same contents as a buffer in the dedup index.
+ *
+ * The contents of the block found are compared with the buffer, since it may
+ * have been modified since it was indexed.
+ *
+ * @param fp    fingerprint of the buffer (see dd_hash()).
+ * @param data  A1FS_BLOCK_SIZE bytes; must not be a pointer from fs_data().
+ * @return      data block number; DD_NONE if none found or on I/O error.
+ */
+static a1fs_blk_t dedup_find(fs_ctx *fs, const dd_fp *fp, const void *data)
+{
+	a1fs_blk_t blk = dd_lookup(&fs->dd, fp);
+	if (blk == DD_NONE) {
+		return DD_NONE;
+	}
+	const void *found = fs_data(fs, blk, false);
+	if (!found || memcmp(found, data, A1FS_BLOCK_SIZE) != 0) {
+		fs->dd_mismatches++;
+		return DD_NONE;
+	}
+	return blk;
+}
+
+/**
+ * Append a buffered block to a regular file by sharing an identical data block
+ * found in the dedup index.
+ *
+ * @param block  buffered block to append; it is at the end of the file.
+ * @param fp     fingerprint of the block.
+ * @return       1 if the block was appended; 0 if it should be written out
+ *               normally; -ENOSPC if out of extents.
+ */
+static int file_append_dup(fs_ctx *fs, a1fs_inode *inode, const da_block *block,
+                           const dd_fp *fp)
+{
+	a1fs_blk_t blk = dedup_find(fs, fp, block->data);
+	if (blk == DD_NONE) {
+		return 0;
+	}
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	a1fs_extent e = { .start = blk, .count = 1 };
+	int n = inode->extent_count;
+	if ((n == 0 || !ext_mergeable(&ext[n - 1], &e)) &&
+	    n >= MAX_EXTENTS - DEDUP_EXTENT_RESERVE)
+	{
+		return 0;
+	}
+	if (share_blocks(fs, blk, 1) < 0) {
+		return 0;
+	}
+	if (ext_insert(ext, &inode->extent_count, MAX_EXTENTS, inode->extent_count,
+	               e) < 0)
+	{
+		free_blocks(fs, blk, 1);
+		return -ENOSPC;
+	}
+	file_extents_changed(fs, inode);
+	fs->dd_shared++;
+	return 1;
+}
+
+/**
+ * Allocate data blocks for the buffered data of a file and write it out.
+ *
+ * Each run of consecutive buffered blocks is requested from the allocator at
+ * once, so that it can be placed in a single extent. Gaps between the runs
+ * become holes. With the compress mount option, the runs are cut at cluster
+ * boundaries instead, and whole clusters are stored compressed where that
+ * saves space (see file_append_cluster()). With the dedup mount option, the
+ * blocks of regular files that are not compressed are appended one at a time
+ * so that each can share an identical block instead (see file_append_dup()),
+ * and the ones written out are added to the dedup index.
+ *
+ * @return  0 on success; -ENOSPC if out of extents; -EIO on I/O error.
+ */
+static int file_flush(fs_ctx *fs, a1fs_inode *inode)
+{
+	da_inode *di = da_find(&fs->da, inode->ino_number, false);
+	if (!di) {
+		return 0;
+	}
+
+	// Hand the reserved blocks over to the allocator
+	a1fs_blk_t reserved = di->reserved;
+	da_reserve(&fs->da, di, 0, 0);
+	int ret = 0;
+	for (size_t i = 0; ret == 0 && i < di->nblocks;) {
+		a1fs_blk_t lblk = di->blocks[i].lblk;
+		size_t run = 1;
+		while (i + run < di->nblocks && di->blocks[i + run].lblk == lblk + run) {
+			run++;
+		}
+
+		a1fs_blk_t end = file_end(fs, inode);
+		if (lblk > end) {
+			ret = file_append_hole(fs, inode, lblk - end);
+		}
+		for (size_t k = 0; ret == 0 && k < run;) {
+			// Blocks inside the extents are written one at a time
+			size_t len = 1;
+			bool dedup = false;
+			dd_fp fp;
+			end = file_end(fs, inode);
+			if (lblk + k >= end) {
+				int n = file_append_cluster(fs, inode, &di->blocks[i + k], run - k);
+				if (n == 0 && fs->dedup && S_ISREG(inode->mode)) {
+					dedup = true;
+					dd_hash(di->blocks[i + k].data, A1FS_BLOCK_SIZE, &fp);
+					n = file_append_dup(fs, inode, &di->blocks[i + k], &fp);
+				}
+				if (n > 0) {
+					k += n;
+					continue;
+				}
+				if (n < 0) {
+					ret = n;
+					file_shrink(fs, inode, end);
+					break;
+				}
+				len = dedup ? 1 : run - k;
+				if (fs->compress) {
+					size_t to_cluster = A1FS_CLUSTER_BLOCKS -
+					                    (lblk + k) % A1FS_CLUSTER_BLOCKS;
+					len = len < to_cluster ? len : to_cluster;
+				}
+				ret = file_extend(fs, inode, len, 0);
+				if (ret < 0) {
+					file_shrink(fs, inode, end);
+					break;
+				}
+			}
+			for (size_t j = 0; ret == 0 && j < len; j++, k++) {
+				unsigned char *data;
+				ret = file_write_block(fs, inode, lblk + k, &data);
+				if (ret == 0) {
+					memcpy(data, di->blocks[i + k].data, A1FS_BLOCK_SIZE);
+				}
+			}
+			if (ret == 0 && dedup) {
+				dd_insert(&fs->dd, &fp, file_bmap(fs, inode, lblk + k - 1));
+			}
+		}
+		i += run;
+	}
+	if (ret < 0) {
+		da_reserve(&fs->da, di, reserved, reserved);
+		return ret;
+	}
+	da_remove(&fs->da, di);
+	return 0;
+}
+
+/**
+ * Flush the files whose data has been buffered since before older_than.
+ *
+ * @param older_than  cutoff time; 0 to flush all files.
+ */
+static void flush_all(fs_ctx *fs, time_t older_than)
+{
+	size_t i = 0;
+	while (i < fs->da.ninodes) {
+		da_inode *di = fs->da.inodes[i];
+		if ((older_than != 0 && di->since >= older_than) ||
+		    file_flush(fs, get_inode(fs, di->ino)) < 0)
+		{
+			// Flushed files are removed from the array; skip the rest
+			i++;
+		}
+	}
+}
+
+/** Flush the files with the most buffered data until below the limit. */
+static void flush_pressure(fs_ctx *fs)
+{
+	while (fs->da.bytes > fs->dirty_max) {
+		da_inode *di = da_largest(&fs->da);
+		if (file_flush(fs, get_inode(fs, di->ino)) < 0) {
+			break;
+		}
+	}
+}
+
+/**
+ * Get a buffer for a file block past the last extent.
+ *
+ * A block that isn't buffered yet gets a zero-filled buffer and a reserved
+ * data block that it will be written to when the file is flushed.
+ *
+ * @param data  receives the pointer to the buffer.
+ * @return      0 on success; -ENOSPC if out of space; -ENOMEM if out of
+ *              memory.
+ */
+static int file_buffer_block(fs_ctx *fs, a1fs_inode *inode, a1fs_blk_t lblk,
+                             unsigned char **data)
+{
+	da_inode *di = da_find(&fs->da, inode->ino_number, true);
+	if (!di) {
+		return -ENOMEM;
+	}
+	*data = da_block_get(&fs->da, di, lblk, false);
+	if (*data) {
+		return 0;
+	}
+	if (!da_reserve(&fs->da, di, di->reserved + 1, fs_avail_blocks(fs))) {
+		if (di->nblocks == 0) {
+			da_remove(&fs->da, di);
+		}
+		return -ENOSPC;
+	}
+	*data = da_block_get(&fs->da, di, lblk, true);
+	if (!*data) {
+		da_reserve(&fs->da, di, di->reserved - 1, 0);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+/**
+ * Grow a file without allocating blocks for it.
+ *
+ * @return  0 on success; -EIO on I/O error.
+ */
+static int file_grow(fs_ctx *fs, a1fs_inode *inode, uint64_t size)
+{
+	assert(size > inode->size);
+	int ret = file_zero_tail(fs, inode);
+	if (ret < 0) {
+		return ret;
+	}
+	inode->size = size;
+	fs_dirty(fs, inode, sizeof(*inode));
+	return 0;
+}
+
+/**
+ * Queue a directory that has more than one extent for compaction.
+ *
+ * The queue is best effort: when it is full, the directory is left as is.
+ */
+static void dir_mark_fragmented(fs_ctx *fs, a1fs_ino_t ino)
+{
+	for (size_t i = 0; i < fs->nfrag_dirs; i++) {
+		if (fs->frag_dirs[i] == ino) {
+			return;
+		}
+	}
+	if (fs->nfrag_dirs < FRAG_DIRS_MAX) {
+		fs->frag_dirs[fs->nfrag_dirs++] = ino;
+	}
+}
+
+/**
+ * Number of physically contiguous runs of data blocks in a file.
+ *
+ * Holes don't end a run, so a sparse file whose blocks are laid out in order
+ * is a single run.
+ */
+static int file_runs(fs_ctx *fs, a1fs_inode *inode)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	a1fs_blk_t next = A1FS_BLK_NONE;
+	int runs = 0;
+	for (int i = 0; i < inode->extent_count; i++) {
+		if (ext_is_hole(&ext[i])) {
+			continue;
+		}
+		if (ext[i].start != next) {
+			runs++;
+		}
+		next = ext[i].start + ext_blocks(&ext[i]);
+	}
+	return runs;
+}
+
+/**
+ * Move the data blocks of a file into one contiguous run.
+ *
+ * The data is copied into a newly allocated run and written back to the image
+ * before the extents are switched over to it, so the extents never point at
+ * blocks that don't hold the file's data yet. Holes stay holes, and unwritten
+ * extents stay unwritten without their blocks being copied.
+ *
+ * @return  0 on success (also if the file is already contiguous); -EBUSY if
+ *          some blocks are shared with other files; -ENOSPC if there is no
+ *          free run large enough; -EIO on I/O error.
+ */
+static int file_defrag(fs_ctx *fs, a1fs_inode *inode)
+{
+	int ret = file_flush(fs, inode);
+	if (ret < 0) {
+		return ret;
+	}
+	if (file_runs(fs, inode) <= 1) {
+		return 0;
+	}
+
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	a1fs_blk_t n = 0;
+	for (int i = 0; i < inode->extent_count; i++) {
+		if (ext_is_hole(&ext[i])) {
+			continue;
+		}
+		// Moving shared blocks would turn the sharing into copies
+		for (a1fs_blk_t b = 0; fs->refcount && b < ext_blocks(&ext[i]); b++) {
+			if (blk_shared(fs, ext[i].start + b)) {
+				return -EBUSY;
+			}
+		}
+		n += ext_blocks(&ext[i]);
+	}
+	// Don't take blocks that are reserved for buffered file data
+	if (n > fs_avail_blocks(fs)) {
+		return -ENOSPC;
+	}
+	a1fs_blk_t start;
+	a1fs_blk_t got = alloc_blocks(fs, A1FS_BLK_NONE, n, &start);
+	if (got < n) {
+		if (got > 0) {
+			free_blocks(fs, start, got);
+		}
+		return -ENOSPC;
+	}
+
+	a1fs_blk_t lblk = 0, pos = 0;
+	for (int i = 0; i < inode->extent_count; lblk += ext[i++].count) {
+		if (ext_is_hole(&ext[i])) {
+			continue;
+		}
+		a1fs_blk_t from = ext[i].start, to = start + pos;
+		pos += ext_blocks(&ext[i]);
+		if (ext[i].unwritten) {
+			continue;
+		}
+		file_prefetch(fs, inode, lblk, ext[i].count);
+		for (a1fs_blk_t b = 0; b < ext_blocks(&ext[i]); b++) {
+			// Only one block pointer is valid at a time, so copy through a buffer
+			unsigned char copy[A1FS_BLOCK_SIZE];
+			const void *src = fs_data(fs, from + b, false);
+			if (!src) {
+				free_blocks(fs, start, n);
+				return -EIO;
+			}
+			memcpy(copy, src, A1FS_BLOCK_SIZE);
+			void *dst = fs_data(fs, to + b, true);
+			if (!dst) {
+				free_blocks(fs, start, n);
+				return -EIO;
+			}
+			memcpy(dst, copy, A1FS_BLOCK_SIZE);
+		}
+	}
+	if (fs_sync(fs) < 0) {
+		free_blocks(fs, start, n);
+		return -EIO;
+	}
+
+	pos = 0;
+	for (int i = 0; i < inode->extent_count; i++) {
+		if (!ext_is_hole(&ext[i])) {
+			free_blocks(fs, ext[i].start, ext_blocks(&ext[i]));
+			ext[i].start = start + pos;
+			pos += ext_blocks(&ext[i]);
+		}
+	}
+	file_extents_changed(fs, inode);
+	return 0;
+}
+
+/**
+ * Make the data blocks of a regular file share identical blocks found in the
+ * dedup index, and add the rest of them to the index.
+ *
+ * Holes, unwritten extents and compressed clusters are skipped, and so are
+ * the blocks that would take the extents in DEDUP_EXTENT_RESERVE. The file
+ * must not have buffered data (see file_flush()), and the dedup index must be
+ * allocated.
+ *
+ * @param dry_run  only count the blocks that could be shared.
+ * @param scanned  receives the number of data blocks looked up.
+ * @param shared   receives the number of blocks that were (or could be) made
+ *                 to share an identical block.
+ * @return         0 on success; -ENOSPC if out of extents (the blocks shared
+ *                 so far stay shared); -EIO on I/O error.
+ */
+static int file_dedup(fs_ctx *fs, a1fs_inode *inode, bool dry_run,
+                      uint64_t *scanned, uint64_t *shared)
+{
+	a1fs_extent *ext = get_extents(fs, inode->ino_number);
+	a1fs_blk_t nblocks = file_end(fs, inode);
+	*scanned = 0;
+	*shared = 0;
+	for (a1fs_blk_t lblk = 0; lblk < nblocks; lblk++) {
+		a1fs_blk_t off;
+		int i = ext_find(ext, inode->extent_count, lblk, &off);
+		if (ext_is_hole(&ext[i]) || ext[i].unwritten || ext[i].zblocks != 0) {
+			lblk += ext[i].count - off - 1;
+			continue;
+		}
+		if (off == 0) {
+			file_prefetch(fs, inode, lblk, ext[i].count);
+		}
+
+		// Only one block pointer is valid at a time, so hash a copy
+		a1fs_blk_t old = ext[i].start + off;
+		unsigned char copy[A1FS_BLOCK_SIZE];
+		const void *data = fs_data(fs, old, false);
+		if (!data) {
+			return -EIO;
+		}
+		memcpy(copy, data, A1FS_BLOCK_SIZE);
+		dd_fp fp;
+		dd_hash(copy, A1FS_BLOCK_SIZE, &fp);
+		(*scanned)++;
+		a1fs_blk_t blk = dedup_find(fs, &fp, copy);
+		if (blk == old ||
+		    (blk != DD_NONE && !dry_run &&
+		     inode->extent_count + 2 > MAX_EXTENTS - DEDUP_EXTENT_RESERVE))
+		{
+			// Splitting the extent could take the last extents of the file
+			continue;
+		}
+		if (blk == DD_NONE || (!dry_run && share_blocks(fs, blk, 1) < 0)) {
+			dd_insert(&fs->dd, &fp, old);
+			continue;
+		}
+		if (dry_run) {
+			(*shared)++;
+			continue;
+		}
+
+		int j = ext_isolate(ext, &inode->extent_count, MAX_EXTENTS, lblk, 1);
+		if (j < 0) {
+			free_blocks(fs, blk, 1);
+			file_extents_changed(fs, inode);
+			return -ENOSPC;
+		}
+		ext[j].start = blk;
+		free_blocks(fs, old, 1);
+		// Shared neighbors that are also contiguous are merged back here
+		file_extents_changed(fs, inode);
+		(*shared)++;
+		fs->dd_shared++;
+	}
+	return 0;
+}
+
+/** Compact the queued fragmented directories that still exist. */
+static void compact_dirs(fs_ctx *fs)
+{
+	const unsigned char *inode_map = (const unsigned char*)fs->image +
+	                                 fs->sb->start_inode_map * A1FS_BLOCK_SIZE;
+	for (size_t i = 0; i < fs->nfrag_dirs; i++) {
+		a1fs_ino_t ino = fs->frag_dirs[i];
+		a1fs_inode *dir = get_inode(fs, ino);
+		if (bitmap_test(inode_map, ino) && S_ISDIR(dir->mode)) {
+			file_defrag(fs, dir);
+		}
+	}
+	fs->nfrag_dirs = 0;
+}
+
+/** Maximum number of files defragmented per background defrag run. */
+#define DEFRAG_IDLE_FILES 4
+
+/**
+ * Defragment some of the fragmented files, continuing the scan of the inode
+ * table where the previous run stopped.
+ *
+ * A pass over the inode table may take several runs. Once a whole pass finds
+ * nothing to do, no more passes are made until the next file system
+ * operation; operations made during the pass (which may have fragmented the
+ * files it had already scanned) get another pass.
+ */
+static void defrag_idle(fs_ctx *fs)
+{
+	const unsigned char *inode_map = (const unsigned char*)fs->image +
+	                                 fs->sb->start_inode_map * A1FS_BLOCK_SIZE;
+	int done = 0;
+	for (a1fs_ino_t n = 0; n < fs->sb->inodes_count; n++) {
+		a1fs_ino_t ino = fs->defrag_cursor;
+		if (ino == 0) {
+			fs->defrag_pass_seq = fs->op_seq;
+			fs->defrag_found = false;
+		}
+		fs->defrag_cursor = (ino + 1) % fs->sb->inodes_count;
+		if (bitmap_test(inode_map, ino)) {
+			a1fs_inode *inode = get_inode(fs, ino);
+			if (file_runs(fs, inode) > 1 && file_defrag(fs, inode) == 0) {
+				fs->defrag_found = true;
+				done++;
+			}
+		}
+		if (fs->defrag_cursor == 0 && !fs->defrag_found) {
+			fs->defrag_scanned = fs->defrag_pass_seq;
+			return;
+		}
+		if (done == DEFRAG_IDLE_FILES) {
+			return;
+		}
+	}
+}
+
+/**
+ * Background flusher thread.
+ *
+ * Wakes up every flush_interval seconds and flushes the files whose data has
+ * been buffered for longer than that. Directories that got fragmented since
+ * the last run are compacted into contiguous extents. With defrag_idle set,
+ * fragmented files are also defragmented once the file system has been idle
+ * for that long.
+ */
+static void *flusher_main(void *arg)
+{
+	fs_ctx *fs = (fs_ctx*)arg;
+	pthread_mutex_lock(&fs->lock);
+	while (!fs->stopping) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += fs->flush_interval;
+		pthread_cond_timedwait(&fs->flush_cond, &fs->lock, &deadline);
+		if (fs_readonly(fs)) {
+			continue;
+		}
+		if (!fs->stopping && (fs->da.ninodes > 0 || fs->nfrag_dirs > 0 ||
+		                      fs->csum.nstale > 0))
+		{
+			flush_all(fs, time(NULL) - fs->flush_interval + 1);
+			compact_dirs(fs);
+			fs_sync(fs);
+		}
+		if (!fs->stopping && fs->defrag_idle != 0 &&
+		    fs->op_seq != fs->defrag_scanned &&
+		    time(NULL) - fs->last_op >= fs->defrag_idle)
+		{
+			defrag_idle(fs);
+			fs_sync(fs);
+		}
+	}
+	pthread_mutex_unlock(&fs->lock);
+	return NULL;
+}
+
+/** Start the background flusher thread. */
+static void start_flusher(fs_ctx *fs)
+{
+	int ret = pthread_create(&fs->flusher, NULL, flusher_main, fs);
+	if (ret != 0) {
+		log_error("Failed to start the flusher: %s\n", strerror(ret));
+		return;
+	}
+	fs->flusher_running = true;
+}
+
+/** Stop the background flusher thread. */
+static void stop_flusher(fs_ctx *fs)
+{
+	if (!fs->flusher_running) {
+		return;
+	}
+	pthread_mutex_lock(&fs->lock);
+	fs->stopping = true;
+	pthread_cond_signal(&fs->flush_cond);
+	pthread_mutex_unlock(&fs->lock);
+	pthread_join(fs->flusher, NULL);
+	fs->flusher_running = false;
+}
+
+/** Maximum number of runs passed to a single storage_discard() call. */
+#define DISCARD_BATCH 64
+
+/**
+ * Discard the queued freed blocks that are still free.
+ *
+ * Blocks that were allocated again since they were freed are skipped; the
+ * file system lock is held throughout, so none can be allocated meanwhile. If
+ * the backend fails to discard (e.g. the host file system can't punch holes),
+ * online discard is turned off.
+ */
+static void discard_queued(fs_ctx *fs)
+{
+	storage_range *ranges;
+	size_t n = dq_take(&fs->dq, &ranges);
+	storage_range batch[DISCARD_BATCH];
+	size_t nbatch = 0;
+	int ret = 0;
+	for (size_t i = 0; i < n && ret == 0; i++) {
+		size_t end = ranges[i].start + ranges[i].count;
+		size_t b = bitmap_find_zero(fs->data_map, ranges[i].start, end);
+		while (b < end && ret == 0) {
+			size_t e = bitmap_find_one(fs->data_map, b, end);
+			batch[nbatch].start = fs->sb->start_data + b;
+			batch[nbatch].count = e - b;
+			if (++nbatch == DISCARD_BATCH) {
+				ret = storage_discard(fs->st, batch, nbatch);
+				nbatch = 0;
+			}
+			b = bitmap_find_zero(fs->data_map, e, end);
+		}
+	}
+	if (ret == 0 && nbatch > 0) {
+		ret = storage_discard(fs->st, batch, nbatch);
+	}
+	free(ranges);
+	if (ret < 0) {
+		log_error("Discard failed, disabling online discard\n");
+		fs->discard = false;
+	}
+}
+
+/**
+ * Background discard thread.
+ *
+ * Wakes up every discard_interval seconds, or early when many blocks have been
+ * freed, and discards the freed blocks in one batch.
+ */
+static void *discarder_main(void *arg)
+{
+	fs_ctx *fs = (fs_ctx*)arg;
+	pthread_mutex_lock(&fs->lock);
+	while (!fs->stopping) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += fs->discard_interval;
+		pthread_cond_timedwait(&fs->discard_cond, &fs->lock, &deadline);
+		if (!fs->stopping && fs->discard && fs->dq.n > 0) {
+			discard_queued(fs);
+		}
+	}
+	pthread_mutex_unlock(&fs->lock);
+	return NULL;
+}
+
+/** Start the background discard thread. */
+static void start_discarder(fs_ctx *fs)
+{
+	int ret = pthread_create(&fs->discarder, NULL, discarder_main, fs);
+	if (ret != 0) {
+		log_error("Failed to start the discarder: %s\n", strerror(ret));
+		return;
+	}
+	fs->discarder_running = true;
+}
+
+/** Stop the background discard thread. */
+static void stop_discarder(fs_ctx *fs)
+{
+	if (!fs->discarder_running) {
+		return;
+	}
+	pthread_mutex_lock(&fs->lock);
+	fs->stopping = true;
+	pthread_cond_signal(&fs->discard_cond);
+	pthread_mutex_unlock(&fs->lock);
+	pthread_join(fs->discarder, NULL);
+	fs->discarder_running = false;
+}
+
+/** Number of directory entries in a block. */
+#define DENTRIES_PER_BLOCK ((int)(A1FS_BLOCK_SIZE / sizeof(a1fs_dentry)))
+
+/**
+ * Find the position of a name in a directory.
+ *
+ * @param ino  receives the inode number of the entry if not NULL.
+ * @return     index of the entry; -ENOENT if not found; -EIO on error.
+ */
+static int dir_find(fs_ctx *fs, a1fs_inode *dir, const char *name, int *ino)
+{
+	int entry_count = dir->size / sizeof(a1fs_dentry);
+	file_prefetch(fs, dir, 0, dir_blocks(dir));
+	for (int pos = 0; pos < entry_count; pos += DENTRIES_PER_BLOCK) {
+		a1fs_dentry *entries = file_block(fs, dir, pos / DENTRIES_PER_BLOCK, false);
+		if (!entries) {
+			return -EIO;
+		}
+		for (int x = 0; x < DENTRIES_PER_BLOCK && pos + x < entry_count; x++) {
+			if (strcmp(entries[x].name, name) == 0) {
+				if (ino) {
+					*ino = entries[x].ino;
+				}
+				stats_add(&fs->stats.dentries_scanned, pos + x + 1);
+				return pos + x;
+			}
+		}
+	}
+	stats_add(&fs->stats.dentries_scanned, entry_count);
+	return -ENOENT;
+}
+
+/**
+ * Look up a name in a directory.
+ *
+ * @return  inode number of the entry; -ENOENT if not found; -EIO on error.
+ */
+static int dir_lookup(fs_ctx *fs, a1fs_inode *dir, const char *name)
+{
+	int ino;
+	int ret = dir_find(fs, dir, name, &ino);
+	return ret < 0 ? ret : ino;
+}
+
+/**
+ * Point an existing directory entry to another inode.
+ *
+ * @return  0 on success; -ENOENT if not found; -EIO on I/O error.
+ */
+static int dir_set_entry(fs_ctx *fs, a1fs_inode *dir, const char *name, int ino)
+{
+	int pos = dir_find(fs, dir, name, NULL);
+	if (pos < 0) {
+		return pos;
+	}
+	a1fs_dentry *entries = file_block(fs, dir, pos / DENTRIES_PER_BLOCK, true);
+	if (!entries) {
+		return -EIO;
+	}
+	entries[pos % DENTRIES_PER_BLOCK].ino = ino;
+	clock_gettime(CLOCK_REALTIME, &dir->mtime);
+	fs_dirty(fs, dir, sizeof(*dir));
+	return 0;
+}
+
+/**
+ * Append a directory entry to a directory, growing it by a block if needed.
+ *
+ * @return  0 on success; -ENOSPC if out of space; -EIO on I/O error.
+ */
+static int dir_add_entry(fs_ctx *fs, a1fs_inode *dir, int ino, const char *name)
+{
+	size_t pos = dir->size / sizeof(a1fs_dentry);
+	if (dir->size % A1FS_BLOCK_SIZE == 0) {
+		int ret = file_extend(fs, dir, 1, EXTEND_ZERO);
+		if (ret < 0) {
+			return ret;
+		}
+		if (dir->extent_count > 1) {
+			dir_mark_fragmented(fs, dir->ino_number);
+		}
+	}
+	a1fs_dentry *entries = file_block(fs, dir, pos / DENTRIES_PER_BLOCK, true);
+	if (!entries) {
+		return -EIO;
+	}
+	a1fs_dentry *entry = &entries[pos % DENTRIES_PER_BLOCK];
+	entry->ino = ino;
+	strncpy(entry->name, name, A1FS_NAME_MAX - 1);
+	entry->name[A1FS_NAME_MAX - 1] = '\0';
+	dir->size += sizeof(a1fs_dentry);
+	clock_gettime(CLOCK_REALTIME, &dir->mtime);
+	fs_dirty(fs, dir, sizeof(*dir));
+	return 0;
+}
+
+/**
+ * Remove a directory entry.
+ *
+ * The hole left by the entry is filled with the last entry of the directory,
+ * so that the entries stay densely packed. A trailing block that no longer
+ * holds any entries is freed.
+ *
+ * @return  0 on success; -ENOENT if not found; -EIO on I/O error.
+ */
+static int dir_remove_entry(fs_ctx *fs, a1fs_inode *dir, const char *name)
+{
+	int entry_count = dir->size / sizeof(a1fs_dentry);
+	int found = dir_find(fs, dir, name, NULL);
+	if (found < 0) {
+		return found;
+	}
+
+	int last = entry_count - 1;
+	if (found != last) {
+		//remove this entry, move last directory entry to this position.
+		a1fs_dentry *entries = file_block(fs, dir, last / DENTRIES_PER_BLOCK, false);
+		if (!entries) {
+			return -EIO;
+		}
+		a1fs_dentry lastdr = entries[last % DENTRIES_PER_BLOCK];
+		entries = file_block(fs, dir, found / DENTRIES_PER_BLOCK, true);
+		if (!entries) {
+			return -EIO;
+		}
+		entries[found % DENTRIES_PER_BLOCK] = lastdr;
+	}
+	dir->size -= sizeof(a1fs_dentry);
+	if (dir->size % A1FS_BLOCK_SIZE == 0) {
+		file_shrink(fs, dir, dir_blocks(dir));
+		if (dir->extent_count > 1) {
+			dir_mark_fragmented(fs, dir->ino_number);
+		}
+	}
+	clock_gettime(CLOCK_REALTIME, &dir->mtime);
+	fs_dirty(fs, dir, sizeof(*dir));
+	return 0;
+}
+
+/**
+ * Look up the inode of a path.
+ *
+ * @param path  absolute path to a file or directory.
+ * @return      inode number on success; -ENAMETOOLONG if the path is too long;
+ *              -ENOENT if a component of the path doesn't exist (or the path
+ *              isn't absolute); -ENOTDIR if a component of the path prefix is
+ *              not a directory.
+ */
+static int path_inode(fs_ctx *fs, const char *path){
+	if(path[0] != '/') {  
+        log_debug("Not an absolute path\n");  
+        return -ENOENT;  
+    }
+	if (strlen(path) >= A1FS_PATH_MAX) {
+		return -ENAMETOOLONG;
+	}
+	if (strcmp(path, "/") == 0) {
+		return 0;
+	}
+	a1fs_superblock *sb = fs->sb;
+	char path_cp[A1FS_PATH_MAX];
+    strcpy(path_cp, path);  
+    char* real_token =strtok(path_cp,"/");
+    a1fs_inode *root = get_inode(fs, 0);
+	log_debug("sb: %d, links: %d, extent%d\n", sb->start_inode, root->links, root->extent_count);
+
+    int result = root->extent_count;  
+    while (real_token != NULL){  
+		
+        result = dir_lookup(fs, root, real_token);
+		if (result < 0){
+			return result;
+		}
+        root = get_inode(fs, result);
+        real_token = strtok(NULL, "/");
+		if (real_token != NULL && (root->mode|0777) != (S_IFDIR|0777)){
+			return -ENOTDIR;
+		}
+    }
+    return result;
+}
+
+/**
+ * Split a path into its parent directory and last component.
+ *
+ * @param path  absolute path of a non-root file or directory.
+ * @param name  pointer to the variable that receives the last component
+ *              (points into path).
+ * @return      inode number of the parent directory; -errno on error.
+ */
+static int path_parent(fs_ctx *fs, const char *path, const char **name)
+{
+	const char *slash = strrchr(path, '/');
+	*name = slash + 1;
+	if (slash == path) {
+		return 0;
+	}
+	char parent_path[A1FS_PATH_MAX];
+	size_t len = slash - path;
+	memcpy(parent_path, path, len);
+	parent_path[len] = '\0';
+	return path_inode(fs, parent_path);
+}
+
+/**
+ * Look up the inode of a path that has to be of a given type.
+ *
+ * FUSE only calls an operation after checking the path with getattr(); the
+ * library API has no such check, so the operations do it here.
+ *
+ * @param path  absolute path to a file or directory.
+ * @param type  S_IFDIR for a directory, S_IFREG for a file, 0 for either.
+ * @return      inode number on success; -errno as for path_inode(), or
+ *              -ENOTDIR/-EISDIR if the path is not of the given type.
+ */
+static int path_lookup(fs_ctx *fs, const char *path, mode_t type)
+{
+	int ino = path_inode(fs, path);
+	if (ino < 0) {
+		return ino;
+	}
+	mode_t mode = get_inode(fs, ino)->mode;
+	if (type == S_IFDIR && !S_ISDIR(mode)) {
+		return -ENOTDIR;
+	}
+	if (type == S_IFREG && S_ISDIR(mode)) {
+		return -EISDIR;
+	}
+	return ino;
+}
+
+/**
+ * Look up the parent directory of a path that is about to be created.
+ *
+ * @param path  absolute path to the new file or directory.
+ * @param name  pointer to the variable that receives the last component
+ *              (points into path).
+ * @return      inode number of the parent directory on success; -errno as for
+ *              path_inode() on the parent; -ENOTDIR if the parent is not a
+ *              directory; -ENAMETOOLONG if the name is too long; -EEXIST if
+ *              the path already exists.
+ */
+static int path_new(fs_ctx *fs, const char *path, const char **name)
+{
+	if (path[0] != '/') {
+		return -ENOENT;
+	}
+	int ino = path_inode(fs, path);
+	if (ino >= 0 || is_stats_file(path)) {
+		return -EEXIST;
+	}
+	if (ino != -ENOENT) {
+		return ino;
+	}
+	int parent_ino = path_parent(fs, path, name);
+	if (parent_ino < 0) {
+		return parent_ino;
+	}
+	if (!S_ISDIR(get_inode(fs, parent_ino)->mode)) {
+		return -ENOTDIR;
+	}
+	if (strlen(*name) >= A1FS_NAME_MAX) {
+		return -ENAMETOOLONG;
+	}
+	return parent_ino;
+}
+
+/**
+ * Free an inode whose last directory entry has been removed, along with its
+ * data blocks and buffered data.
+ */
+static void inode_release(fs_ctx *fs, int ino)
+{
+	da_inode *di = da_find(&fs->da, ino, false);
+	if (di) {
+		da_remove(&fs->da, di);
+	}
+	file_shrink(fs, get_inode(fs, ino), 0);
+	free_inode(fs, ino);
+}
+
+/**
+ * Get file system statistics.
+ *
+ * Implements the statvfs() system call. See "man 2 statvfs" for details.
+ * The f_bfree and f_bavail fields should be set to the same value.
+ * The f_ffree and f_favail fields should be set to the same value.
+ * The following fields can be ignored: f_fsid, f_flag.
+ * All remaining fields are required.
+ *
+ * Errors: none
+ *
+ * @param fs    file system context.
+ * @param st    pointer to the struct statvfs that receives the result.
+ * @return      0 on success; -errno on error.
+ */
+static int a1fs_statfs(fs_ctx *fs, struct statvfs *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->f_bsize   = A1FS_BLOCK_SIZE;
+	st->f_frsize  = A1FS_BLOCK_SIZE;
+	a1fs_superblock *sb = fs->sb;
+	st->f_blocks = fs->size/A1FS_BLOCK_SIZE;
+	st->f_bfree = fs_avail_blocks(fs);
+	st->f_bavail = fs_avail_blocks(fs);
+	st->f_files = sb->inodes_count;
+	st->f_ffree = sb->free_inodes_count;
+	st->f_favail = sb->free_inodes_count;
+	st->f_namemax = A1FS_NAME_MAX;
+	return 0;
+}
+
+/**
+ * Get file or directory attributes.
+ *
+ * Implements the lstat() system call. See "man 2 lstat" for details.
+ * The following fields can be ignored: st_dev, st_ino, st_uid, st_gid, st_rdev,
+ *                                      st_blksize, st_atim, st_ctim.
+ * All remaining fields are required.
+ *
+ * NOTE: the st_blocks field is measured in 512-byte units (disk sectors);
+ *       it should include any metadata blocks that are allocated to the inode.
+ *
+ * NOTE: the st_mode field must be set correctly for files and directories.
+ *
+ * Errors:
+ *   ENAMETOOLONG  the path or one of its components is too long.
+ *   ENOENT        a component of the path does not exist.
+ *   ENOTDIR       a component of the path prefix is not a directory.
+ *
+ * @param fs    file system context.
+ * @param path  path to a file or directory.
+ * @param st    pointer to the struct stat that receives the result.
+ * @return      0 on success; -errno on error;
+ */
+static int a1fs_getattr(fs_ctx *fs, const char *path, struct stat *st)
+{
+	if (strlen(path) >= A1FS_PATH_MAX) {
+		return -ENAMETOOLONG;
+	}
+
+	memset(st, 0, sizeof(*st));
+	if (is_stats_file(path)) {
+		stats_file_getattr(fs, st);
+		return 0;
+	}
+
+	int inode = path_inode(fs, path);
+	if (inode == -ENOENT){
+		log_debug("ENOENT-------getattr(%s, %d, %p)\n", path, inode, (void *)st);
+
+		return -ENOENT;
+	}
+	if (inode < 0){
+		log_debug("ENOTDIR------getattr(%s, %d, %p)\n", path, inode, (void *)st);
+		return inode;
+	}
+	log_debug("--------getattr(%s, %d, %p)\n", path, inode, (void *)st);
+	a1fs_inode *found = get_inode(fs, inode);
+	st->st_ino = inode;
+	st->st_mode = found->mode;
+	st->st_nlink = found->links;
+	st->st_size = found->size;
+	da_inode *di = da_find(&fs->da, inode, false);
+	a1fs_blk_t blocks = file_blocks(fs, found) + (di ? di->reserved : 0);
+	st->st_blocks = blocks * A1FS_BLOCK_SIZE / 512;
+	st->st_mtim = found->mtime;
+	return 0;
+}
+
+/**
+ * Read a directory.
+ *
+ * Implements the readdir() system call. Should call filler(buf, name, NULL, 0)
+ * for each directory entry. See fuse.h in libfuse source code for details.
+ *
+ * Errors:
+ *   ENOENT   "path" does not exist.
+ *   ENOTDIR  "path" is not a directory.
+ *   ENOMEM   not enough memory (e.g. a filler() call failed).
+ *
+ * @param fs      file system context.
+ * @param path    path to the directory.
+ * @param buf     buffer that receives the result.
+ * @param filler  function that needs to be called for each directory entry.
+ *                Pass 0 as offset (4th argument). 3rd argument can be NULL.
+ * @param offset  unused.
+ * @return        0 on success; -errno on error.
+ */
+static int a1fs_readdir(fs_ctx *fs, const char *path, void *buf,
+                        fs_fill_dir_t filler, off_t offset)
+{
+	(void)offset;// unused
+
+	int dir_ino = path_lookup(fs, path, S_IFDIR);
+	if (dir_ino < 0) {
+		return dir_ino;
+	}
+	a1fs_inode *inode = get_inode(fs, dir_ino);
+	int entry_num = inode->size / sizeof(a1fs_dentry);
+	file_prefetch(fs, inode, 0, dir_blocks(inode));
+	for (int pos = 0; pos < entry_num; pos += DENTRIES_PER_BLOCK) {
+		a1fs_dentry *data_block = file_block(fs, inode, pos / DENTRIES_PER_BLOCK, false);
+		if (!data_block) {
+			return -EIO;
+		}
+		for (int x = 0; x < DENTRIES_PER_BLOCK && pos + x < entry_num; x++) {
+			if (filler(buf, data_block[x].name, NULL, 0) != 0) {
+				return -ENOMEM;
+			}
+		}
+	}
+	stats_add(&fs->stats.dentries_scanned, entry_num);
+	if (dir_ino == 0 && filler(buf, A1FS_STATS_FILE + 1, NULL, 0) != 0) {
+		return -ENOMEM;
+	}
+	log_debug("links:%d, space:%ld\n", inode->links, inode->size);  
+	return 0;
+}
+
+
+/**
+ * Create a directory.
+ *
+ * Implements the mkdir() system call.
+ *
+ * Errors:
+ *   EEXIST        "path" already exists.
+ *   ENOENT        the parent directory of "path" does not exist.
+ *   ENOTDIR       the parent of "path" is not a directory.
+ *   ENAMETOOLONG  "path" or its last component is too long.
+ *   ENOMEM        not enough memory (e.g. a malloc() call failed).
+ *   ENOSPC        not enough free space in the file system.
+ *
+ * @param fs    file system context.
+ * @param path  path to the directory to create.
+ * @param mode  file mode bits.
+ * @return      0 on success; -errno on error.
+ */
+static int a1fs_mkdir(fs_ctx *fs, const char *path, mode_t mode)
+{
+	mode = mode | S_IFDIR;
+	//find parent, then an empty inode near it
+	const char *new_dr;
+	int parent_ino = path_new(fs, path, &new_dr);
+	if (parent_ino < 0) {
+		return parent_ino;
+	}
+	if (fs_avail_blocks(fs) == 0) {
+		return -ENOSPC;
+	}
+	a1fs_inode *parent = get_inode(fs, parent_ino);
+	int free_inode_ind = alloc_inode(fs, parent_ino);
+	if (free_inode_ind < 0) {
+		return free_inode_ind;
+	}
+	//find empty data
+	a1fs_blk_t free_data_ind;
+	if (alloc_blocks(fs, fs->alloc_cursor, 1, &free_data_ind) == 0) {
+		free_inode(fs, free_inode_ind);
+		return -ENOSPC;
+	}
+	log_debug("free inode: %d, free data:%d\n", free_inode_ind, free_data_ind);
+	// create new directory
+	log_debug("mkdir: %s\n", new_dr);
+	a1fs_extent *new_extent = get_extents(fs, free_inode_ind);
+	*new_extent = (a1fs_extent){ .start = free_data_ind, .count = 1 };
+	fs_dirty(fs, new_extent, sizeof(*new_extent));
+
+	a1fs_inode *new_ino = get_inode(fs, free_inode_ind);
+	new_ino->mode = mode;
+	new_ino->links = 2;
+	new_ino->size = 512;
+	new_ino->ino_number = free_inode_ind;
+	new_ino->extent_count = 1;
+	clock_gettime(CLOCK_REALTIME, &new_ino->mtime);
+	fs_dirty(fs, new_ino, sizeof(*new_ino));
+	a1fs_dentry *new_entry = fs_data(fs, free_data_ind, true);
+	if (!new_entry) {
+		return -EIO;
+	}
+	new_entry[0].ino = free_inode_ind;
+	strcpy(new_entry[0].name, ".");
+	new_entry[1].ino = parent_ino;
+	strcpy(new_entry[1].name, "..");
+	//append new directory to end of parent, growing it if its last block is full
+	int ret = dir_add_entry(fs, parent, free_inode_ind, new_dr);
+	if (ret < 0) {
+		free_blocks(fs, free_data_ind, 1);
+		free_inode(fs, free_inode_ind);
+		return ret;
+	}
+	parent->links = (parent->links)+1;
+	fs_dirty(fs, parent, sizeof(*parent));
+	return 0;
+}
+
+/**
+ * Remove a directory.
+ *
+ * Implements the rmdir() system call.
+ *
+ * Errors:
+ *   ENOENT     "path" does not exist.
+ *   ENOTDIR    "path" is not a directory.
+ *   EBUSY      "path" is the root directory.
+ *   ENOTEMPTY  the directory is not empty.
+ *
+ * @param fs    file system context.
+ * @param path  path to the directory to remove.
+ * @return      0 on success; -errno on error.
+ */
+static int a1fs_rmdir(fs_ctx *fs, const char *path)
+{
+	int dr_ino = path_lookup(fs, path, S_IFDIR);
+	if (dr_ino < 0) {
+		return dr_ino;
+	}
+	if (dr_ino == 0) {
+		return -EBUSY;
+	}
+	a1fs_inode *current_ino = get_inode(fs, dr_ino);
+	if (current_ino->links != 2){
+		return -ENOTEMPTY;
+	}
+	//modify its parent
+	const char *new_dr;
+	int parent_ino = path_parent(fs, path, &new_dr);
+	a1fs_inode *parent = get_inode(fs, parent_ino);
+	int ret = dir_remove_entry(fs, parent, new_dr);
+	if (ret < 0) {
+		return ret;
+	}
+	parent->links--;
+	fs_dirty(fs, parent, sizeof(*parent));
+	// free its block and inode
+	inode_release(fs, dr_ino);
+	return 0;
+}
+
+
+/**
+ * Create a file.
+ *
+ * Implements the open()/creat() system call.
+ *
+ * Errors:
+ *   EEXIST        "path" already exists.
+ *   ENOENT        the parent directory of "path" does not exist.
+ *   ENOTDIR       the parent of "path" is not a directory.
+ *   ENAMETOOLONG  "path" or its last component is too long.
+ *   ENOMEM        not enough memory (e.g. a malloc() call failed).
+ *   ENOSPC        not enough free space in the file system.
+ *
+ * @param fs    file system context.
+ * @param path  path to the file to create.
+ * @param mode  file mode bits.
+ * @param fh    receives the open file handle.
+ * @return      0 on success; -errno on error.
+ */
+static int a1fs_create(fs_ctx *fs, const char *path, mode_t mode, uint64_t *fh)
+{
+	assert(S_ISREG(mode));
+	//find parent, then an empty inode near it
+	const char *new_dr;
+	int parent_ino = path_new(fs, path, &new_dr);
+	if (parent_ino < 0) {
+		return parent_ino;
+	}
+	a1fs_inode *parent = get_inode(fs, parent_ino);
+	int free_inode_ind = alloc_inode(fs, parent_ino);
+	if (free_inode_ind < 0) {
+		return free_inode_ind;
+	}
+	// create new file
+	log_debug("create: %s\n", new_dr);
+	int ret = dir_add_entry(fs, parent, free_inode_ind, new_dr);
+	if (ret < 0) {
+		free_inode(fs, free_inode_ind);
+		return ret;
+	}
+	parent->links = (parent->links)+1;
+	fs_dirty(fs, parent, sizeof(*parent));
+
+	a1fs_inode *new_ino = get_inode(fs, free_inode_ind);
+	new_ino->mode = mode;
+	new_ino->links = 1;
+	new_ino->size = 0;
+	new_ino->ino_number = free_inode_ind;
+	new_ino->extent_count = 0;
+	clock_gettime(CLOCK_REALTIME, &new_ino->mtime);
+	fs_dirty(fs, new_ino, sizeof(*new_ino));
+	return file_open(fs, fh);
+}
+
+/**
+ * Remove a file.
+ *
+ * Implements the unlink() system call.
+ *
+ * Errors:
+ *   ENOENT  "path" does not exist.
+ *   EISDIR  "path" is a directory.
+ *
+ * @param fs    file system context.
+ * @param path  path to the file to remove.
+ * @return      0 on success; -errno on error.
+ */
+static int a1fs_unlink(fs_ctx *fs, const char *path)
+{
+	if (is_stats_file(path)) {
+		return -EPERM;
+	}
+
+	int file_ino = path_lookup(fs, path, S_IFREG);
+	if (file_ino < 0) {
+		return file_ino;
+	}
+	//modify its parent
+	const char *new_dr;
+	int parent_ino = path_parent(fs, path, &new_dr);
+	a1fs_inode *parent = get_inode(fs, parent_ino);
+	int ret = dir_remove_entry(fs, parent, new_dr);
+	if (ret < 0) {
+		return ret;
+	}
+	parent->links--;
+	fs_dirty(fs, parent, sizeof(*parent));
+	// update data bitmap to 0 of file location; buffered data is dropped
+	inode_release(fs, file_ino);
+	return 0; 
+}
+
+
+/**
+ * Rename a file or directory.
+ *
+ * Implements the rename() system call. Only the directory entries are
+ * changed; the data stays where it is. If "to" exists, it is replaced
+ * atomically: its entry is pointed to the renamed inode, and the replaced
+ * inode is released.
+ *
+ * Errors:
+ *   ENOENT        "from" or the parent directory of "to" does not exist.
+ *   ENOTDIR       the parent of "to" is not a directory.
+ *   EBUSY         "from" or "to" is the root directory.
+ *   EINVAL        "from" is a directory and "to" is inside it.
+ *   EISDIR        "to" is a directory and "from" is not.
+ *   ENOTDIR       "from" is a directory and "to" is not.
+ *   ENOTEMPTY     "to" is a non-empty directory.
+ *   ENAMETOOLONG  "to" or its last component is too long.
+ *   ENOSPC        not enough free space in the file system.
+ *
+ * @param fs    file system context.
+ * @param from  path to the file or directory to rename.
+ * @param to    new path.
+ * @return      0 on success; -errno on error.
+ */
+static int a1fs_rename(fs_ctx *fs, const char *from, const char *to)
+{
+	if (strcmp(from, to) == 0) {
+		return 0;
+	}
+	if (is_stats_file(from) || is_stats_file(to)) {
+		return -EPERM;
+	}
+	int ino = path_inode(fs, from);
+	if (ino < 0) {
+		return ino;
+	}
+	if (ino == 0 || strcmp(to, "/") == 0) {
+		return -EBUSY;
+	}
+	if (to[0] != '/') {
+		return -ENOENT;
+	}
+	if (strlen(to) >= A1FS_PATH_MAX) {
+		return -ENAMETOOLONG;
+	}
+	a1fs_inode *inode = get_inode(fs, ino);
+	bool is_dir = S_ISDIR(inode->mode);
+	size_t len = strlen(from);
+	if (is_dir && strncmp(to, from, len) == 0 && to[len] == '/') {
+		return -EINVAL;
+	}
+
+	const char *from_name, *to_name;
+	int from_pino = path_parent(fs, from, &from_name);
+	int to_pino = path_parent(fs, to, &to_name);
+	if (from_pino < 0 || to_pino < 0) {
+		return from_pino < 0 ? from_pino : to_pino;
+	}
+	if (strlen(to_name) >= A1FS_NAME_MAX) {
+		return -ENAMETOOLONG;
+	}
+	a1fs_inode *to_parent = get_inode(fs, to_pino);
+	if (!S_ISDIR(to_parent->mode)) {
+		return -ENOTDIR;
+	}
+	int target = dir_lookup(fs, to_parent, to_name);
+	if (target < 0 && target != -ENOENT) {
+		return target;
+	}
+	if (target == ino) {
+		return 0;
+	}
+
+	int ret;
+	if (target >= 0) {
+		a1fs_inode *old = get_inode(fs, target);
+		if (is_dir != S_ISDIR(old->mode)) {
+			return is_dir ? -ENOTDIR : -EISDIR;
+		}
+		if (is_dir && old->links != 2) {
+			return -ENOTEMPTY;
+		}
+		// The entry now refers to the renamed inode; the old one is gone
+		ret = dir_set_entry(fs, to_parent, to_name, ino);
+		if (ret < 0) {
+			return ret;
+		}
+		inode_release(fs, target);
+	} else {
+		ret = dir_add_entry(fs, to_parent, ino, to_name);
+		if (ret < 0) {
+			return ret;
+		}
+		to_parent->links++;
+		fs_dirty(fs, to_parent, sizeof(*to_parent));
+	}
+
+	a1fs_inode *from_parent = get_inode(fs, from_pino);
+	ret = dir_remove_entry(fs, from_parent, from_name);
+	if (ret < 0) {
+		return ret;
+	}
+	from_parent->links--;
+	fs_dirty(fs, from_parent, sizeof(*from_parent));
+	if (is_dir && from_pino != to_pino) {
+		return dir_set_entry(fs, inode, "..", to_pino);
+	}
+	return 0;
+}
+
+
+/**
+ * Change the modification time of a file or directory.
+ *
+ * Implements the utimensat() system call. See "man 2 utimensat" for details.
+ *
+ * NOTE: You only need to implement the setting of modification time (mtime).
+ *       Timestamp modifications are not recursive. 
+ *
+ * Errors:
+ *   ENOENT  "path" does not exist.
+ *
+ * @param fs     file system context.
+ * @param path   path to the file or directory.
+ * @param times  timestamps array. See "man 2 utimensat" for details.
+ * @return       0 on success; -errno on failure.
+ */
+static int a1fs_utimens(fs_ctx *fs, const char *path,
+                        const struct timespec times[2])
+{
+	if (is_stats_file(path)) {
+		return 0;
+	}
+
+	int current_ino = path_inode(fs, path);
+	if (current_ino < 0) {
+		return current_ino;
+	}
+	a1fs_inode *current = get_inode(fs, current_ino);
+	if (times == NULL || times[1].tv_nsec == UTIME_NOW){
+		clock_gettime(CLOCK_REALTIME, &current->mtime);
+	}else if (times[1].tv_nsec != UTIME_OMIT){
+		current->mtime = times[1];
+	}
+	fs_dirty(fs, current, sizeof(*current));
+	return 0;
+}
+
+/**
+ * Change the size of a file.
+ *
+ * Implements the truncate() system call. Supports both extending and shrinking.
+ * If the file is extended, the new uninitialized range at the end must be
+ * filled with zeros.
+ *
+ * Errors:
+ *   ENOENT  "path" does not exist.
+ *   EISDIR  "path" is a directory.
+ *   ENOMEM  not enough memory (e.g. a malloc() call failed).
+ *   ENOSPC  not enough free space in the file system.
+ *
+ * @param fs    file system context.
+ * @param path  path to the file to set the size.
+ * @param size  new file size in bytes.
+ * @return      0 on success; -errno on error.
+ */
+static int a1fs_truncate(fs_ctx *fs, const char *path, off_t size)
+{
+	if (is_stats_file(path)) {
+		stats_reset(&fs->stats);
+		return 0;
+	}
+	int inode_num= path_lookup(fs, path, S_IFREG);
+	if (inode_num < 0) {
+		return inode_num;
+	}
+	a1fs_inode *inode = get_inode(fs, inode_num);
+	// the buffered data has to be in place before the blocks can be resized
+	int ret = file_flush(fs, inode);
+	if (ret < 0) {
+		return ret;
+	}
+	return file_resize(fs, inode, size);
+}
+
+
+/**
+ * Open a file.
+ *
+ * Implements the open() system call. Sets up the per-open-file state (e.g.
+ * readahead) that is released in a1fs_release().
+ *
+ * Errors:
+ *   ENOENT  "path" does not exist.
+ *   EISDIR  "path" is a directory.
+ *   ENOMEM  not enough memory.
+ *
+ * @param fs    file system context.
+ * @param path  path to the file to open.
+ * @param fh    receives the open file handle.
+ * @return      0 on success; -errno on error.
+ */
+static int a1fs_open(fs_ctx *fs, const char *path, uint64_t *fh)
+{
+	if (is_stats_file(path)) {
+		return stats_file_open(fs, fh);
+	}
+	int ino = path_lookup(fs, path, S_IFREG);
+	if (ino < 0) {
+		return ino;
+	}
+	return file_open(fs, fh);
+}
+
+/**
+ * Read data from a file.
+ *
+ * Implements the pread() system call. Must return exactly the number of bytes
+ * requested except on EOF (end of file). Reads from file ranges that have not
+ * been written to must return ranges filled with zeros. You can assume that the
+ * byte range from offset to offset + size is contained within a single block.
+ *
+ * Errors:
+ *   ENOENT  "path" does not exist.
+ *   EISDIR  "path" is a directory.
+ *
+ * @param fs      file system context.
+ * @param path    path to the file to read from.
+ * @param buf     pointer to the buffer that receives the data.
+ * @param size    buffer size (number of bytes requested).
+ * @param offset  offset from the beginning of the file to read from.
+ * @param fh      open file handle; 0 if none.
+ * @return        number of bytes read on success; 0 if offset is beyond EOF;
+ *                -errno on error.
+ */
+static int a1fs_read(fs_ctx *fs, const char *path, char *buf, size_t size,
+                     off_t offset, uint64_t fh)
+{
+	if (is_stats_file(path)) {
+		return stats_file_read(fs, buf, size, offset, fh);
+	}
+
+	int file_ind = path_lookup(fs, path, S_IFREG);
+	if (file_ind < 0) {
+		return file_ind;
+	}
+	a1fs_inode *file_ino = get_inode(fs, file_ind);
+	if ((uint64_t)offset >= file_ino->size) {
+		return 0;
+	}
+	if (offset + size > file_ino->size) {
+		size = file_ino->size - offset;
+	}
+	// start reading the blocks ahead of a sequential reader
+	a1fs_file *file = get_file(fh);
+	a1fs_blk_t ra_start, ra_count;
+	if (file && ra_access(&file->ra, offset / A1FS_BLOCK_SIZE,
+	                      file_end(fs, file_ino), &ra_start, &ra_count))
+	{
+		file_prefetch(fs, file_ino, ra_start, ra_count);
+	}
+	// find block where offset locate.
+	a1fs_blk_t lblk = offset / A1FS_BLOCK_SIZE;
+	const unsigned char *data;
+	if (file_bmap(fs, file_ino, lblk) >= 0) {
+		data = file_block(fs, file_ino, lblk, false);
+		if (!data) {
+			return -EIO;
+		}
+	} else {
+		// no data block: buffered, a hole, or unwritten (zeros)
+		da_inode *di = da_find(&fs->da, file_ind, false);
+		data = di ? da_block_get(&fs->da, di, lblk, false) : NULL;
+		if (!data) {
+			memset(buf, 0, size);
+			stats_add(&fs->stats.bytes_read, size);
+			return size;
+		}
+	}
+	memcpy(buf, data + offset % A1FS_BLOCK_SIZE, size);
+	stats_add(&fs->stats.bytes_read, size);
+	return size;
+}
+
+/**
+ * Write data to a file.
+ *
+ * Implements the pwrite() system call. Must return exactly the number of bytes
+ * requested except on error. If the offset is beyond EOF (end of file), the
+ * file must be extended. If the write creates a "hole" of uninitialized data,
+ * the new uninitialized range must filled with zeros. You can assume that the
+ * byte range from offset to offset + size is contained within a single block.
+ *
+ * Errors:
+ *   ENOENT  "path" does not exist.
+ *   EISDIR  "path" is a directory.
+ *   ENOMEM  not enough memory (e.g. a malloc() call failed).
+ *   ENOSPC  not enough free space in the file system.
+ *   ENOSPC  too many extents (a1fs only needs to support 512 extents per file)
+ *
+ * Blocks past the allocated ones are not allocated here: the data is buffered
+ * in memory until the file is flushed (see file_flush()).
+ *
+ * @param fs      file system context.
+ * @param path    path to the file to write to.
+ * @param buf     pointer to the buffer containing the data.
+ * @param size    buffer size (number of bytes requested).
+ * @param offset  offset from the beginning of the file to write to.
+ * @return        number of bytes written on success; -errno on error.
+ */
+static int a1fs_write(fs_ctx *fs, const char *path, const char *buf,
+                      size_t size, off_t offset)
+{
+	if (is_stats_file(path)) {
+		stats_reset(&fs->stats);
+		return size;
+	}
+	int inode_num= path_lookup(fs, path, S_IFREG);
+	if (inode_num < 0) {
+		return inode_num;
+	}
+	a1fs_inode *inode = get_inode(fs, inode_num);
+
+	// extend the file if writing past the end; blocks are allocated later
+	uint64_t old_size = inode->size;
+	if (offset + size > inode->size) {
+		int ret = file_grow(fs, inode, offset + size);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	a1fs_blk_t lblk = offset / A1FS_BLOCK_SIZE;
+	unsigned char *data;
+	int ret;
+	if (lblk < file_end(fs, inode)) {
+		ret = file_write_block(fs, inode, lblk, &data);
+	} else {
+		ret = file_buffer_block(fs, inode, lblk, &data);
+	}
+	if (ret < 0) {
+		// A failed write doesn't extend the file; the zeroed tail of the
+		// last block is past the old end and can stay as is
+		if (inode->size != old_size) {
+			inode->size = old_size;
+			fs_dirty(fs, inode, sizeof(*inode));
+		}
+		return ret;
+	}
+	memcpy(data + offset % A1FS_BLOCK_SIZE, buf, size);
+	clock_gettime(CLOCK_REALTIME, &inode->mtime);
+	fs_dirty(fs, inode, sizeof(*inode));
+	flush_pressure(fs);
+	stats_add(&fs->stats.bytes_written, size);
+	return size;
+}
+
+/**
+ * Release an open file.
+ *
+ * Called when the last file descriptor referring to an open file is closed.
+ * Allocates blocks for and writes out the file data buffered so far.
+ *
+ * @param fs    file system context.
+ * @param path  path to the file.
+ * @param fh    open file handle.
+ * @return      0.
+ */
+static int a1fs_release(fs_ctx *fs, const char *path, uint64_t fh)
+{
+	int ino = path_inode(fs, path);
+	if (ino >= 0 && !fs_readonly(fs)) {
+		file_flush(fs, get_inode(fs, ino));
+	}
+	file_close(fh);
+	return 0;
+}
+
+/**
+ * Synchronize the contents of a file with the image.
+ *
+ * Implements the fsync() system call. Allocates blocks for and writes out the
+ * buffered data of the file, then writes all modified blocks back to the
+ * image file.
+ *
+ * Errors:
+ *   EIO     I/O error.
+ *   ENOSPC  too many extents.
+ *
+ * @param fs        file system context.
+ * @param path      path to the file.
+ * @param datasync  unused.
+ * @return          0 on success; -errno on error.
+ */
+static int a1fs_fsync(fs_ctx *fs, const char *path, int datasync)
+{
+	(void)datasync;// unused
+	if (is_stats_file(path)) {
+		return 0;
+	}
+	int ino = path_inode(fs, path);
+	if (ino < 0) {
+		return ino;
+	}
+	int ret = file_flush(fs, get_inode(fs, ino));
+	if (ret < 0) {
+		return ret;
+	}
+	return fs_sync(fs) < 0 ? -EIO : 0;
+}
+
+/**
+ * Allocate or deallocate space for a range of a file.
+ *
+ * Implements the fallocate() system call. Supported modes are the default
+ * mode, FALLOC_FL_KEEP_SIZE, and FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE.
+ * Allocated blocks are marked unwritten and read as zeros without being
+ * initialized, so preallocating any amount of space only updates metadata.
+ *
+ * Errors:
+ *   ENOENT      "path" does not exist.
+ *   EISDIR      "path" is a directory.
+ *   EINVAL      invalid offset or length.
+ *   EOPNOTSUPP  unsupported mode.
+ *   ENOSPC      not enough free space in the file system.
+ *   ENOSPC      too many extents.
+ *   EIO         I/O error.
+ *
+ * @param fs      file system context.
+ * @param path    path to the file.
+ * @param mode    FALLOC_FL_* flags.
+ * @param offset  offset of the range in bytes.
+ * @param length  length of the range in bytes.
+ * @return        0 on success; -errno on error.
+ */
+static int a1fs_fallocate(fs_ctx *fs, const char *path, int mode,
+                          off_t offset, off_t length)
+{
+	if (offset < 0 || length <= 0) {
+		return -EINVAL;
+	}
+	if (mode != 0 && mode != FALLOC_FL_KEEP_SIZE &&
+	    mode != (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE))
+	{
+		return -EOPNOTSUPP;
+	}
+	if (is_stats_file(path)) {
+		return -EOPNOTSUPP;
+	}
+	int ino = path_lookup(fs, path, S_IFREG);
+	if (ino < 0) {
+		return ino;
+	}
+	a1fs_inode *inode = get_inode(fs, ino);
+	// the buffered data has to be in place before the extents are changed
+	int ret = file_flush(fs, inode);
+	if (ret < 0) {
+		return ret;
+	}
+
+	uint64_t end = (uint64_t)offset + length;
+	if (mode & FALLOC_FL_PUNCH_HOLE) {
+		ret = file_punch(fs, inode, offset, length);
+	} else {
+		a1fs_blk_t first = offset / A1FS_BLOCK_SIZE;
+		a1fs_blk_t last = (end + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE;
+		ret = file_prealloc(fs, inode, first, last - first);
+		if (ret == 0 && !(mode & FALLOC_FL_KEEP_SIZE) && end > inode->size) {
+			ret = file_grow(fs, inode, end);
+		}
+	}
+	if (ret < 0) {
+		return ret;
+	}
+	clock_gettime(CLOCK_REALTIME, &inode->mtime);
+	fs_dirty(fs, inode, sizeof(*inode));
+	return 0;
+}
+
+/** Handle an A1FS_IOC_CLONE_RANGE request on dst. */
+static int clone_range(fs_ctx *fs, a1fs_inode *dst, a1fs_clone_range *req)
+{
+	if (!fs->refcount) {
+		return -EOPNOTSUPP;
+	}
+	req->src_path[sizeof(req->src_path) - 1] = '\0';
+	if (req->src_path[0] != '/') {
+		return -EINVAL;
+	}
+	int ino = path_inode(fs, req->src_path);
+	if (ino < 0) {
+		return ino;
+	}
+	a1fs_inode *src = get_inode(fs, ino);
+	if (S_ISDIR(src->mode) || S_ISDIR(dst->mode)) {
+		return -EISDIR;
+	}
+
+	uint64_t length = req->length;
+	if (req->src_offset < 0 || req->length < 0 || req->dest_offset < 0 ||
+	    (uint64_t)req->src_offset > src->size)
+	{
+		return -EINVAL;
+	}
+	if (length == 0) {
+		length = src->size - req->src_offset;
+	}
+	uint64_t src_end = req->src_offset + length;
+	uint64_t dest_end = req->dest_offset + length;
+	if (src_end > src->size || req->src_offset % A1FS_BLOCK_SIZE != 0 ||
+	    req->dest_offset % A1FS_BLOCK_SIZE != 0 ||
+	    (length % A1FS_BLOCK_SIZE != 0 &&
+	     (src_end != src->size || dest_end < dst->size)))
+	{
+		return -EINVAL;
+	}
+	if (length == 0) {
+		return 0;
+	}
+
+	int ret = file_flush(fs, src);
+	if (ret == 0) {
+		ret = file_flush(fs, dst);
+	}
+	if (ret == 0 && dest_end > dst->size) {
+		// What was past the end of file must read as zeros once inside
+		ret = file_zero_tail(fs, dst);
+	}
+	if (ret == 0) {
+		ret = file_clone(fs, src, dst, req->src_offset / A1FS_BLOCK_SIZE,
+		                 req->dest_offset / A1FS_BLOCK_SIZE,
+		                 (length + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE);
+	}
+	if (ret < 0) {
+		return ret;
+	}
+	if (dest_end > dst->size) {
+		dst->size = dest_end;
+	}
+	clock_gettime(CLOCK_REALTIME, &dst->mtime);
+	fs_dirty(fs, dst, sizeof(*dst));
+	return 0;
+}
+
+/**
+ * Grow the file system to the given number of data blocks.
+ *
+ * The image file is extended first, so if anything fails the file system is
+ * left as it was (possibly in a larger file).
+ *
+ * Errors:
+ *   EINVAL  fewer blocks than the file system has.
+ *   EFBIG   more blocks than the data bitmap has room for.
+ *   ENOMEM  not enough memory for the dedup index.
+ *   EIO     the image file can't be extended.
+ *
+ * @param fs      file system context.
+ * @param blocks  new number of data blocks.
+ * @return        0 on success; -errno on error.
+ */
+static int grow_fs(fs_ctx *fs, size_t blocks)
+{
+	a1fs_superblock *sb = fs->sb;
+	if (blocks < sb->blocks_count) {
+		return -EINVAL;
+	}
+	if (blocks > grow_limit(sb)) {
+		return -EFBIG;
+	}
+	if (blocks == sb->blocks_count) {
+		return 0;
+	}
+	if (fs->dd.table && !dd_grow(&fs->dd, blocks)) {
+		return -ENOMEM;
+	}
+	size_t size = ((size_t)sb->start_data + blocks) * A1FS_BLOCK_SIZE;
+	if (storage_grow(fs->st, size) < 0) {
+		log_error("Failed to extend the image to %zu bytes\n", size);
+		return -EIO;
+	}
+
+	// The bits and reference counts past the old end should be clear
+	// already; clearing them makes sure that the new blocks start out free
+	a1fs_blk_t old = sb->blocks_count;
+	size_t added = blocks - old;
+	bitmap_clear_range(fs->data_map, old, added);
+	fs_dirty(fs, fs->data_map + old / 8, (blocks + 7) / 8 - old / 8);
+	if (fs->refcount) {
+		memset(fs->refcount + old, 0, added * sizeof(uint16_t));
+		fs_dirty(fs, fs->refcount + old, added * sizeof(uint16_t));
+	}
+
+	fs->size = size;
+	sb->size = size;
+	sb->blocks_count = blocks;
+	sb->free_blocks_count += added;
+	fs_dirty(fs, sb, sizeof(*sb));
+	log_info("Grown to %zu data blocks (%zu MiB)\n", blocks, size >> 20);
+	return 0;
+}
+
+/** Handle an A1FS_IOC_RESIZE request. */
+static int resize(fs_ctx *fs, a1fs_resize *req)
+{
+	a1fs_superblock *sb = fs->sb;
+	if (req->size != 0) {
+		if (fs_readonly(fs)) {
+			return -EROFS;
+		}
+		size_t nblocks = req->size / A1FS_BLOCK_SIZE;
+		if (nblocks < (size_t)sb->start_data) {
+			return -EINVAL;
+		}
+		int ret = grow_fs(fs, nblocks - sb->start_data);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	req->size = ((uint64_t)sb->start_data + sb->blocks_count) * A1FS_BLOCK_SIZE;
+	req->max_size = ((uint64_t)sb->start_data + grow_limit(sb)) *
+	                A1FS_BLOCK_SIZE;
+	req->blocks = sb->blocks_count;
+	req->free_blocks = fs_avail_blocks(fs);
+	return 0;
+}
+
+/**
+ * Perform an a1fs specific request on a file.
+ *
+ * Implements the ioctl() system call for the requests in a1fs_ioctl.h.
+ *
+ * Errors:
+ * Only the requests that modify the file system (clone, defrag and dedup that
+ * are not dry runs, and growing the image) fail once it has gone read-only
+ * after finding corrupted metadata; the others can't write out the buffered
+ * data of the file first then, and work on the extents as they are.
+ *
+ * Errors:
+ *   ENOENT      "path" does not exist.
+ *   EROFS       the request modifies the file system, which is read-only.
+ *   ENOTTY      unknown request.
+ *   EINVAL      invalid request argument.
+ *   ENXIO       no data or hole found (A1FS_IOC_SEEK).
+ *   EISDIR      source is a directory (A1FS_IOC_CLONE_RANGE), or the file is
+ *               a directory (A1FS_IOC_DEDUP).
+ *   EFBIG       the image can't grow that large (A1FS_IOC_RESIZE).
+ *   EBUSY       the file shares blocks with other files (A1FS_IOC_DEFRAG).
+ *   EOPNOTSUPP  block sharing is not enabled (A1FS_IOC_CLONE_RANGE,
+ *               A1FS_IOC_DEDUP).
+ *   EMLINK      a block has too many references (A1FS_IOC_CLONE_RANGE).
+ *   ENOMEM      not enough memory for the dedup index (A1FS_IOC_DEDUP,
+ *               A1FS_IOC_RESIZE).
+ *   ENOSPC      too many extents, or no free run large enough
+ *               (A1FS_IOC_DEFRAG).
+ *   EIO         I/O error.
+ *
+ * @param fs     file system context.
+ * @param path   path to the file.
+ * @param cmd    request code.
+ * @param data   request argument, read and updated in place.
+ * @return       0 on success; -errno on error.
+ */
+static int a1fs_ioctl(fs_ctx *fs, const char *path, int cmd, void *data)
+{
+	if (is_stats_file(path)) {
+		return -ENOTTY;
+	}
+	int ino = path_inode(fs, path);
+	if (ino < 0) {
+		return ino;
+	}
+	a1fs_inode *inode = get_inode(fs, ino);
+	bool readonly = fs_readonly(fs);
+
+	switch ((unsigned int)cmd) {
+	case A1FS_IOC_SEEK: {
+		a1fs_seek *seek = data;
+		if (seek->offset < 0 || seek->pad != 0 ||
+		    (seek->whence != SEEK_DATA && seek->whence != SEEK_HOLE))
+		{
+			return -EINVAL;
+		}
+		// buffered blocks are data, so they have to be in the extents
+		int ret = readonly ? 0 : file_flush(fs, inode);
+		if (ret < 0) {
+			return ret;
+		}
+		int64_t off = file_seek(fs, inode, seek->offset, seek->whence);
+		if (off < 0) {
+			return off;
+		}
+		seek->offset = off;
+		return 0;
+	}
+	case A1FS_IOC_CLONE_RANGE:
+		if (readonly) {
+			return -EROFS;
+		}
+		return clone_range(fs, inode, data);
+	case A1FS_IOC_DEFRAG: {
+		a1fs_defrag *req = data;
+		if ((req->flags & ~A1FS_DEFRAG_DRY_RUN) != 0 || req->pad != 0) {
+			return -EINVAL;
+		}
+		if (readonly && !(req->flags & A1FS_DEFRAG_DRY_RUN)) {
+			return -EROFS;
+		}
+		int ret = readonly ? 0 : file_flush(fs, inode);
+		if (ret < 0) {
+			return ret;
+		}
+		req->extents_before = inode->extent_count;
+		req->runs_before = file_runs(fs, inode);
+		if (!(req->flags & A1FS_DEFRAG_DRY_RUN)) {
+			ret = file_defrag(fs, inode);
+			if (ret < 0) {
+				return ret;
+			}
+		}
+		req->extents_after = inode->extent_count;
+		req->runs_after = file_runs(fs, inode);
+		return 0;
+	}
+	case A1FS_IOC_DEDUP: {
+		a1fs_dedup *req = data;
+		if ((req->flags & ~A1FS_DEDUP_DRY_RUN) != 0 || req->pad != 0) {
+			return -EINVAL;
+		}
+		if (S_ISDIR(inode->mode)) {
+			return -EISDIR;
+		}
+		if (!fs->refcount) {
+			return -EOPNOTSUPP;
+		}
+		if (readonly && !(req->flags & A1FS_DEDUP_DRY_RUN)) {
+			return -EROFS;
+		}
+		if (!fs->dd.table &&
+		    !dd_init(&fs->dd, fs->dedup_index, fs->sb->blocks_count))
+		{
+			return -ENOMEM;
+		}
+		int ret = readonly ? 0 : file_flush(fs, inode);
+		if (ret == 0) {
+			ret = file_dedup(fs, inode, req->flags & A1FS_DEDUP_DRY_RUN,
+			                 &req->scanned, &req->shared);
+		}
+		req->index_entries = fs->dd.entries;
+		req->index_capacity = fs->dd.capacity;
+		req->index_memory = dd_memory(&fs->dd);
+		return ret;
+	}
+	case A1FS_IOC_RESIZE:
+		return resize(fs, data);
+	default:
+		return -ENOTTY;
+	}
+}
+
+/**
+ * Look up a file or directory.
+ *
+ * Errors:
+ *   ENAMETOOLONG  the path or one of its components is too long.
+ *   ENOENT        a component of the path does not exist.
+ *   ENOTDIR       a component of the path prefix is not a directory.
+ *
+ * @param fs    file system context.
+ * @param path  path to a file or directory.
+ * @return      inode number on success; -errno on error.
+ */
+static int a1fs_lookup(fs_ctx *fs, const char *path)
+{
+	if (strlen(path) >= A1FS_PATH_MAX) {
+		return -ENAMETOOLONG;
+	}
+	return path_inode(fs, path);
+}
+
+void fs_start(fs_ctx *fs)
+{
+	start_flusher(fs);
+	if (fs->discard) {
+		start_discarder(fs);
+	}
+	trace_start(&fs->trace);
+}
+
+
+/** Arguments of an operation that are recorded in the trace. */
+typedef struct op_trace {
+	/** Path; NULL if none. */
+	const char *path;
+	/** Second path (rename target); NULL if none. */
+	const char *path2;
+	/** See a1fs_trace_rec. */
+	uint64_t offset;
+	uint64_t size;
+	uint32_t arg;
+	/** Open file handle, read after the operation; NULL if none. */
+	const uint64_t *fh;
+
+} op_trace;
+
+/** Initializer of an op_trace from the arguments in the LOCKED_OP macros. */
+#define OP_TRACE(path, path2, offset, size, arg, fh) \
+	{ path, path2, offset, size, arg, fh }
+
+/** Look up the inode of a traced path; -1 if none. */
+static int trace_inode(fs_ctx *fs, const char *path)
+{
+	if (!path || strlen(path) >= A1FS_PATH_MAX || is_stats_file(path)) {
+		return -1;
+	}
+	int ino = path_inode(fs, path);
+	return ino < 0 ? -1 : ino;
+}
+
+/**
+ * Get the inode number of the file an operation is about to work on, if it
+ * is being traced.
+ *
+ * @return  inode number; -1 if not tracing or the file doesn't exist (yet).
+ */
+static int trace_begin(fs_ctx *fs, const op_trace *tr)
+{
+	return trace_enabled(&fs->trace) ? trace_inode(fs, tr->path) : -1;
+}
+
+/**
+ * Record an operation in the trace, if enabled.
+ *
+ * @param fs     file system context.
+ * @param tr     operation arguments.
+ * @param op     operation.
+ * @param start  time the operation was called at (stats_now()).
+ * @param ino    inode number returned by trace_begin().
+ * @param ret    operation return value.
+ */
+static void trace_end(fs_ctx *fs, const op_trace *tr, stats_op op,
+                      uint64_t start, int ino, int ret)
+{
+	if (!trace_enabled(&fs->trace)) {
+		return;
+	}
+	if (ino < 0 && ret >= 0) {
+		// Created by the operation
+		ino = trace_inode(fs, tr->path);
+	}
+	a1fs_trace_rec rec = {
+		.start     = start - fs->trace.start,
+		.end       = stats_now() - fs->trace.start,
+		.offset    = tr->offset,
+		.size      = tr->size,
+		.fh        = tr->fh ? *tr->fh : 0,
+		.ino       = ino,
+		.ret       = ret,
+		.arg       = tr->arg,
+		.op        = op,
+		.path_len  = tr->path ? strnlen(tr->path, A1FS_PATH_MAX - 1) : 0,
+		.path2_len = tr->path2 ? strnlen(tr->path2, A1FS_PATH_MAX - 1) : 0,
+	};
+	trace_record(&fs->trace, &rec, tr->path, tr->path2);
+}
+
+/**
+ * Define the public fs_<name>() operation that runs a1fs_<name>() with the
+ * file system lock held, so that it doesn't race with the background threads.
+ *
+ * If the operation used a metadata block that turned out to be corrupted, it
+ * fails with EIO, whatever the callback returned. The call is counted in the
+ * file system statistics; its latency includes waiting for the lock. If
+ * tracing, the call is recorded with the arguments in targs (see OP_TRACE).
+ */
+#define LOCKED_OP(name, params, args, targs)       \
+	int fs_##name params                           \
+	{                                              \
+		uint64_t start = stats_now();              \
+		op_trace tr = OP_TRACE targs;              \
+		pthread_mutex_lock(&fs->lock);             \
+		fs->last_op = time(NULL);                  \
+		fs->op_seq++;                              \
+		int ino = trace_begin(fs, &tr);            \
+		uint64_t failures = fs->csum.failures;     \
+		int ret = a1fs_##name args;                \
+		if (fs->csum.failures != failures) {       \
+			ret = -EIO;                            \
+		}                                          \
+		trace_end(fs, &tr, STATS_OP_##name,        \
+		          start, ino, ret);                \
+		pthread_mutex_unlock(&fs->lock);           \
+		stats_op_done(&fs->stats, STATS_OP_##name, \
+		              start, ret);                 \
+		return ret;                                \
+	}
+
+/**
+ * Define an operation like LOCKED_OP for a callback that may modify the file
+ * system; it fails with EROFS once corrupted metadata has been found.
+ */
+#define LOCKED_WRITE_OP(name, params, args, targs) \
+	int fs_##name params                           \
+	{                                              \
+		uint64_t start = stats_now();              \
+		op_trace tr = OP_TRACE targs;              \
+		pthread_mutex_lock(&fs->lock);             \
+		fs->last_op = time(NULL);                  \
+		fs->op_seq++;                              \
+		int ino = trace_begin(fs, &tr);            \
+		uint64_t failures = fs->csum.failures;     \
+		int ret = -EROFS;                          \
+		if (!fs_readonly(fs)) {                    \
+			ret = a1fs_##name args;                \
+		}                                          \
+		if (fs->csum.failures != failures) {       \
+			ret = -EIO;                            \
+		}                                          \
+		trace_end(fs, &tr, STATS_OP_##name,        \
+		          start, ino, ret);                \
+		pthread_mutex_unlock(&fs->lock);           \
+		stats_op_done(&fs->stats, STATS_OP_##name, \
+		              start, ret);                 \
+		return ret;                                \
+	}
+
+LOCKED_OP(lookup, (fs_ctx *fs, const char *path), (fs, path),
+          (path, NULL, 0, 0, 0, NULL))
+LOCKED_OP(statfs, (fs_ctx *fs, struct statvfs *st), (fs, st),
+          (NULL, NULL, 0, 0, 0, NULL))
+LOCKED_OP(getattr, (fs_ctx *fs, const char *path, struct stat *st),
+          (fs, path, st), (path, NULL, 0, 0, 0, NULL))
+LOCKED_OP(readdir, (fs_ctx *fs, const char *path, void *buf,
+                    fs_fill_dir_t filler), (fs, path, buf, filler, 0),
+          (path, NULL, 0, 0, 0, NULL))
+LOCKED_WRITE_OP(mkdir, (fs_ctx *fs, const char *path, mode_t mode),
+                (fs, path, mode), (path, NULL, 0, 0, mode, NULL))
+LOCKED_WRITE_OP(rmdir, (fs_ctx *fs, const char *path), (fs, path),
+                (path, NULL, 0, 0, 0, NULL))
+LOCKED_WRITE_OP(create, (fs_ctx *fs, const char *path, mode_t mode,
+                         uint64_t *fh), (fs, path, mode, fh),
+                (path, NULL, 0, 0, mode, fh))
+LOCKED_WRITE_OP(unlink, (fs_ctx *fs, const char *path), (fs, path),
+                (path, NULL, 0, 0, 0, NULL))
+LOCKED_WRITE_OP(rename, (fs_ctx *fs, const char *from, const char *to),
+                (fs, from, to), (from, to, 0, 0, 0, NULL))
+LOCKED_WRITE_OP(utimens, (fs_ctx *fs, const char *path,
+                          const struct timespec times[2]), (fs, path, times),
+                (path, NULL, 0, 0, 0, NULL))
+LOCKED_WRITE_OP(truncate, (fs_ctx *fs, const char *path, off_t size),
+                (fs, path, size), (path, NULL, 0, size, 0, NULL))
+LOCKED_OP(open, (fs_ctx *fs, const char *path, uint64_t *fh), (fs, path, fh),
+          (path, NULL, 0, 0, 0, fh))
+LOCKED_OP(read, (fs_ctx *fs, const char *path, char *buf, size_t size,
+                 off_t offset, uint64_t fh), (fs, path, buf, size, offset, fh),
+          (path, NULL, offset, size, 0, &fh))
+LOCKED_WRITE_OP(write, (fs_ctx *fs, const char *path, const char *buf,
+                        size_t size, off_t offset),
+                (fs, path, buf, size, offset),
+                (path, NULL, offset, size, 0, NULL))
+LOCKED_OP(release, (fs_ctx *fs, const char *path, uint64_t fh),
+          (fs, path, fh), (path, NULL, 0, 0, 0, &fh))
+LOCKED_WRITE_OP(fsync, (fs_ctx *fs, const char *path, int datasync),
+                (fs, path, datasync), (path, NULL, 0, 0, datasync, NULL))
+LOCKED_WRITE_OP(fallocate, (fs_ctx *fs, const char *path, int mode,
+                            off_t offset, off_t length),
+                (fs, path, mode, offset, length),
+                (path, NULL, offset, length, mode, NULL))
+LOCKED_OP(ioctl, (fs_ctx *fs, const char *path, int cmd, void *data),
+          (fs, path, cmd, data), (path, NULL, 0, 0, cmd, NULL))
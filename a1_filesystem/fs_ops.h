@@ -0,0 +1,174 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - a1fs file system operations header file.
+ *
+ * The a1fs core (liba1fs): mounting an image and the file system operations
+ * on it, with an explicit file system context instead of the FUSE one. The
+ * FUSE driver (a1fs.c) is a thin layer on top; other programs can link the
+ * library to use an image in-process, e.g. to benchmark it (a1fs_bench)
+ * without a kernel mount in the way.
+ *
+ * The operations behave like the FUSE callbacks they implement (see the
+ * a1fs_*() functions in fs_ops.c). They check their paths themselves instead
+ * of relying on the kernel to do it, and fail like the system calls do: e.g.
+ * fs_create() with -EEXIST for a path that already exists, and fs_read() with
+ * -ENOENT or -EISDIR for a path that is not a regular file. Paths are absolute
+ * within the file system.
+ *
+ * Every operation takes the file system lock, so they are safe to call from
+ * several threads and alongside the background threads started by
+ * fs_start(). They return 0 (or a non-negative result) on success, and
+ * -errno on error.
+ *
+ * The calls, errors and latencies of the operations are counted (see
+ * stats.h), and can be read from a virtual file in the root directory,
+ * A1FS_STATS_FILE, that doesn't exist in the image.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "fs_ctx.h"
+#include "options.h"
+
+
+/**
+ * Function called by fs_readdir() for each directory entry; compatible with
+ * FUSE's fuse_fill_dir_t. Returns non-zero to stop (out of buffer space).
+ */
+typedef int (*fs_fill_dir_t)(void *buf, const char *name,
+                             const struct stat *st, off_t off);
+
+/**
+ * Path of the virtual statistics file.
+ *
+ * Reading it gives a text report of the file system statistics, as of when it
+ * was opened; writing to it or truncating it resets them.
+ */
+#define A1FS_STATS_FILE "/.a1fs_stats"
+
+/**
+ * Mount an image.
+ *
+ * Opens the image with the storage backend chosen in the options and
+ * initializes the file system context. The image is locked (flock()) until it
+ * is unmounted, so mounting an image that is already mounted fails. The
+ * background threads are not started; see fs_start().
+ *
+ * @param fs    file system context to initialize.
+ * @param opts  mount options; fields that a1fs_opt_parse() gives a default
+ *              must be set (see a1fs_opt_defaults()).
+ * @return      true on success; false on failure.
+ */
+bool fs_mount(fs_ctx *fs, const a1fs_opts *opts);
+
+/**
+ * Start the background flusher (and discard) threads of a mounted file system.
+ *
+ * The FUSE driver calls it once FUSE has daemonized; threads started before
+ * that would not survive the fork.
+ */
+void fs_start(fs_ctx *fs);
+
+/**
+ * Unmount the file system.
+ *
+ * Stops the background threads, writes out the buffered data and releases
+ * all the resources of the context. Does nothing if fs_mount() wasn't called
+ * (or failed).
+ */
+void fs_unmount(fs_ctx *fs);
+
+/** Look up a path; returns its inode number or -errno. */
+int fs_lookup(fs_ctx *fs, const char *path);
+
+/** Get file system statistics (statvfs()). */
+int fs_statfs(fs_ctx *fs, struct statvfs *st);
+
+/** Get file or directory attributes (lstat()). */
+int fs_getattr(fs_ctx *fs, const char *path, struct stat *st);
+
+/** Call filler(buf, name, NULL, 0) for each entry of a directory. */
+int fs_readdir(fs_ctx *fs, const char *path, void *buf, fs_fill_dir_t filler);
+
+/** Create a directory (mkdir()). */
+int fs_mkdir(fs_ctx *fs, const char *path, mode_t mode);
+
+/** Remove an empty directory (rmdir()). */
+int fs_rmdir(fs_ctx *fs, const char *path);
+
+/**
+ * Create and open a regular file (creat()).
+ *
+ * The handle stored in *fh must be passed to fs_release() when done.
+ */
+int fs_create(fs_ctx *fs, const char *path, mode_t mode, uint64_t *fh);
+
+/** Remove a file (unlink()). */
+int fs_unlink(fs_ctx *fs, const char *path);
+
+/** Rename a file or directory (rename()). */
+int fs_rename(fs_ctx *fs, const char *from, const char *to);
+
+/** Change the modification time of a file or directory (utimensat()). */
+int fs_utimens(fs_ctx *fs, const char *path, const struct timespec times[2]);
+
+/** Change the size of a file (truncate()). */
+int fs_truncate(fs_ctx *fs, const char *path, off_t size);
+
+/**
+ * Open a file (open()).
+ *
+ * The handle stored in *fh keeps the per-open-file state (e.g. readahead)
+ * and must be passed to fs_release() when done.
+ */
+int fs_open(fs_ctx *fs, const char *path, uint64_t *fh);
+
+/**
+ * Read data from a file (pread()).
+ *
+ * The range must be within a single block. Returns the number of bytes read.
+ * fh is the handle from fs_open(), or 0 to read without readahead.
+ */
+int fs_read(fs_ctx *fs, const char *path, char *buf, size_t size,
+            off_t offset, uint64_t fh);
+
+/**
+ * Write data to a file (pwrite()).
+ *
+ * The range must be within a single block. Returns the number of bytes
+ * written.
+ */
+int fs_write(fs_ctx *fs, const char *path, const char *buf, size_t size,
+             off_t offset);
+
+/** Write out the buffered data of a file and release its handle (close()). */
+int fs_release(fs_ctx *fs, const char *path, uint64_t fh);
+
+/** Write a file and all modified blocks back to the image file (fsync()). */
+int fs_fsync(fs_ctx *fs, const char *path, int datasync);
+
+/** Allocate or deallocate space for a range of a file (fallocate()). */
+int fs_fallocate(fs_ctx *fs, const char *path, int mode, off_t offset,
+                 off_t length);
+
+/** Perform an a1fs specific request (see a1fs_ioctl.h) on a file. */
+int fs_ioctl(fs_ctx *fs, const char *path, int cmd, void *data);
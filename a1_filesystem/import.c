@@ -0,0 +1,487 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Directory tree import implementation.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "a1fs.h"
+#include "bitmap.h"
+#include "format.h"
+#include "fs_ops.h"
+#include "import.h"
+
+
+/** Import state. */
+typedef struct import_ctx {
+	/** Mapped image. */
+	unsigned char *image;
+	/** Superblock of the image. */
+	a1fs_superblock *sb;
+	/** Image file that file data is copied into. */
+	int img_fd;
+	/** Next inode number to allocate. */
+	a1fs_ino_t next_ino;
+	/** Next data block to allocate. */
+	a1fs_blk_t next_blk;
+	/** Host path of the file being imported, for messages. */
+	char path[PATH_MAX];
+
+} import_ctx;
+
+/** An entry of a source directory. */
+typedef struct src_entry {
+	/** File name. */
+	char *name;
+	/** File attributes (not following symbolic links). */
+	struct stat st;
+
+} src_entry;
+
+
+/** Append a file name to ic->path; returns the length to restore it to. */
+static size_t path_push(import_ctx *ic, const char *name)
+{
+	size_t len = strlen(ic->path);
+	snprintf(ic->path + len, sizeof(ic->path) - len, "/%s", name);
+	return len;
+}
+
+/** Get a pointer to the inode table entry of an inode. */
+static a1fs_inode *get_inode(import_ctx *ic, a1fs_ino_t ino)
+{
+	return (a1fs_inode*)(ic->image + (size_t)ic->sb->start_inode *
+	                     A1FS_BLOCK_SIZE) + ino;
+}
+
+/** Get a pointer to the extent block of an inode. */
+static a1fs_extent *get_extents(import_ctx *ic, a1fs_ino_t ino)
+{
+	return (a1fs_extent*)(ic->image + (size_t)(ic->sb->start_extent + ino) *
+	                      A1FS_BLOCK_SIZE);
+}
+
+/** Get a pointer to the contents of a data block. */
+static unsigned char *data_block(import_ctx *ic, a1fs_blk_t blk)
+{
+	return ic->image + (size_t)(ic->sb->start_data + blk) * A1FS_BLOCK_SIZE;
+}
+
+/** Take the next inode number; false if there are no inodes left. */
+static bool next_inode(import_ctx *ic, a1fs_ino_t *ino)
+{
+	if (ic->next_ino >= ic->sb->inodes_count) {
+		fprintf(stderr, "Not enough inodes for %s\n", ic->path);
+		return false;
+	}
+	*ino = ic->next_ino++;
+	return true;
+}
+
+/** Take the next count data blocks; false if there is not enough space. */
+static bool next_blocks(import_ctx *ic, a1fs_blk_t count, a1fs_blk_t *start)
+{
+	if (count > ic->sb->blocks_count - ic->next_blk) {
+		fprintf(stderr, "Not enough space for %s\n", ic->path);
+		return false;
+	}
+	*start = ic->next_blk;
+	ic->next_blk += count;
+	return true;
+}
+
+/**
+ * Initialize the inode table entry of an inode from the attributes of its
+ * source file.
+ *
+ * @param ic    import state.
+ * @param ino   inode number.
+ * @param type  file type bits (S_IFREG or S_IFDIR).
+ * @param st    attributes of the source file.
+ * @return      pointer to the inode.
+ */
+static a1fs_inode *init_inode(import_ctx *ic, a1fs_ino_t ino, mode_t type,
+                              const struct stat *st)
+{
+	a1fs_superblock *sb = ic->sb;
+	a1fs_inode *inode = get_inode(ic, ino);
+	memset(inode, 0, sizeof(*inode));
+	inode->mode = type | (st->st_mode & 07777);
+	inode->mtime = st->st_mtim;
+	inode->ino_number = ino;
+	// The extent block of an inode of a lazily initialized image may still
+	// hold what the image contained before it was formatted
+	if ((sb->flags & A1FS_FEATURE_LAZY_INIT) && ino >= sb->inodes_init) {
+		memset(get_extents(ic, ino), 0, A1FS_BLOCK_SIZE);
+	}
+	return inode;
+}
+
+/**
+ * Point an inode to a run of data blocks, split into as many extents as it
+ * takes.
+ *
+ * @return  true on success; false if the run needs too many extents.
+ */
+static bool set_extents(import_ctx *ic, a1fs_inode *inode, a1fs_blk_t start,
+                        a1fs_blk_t count)
+{
+	a1fs_extent *extents = get_extents(ic, inode->ino_number);
+	size_t max = A1FS_BLOCK_SIZE / sizeof(a1fs_extent);
+	size_t n = 0;
+	while (count > 0) {
+		if (n == max) {
+			fprintf(stderr, "%s is too large\n", ic->path);
+			return false;
+		}
+		a1fs_blk_t len = count < A1FS_EXTENT_MAX ? count : A1FS_EXTENT_MAX;
+		extents[n++] = (a1fs_extent){ .start = start, .count = len };
+		start += len;
+		count -= len;
+	}
+	inode->extent_count = n;
+	return true;
+}
+
+/**
+ * Copy the contents of a source file into a run of data blocks.
+ *
+ * copy_file_range() lets the kernel (or the host file system, e.g. by sharing
+ * the blocks) do the copy; sendfile() works between any two files, but only
+ * avoids the copy through user space.
+ *
+ * @param ic    import state.
+ * @param fd    source file, at offset 0.
+ * @param blk   first data block of the run.
+ * @param size  number of bytes to copy.
+ * @return      true on success; false on error.
+ */
+static bool copy_data(import_ctx *ic, int fd, a1fs_blk_t blk, size_t size)
+{
+	loff_t offset = (loff_t)(ic->sb->start_data + blk) * A1FS_BLOCK_SIZE;
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = copy_file_range(fd, NULL, ic->img_fd, &offset,
+		                            size - done, 0);
+		if (n <= 0) {
+			break;
+		}
+		done += n;
+	}
+
+	if (done < size && lseek(ic->img_fd, offset, SEEK_SET) < 0) {
+		perror("lseek");
+		return false;
+	}
+	while (done < size) {
+		ssize_t n = sendfile(ic->img_fd, fd, NULL, size - done);
+		if (n < 0) {
+			perror(ic->path);
+			return false;
+		}
+		if (n == 0) {
+			fprintf(stderr, "%s was truncated while importing\n", ic->path);
+			return false;
+		}
+		done += n;
+	}
+	return true;
+}
+
+/**
+ * Import a regular file.
+ *
+ * @param ic     import state.
+ * @param dirfd  source directory of the file.
+ * @param e      directory entry of the file.
+ * @param ino    inode number of the file.
+ * @return       true on success; false on error.
+ */
+static bool import_file(import_ctx *ic, int dirfd, const src_entry *e,
+                        a1fs_ino_t ino)
+{
+	a1fs_inode *inode = init_inode(ic, ino, S_IFREG, &e->st);
+	inode->links = 1;
+	inode->size = e->st.st_size;
+	a1fs_blk_t count = (inode->size + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE;
+	if (count == 0) {
+		return true;
+	}
+
+	a1fs_blk_t start;
+	if (!next_blocks(ic, count, &start) ||
+	    !set_extents(ic, inode, start, count))
+	{
+		return false;
+	}
+	int fd = openat(dirfd, e->name, O_RDONLY | O_NOFOLLOW);
+	if (fd < 0) {
+		perror(ic->path);
+		return false;
+	}
+	bool ok = copy_data(ic, fd, start, inode->size);
+	close(fd);
+
+	// The rest of the last block may hold stale contents of the image
+	size_t tail = inode->size % A1FS_BLOCK_SIZE;
+	if (ok && tail > 0) {
+		memset(data_block(ic, start + count - 1) + tail, 0,
+		       A1FS_BLOCK_SIZE - tail);
+	}
+	return ok;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+	return strcmp(((const src_entry*)a)->name, ((const src_entry*)b)->name);
+}
+
+/**
+ * Read the entries of a source directory that can be imported, sorted by
+ * name so that the same tree always gives the same image.
+ *
+ * @param ic       import state.
+ * @param dir      source directory.
+ * @param root     true if dir is the root directory.
+ * @param entries  receives the entries; must be freed by the caller.
+ * @param n        receives the number of entries.
+ * @return         true on success; false on error.
+ */
+static bool read_entries(import_ctx *ic, DIR *dir, bool root,
+                         src_entry **entries, size_t *n)
+{
+	size_t cap = 0;
+	struct dirent *d;
+	errno = 0;
+	while ((d = readdir(dir)) != NULL) {
+		if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+			continue;
+		}
+		size_t len = path_push(ic, d->d_name);
+		struct stat st;
+		bool skip = false;
+		if (fstatat(dirfd(dir), d->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+			perror(ic->path);
+			return false;
+		}
+		if (strlen(d->d_name) >= A1FS_NAME_MAX) {
+			fprintf(stderr, "%s: File name too long\n", ic->path);
+			return false;
+		}
+		if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)) {
+			fprintf(stderr, "Skipping %s: not a regular file or directory\n",
+			        ic->path);
+			skip = true;
+		} else if (root && strcmp(d->d_name, A1FS_STATS_FILE + 1) == 0) {
+			fprintf(stderr, "Skipping %s: reserved name\n", ic->path);
+			skip = true;
+		}
+		ic->path[len] = '\0';
+		if (skip) {
+			continue;
+		}
+
+		if (*n == cap) {
+			cap = cap ? cap * 2 : 16;
+			src_entry *tmp = realloc(*entries, cap * sizeof(src_entry));
+			if (!tmp) {
+				perror("realloc");
+				return false;
+			}
+			*entries = tmp;
+		}
+		char *name = strdup(d->d_name);
+		if (!name) {
+			perror("strdup");
+			return false;
+		}
+		(*entries)[(*n)++] = (src_entry){ .name = name, .st = st };
+		errno = 0;
+	}
+	if (errno != 0) {
+		perror(ic->path);
+		return false;
+	}
+	qsort(*entries, *n, sizeof(src_entry), entry_cmp);
+	return true;
+}
+
+static bool import_dir(import_ctx *ic, int fd, a1fs_ino_t ino,
+                       a1fs_ino_t parent, const struct stat *st);
+
+/**
+ * Lay out a directory and import its entries.
+ *
+ * The directory's entries take a contiguous run of blocks, followed by the
+ * inodes and data of the entries in order.
+ *
+ * @param ic       import state.
+ * @param dirfd    source directory.
+ * @param ino      inode number of the directory.
+ * @param parent   inode number of the parent directory.
+ * @param st       attributes of the source directory.
+ * @param entries  entries to import.
+ * @param n        number of entries.
+ * @return         true on success; false on error.
+ */
+static bool fill_dir(import_ctx *ic, int dirfd, a1fs_ino_t ino,
+                     a1fs_ino_t parent, const struct stat *st,
+                     const src_entry *entries, size_t n)
+{
+	size_t size = (n + 2) * sizeof(a1fs_dentry);
+	a1fs_blk_t count = (size + A1FS_BLOCK_SIZE - 1) / A1FS_BLOCK_SIZE;
+	a1fs_blk_t start;
+	if (!next_blocks(ic, count, &start)) {
+		return false;
+	}
+	a1fs_inode *inode = init_inode(ic, ino, S_IFDIR, st);
+	// Every entry counts, as with a1fs_create() and a1fs_mkdir()
+	inode->links = 2 + n;
+	inode->size = size;
+	if (!set_extents(ic, inode, start, count)) {
+		return false;
+	}
+
+	a1fs_dentry *dentries = (a1fs_dentry*)data_block(ic, start);
+	memset(dentries, 0, (size_t)count * A1FS_BLOCK_SIZE);
+	dentries[0] = (a1fs_dentry){ .ino = ino, .name = "." };
+	dentries[1] = (a1fs_dentry){ .ino = parent, .name = ".." };
+
+	for (size_t i = 0; i < n; i++) {
+		const src_entry *e = &entries[i];
+		size_t len = path_push(ic, e->name);
+		a1fs_ino_t child;
+		if (!next_inode(ic, &child)) {
+			return false;
+		}
+		dentries[i + 2].ino = child;
+		strcpy(dentries[i + 2].name, e->name);
+
+		bool ok;
+		if (S_ISDIR(e->st.st_mode)) {
+			int cfd = openat(dirfd, e->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+			if (cfd < 0) {
+				perror(ic->path);
+				return false;
+			}
+			ok = import_dir(ic, cfd, child, ino, &e->st);
+		} else {
+			ok = import_file(ic, dirfd, e, child);
+		}
+		ic->path[len] = '\0';
+		if (!ok) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Import a directory tree.
+ *
+ * @param ic      import state.
+ * @param fd      source directory; closed by this function.
+ * @param ino     inode number of the directory.
+ * @param parent  inode number of the parent directory.
+ * @param st      attributes of the source directory.
+ * @return        true on success; false on error.
+ */
+static bool import_dir(import_ctx *ic, int fd, a1fs_ino_t ino,
+                       a1fs_ino_t parent, const struct stat *st)
+{
+	DIR *dir = fdopendir(fd);
+	if (!dir) {
+		perror(ic->path);
+		close(fd);
+		return false;
+	}
+
+	src_entry *entries = NULL;
+	size_t n = 0;
+	bool ok = read_entries(ic, dir, ino == 0, &entries, &n) &&
+	          fill_dir(ic, dirfd(dir), ino, parent, st, entries, n);
+
+	for (size_t i = 0; i < n; i++) {
+		free(entries[i].name);
+	}
+	free(entries);
+	closedir(dir);
+	return ok;
+}
+
+bool import_tree(void *image, const char *img_path, const char *src)
+{
+	import_ctx ic = {
+		.image = image,
+		.sb = (a1fs_superblock*)image,
+		// The root directory is laid out again along with its entries
+		.next_ino = 1,
+		.next_blk = 0,
+	};
+	a1fs_superblock *sb = ic.sb;
+	strncpy(ic.path, src, sizeof(ic.path) - 1);
+
+	int fd = open(src, O_RDONLY | O_DIRECTORY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(src);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return false;
+	}
+	ic.img_fd = open(img_path, O_RDWR);
+	if (ic.img_fd < 0) {
+		perror(img_path);
+		close(fd);
+		return false;
+	}
+	bool ok = import_dir(&ic, fd, 0, 0, &st);
+	close(ic.img_fd);
+	if (!ok) {
+		// The root directory may already refer to inodes that the bitmaps
+		// don't have; make sure the image isn't mounted
+		sb->magic = 0;
+		return false;
+	}
+
+	unsigned char *inode_map = ic.image + (size_t)sb->start_inode_map *
+	                           A1FS_BLOCK_SIZE;
+	unsigned char *data_map = ic.image + (size_t)sb->start_data_map *
+	                          A1FS_BLOCK_SIZE;
+	bitmap_set_range(inode_map, 0, ic.next_ino);
+	bitmap_set_range(data_map, 0, ic.next_blk);
+	sb->free_inodes_count = sb->inodes_count - ic.next_ino;
+	sb->free_blocks_count = sb->blocks_count - ic.next_blk;
+	if ((sb->flags & A1FS_FEATURE_LAZY_INIT) && sb->inodes_init < ic.next_ino) {
+		sb->inodes_init = ic.next_ino;
+	}
+	if (sb->flags & A1FS_FEATURE_CSUM) {
+		format_csum(image);
+	}
+	return true;
+}
@@ -0,0 +1,49 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+/**
+ * CSC369 Assignment 1 - Directory tree import header file.
+ *
+ * Used by mkfs.a1fs -d to build an image that already contains a host
+ * directory tree, without mounting it and copying the files through FUSE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+
+/**
+ * Copy a host directory tree into a freshly formatted image.
+ *
+ * The tree is laid out offline: inodes are numbered and data blocks are
+ * allocated in depth-first order, each directory's entries are followed by
+ * the inodes and data of its files, and every file (and directory) gets a
+ * single contiguous run of data blocks. The inodes, directory entries and
+ * bitmaps are filled in directly in the mapped image, while the file data is
+ * copied from the source files into the image file with copy_file_range()
+ * (or sendfile() if the host file systems don't support it).
+ *
+ * Only regular files and directories are imported; other file types are
+ * skipped with a warning, and hard links are imported as separate files.
+ * The source directory itself becomes the root directory.
+ *
+ * @param image     pointer to the start of the mapped image, formatted by
+ *                  format_image() and not modified since.
+ * @param img_path  image file path.
+ * @param src       path of the directory to import.
+ * @return          true on success; false on error (e.g. the tree doesn't
+ *                  fit into the image), in which case the image is left
+ *                  unformatted.
+ */
+bool import_tree(void *image, const char *img_path, const char *src);
@@ -0,0 +1,125 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Block I/O engine interface header file.
+ *
+ * An I/O engine performs batches of reads and writes on the image file for the
+ * block cache backend. A batch is submitted as a whole and the call returns
+ * when every request in it has completed, so an engine is free to have all of
+ * them in flight at once.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+
+/** A single vectored read or write. */
+typedef struct io_req {
+	/** Buffers to transfer, in file order. */
+	struct iovec *iov;
+	/** Number of buffers. */
+	int iovcnt;
+	/** File offset of the first buffer. */
+	off_t offset;
+	/** Write (true) or read (false). */
+	bool write;
+
+} io_req;
+
+typedef struct io_engine io_engine;
+
+/** I/O engine operations. */
+typedef struct io_engine_ops {
+	/** Engine name, as given in the backend= mount option. */
+	const char *name;
+
+	/**
+	 * Perform a batch of requests and wait for all of them to complete.
+	 *
+	 * @param io    I/O engine.
+	 * @param reqs  array of requests.
+	 * @param n     number of requests.
+	 * @return      0 on success; -1 if any request failed.
+	 */
+	int (*submit)(io_engine *io, io_req *reqs, size_t n);
+
+	/** Release all resources; does not close the file. */
+	void (*destroy)(io_engine *io);
+
+} io_engine_ops;
+
+/** I/O engine state common to all engines. */
+struct io_engine {
+	/** Engine operations. */
+	const io_engine_ops *ops;
+	/** Image file descriptor. */
+	int fd;
+};
+
+/**
+ * Create an engine that performs requests one by one with preadv()/pwritev().
+ *
+ * @param fd  image file descriptor.
+ * @return    I/O engine on success; NULL on failure.
+ */
+io_engine *io_psync_open(int fd);
+
+/**
+ * Create an engine that submits requests through an io_uring.
+ *
+ * A batch is pushed to the submission queue and handed to the kernel with a
+ * single io_uring_enter() call per queue-full of requests.
+ *
+ * @param fd     image file descriptor.
+ * @param depth  submission queue depth.
+ * @return       I/O engine on success; NULL on failure (e.g. io_uring is not
+ *               supported by the kernel).
+ */
+io_engine *io_uring_open(int fd, unsigned int depth);
+
+/**
+ * Complete a request synchronously, starting done bytes into it.
+ *
+ * Used by the engines to finish short transfers.
+ *
+ * @return  0 on success; -1 on failure.
+ */
+int io_req_finish(int fd, const io_req *req, size_t done);
+
+/** Total number of bytes in a request. */
+static inline size_t io_req_len(const io_req *req)
+{
+	size_t len = 0;
+	for (int i = 0; i < req->iovcnt; i++) {
+		len += req->iov[i].iov_len;
+	}
+	return len;
+}
+
+/** Perform a batch of requests; see io_engine_ops.submit. */
+static inline int io_submit(io_engine *io, io_req *reqs, size_t n)
+{
+	return io->ops->submit(io, reqs, n);
+}
+
+/** Release an I/O engine. */
+static inline void io_destroy(io_engine *io)
+{
+	io->ops->destroy(io);
+}
@@ -0,0 +1,96 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Synchronous preadv()/pwritev() I/O engine.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "io.h"
+
+
+int io_req_finish(int fd, const io_req *req, size_t done)
+{
+	int i = 0;
+	size_t skip = done;
+	while (i < req->iovcnt && skip >= req->iov[i].iov_len) {
+		skip -= req->iov[i].iov_len;
+		i++;
+	}
+	off_t offset = req->offset + done;
+	while (i < req->iovcnt) {
+		struct iovec first = req->iov[i];
+		first.iov_base = (char*)first.iov_base + skip;
+		first.iov_len -= skip;
+
+		// Transfer the (partial) first buffer together with the rest
+		struct iovec saved = req->iov[i];
+		req->iov[i] = first;
+		ssize_t n = req->write ? pwritev(fd, req->iov + i, req->iovcnt - i, offset)
+		                       : preadv(fd, req->iov + i, req->iovcnt - i, offset);
+		req->iov[i] = saved;
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			perror(req->write ? "pwritev" : "preadv");
+			return -1;
+		}
+		offset += n;
+		skip += n;
+		while (i < req->iovcnt && skip >= req->iov[i].iov_len) {
+			skip -= req->iov[i].iov_len;
+			i++;
+		}
+	}
+	return 0;
+}
+
+static int psync_submit(io_engine *io, io_req *reqs, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		if (io_req_finish(io->fd, &reqs[i], 0) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void psync_destroy(io_engine *io)
+{
+	free(io);
+}
+
+static const io_engine_ops psync_ops = {
+	.name    = "psync",
+	.submit  = psync_submit,
+	.destroy = psync_destroy,
+};
+
+io_engine *io_psync_open(int fd)
+{
+	io_engine *io = malloc(sizeof(*io));
+	if (!io) {
+		perror("malloc");
+		return NULL;
+	}
+	io->ops = &psync_ops;
+	io->fd = fd;
+	return io;
+}
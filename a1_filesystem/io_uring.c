@@ -0,0 +1,259 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - io_uring I/O engine.
+ *
+ * Talks to the kernel directly through the io_uring_setup() and
+ * io_uring_enter() system calls, so no liburing is needed. Each batch is
+ * split into queue-sized chunks; the requests of a chunk are placed in the
+ * submission queue and submitted, and waited for, with one io_uring_enter().
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+#include "io.h"
+
+
+/** io_uring engine state. */
+typedef struct uring {
+	/** Common engine state; must be the first field. */
+	io_engine io;
+	/** io_uring file descriptor. */
+	int ring_fd;
+	/** Number of submission queue entries. */
+	unsigned int depth;
+
+	/** Submission queue ring mapping and its size. */
+	void *sq_ring;
+	size_t sq_ring_size;
+	/** Completion queue ring mapping and its size (may equal sq_ring). */
+	void *cq_ring;
+	size_t cq_ring_size;
+	/** Submission queue entries. */
+	struct io_uring_sqe *sqes;
+
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+
+} uring;
+
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+                              unsigned int min_complete, unsigned int flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+	                    flags, NULL, 0);
+}
+
+/** Submit reqs[0..n) (n <= depth) and wait for all of them. */
+static int submit_chunk(uring *u, io_req *reqs, unsigned int n)
+{
+	unsigned int tail = *u->sq_tail;
+	for (unsigned int i = 0; i < n; i++) {
+		unsigned int idx = (tail + i) & *u->sq_mask;
+		struct io_uring_sqe *sqe = &u->sqes[idx];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = reqs[i].write ? IORING_OP_WRITEV : IORING_OP_READV;
+		sqe->fd = u->io.fd;
+		sqe->addr = (uintptr_t)reqs[i].iov;
+		sqe->len = reqs[i].iovcnt;
+		sqe->off = reqs[i].offset;
+		sqe->user_data = i;
+		u->sq_array[idx] = idx;
+	}
+	// Publish the new entries before the tail that makes them visible
+	__atomic_store_n(u->sq_tail, tail + n, __ATOMIC_RELEASE);
+
+	unsigned int submitted = 0;
+	while (submitted < n) {
+		int ret = sys_io_uring_enter(u->ring_fd, n - submitted, n - submitted,
+		                             IORING_ENTER_GETEVENTS);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			perror("io_uring_enter");
+			return -1;
+		}
+		submitted += ret;
+	}
+
+	int result = 0;
+	unsigned int completed = 0;
+	while (completed < n) {
+		unsigned int head = *u->cq_head;
+		unsigned int cq_tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+		if (head == cq_tail) {
+			// Completions of the last submission may still be on their way
+			if (sys_io_uring_enter(u->ring_fd, 0, 1,
+			                       IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+			{
+				perror("io_uring_enter");
+				return -1;
+			}
+			continue;
+		}
+		for (; head != cq_tail; head++, completed++) {
+			struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+			io_req *req = &reqs[cqe->user_data];
+			size_t done = cqe->res > 0 ? (size_t)cqe->res : 0;
+			if (cqe->res < 0 && cqe->res != -EAGAIN && cqe->res != -EINTR) {
+				errno = -cqe->res;
+				perror(req->write ? "io_uring write" : "io_uring read");
+				result = -1;
+			} else if (done < io_req_len(req) &&
+			           io_req_finish(u->io.fd, req, done) < 0)
+			{
+				result = -1;
+			}
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return result;
+}
+
+static int uring_submit(io_engine *io, io_req *reqs, size_t n)
+{
+	uring *u = (uring*)io;
+	int result = 0;
+	while (n > 0) {
+		unsigned int chunk = n < u->depth ? n : u->depth;
+		if (submit_chunk(u, reqs, chunk) < 0) {
+			result = -1;
+		}
+		reqs += chunk;
+		n -= chunk;
+	}
+	return result;
+}
+
+static void uring_destroy(io_engine *io)
+{
+	uring *u = (uring*)io;
+	if (u->sqes) {
+		munmap(u->sqes, u->depth * sizeof(struct io_uring_sqe));
+	}
+	if (u->cq_ring && u->cq_ring != u->sq_ring) {
+		munmap(u->cq_ring, u->cq_ring_size);
+	}
+	if (u->sq_ring) {
+		munmap(u->sq_ring, u->sq_ring_size);
+	}
+	if (u->ring_fd >= 0) {
+		close(u->ring_fd);
+	}
+	free(u);
+}
+
+static const io_engine_ops uring_ops = {
+	.name    = "uring",
+	.submit  = uring_submit,
+	.destroy = uring_destroy,
+};
+
+/** Map the submission and completion rings of a freshly set up io_uring. */
+static bool map_rings(uring *u, const struct io_uring_params *p)
+{
+	u->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+	u->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+	bool single = p->features & IORING_FEAT_SINGLE_MMAP;
+	if (single && u->cq_ring_size > u->sq_ring_size) {
+		u->sq_ring_size = u->cq_ring_size;
+	}
+
+	u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+	                  MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING);
+	if (u->sq_ring == MAP_FAILED) {
+		u->sq_ring = NULL;
+		return false;
+	}
+	if (single) {
+		u->cq_ring = u->sq_ring;
+	} else {
+		u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE,
+		                  MAP_SHARED | MAP_POPULATE, u->ring_fd,
+		                  IORING_OFF_CQ_RING);
+		if (u->cq_ring == MAP_FAILED) {
+			u->cq_ring = NULL;
+			return false;
+		}
+	}
+	u->sqes = mmap(NULL, p->sq_entries * sizeof(struct io_uring_sqe),
+	               PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	               u->ring_fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		u->sqes = NULL;
+		return false;
+	}
+
+	char *sq = u->sq_ring;
+	char *cq = u->cq_ring;
+	u->sq_tail  = (unsigned int*)(sq + p->sq_off.tail);
+	u->sq_mask  = (unsigned int*)(sq + p->sq_off.ring_mask);
+	u->sq_array = (unsigned int*)(sq + p->sq_off.array);
+	u->cq_head  = (unsigned int*)(cq + p->cq_off.head);
+	u->cq_tail  = (unsigned int*)(cq + p->cq_off.tail);
+	u->cq_mask  = (unsigned int*)(cq + p->cq_off.ring_mask);
+	u->cqes     = (struct io_uring_cqe*)(cq + p->cq_off.cqes);
+	return true;
+}
+
+io_engine *io_uring_open(int fd, unsigned int depth)
+{
+	uring *u = calloc(1, sizeof(*u));
+	if (!u) {
+		perror("calloc");
+		return NULL;
+	}
+	u->io.ops = &uring_ops;
+	u->io.fd = fd;
+
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	u->ring_fd = sys_io_uring_setup(depth, &p);
+	if (u->ring_fd < 0) {
+		perror("io_uring_setup");
+		free(u);
+		return NULL;
+	}
+	u->depth = p.sq_entries;
+	if (!map_rings(u, &p)) {
+		perror("mmap");
+		uring_destroy(&u->io);
+		return NULL;
+	}
+	return &u->io;
+}
@@ -0,0 +1,53 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Diagnostic output header file.
+ *
+ * Diagnostic messages go to stderr through the log_*() macros. Messages above
+ * the log level the code was compiled with (A1FS_LOG_LEVEL, set with
+ * "make LOG_LEVEL=<n>" after a "make clean") are compiled out together with
+ * the evaluation of their arguments, so that debug output costs nothing in
+ * a normal build.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+
+/** No diagnostic output. */
+#define A1FS_LOG_NONE  0
+/** Errors: failed mounts, corrupted metadata, failed I/O. */
+#define A1FS_LOG_ERROR 1
+/** Informational messages, e.g. the statistics printed on unmount. */
+#define A1FS_LOG_INFO  2
+/** Tracing of individual operations; very verbose. */
+#define A1FS_LOG_DEBUG 3
+
+#ifndef A1FS_LOG_LEVEL
+#define A1FS_LOG_LEVEL A1FS_LOG_INFO
+#endif
+
+/** Print a message to stderr if level is enabled at compile time. */
+#define a1fs_log(level, ...)                 \
+	do {                                     \
+		if ((level) <= A1FS_LOG_LEVEL) {     \
+			fprintf(stderr, __VA_ARGS__);    \
+		}                                    \
+	} while (0)
+
+#define log_error(...) a1fs_log(A1FS_LOG_ERROR, __VA_ARGS__)
+#define log_info(...)  a1fs_log(A1FS_LOG_INFO, __VA_ARGS__)
+#define log_debug(...) a1fs_log(A1FS_LOG_DEBUG, __VA_ARGS__)
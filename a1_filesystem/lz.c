@@ -0,0 +1,196 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - LZ77 block compression implementation.
+ *
+ * The compressor is greedy: it looks up the last position with the same 4
+ * leading bytes in a hash table and takes the match if there is one.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lz.h"
+
+
+/** Shortest match that is encoded as a match rather than literals. */
+#define MIN_MATCH 4
+/** Largest match offset. */
+#define MAX_OFFSET 65535
+/** log2 of the number of hash table entries. */
+#define HASH_BITS 12
+
+static uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t hash(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/** Write the extra length bytes of a length that didn't fit in the token. */
+static uint8_t *put_length(uint8_t *op, size_t n)
+{
+	for (n -= 15; n >= 255; n -= 255) {
+		*op++ = 255;
+	}
+	*op++ = (uint8_t)n;
+	return op;
+}
+
+/**
+ * Append a sequence to the output.
+ *
+ * @param mlen  match length; 0 for the last sequence (literals only).
+ * @return      new output position; NULL if the output is full.
+ */
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *oend,
+                             const uint8_t *lit, size_t nlit, size_t offset,
+                             size_t mlen)
+{
+	// Worst case: token, both lengths, literals and offset
+	size_t need = 1 + nlit / 255 + 1 + nlit + 2 + mlen / 255 + 1;
+	if (need > (size_t)(oend - op)) {
+		return NULL;
+	}
+	uint8_t *token = op++;
+	*token = (nlit < 15 ? nlit : 15) << 4;
+	if (nlit >= 15) {
+		op = put_length(op, nlit);
+	}
+	memcpy(op, lit, nlit);
+	op += nlit;
+	if (mlen == 0) {
+		return op;
+	}
+	*op++ = offset & 0xff;
+	*op++ = offset >> 8;
+	mlen -= MIN_MATCH;
+	*token |= mlen < 15 ? mlen : 15;
+	if (mlen >= 15) {
+		op = put_length(op, mlen);
+	}
+	return op;
+}
+
+size_t lz_compress(const void *src, size_t len, void *dst, size_t cap)
+{
+	const uint8_t *in = src;
+	uint8_t *op = dst;
+	const uint8_t *oend = op + cap;
+	// Positions plus 1, so that 0 means no entry
+	uint32_t table[1 << HASH_BITS] = {0};
+
+	size_t anchor = 0, ip = 0;
+	while (ip + MIN_MATCH <= len) {
+		uint32_t seq = read32(in + ip);
+		uint32_t h = hash(seq);
+		size_t ref = table[h];
+		table[h] = ip + 1;
+		if (ref == 0 || ip - (ref - 1) > MAX_OFFSET ||
+		    read32(in + ref - 1) != seq)
+		{
+			ip++;
+			continue;
+		}
+		ref--;
+
+		size_t mlen = MIN_MATCH;
+		while (ip + mlen < len && in[ref + mlen] == in[ip + mlen]) {
+			mlen++;
+		}
+		op = put_sequence(op, oend, in + anchor, ip - anchor, ip - ref, mlen);
+		if (!op) {
+			return 0;
+		}
+		ip += mlen;
+		anchor = ip;
+	}
+	op = put_sequence(op, oend, in + anchor, len - anchor, 0, 0);
+	return op ? (size_t)(op - (uint8_t*)dst) : 0;
+}
+
+/**
+ * Read the extra length bytes of a length that didn't fit in the token.
+ *
+ * @return  new input position; NULL if the input ends early.
+ */
+static const uint8_t *get_length(const uint8_t *ip, const uint8_t *iend,
+                                 size_t *n)
+{
+	uint8_t b;
+	do {
+		if (ip >= iend) {
+			return NULL;
+		}
+		b = *ip++;
+		*n += b;
+	} while (b == 255);
+	return ip;
+}
+
+long lz_decompress(const void *src, size_t len, void *dst, size_t cap)
+{
+	const uint8_t *ip = src;
+	const uint8_t *iend = ip + len;
+	uint8_t *out = dst;
+	uint8_t *op = out;
+	const uint8_t *oend = out + cap;
+
+	while (ip < iend) {
+		uint8_t token = *ip++;
+		size_t nlit = token >> 4;
+		if (nlit == 15 && !(ip = get_length(ip, iend, &nlit))) {
+			return -1;
+		}
+		if (nlit > (size_t)(iend - ip) || nlit > (size_t)(oend - op)) {
+			return -1;
+		}
+		memcpy(op, ip, nlit);
+		ip += nlit;
+		op += nlit;
+		if (ip == iend) {
+			break;// last sequence
+		}
+
+		if (iend - ip < 2) {
+			return -1;
+		}
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - out)) {
+			return -1;
+		}
+		size_t mlen = token & 15;
+		if (mlen == 15 && !(ip = get_length(ip, iend, &mlen))) {
+			return -1;
+		}
+		mlen += MIN_MATCH;
+		if (mlen > (size_t)(oend - op)) {
+			return -1;
+		}
+		// Byte by byte: the match may overlap the bytes being written
+		const uint8_t *ref = op - offset;
+		for (size_t i = 0; i < mlen; i++) {
+			op[i] = ref[i];
+		}
+		op += mlen;
+	}
+	return op - out;
+}
@@ -0,0 +1,57 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - LZ77 block compression header file.
+ *
+ * A small byte-oriented LZ77 codec in the style of LZ4, used for compressed
+ * file clusters. The compressed stream is a sequence of:
+ *
+ *   token     1 byte: literal count (high 4 bits) and match length minus 4
+ *             (low 4 bits); 15 in either means more length bytes follow
+ *   length    extra literal count bytes: 255 means another byte follows
+ *   literals  copied to the output as is
+ *   offset    2 bytes, little endian: distance back to the match (1..65535)
+ *   length    extra match length bytes, like the literal count ones
+ *
+ * The last sequence has only literals, and the stream ends right after them.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+
+/**
+ * Compress a buffer.
+ *
+ * @param src  data to compress.
+ * @param len  length of the data in bytes.
+ * @param dst  buffer that receives the compressed data.
+ * @param cap  size of dst in bytes.
+ * @return     length of the compressed data; 0 if it doesn't fit in cap bytes.
+ */
+size_t lz_compress(const void *src, size_t len, void *dst, size_t cap);
+
+/**
+ * Decompress a buffer produced by lz_compress().
+ *
+ * @param src  compressed data.
+ * @param len  length of the compressed data in bytes.
+ * @param dst  buffer that receives the decompressed data.
+ * @param cap  size of dst in bytes.
+ * @return     length of the decompressed data; -1 if the compressed data is
+ *             invalid or doesn't fit in cap bytes.
+ */
+long lz_decompress(const void *src, size_t len, void *dst, size_t cap);
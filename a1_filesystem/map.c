@@ -16,8 +16,14 @@
  * CSC369 Assignment 1 - File mapping helper implementation.
  */
 
+#define _GNU_SOURCE
+
+#include <errno.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -26,10 +32,138 @@
 #include "util.h"
 
 
-void *map_file(const char *path, size_t block_size, size_t *size)
+bool map_parse_advice(const char *name, map_advice *advice)
+{
+	if (strcmp(name, "normal") == 0) {
+		*advice = MAP_ADVICE_NORMAL;
+	} else if (strcmp(name, "sequential") == 0) {
+		*advice = MAP_ADVICE_SEQUENTIAL;
+	} else if (strcmp(name, "random") == 0) {
+		*advice = MAP_ADVICE_RANDOM;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Reserve a range of virtual addresses aligned to MAP_HUGE_SIZE.
+ *
+ * Huge pages can only back the mapping if the virtual address is aligned the
+ * same way as the file offset, which plain mmap() doesn't guarantee.
+ *
+ * @param len  length of the range in bytes.
+ * @return     start of the reserved range on success; NULL on failure.
+ */
+static void *reserve_aligned(size_t len)
+{
+	size_t padded = len + MAP_HUGE_SIZE;
+	void *addr = mmap(NULL, padded, PROT_NONE,
+	                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (addr == MAP_FAILED) {
+		return NULL;
+	}
+
+	// Trim the unaligned head and the tail of the reservation
+	uintptr_t start = align_up((uintptr_t)addr, MAP_HUGE_SIZE);
+	size_t head = start - (uintptr_t)addr;
+	if (head > 0) {
+		munmap(addr, head);
+	}
+	if (padded - head > len) {
+		munmap((char*)start + len, padded - head - len);
+	}
+	return (void*)start;
+}
+
+/**
+ * Apply the data region options in opts to the part of the mapping at addr
+ * that covers the file range [start, end).
+ */
+static void tune_data(void *addr, size_t start, size_t end,
+                      const map_opts *opts)
+{
+	// Huge pages only cover whole aligned 2 MB ranges
+	char *data = (char*)addr + start;
+	size_t data_size = end - start;
+	if (opts->hugepage) {
+		size_t skip = align_up(start, MAP_HUGE_SIZE) - start;
+		if (data_size > skip &&
+		    madvise(data + skip, data_size - skip, MADV_HUGEPAGE) < 0)
+		{
+			perror("madvise(MADV_HUGEPAGE)");
+		}
+	}
+
+	int advice = MADV_NORMAL;
+	switch (opts->advice) {
+		case MAP_ADVICE_NORMAL    : advice = MADV_NORMAL;     break;
+		case MAP_ADVICE_SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+		case MAP_ADVICE_RANDOM    : advice = MADV_RANDOM;     break;
+	}
+	if (advice != MADV_NORMAL && data_size > 0 &&
+	    madvise(data, data_size, advice) < 0)
+	{
+		perror("madvise");
+	}
+}
+
+/** Apply the options in opts to the mapping of fd at addr. */
+static void tune_mapping(int fd, void *addr, size_t size, int prot,
+                         const map_opts *opts)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t meta = opts->meta_size ? opts->meta_size(addr, size, opts->arg) : 0;
+	meta = meta > size ? size : align_up(meta, page_size);
+
+	if (opts->populate && meta > 0) {
+		// Remapping the same file range in place with MAP_POPULATE prefaults
+		// it without touching the data region
+		void *m = mmap(addr, meta, prot,
+		               MAP_SHARED | MAP_FIXED | MAP_POPULATE, fd, 0);
+		if (m == MAP_FAILED) {
+			perror("mmap(MAP_POPULATE)");
+		}
+	}
+
+	if (opts->lock && meta > 0 && mlock(addr, meta) < 0) {
+		perror("mlock");
+	}
+	tune_data(addr, meta, size, opts);
+}
+
+/**
+ * Move a mapping to the start of a reserved range of max_size bytes of address
+ * space, so that it can grow in place.
+ *
+ * @return  new address of the mapping; NULL on failure (the mapping is
+ *          released).
+ */
+static void *reserve_growth(void *addr, size_t size, size_t max_size)
+{
+	void *start = reserve_aligned(max_size);
+	if (!start) {
+		perror("mmap(reserve)");
+		munmap(addr, size);
+		return NULL;
+	}
+	void *m = mremap(addr, size, size, MREMAP_MAYMOVE | MREMAP_FIXED, start);
+	if (m == MAP_FAILED) {
+		perror("mremap");
+		munmap(start, max_size);
+		munmap(addr, size);
+		return NULL;
+	}
+	return m;
+}
+
+void *map_file(const char *path, size_t block_size, size_t *size,
+               const map_opts *opts)
 {
 	// Open the file for reading and writing
-	int fd = open(path, O_RDWR);
+	bool readonly = opts && opts->readonly;
+	int fd = open(path, readonly ? O_RDONLY : O_RDWR);
+	int prot = readonly ? PROT_READ : PROT_READ | PROT_WRITE;
 	if (fd < 0) {
 		perror(path);
 		return NULL;
@@ -54,18 +188,99 @@ void *map_file(const char *path, size_t block_size, size_t *size)
 	}
 
 	// Map file contents into memory
-	addr = mmap(NULL, s.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	void *hint = NULL;
+	int flags = MAP_SHARED;
+	if (opts && opts->hugepage) {
+		hint = reserve_aligned(s.st_size);
+		if (hint) {
+			flags |= MAP_FIXED;
+		}
+	}
+	addr = mmap(hint, s.st_size, prot, flags, fd, 0);
 	if (addr == MAP_FAILED) {
 		perror("mmap");
+		if (hint) {
+			munmap(hint, s.st_size);
+		}
 		addr = NULL;
 		goto end;
 	}
 	assert(is_aligned((size_t)addr, block_size));
 	*size = s.st_size;
 
+	if (opts && opts->max_size) {
+		size_t max_size = opts->max_size(addr, s.st_size, opts->arg);
+		if (max_size > (size_t)s.st_size &&
+		    !(addr = reserve_growth(addr, s.st_size, max_size)))
+		{
+			goto end;
+		}
+	}
+	if (opts) {
+		tune_mapping(fd, addr, s.st_size, prot, opts);
+	}
+
 end:
 	//NOTE: memory mapping keeps a reference to the open file; can safely close
 	// the file descriptor now; a future munmap() will close the file
 	close(fd);
 	return addr;
 }
+
+bool map_grow(const char *path, void *addr, size_t size, size_t new_size,
+              const map_opts *opts)
+{
+	assert(new_size > size);
+	int fd = open(path, O_RDWR);
+	if (fd < 0) {
+		perror(path);
+		return false;
+	}
+
+	bool ret = false;
+	struct stat s;
+	if (fstat(fd, &s) < 0) {
+		perror("fstat");
+		goto end;
+	}
+	if ((size_t)s.st_size < new_size && ftruncate(fd, new_size) < 0) {
+		perror("ftruncate");
+		goto end;
+	}
+
+	// Replaces the reserved address space after the mapping
+	void *m = mmap((char*)addr + size, new_size - size, PROT_READ | PROT_WRITE,
+	               MAP_SHARED | MAP_FIXED, fd, size);
+	if (m == MAP_FAILED) {
+		perror("mmap");
+		goto end;
+	}
+	if (opts) {
+		tune_data(addr, size, new_size, opts);
+	}
+	ret = true;
+
+end:
+	close(fd);
+	return ret;
+}
+
+int lock_file(const char *path, bool shared)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	if (flock(fd, (shared ? LOCK_SH : LOCK_EX) | LOCK_NB) < 0) {
+		if (errno == EWOULDBLOCK) {
+			fprintf(stderr, "%s: the image is in use (already mounted?)\n",
+			        path);
+		} else {
+			perror("flock");
+		}
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
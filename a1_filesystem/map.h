@@ -18,18 +18,120 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 
 
+/** Size of a transparent huge page (x86-64 PMD). */
+#define MAP_HUGE_SIZE (2ul << 20)
+
+/** Access pattern advice applied to the data region of the mapping. */
+typedef enum map_advice {
+	/** Default kernel readahead behaviour. */
+	MAP_ADVICE_NORMAL,
+	/** Aggressive readahead, pages are dropped soon after access. */
+	MAP_ADVICE_SEQUENTIAL,
+	/** No readahead. */
+	MAP_ADVICE_RANDOM,
+} map_advice;
+
+/**
+ * Optional tuning of the file mapping.
+ *
+ * The image is split into a metadata region at the start of the file (its
+ * size is reported by the meta_size() callback) and a data region that covers
+ * the rest of the file.
+ */
+typedef struct map_opts {
+	/** Prefault the metadata region (MAP_POPULATE). */
+	bool populate;
+	/** Back the data region with transparent huge pages (MADV_HUGEPAGE). */
+	bool hugepage;
+	/** Lock the metadata region in memory (mlock). */
+	bool lock;
+	/** Access pattern advice for the data region. */
+	map_advice advice;
+	/** Open and map the file for reading only. */
+	bool readonly;
+
+	/**
+	 * Compute the size of the metadata region in bytes.
+	 *
+	 * Called after the file is mapped. May return 0 if the image doesn't
+	 * contain a valid layout yet; the whole image is then treated as data.
+	 * If NULL, the whole image is treated as data.
+	 */
+	size_t (*meta_size)(const void *image, size_t size, void *arg);
+	/**
+	 * Compute the size in bytes that the file may be grown to while it is
+	 * mapped (see map_grow()).
+	 *
+	 * Called after the file is mapped; the mapping is then moved to the start
+	 * of a reserved range of address space of this size, so that it can be
+	 * extended in place; map_file() fails if it can't be reserved. If NULL
+	 * (or not larger than the file), nothing is reserved.
+	 */
+	size_t (*max_size)(const void *image, size_t size, void *arg);
+	/** Argument passed to meta_size() and max_size(). */
+	void *arg;
+
+} map_opts;
+
+/**
+ * Parse the name of an access pattern advice.
+ *
+ * @param name    one of "normal", "sequential" or "random".
+ * @param advice  pointer to the variable that receives the result.
+ * @return        true on success; false if the name is not recognized.
+ */
+bool map_parse_advice(const char *name, map_advice *advice);
+
 /**
- * Map the whole file into memory for reading and writing.
+ * Map the whole file into memory for reading and writing (or only for reading
+ * if opts->readonly is set).
  *
- * File size must be a non-zero multiple of the block_size.
+ * File size must be a non-zero multiple of the block_size. Failures to apply
+ * the tuning in opts (e.g. mlock() over RLIMIT_MEMLOCK or no THP support for
+ * the backing file system) are reported but are not fatal.
  *
  * @param path        image file path.
  * @param block_size  file system block size.
  * @param size        pointer to the variable that will be set to file size.
+ * @param opts        mapping tuning options; NULL for a plain mapping.
  * @return            pointer to the file mapping in memory on success;
  *                    NULL on failure.
  */
-void *map_file(const char *path, size_t block_size, size_t *size);
+void *map_file(const char *path, size_t block_size, size_t *size,
+               const map_opts *opts);
+
+/**
+ * Grow a file mapped with map_file() and extend the mapping over the new part.
+ *
+ * The file is extended to new_size (sparse) unless it is already that large.
+ * The mapping stays at the same address, so new_size must not be larger than
+ * what opts->max_size() returned when the file was mapped. The data region
+ * tuning in opts is applied to the new part.
+ *
+ * @param path      image file path.
+ * @param addr      start of the mapping.
+ * @param size      current size of the mapping in bytes.
+ * @param new_size  new size in bytes; a multiple of the page size.
+ * @param opts      the options the file was mapped with; NULL for none.
+ * @return          true on success; false on failure.
+ */
+bool map_grow(const char *path, void *addr, size_t size, size_t new_size,
+              const map_opts *opts);
+
+/**
+ * Lock a file against its use by other a1fs programs (flock()).
+ *
+ * The a1fs driver holds an exclusive lock on the image while it is mounted;
+ * the tools that modify an image take one too, and the ones that only read it
+ * take a shared lock. Fails rather than waiting if the file is already locked.
+ *
+ * @param path    file path.
+ * @param shared  take a shared lock instead of an exclusive one.
+ * @return        file descriptor holding the lock (closing it releases the
+ *                lock) on success; -1 on failure.
+ */
+int lock_file(const char *path, bool shared);
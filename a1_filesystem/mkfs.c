@@ -16,23 +16,32 @@
  * CSC369 Assignment 1 - a1fs formatting tool.
  */
 
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/random.h>
 #include <unistd.h>
 
 #include "a1fs.h"
+#include "format.h"
+#include "import.h"
 #include "map.h"
+#include "util.h"
 
 
 /** Command line options. */
 typedef struct mkfs_opts {
 	/** File system image file path. */
 	const char *img_path;
-	/** Number of inodes. */
-	size_t n_inodes;
+	/** Layout and features of the file system. */
+	format_opts format;
 
 	/** Print help and exit. */
 	bool help;
@@ -40,6 +49,17 @@ typedef struct mkfs_opts {
 	bool force;
 	/** Zero out image contents. */
 	bool zero;
+	/** Host directory to import into the image; NULL if none. */
+	const char *import_dir;
+	/** Other member images of a striped volume. */
+	const char *members[A1FS_STRIPE_MAX - 1];
+	/** Number of other member images. */
+	size_t nmembers;
+	/** Stripe chunk size in bytes. */
+	size_t stripe_size;
+
+	/** Image mapping tuning. */
+	map_opts map;
 
 } mkfs_opts;
 
@@ -53,26 +73,78 @@ Options:\n\
     -i num  number of inodes; required argument\n\
     -h      print help and exit\n\
     -f      force format - overwrite existing a1fs file system\n\
-    -z      zero out image contents\n\
+    -z      zero out image contents; otherwise the inode table and extent\n\
+            blocks are initialized by the file system as they are used\n\
+    -A      align the inode table, extent blocks and data region to 2 MB\n\
+    -r      enable file clones (adds a block reference count table)\n\
+    -c      enable metadata checksums (adds a checksum table)\n\
+    -g size make room for growing the image up to size bytes later with\n\
+            a1fs-resize (K, M, G or T suffix); by default it can only grow\n\
+            by the room left in the last data bitmap block\n\
+    -d dir  copy the contents of a host directory into the image\n\
+    -s path stripe the data region over this image file too (up to %d\n\
+            times); all images must have the same size, and are mounted\n\
+            together with -o stripe=path[:path...]\n\
+    -S size stripe chunk size (K or M suffix, power of 2; default 512K)\n\
+    -P      prefault the metadata region of the image before formatting\n\
+    -H      use huge pages for the data region of the image\n\
+    -L      lock the metadata region of the image in memory (mlock)\n\
+    -a mode data access pattern advice: normal, sequential or random\n\
 ";
 
 static void print_help(FILE *f, const char *progname)
 {
-	fprintf(f, help_str, progname, A1FS_BLOCK_SIZE);
+	fprintf(f, help_str, progname, A1FS_BLOCK_SIZE, A1FS_STRIPE_MAX - 1);
 }
 
 
 static bool parse_args(int argc, char *argv[], mkfs_opts *opts)
 {
 	char o;
-	while ((o = getopt(argc, argv, "i:hfvz")) != -1) {
+	while ((o = getopt(argc, argv, "i:hfvzArcg:d:s:S:PHLa:")) != -1) {
 		switch (o) {
-			case 'i': opts->n_inodes = strtoul(optarg, NULL, 10); break;
+			case 'i': opts->format.n_inodes = strtoul(optarg, NULL, 10); break;
 
 			case 'h': opts->help  = true; return true;// skip other arguments
 			case 'f': opts->force = true; break;
 			case 'z': opts->zero  = true; break;
 
+			case 'A': opts->format.align = true; break;
+			case 'r': opts->format.reflink = true; break;
+			case 'c': opts->format.csum = true; break;
+			case 'g':
+				if (!parse_size(optarg, &opts->format.max_size)) {
+					fprintf(stderr, "Invalid size: %s\n", optarg);
+					return false;
+				}
+				break;
+			case 'd': opts->import_dir = optarg; break;
+			case 's':
+				if (opts->nmembers == A1FS_STRIPE_MAX - 1) {
+					fprintf(stderr, "Too many images to stripe over\n");
+					return false;
+				}
+				opts->members[opts->nmembers++] = optarg;
+				break;
+			case 'S':
+				if (!parse_size(optarg, &opts->stripe_size) ||
+				    opts->stripe_size < A1FS_BLOCK_SIZE ||
+				    !is_powerof2(opts->stripe_size))
+				{
+					fprintf(stderr, "Invalid stripe chunk size: %s\n", optarg);
+					return false;
+				}
+				break;
+			case 'P': opts->map.populate = true; break;
+			case 'H': opts->map.hugepage = true; break;
+			case 'L': opts->map.lock = true; break;
+			case 'a':
+				if (!map_parse_advice(optarg, &opts->map.advice)) {
+					fprintf(stderr, "Invalid advice: %s\n", optarg);
+					return false;
+				}
+				break;
+
 			case '?': return false;
 			default : assert(false);
 		}
@@ -84,10 +156,96 @@ static bool parse_args(int argc, char *argv[], mkfs_opts *opts)
 	}
 	opts->img_path = argv[optind];
 
-	if (!opts->n_inodes) {
+	if (!opts->format.n_inodes) {
 		fprintf(stderr, "Missing or invalid number of inodes\n");
 		return false;
 	}
+	if (opts->nmembers > 0) {
+		if (opts->import_dir || opts->format.max_size) {
+			fprintf(stderr, "-d and -g are not supported with -s\n");
+			return false;
+		}
+		opts->format.stripe_count = opts->nmembers + 1;
+		opts->format.stripe_blocks = (opts->stripe_size ? opts->stripe_size
+		                                                : 512 << 10) /
+		                             A1FS_BLOCK_SIZE;
+	}
+	return true;
+}
+
+
+/** Largest number of threads that zero out the image. */
+#define ZERO_THREADS_MAX 16
+
+/** A part of the image zeroed by one thread. */
+typedef struct zero_part {
+	unsigned char *start;
+	size_t len;
+	pthread_t thread;
+	bool started;
+
+} zero_part;
+
+static void *zero_thread(void *arg)
+{
+	zero_part *part = (zero_part*)arg;
+	memset(part->start, 0, part->len);
+	return NULL;
+}
+
+/**
+ * Zero out the image contents.
+ *
+ * Asks the host file system to zero the file (or to punch a hole over all of
+ * it) so that nothing has to be written. If it can't, the mapped image is
+ * zeroed by one thread per CPU, up to ZERO_THREADS_MAX.
+ *
+ * @param path   image file path.
+ * @param image  pointer to the start of the mapped image.
+ * @param size   image size in bytes.
+ * @return       true on success; false on error.
+ */
+static bool zero_image(const char *path, void *image, size_t size)
+{
+	int fd = open(path, O_RDWR);
+	if (fd < 0) {
+		perror(path);
+		return false;
+	}
+	// Both keep the mapping coherent with the file
+	bool done = (fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, size) == 0) ||
+	            (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	                       0, size) == 0);
+	close(fd);
+	if (done) {
+		return true;
+	}
+
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t nparts = ncpus < 1 ? 1 : ncpus > ZERO_THREADS_MAX ? ZERO_THREADS_MAX
+	                                                         : (size_t)ncpus;
+	size_t blocks = size / A1FS_BLOCK_SIZE;
+	zero_part parts[ZERO_THREADS_MAX];
+	for (size_t i = 0; i < nparts; i++) {
+		size_t first = blocks * i / nparts;
+		size_t last = blocks * (i + 1) / nparts;
+		parts[i] = (zero_part){
+			.start = (unsigned char*)image + first * A1FS_BLOCK_SIZE,
+			.len = (last - first) * A1FS_BLOCK_SIZE,
+		};
+		// The first part is zeroed by this thread, as is any part whose
+		// thread couldn't be started
+		parts[i].started = (i > 0) &&
+		                   (pthread_create(&parts[i].thread, NULL,
+		                                   zero_thread, &parts[i]) == 0);
+	}
+	for (size_t i = 0; i < nparts; i++) {
+		if (parts[i].started) {
+			pthread_join(parts[i].thread, NULL);
+		} else {
+			zero_thread(&parts[i]);
+		}
+	}
 	return true;
 }
 
@@ -104,71 +262,40 @@ static bool a1fs_is_present(void *image)
 	return false;
 }
 
-
-/**
- * Format the image into a1fs.
- *
- * NOTE: Must update mtime of the root directory.
- *
- * @param image  pointer to the start of the image.
- * @param size   image size in bytes.
- * @param opts   command line options.
- * @return       true on success;
- *               false on error, e.g. options are invalid for given image size.
- */
-static bool mkfs(void *image, size_t size, mkfs_opts *opts)
+/** Map the other members of a striped volume; they must be as large as size. */
+static bool map_members(mkfs_opts *opts, void **members, size_t size)
 {
-	//TODO: initialize the superblock and create an empty root directory
-	//NOTE: the mode of the root directory inode should be set to S_IFDIR | 0777
-	(void)image;
-	(void)size;
-	(void)opts;
-	// initialize super block
-	a1fs_superblock sb = {0};
-	
-	sb.magic = A1FS_MAGIC;
-	sb.size = size;
-	int inode_bit_size = opts->n_inodes / (4096*8) + 1;
-	int inode_size = opts->n_inodes / 64 + 1;   // number of blocks inodes take
-	sb.start_inode = inode_bit_size + 3;
-	sb.start_extent = sb.start_inode + inode_size;
-	sb.start_data = sb.start_extent + opts->n_inodes;
-	sb.start_inode_map = 1;
-	sb.start_data_map = 1+inode_bit_size;
-	sb.inodes_count = opts->n_inodes;
-	sb.blocks_count = size/A1FS_BLOCK_SIZE - (sb.start_extent + opts->n_inodes + 3);
-	sb.free_inodes_count = opts->n_inodes;
-	sb.free_blocks_count = size/A1FS_BLOCK_SIZE - (sb.start_extent + opts->n_inodes + 3);
-
-	memcpy(image, &sb, sizeof(a1fs_superblock));
-
-	// create empty root dir
-	a1fs_inode root = {.mode =S_IFDIR | 0777, .links=2, .size=512, .ino_number = 0, .extent_count = 1};
-	memcpy((image + sb.start_inode * A1FS_BLOCK_SIZE), &root, sizeof(a1fs_inode));
-
-	bitmap bit_zero = {.map={0}};
-	for(int i=0; i<inode_bit_size; i++){
-		memcpy(image+sb.start_inode_map*A1FS_BLOCK_SIZE*i, &bit_zero, sizeof(bit_zero));
-	}
-	memcpy(image+sb.start_data_map*A1FS_BLOCK_SIZE, &bit_zero, sizeof(bit_zero));
-	memcpy(image+(sb.start_data_map+1)*A1FS_BLOCK_SIZE, &bit_zero, sizeof(bit_zero));
-	//test
-	memcpy(image, &sb, sizeof(a1fs_superblock));
-
-	unsigned int start = 1 << 7;
-	// start = 1000 0000
-	memcpy(image+sb.start_inode_map*A1FS_BLOCK_SIZE, &start, sizeof(start)); 
-	//set begining inode, data bitmap to 1
-	memcpy(image+sb.start_data_map*A1FS_BLOCK_SIZE, &start, sizeof(start));
-	// change extent and data block
-	a1fs_extent root_extent = {.start = 0, .count = 1};
-	a1fs_dentry root_entry_self = {.ino = 0, .name = "."};
-	a1fs_dentry root_entry_parent = {.ino = 0, .name = ".."};
-	memcpy(image+sb.start_data*A1FS_BLOCK_SIZE, &root_entry_self, sizeof(a1fs_dentry));
-	memcpy(image+sb.start_data*A1FS_BLOCK_SIZE+256, &root_entry_parent, sizeof(a1fs_dentry));
-	memcpy(image+sb.start_extent*A1FS_BLOCK_SIZE, &root_extent, sizeof(root_extent));
-	sb.free_blocks_count = sb.free_blocks_count-1;
-	sb.free_inodes_count = sb.free_inodes_count-1;
+	for (size_t i = 0; i < opts->nmembers; i++) {
+		size_t msize;
+		members[i] = map_file(opts->members[i], A1FS_BLOCK_SIZE, &msize, NULL);
+		if (!members[i]) {
+			return false;
+		}
+		if (msize != size) {
+			fprintf(stderr, "%s: size differs from %s\n", opts->members[i],
+			        opts->img_path);
+			munmap(members[i], msize);
+			members[i] = NULL;
+			return false;
+		}
+		const a1fs_stripe_header *hdr = members[i];
+		if (!opts->force && hdr->magic == A1FS_STRIPE_MAGIC) {
+			fprintf(stderr, "%s already belongs to a striped a1fs; use -f "
+			        "to overwrite\n", opts->members[i]);
+			return false;
+		}
+		if (!opts->force && a1fs_is_present(members[i])) {
+			fprintf(stderr, "%s already contains a1fs; use -f to "
+			        "overwrite\n", opts->members[i]);
+			return false;
+		}
+	}
+	if (getrandom(&opts->format.volume_id, sizeof(opts->format.volume_id),
+	              0) < 0)
+	{
+		perror("getrandom");
+		return false;
+	}
 	return true;
 }
 
@@ -187,33 +314,64 @@ int main(int argc, char *argv[])
 		return 0;
 	}
 
+	// Formatting a mounted image would corrupt it
+	int lock_fd = lock_file(opts.img_path, false);
+	if (lock_fd < 0) {
+		return 1;
+	}
+
 	// Map image file into memory
+	opts.map.meta_size = format_meta_size;
+	opts.map.arg = &opts.format;
 	size_t size;
-	void *image = map_file(opts.img_path, A1FS_BLOCK_SIZE, &size);
+	void *image = map_file(opts.img_path, A1FS_BLOCK_SIZE, &size, &opts.map);
 	if (!image) {
+		close(lock_fd);
 		return 1;
 	}
 
 	// Check if overwriting existing file system
 	int ret = 1;
+	void *members[A1FS_STRIPE_MAX - 1] = {0};
 	if (!opts.force && a1fs_is_present(image)) {
 		fprintf(stderr, "Image already contains a1fs; use -f to overwrite\n");
 		goto end;
 	}
 
+	if (!map_members(&opts, members, size)) {
+		goto end;
+	}
+
 	if (opts.zero) {
-		memset(image, 0, size);
+		if (!zero_image(opts.img_path, image, size)) {
+			goto end;
+		}
+		for (size_t i = 0; i < opts.nmembers; i++) {
+			if (!zero_image(opts.members[i], members[i], size)) {
+				goto end;
+			}
+		}
+		opts.format.zeroed = true;
 	}
-	if (!mkfs(image, size, &opts)) {
-		//a1fs_superblock *sb2 = (a1fs_superblock*) image;
-    	//printf("\n2:   %ld", sb2->magic);
+	if (!format_image(image, size, &opts.format)) {
 		fprintf(stderr, "Failed to format the image\n");
 		goto end;
 	}
-	// a1fs_superblock *sb2 = (a1fs_superblock*) image;
-    // printf("\n3:  %ld", sb2->magic);
+	if (opts.import_dir && !import_tree(image, opts.img_path, opts.import_dir)) {
+		fprintf(stderr, "Failed to import %s\n", opts.import_dir);
+		goto end;
+	}
+	for (size_t i = 0; i < opts.nmembers; i++) {
+		format_stripe_member(members[i], image, i + 1);
+	}
 	ret = 0;
 end:
+	for (size_t i = 0; i < opts.nmembers; i++) {
+		if (members[i]) {
+			munmap(members[i], size);
+		}
+	}
 	munmap(image, size);
+	close(lock_fd);
 	return ret;
 }
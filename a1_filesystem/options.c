@@ -20,6 +20,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <fuse_opt.h>
+
+#include "map.h"
 #include "options.h"
 
 
@@ -31,6 +34,24 @@
 static const struct fuse_opt opt_spec[] = {
 	A1FS_OPT("-h"    , help),
 	A1FS_OPT("--help", help),
+	A1FS_OPT("populate", populate),
+	A1FS_OPT("hugepage", hugepage),
+	A1FS_OPT("mlock", mlock),
+	A1FS_OPT("advice=%s", advice),
+	A1FS_OPT("backend=%s", backend),
+	A1FS_OPT("cache_size=%u", cache_size),
+	A1FS_OPT("odirect", odirect),
+	A1FS_OPT("stripe=%s", stripe),
+	A1FS_OPT("dirty_max=%u", dirty_max),
+	A1FS_OPT("flush_interval=%u", flush_interval),
+	A1FS_OPT("discard", discard),
+	A1FS_OPT("discard_interval=%u", discard_interval),
+	A1FS_OPT("defrag_idle=%u", defrag_idle),
+	A1FS_OPT("compress", compress),
+	A1FS_OPT("dedup", dedup),
+	A1FS_OPT("dedup_index=%u", dedup_index),
+	A1FS_OPT("csum=%s", csum),
+	A1FS_OPT("trace=%s", trace),
 	FUSE_OPT_END
 };
 
@@ -44,6 +65,40 @@ general options:\n\
     -o opt,[opt...]        mount options\n\
     -h   --help            print help\n\
 \n\
+a1fs options:\n\
+    -o populate            prefault the image metadata on mount\n\
+    -o hugepage            use huge pages for the image data region\n\
+    -o mlock               lock the image metadata in memory\n\
+    -o advice=MODE         data access pattern advice: normal (default),\n\
+                           sequential or random\n\
+    -o backend=NAME        image storage backend: mmap (default), cache\n\
+                           (pread/pwrite) or uring (io_uring)\n\
+    -o cache_size=N        block cache size in MiB (cache, uring; default 64)\n\
+                           for data blocks; the superblock, bitmaps and\n\
+                           inode table are kept in memory on top of it\n\
+    -o odirect             bypass the host page cache (cache, uring)\n\
+    -o stripe=PATH[:PATH...]\n\
+                           the other images of a striped volume, in order\n\
+                           (mkfs.a1fs -s; mmap backend only)\n\
+    -o dirty_max=N         buffered file data limit in MiB (default 16)\n\
+    -o flush_interval=N    flush buffered file data older than N seconds\n\
+                           (default 5)\n\
+    -o discard             release the image file space of freed blocks\n\
+    -o discard_interval=N  discard freed blocks in batches every N seconds\n\
+                           (default 10)\n\
+    -o defrag_idle=N       defragment files in the background after N seconds\n\
+                           without file system operations (default off)\n\
+    -o compress            store file data appended from now on in\n\
+                           compressed 64 KiB clusters where it pays off\n\
+    -o dedup               share the data blocks appended from now on with\n\
+                           identical blocks (requires mkfs.a1fs -r)\n\
+    -o dedup_index=N       dedup index memory budget in MiB (default 16);\n\
+                           it takes 24 bytes per block of unique data\n\
+    -o csum=MODE           metadata checksums (mkfs.a1fs -c): verify\n\
+                           (default), noverify (only keep them up to date)\n\
+                           or rebuild (recompute all, e.g. after a crash)\n\
+    -o trace=FILE          record all operations in FILE for a1fs-replay\n\
+\n\
 ";
 
 // Callback for fuse_opt_parse()
@@ -60,6 +115,25 @@ static int opt_proc(void *data, const char *arg, int key, struct fuse_args *out)
 }
 
 
+void a1fs_opt_defaults(a1fs_opts *opts)
+{
+	if (opts->cache_size == 0) {
+		opts->cache_size = 64;
+	}
+	if (opts->dirty_max == 0) {
+		opts->dirty_max = 16;
+	}
+	if (opts->flush_interval == 0) {
+		opts->flush_interval = 5;
+	}
+	if (opts->discard_interval == 0) {
+		opts->discard_interval = 10;
+	}
+	if (opts->dedup_index == 0) {
+		opts->dedup_index = 16;
+	}
+}
+
 bool a1fs_opt_parse(struct fuse_args *args, a1fs_opts *opts)
 {
 	if (fuse_opt_parse(args, opts, opt_spec, opt_proc) != 0) {
@@ -75,6 +149,30 @@ bool a1fs_opt_parse(struct fuse_args *args, a1fs_opts *opts)
 		fprintf(stderr, "Missing image path\n");
 		return false;
 	}
+	map_advice advice;
+	if (opts->advice && !map_parse_advice(opts->advice, &advice)) {
+		fprintf(stderr, "Invalid advice: %s\n", opts->advice);
+		return false;
+	}
+	if (opts->backend && strcmp(opts->backend, "mmap") != 0 &&
+	    strcmp(opts->backend, "cache") != 0 &&
+	    strcmp(opts->backend, "uring") != 0)
+	{
+		fprintf(stderr, "Invalid backend: %s\n", opts->backend);
+		return false;
+	}
+	if (opts->stripe && opts->backend && strcmp(opts->backend, "mmap") != 0) {
+		fprintf(stderr, "Striped volumes require the mmap backend\n");
+		return false;
+	}
+	if (opts->csum && strcmp(opts->csum, "verify") != 0 &&
+	    strcmp(opts->csum, "noverify") != 0 &&
+	    strcmp(opts->csum, "rebuild") != 0)
+	{
+		fprintf(stderr, "Invalid csum mode: %s\n", opts->csum);
+		return false;
+	}
+	a1fs_opt_defaults(opts);
 
 	// Only single-threaded mount is supported
 	fuse_opt_add_arg(args, "-s");
@@ -20,7 +20,7 @@
 
 #include <stdbool.h>
 
-#include <fuse_opt.h>
+struct fuse_args;
 
 
 /** a1fs command line options. */
@@ -30,8 +30,65 @@ typedef struct a1fs_opts {
 	/** Print help and exit. FUSE option. */
 	int help;
 
+	/** Prefault the metadata region of the image. */
+	int populate;
+	/** Use transparent huge pages for the data region of the image. */
+	int hugepage;
+	/** Lock the metadata region of the image in memory. */
+	int mlock;
+	/** Access pattern advice for the data region ("normal", "sequential" or
+	 *  "random"). */
+	const char *advice;
+
+	/** Image storage backend ("mmap", "cache" or "uring"). */
+	const char *backend;
+	/** Block cache size in MiB (cache and uring backends). */
+	unsigned int cache_size;
+	/** Bypass the host page cache (cache and uring backends). */
+	int odirect;
+	/** Other images of a striped volume, separated by ':' (mmap backend). */
+	const char *stripe;
+
+	/** Buffered file data limit in MiB before files are flushed early. */
+	unsigned int dirty_max;
+	/** Age in seconds after which buffered file data is flushed. */
+	unsigned int flush_interval;
+
+	/** Release the image file space of freed blocks. */
+	int discard;
+	/** Interval in seconds between batches of discards. */
+	unsigned int discard_interval;
+
+	/** Idle time in seconds before files are defragmented in the background;
+	 *  0 to disable. */
+	unsigned int defrag_idle;
+
+	/** Compress file data in clusters as it is written out. */
+	int compress;
+
+	/** Share identical data blocks as file data is written out. */
+	int dedup;
+	/** Dedup index memory budget in MiB. */
+	unsigned int dedup_index;
+
+	/** Metadata checksum mode ("verify", "noverify" or "rebuild"). */
+	const char *csum;
+
+	/** Operation trace file path; NULL to disable tracing. */
+	const char *trace;
+
 } a1fs_opts;
 
+/**
+ * Set the options that were not given (left 0) to their defaults.
+ *
+ * Called by a1fs_opt_parse(); programs that mount an image in-process with
+ * fs_mount() call it on the options they fill in themselves.
+ *
+ * @param opts  pointer to the options struct.
+ */
+void a1fs_opt_defaults(a1fs_opts *opts);
+
 /**
  * Parse a1fs command line options.
  *
@@ -0,0 +1,73 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Sequential readahead implementation.
+ */
+
+#include "readahead.h"
+
+
+void ra_init(readahead *ra, a1fs_blk_t max)
+{
+	// A read from the start of the file is the beginning of a stream
+	ra->next = 0;
+	ra->ahead = 0;
+	ra->window = RA_MIN_BLOCKS;
+	ra->max = (max == 0 || max > RA_MAX_BLOCKS) ? RA_MAX_BLOCKS : max;
+	if (ra->max < RA_MIN_BLOCKS) {
+		ra->max = RA_MIN_BLOCKS;
+	}
+}
+
+bool ra_access(readahead *ra, a1fs_blk_t lblk, a1fs_blk_t nblocks,
+               a1fs_blk_t *start, a1fs_blk_t *count)
+{
+	if (lblk + 1 == ra->next) {
+		// Another read within the same block; nothing new to learn
+		return false;
+	}
+	bool sequential = lblk == ra->next;
+	ra->next = lblk + 1;
+
+	if (!sequential) {
+		if (ra->window > RA_MIN_BLOCKS) {
+			ra->window /= 2;
+		}
+		// Whatever was prefetched past the old position is of no use now
+		ra->ahead = lblk + 1;
+		return false;
+	}
+	if (ra->window < ra->max) {
+		ra->window *= 2;
+		if (ra->window > ra->max) {
+			ra->window = ra->max;
+		}
+	}
+
+	if (ra->ahead < lblk) {
+		ra->ahead = lblk;
+	}
+	// Wait until the reader is half way through the prefetched blocks
+	if (ra->ahead - lblk > ra->window / 2 || ra->ahead >= nblocks) {
+		return false;
+	}
+	*start = ra->ahead;
+	*count = lblk + ra->window - ra->ahead;
+	if (*count > nblocks - *start) {
+		*count = nblocks - *start;
+	}
+	ra->ahead = *start + *count;
+	return true;
+}
@@ -0,0 +1,73 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Sequential readahead header file.
+ *
+ * Each open file tracks whether it is being read sequentially. While it is,
+ * the blocks ahead of the reader are prefetched in a window that doubles on
+ * every sequential read up to a maximum size; the next window is requested
+ * when the reader is half way through the current one, so that the reads
+ * overlap with the consumption of the previous window. A non-sequential read
+ * halves the window and stops prefetching until the stream becomes sequential
+ * again.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "a1fs.h"
+
+
+/** Smallest readahead window in blocks. */
+#define RA_MIN_BLOCKS 4
+/** Largest readahead window in blocks (1 MB). */
+#define RA_MAX_BLOCKS 256
+
+/** Per-open-file readahead state. */
+typedef struct readahead {
+	/** Block that a sequential reader will read next. */
+	a1fs_blk_t next;
+	/** First block that has not been prefetched yet. */
+	a1fs_blk_t ahead;
+	/** Current window size in blocks. */
+	a1fs_blk_t window;
+	/** Largest window size in blocks. */
+	a1fs_blk_t max;
+
+} readahead;
+
+/**
+ * Initialize readahead state for a newly opened file.
+ *
+ * @param ra   readahead state.
+ * @param max  largest window in blocks, e.g. what the storage backend can
+ *             keep cached; 0 or anything above RA_MAX_BLOCKS means
+ *             RA_MAX_BLOCKS.
+ */
+void ra_init(readahead *ra, a1fs_blk_t max);
+
+/**
+ * Record a read of file block lblk and decide what to prefetch.
+ *
+ * @param ra       readahead state.
+ * @param lblk     file block being read.
+ * @param nblocks  number of blocks in the file.
+ * @param start    receives the first file block to prefetch.
+ * @param count    receives the number of blocks to prefetch.
+ * @return         true if [start, start + count) should be prefetched.
+ */
+bool ra_access(readahead *ra, a1fs_blk_t lblk, a1fs_blk_t nblocks,
+               a1fs_blk_t *start, a1fs_blk_t *count);
@@ -0,0 +1,450 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Operation trace replay tool.
+ *
+ * Replays a trace recorded with "-o trace=FILE" (see trace.h) against an
+ * image through the a1fs core library, e.g. to compare allocator or cache
+ * changes on a real workload. The image should be a copy of the one the trace
+ * was recorded on, as it was when the recording started; otherwise some
+ * operations will have a different outcome (which is reported).
+ *
+ * Operations are replayed in the order they were called in, either back to
+ * back or at their recorded times (optionally sped up). Written data is not
+ * recorded, so writes are replayed with a fixed non-zero pattern. Ioctls
+ * (whose arguments are not recorded) and accesses to the statistics file
+ * (which would reset the statistics of the replay) are skipped.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fs_ops.h"
+#include "stats.h"
+#include "trace.h"
+
+
+/** Command line options. */
+typedef struct replay_opts {
+	/** Trace file path. */
+	const char *trace_path;
+	/** Image file path. */
+	const char *img_path;
+	/** Storage backend, as in the backend= mount option. */
+	const char *backend;
+	/** Keep the recorded times between the operations. */
+	bool realtime;
+	/** Speed-up factor for realtime replay. */
+	double speed;
+	/** Print the statistics of the replayed operations. */
+	bool verbose;
+
+} replay_opts;
+
+/** Trace record with its paths. */
+typedef struct replay_rec {
+	a1fs_trace_rec rec;
+	/** Path; empty if none. */
+	char *path;
+	/** Second path; empty if none. */
+	char *path2;
+
+} replay_rec;
+
+/** Recorded open file handle mapped to the one of the replay. */
+typedef struct fh_map {
+	uint64_t recorded;
+	uint64_t fh;
+	/** Path the file was opened with. */
+	const char *path;
+
+} fh_map;
+
+/** Replay state. */
+typedef struct replay {
+	fs_ctx fs;
+	/** Records sorted by start time. */
+	replay_rec *recs;
+	size_t nrecs;
+	/** Open files. */
+	fh_map *files;
+	size_t nfiles;
+	size_t files_cap;
+	/** Data buffer for reads and writes. */
+	char *buf;
+	size_t buf_size;
+
+} replay;
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, "Usage: %s [options] trace image\n\
+\n\
+Replay an a1fs operation trace (recorded with -o trace=FILE) against a copy\n\
+of the image it was recorded on, in-process.\n\
+\n\
+    -b backend   storage backend: mmap (default), cache or uring\n\
+    -t timing    fast (default): run the operations back to back;\n\
+                 real: run them at their recorded times\n\
+    -x speed     speed-up factor for -t real (default 1)\n\
+    -v           print the statistics of the replayed operations\n\
+    -h           print help and exit\n\
+", progname);
+}
+
+static bool parse_args(int argc, char *argv[], replay_opts *opts)
+{
+	char o;
+	while ((o = getopt(argc, argv, "b:t:x:vh")) != -1) {
+		switch (o) {
+			case 'b': opts->backend = optarg; break;
+			case 't':
+				if (strcmp(optarg, "real") == 0) {
+					opts->realtime = true;
+				} else if (strcmp(optarg, "fast") != 0) {
+					fprintf(stderr, "Invalid timing: %s\n", optarg);
+					return false;
+				}
+				break;
+			case 'x': opts->speed = strtod(optarg, NULL); break;
+			case 'v': opts->verbose = true; break;
+			case 'h': print_help(stdout, argv[0]); exit(0);
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+	if (optind != argc - 2) {
+		fprintf(stderr, "Missing trace or image path\n");
+		return false;
+	}
+	opts->trace_path = argv[optind];
+	opts->img_path = argv[optind + 1];
+	if (!(opts->speed > 0)) {
+		fprintf(stderr, "Invalid speed\n");
+		return false;
+	}
+	if (opts->backend && strcmp(opts->backend, "mmap") != 0 &&
+	    strcmp(opts->backend, "cache") != 0 &&
+	    strcmp(opts->backend, "uring") != 0)
+	{
+		fprintf(stderr, "Invalid backend: %s\n", opts->backend);
+		return false;
+	}
+	return true;
+}
+
+/** Read a path of a record; returns a null-terminated copy. */
+static char *read_path(FILE *f, size_t len)
+{
+	char *path = malloc(len + 1);
+	if (!path) {
+		return NULL;
+	}
+	if (fread(path, 1, len, f) != len) {
+		free(path);
+		return NULL;
+	}
+	path[len] = '\0';
+	return path;
+}
+
+static int cmp_start(const void *a, const void *b)
+{
+	uint64_t x = ((const replay_rec*)a)->rec.start;
+	uint64_t y = ((const replay_rec*)b)->rec.start;
+	return (x > y) - (x < y);
+}
+
+/** Load all records of a trace file, sorted by start time. */
+static bool load_trace(replay *r, const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return false;
+	}
+	a1fs_trace_header hdr;
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != A1FS_TRACE_MAGIC ||
+	    hdr.version != A1FS_TRACE_VERSION ||
+	    hdr.rec_size != sizeof(a1fs_trace_rec))
+	{
+		fprintf(stderr, "%s: not an a1fs trace file\n", path);
+		fclose(f);
+		return false;
+	}
+
+	size_t cap = 0;
+	a1fs_trace_rec rec;
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (r->nrecs == cap) {
+			cap = cap ? cap * 2 : 4096;
+			replay_rec *recs = realloc(r->recs, cap * sizeof(*recs));
+			if (!recs) {
+				perror("realloc");
+				fclose(f);
+				return false;
+			}
+			r->recs = recs;
+		}
+		replay_rec *rr = &r->recs[r->nrecs];
+		rr->rec = rec;
+		rr->path = read_path(f, rec.path_len);
+		rr->path2 = rr->path ? read_path(f, rec.path2_len) : NULL;
+		size_t len = sizeof(rec) + rec.path_len + rec.path2_len;
+		size_t pad = ((len + 7) & ~(size_t)7) - len;
+		if (!rr->path2 || fseek(f, pad, SEEK_CUR) != 0) {
+			fprintf(stderr, "%s: truncated record\n", path);
+			free(rr->path);
+			break;
+		}
+		r->nrecs++;
+
+		if (rec.size > r->buf_size && (rec.op == STATS_OP_read ||
+		                               rec.op == STATS_OP_write))
+		{
+			char *buf = realloc(r->buf, rec.size);
+			if (!buf) {
+				perror("realloc");
+				fclose(f);
+				return false;
+			}
+			// Non-zero, so that it isn't mistaken for a hole
+			memset(buf, 0x5a, rec.size);
+			r->buf = buf;
+			r->buf_size = rec.size;
+		}
+	}
+	fclose(f);
+
+	// Records of different threads are drained to the file separately
+	qsort(r->recs, r->nrecs, sizeof(*r->recs), cmp_start);
+	return true;
+}
+
+/** Find the replay handle of a recorded open file handle; NULL if none. */
+static fh_map *find_file(replay *r, uint64_t recorded)
+{
+	for (size_t i = 0; i < r->nfiles; i++) {
+		if (r->files[i].recorded == recorded) {
+			return &r->files[i];
+		}
+	}
+	return NULL;
+}
+
+/** Remember the replay handle of a recorded open file handle. */
+static int add_file(replay *r, uint64_t recorded, uint64_t fh,
+                    const char *path)
+{
+	if (r->nfiles == r->files_cap) {
+		size_t cap = r->files_cap ? r->files_cap * 2 : 64;
+		fh_map *files = realloc(r->files, cap * sizeof(*files));
+		if (!files) {
+			return -ENOMEM;
+		}
+		r->files = files;
+		r->files_cap = cap;
+	}
+	r->files[r->nfiles++] = (fh_map){
+		.recorded = recorded, .fh = fh, .path = path
+	};
+	return 0;
+}
+
+static int fill_none(void *buf, const char *name, const struct stat *st,
+                     off_t off)
+{
+	(void)buf;// unused
+	(void)name;// unused
+	(void)st;// unused
+	(void)off;// unused
+	return 0;
+}
+
+/**
+ * Replay one operation.
+ *
+ * @return  operation return value; 1 if the operation was skipped.
+ */
+static int replay_op(replay *r, const replay_rec *rr)
+{
+	const a1fs_trace_rec *rec = &rr->rec;
+	fs_ctx *fs = &r->fs;
+	if (strcmp(rr->path, A1FS_STATS_FILE) == 0 ||
+	    strcmp(rr->path2, A1FS_STATS_FILE) == 0)
+	{
+		return 1;
+	}
+	struct stat st;
+	struct statvfs stv;
+	uint64_t fh = 0;
+	fh_map *file;
+	int ret;
+
+	switch (rec->op) {
+		case STATS_OP_lookup: return fs_lookup(fs, rr->path);
+		case STATS_OP_statfs: return fs_statfs(fs, &stv);
+		case STATS_OP_getattr: return fs_getattr(fs, rr->path, &st);
+		case STATS_OP_readdir:
+			return fs_readdir(fs, rr->path, NULL, fill_none);
+		case STATS_OP_mkdir: return fs_mkdir(fs, rr->path, rec->arg);
+		case STATS_OP_rmdir: return fs_rmdir(fs, rr->path);
+		case STATS_OP_unlink: return fs_unlink(fs, rr->path);
+		case STATS_OP_rename: return fs_rename(fs, rr->path, rr->path2);
+		case STATS_OP_utimens: return fs_utimens(fs, rr->path, NULL);
+		case STATS_OP_truncate:
+			return fs_truncate(fs, rr->path, rec->size);
+		case STATS_OP_fsync: return fs_fsync(fs, rr->path, rec->arg);
+		case STATS_OP_fallocate:
+			return fs_fallocate(fs, rr->path, rec->arg, rec->offset,
+			                    rec->size);
+		case STATS_OP_write:
+			return fs_write(fs, rr->path, r->buf, rec->size, rec->offset);
+
+		case STATS_OP_create:
+		case STATS_OP_open:
+			ret = (rec->op == STATS_OP_create)
+			    ? fs_create(fs, rr->path, rec->arg, &fh)
+			    : fs_open(fs, rr->path, &fh);
+			if (ret == 0 && add_file(r, rec->fh, fh, rr->path) < 0) {
+				fs_release(fs, rr->path, fh);
+				ret = -ENOMEM;
+			}
+			return ret;
+		case STATS_OP_read:
+			file = find_file(r, rec->fh);
+			return fs_read(fs, rr->path, r->buf, rec->size, rec->offset,
+			               file ? file->fh : 0);
+		case STATS_OP_release:
+			file = find_file(r, rec->fh);
+			if (!file) {
+				// Opened before the trace started, or the open failed
+				return 1;
+			}
+			ret = fs_release(fs, rr->path, file->fh);
+			*file = r->files[--r->nfiles];
+			return ret;
+
+		default:
+			// ioctl arguments are not recorded
+			return 1;
+	}
+}
+
+/** Sleep until a stats_now() time. */
+static void sleep_until(uint64_t t)
+{
+	uint64_t now = stats_now();
+	if (t > now) {
+		struct timespec ts = {
+			.tv_sec  = (t - now) / 1000000000,
+			.tv_nsec = (t - now) % 1000000000,
+		};
+		nanosleep(&ts, NULL);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	replay_opts opts = { .speed = 1.0 };
+	if (!parse_args(argc, argv, &opts)) {
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+
+	replay *r = calloc(1, sizeof(*r));
+	if (!r) {
+		perror("calloc");
+		return 1;
+	}
+	if (!load_trace(r, opts.trace_path)) {
+		free(r);
+		return 1;
+	}
+	a1fs_opts mopts = {
+		.img_path = opts.img_path,
+		.backend  = opts.backend,
+	};
+	a1fs_opt_defaults(&mopts);
+	if (!fs_mount(&r->fs, &mopts)) {
+		fprintf(stderr, "Failed to mount the image\n");
+		free(r);
+		return 1;
+	}
+	fs_start(&r->fs);
+
+	size_t skipped = 0, mismatched = 0;
+	uint64_t recorded_ns = 0, replayed_ns = 0;
+	uint64_t first = r->nrecs > 0 ? r->recs[0].rec.start : 0;
+	uint64_t start = stats_now();
+	for (size_t i = 0; i < r->nrecs; i++) {
+		const a1fs_trace_rec *rec = &r->recs[i].rec;
+		if (opts.realtime) {
+			sleep_until(start + (uint64_t)((rec->start - first) / opts.speed));
+		}
+		uint64_t op_start = stats_now();
+		int ret = replay_op(r, &r->recs[i]);
+		if (ret == 1) {
+			skipped++;
+			continue;
+		}
+		replayed_ns += stats_now() - op_start;
+		recorded_ns += rec->end - rec->start;
+		if ((ret < 0) != (rec->ret < 0)) {
+			mismatched++;
+		}
+	}
+	uint64_t elapsed = stats_now() - start;
+
+	uint64_t span = r->nrecs > 0 ? r->recs[r->nrecs - 1].rec.end - first : 0;
+	printf("%zu operations replayed, %zu skipped, %zu with a different "
+	       "outcome\n", r->nrecs - skipped, skipped, mismatched);
+	printf("recorded: %.3f s, %.3f s in operations\n", span / 1e9,
+	       recorded_ns / 1e9);
+	printf("replayed: %.3f s, %.3f s in operations\n", elapsed / 1e9,
+	       replayed_ns / 1e9);
+	if (opts.verbose) {
+		size_t len = stats_format(&r->fs.stats, NULL, 0);
+		char *report = malloc(len + 1);
+		if (report) {
+			stats_format(&r->fs.stats, report, len + 1);
+			fputs(report, stdout);
+			free(report);
+		}
+	}
+
+	// Close the files left open by the trace
+	for (size_t i = 0; i < r->nfiles; i++) {
+		fs_release(&r->fs, r->files[i].path, r->files[i].fh);
+	}
+	fs_unmount(&r->fs);
+	for (size_t i = 0; i < r->nrecs; i++) {
+		free(r->recs[i].path);
+		free(r->recs[i].path2);
+	}
+	free(r->recs);
+	free(r->files);
+	free(r->buf);
+	free(r);
+	return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - a1fs resize tool.
+ *
+ * Grows an a1fs file system in place, either online through the
+ * A1FS_IOC_RESIZE request on a mounted file system, or offline by mounting an
+ * image in-process with the a1fs core library and making the same request.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "a1fs_ioctl.h"
+#include "fs_ops.h"
+#include "util.h"
+
+
+/** Command line options. */
+typedef struct resize_opts {
+	/** Image file or a path in a mounted a1fs. */
+	const char *path;
+	/** New size in bytes (or how much to grow by); 0 if not given. */
+	size_t size;
+	/** The size is relative to the current one. */
+	bool relative;
+	/** Storage backend for an image, as in the backend= mount option. */
+	const char *backend;
+
+	/** Print help and exit. */
+	bool help;
+
+} resize_opts;
+
+static const char *help_str = "\
+Usage: %s options path [size]\n\
+\n\
+Grow an a1fs file system. The path is either an image file that is not\n\
+mounted, or any file or directory in a mounted a1fs. The size is the new\n\
+image size in bytes with an optional K, M, G or T suffix, or +size to grow\n\
+the image by that much; without it, the current size and the largest size\n\
+that the image can be grown to (see mkfs.a1fs -g) are reported.\n\
+\n\
+Options:\n\
+    -b name  storage backend for an image file: mmap, cache or uring\n\
+             (default mmap)\n\
+    -h       print help and exit\n\
+";
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, help_str, progname);
+}
+
+
+static bool parse_args(int argc, char *argv[], resize_opts *opts)
+{
+	char o;
+	while ((o = getopt(argc, argv, "b:h")) != -1) {
+		switch (o) {
+			case 'b': opts->backend = optarg; break;
+
+			case 'h': opts->help = true; return true;// skip other arguments
+
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "Missing path\n");
+		return false;
+	}
+	opts->path = argv[optind];
+	if (optind + 1 < argc) {
+		const char *size = argv[optind + 1];
+		opts->relative = (size[0] == '+');
+		if (!parse_size(size + opts->relative, &opts->size) || !opts->size) {
+			fprintf(stderr, "Invalid size: %s\n", size);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/**
+ * Make an A1FS_IOC_RESIZE request on a path in a mounted a1fs.
+ *
+ * @return  0 on success; -ENOTTY if the path is not in an a1fs; -errno on
+ *          other errors.
+ */
+static int resize_mounted(const char *path, a1fs_resize *req)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -errno;
+	}
+	int ret = ioctl(fd, A1FS_IOC_RESIZE, req) < 0 ? -errno : 0;
+	close(fd);
+	return ret;
+}
+
+/**
+ * Make an A1FS_IOC_RESIZE request on an image that is not mounted.
+ *
+ * @return  0 on success; -errno on error (-ENODEV if the image can't be
+ *          mounted).
+ */
+static int resize_image(const resize_opts *opts, a1fs_resize *req)
+{
+	a1fs_opts mopts = {
+		.img_path = opts->path,
+		.backend  = opts->backend,
+	};
+	a1fs_opt_defaults(&mopts);
+	fs_ctx fs = {0};
+	if (!fs_mount(&fs, &mopts)) {
+		return -ENODEV;
+	}
+	int ret = fs_ioctl(&fs, "/", A1FS_IOC_RESIZE, req);
+	fs_unmount(&fs);
+	return ret;
+}
+
+/**
+ * Make an A1FS_IOC_RESIZE request on the path, mounted or not.
+ *
+ * @return  0 on success; -ENOTTY if the path is neither in an a1fs nor a
+ *          regular file; -errno on other errors.
+ */
+static int resize(const resize_opts *opts, a1fs_resize *req)
+{
+	// Files outside of a1fs (e.g. the image itself) don't know the request
+	int ret = resize_mounted(opts->path, req);
+	struct stat st;
+	if (ret == -ENOTTY && stat(opts->path, &st) == 0 && S_ISREG(st.st_mode)) {
+		ret = resize_image(opts, req);
+	}
+	return ret;
+}
+
+
+int main(int argc, char *argv[])
+{
+	resize_opts opts = {0};// defaults are all 0
+	if (!parse_args(argc, argv, &opts)) {
+		// Invalid arguments, print help to stderr
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+	if (opts.help) {
+		// Help requested, print it to stdout
+		print_help(stdout, argv[0]);
+		return 0;
+	}
+
+	a1fs_resize cur = {0};
+	int ret = resize(&opts, &cur);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", opts.path,
+		        ret == -ENOTTY ? "not an a1fs image or file system"
+		        : ret == -ENODEV ? "failed to mount the image"
+		        : strerror(-ret));
+		return 1;
+	}
+	if (!opts.size) {
+		printf("Size: %lu MiB (%lu data blocks, %lu free)\n", cur.size >> 20,
+		       cur.blocks, cur.free_blocks);
+		printf("Largest size: %lu MiB\n", cur.max_size >> 20);
+		return 0;
+	}
+
+	a1fs_resize req = {
+		.size = opts.relative ? cur.size + opts.size : opts.size
+	};
+	ret = resize(&opts, &req);
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s\n", opts.path,
+		        ret == -EINVAL ? "shrinking is not supported"
+		        : ret == -EFBIG ? "larger than the image can be grown to"
+		        : strerror(-ret));
+		if (ret == -EFBIG) {
+			fprintf(stderr, "Largest size: %lu MiB\n", cur.max_size >> 20);
+		}
+		return 1;
+	}
+	printf("Resized from %lu to %lu MiB, %lu MiB free\n", cur.size >> 20,
+	       req.size >> 20, req.free_blocks * A1FS_BLOCK_SIZE >> 20);
+	return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - File system statistics implementation.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "stats.h"
+
+
+/** Names of the operations, indexed by stats_op. */
+static const char *const op_names[STATS_NOPS] = {
+#define STATS_OP_NAME(name) #name,
+	STATS_OPS(STATS_OP_NAME)
+#undef STATS_OP_NAME
+};
+
+uint64_t stats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Get the histogram bucket of a latency. */
+static unsigned int latency_bucket(uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	if (us == 0) {
+		return 0;
+	}
+	unsigned int b = 64 - __builtin_clzll(us);
+	return b < STATS_BUCKETS ? b : STATS_BUCKETS - 1;
+}
+
+void stats_op_done(fs_stats *stats, stats_op op, uint64_t start, int ret)
+{
+	uint64_t ns = stats_now() - start;
+	stats_op_counters *c = &stats->ops[op];
+	stats_add(&c->calls, 1);
+	if (ret < 0) {
+		stats_add(&c->errors, 1);
+	}
+	stats_add(&c->total_ns, ns);
+	stats_add(&c->hist[latency_bucket(ns)], 1);
+}
+
+void stats_reset(fs_stats *stats)
+{
+	uint64_t *counters = (uint64_t*)stats;
+	for (size_t i = 0; i < sizeof(*stats) / sizeof(uint64_t); i++) {
+		__atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+	}
+}
+
+/** Report being formatted by stats_format(). */
+typedef struct report {
+	char *buf;
+	size_t size;
+	size_t len;
+} report;
+
+/** Append formatted text to a report, truncating it at the buffer size. */
+__attribute__((format(printf, 2, 3)))
+static void report_add(report *r, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	size_t left = r->len < r->size ? r->size - r->len : 0;
+	int n = vsnprintf(left ? r->buf + r->len : NULL, left, fmt, args);
+	va_end(args);
+	if (n > 0) {
+		r->len += n;
+	}
+}
+
+/** Append a counter value in a field of given width, including a leading
+ *  space; the value saturates instead of widening the field. */
+static void report_counter(report *r, int width, const uint64_t *counter)
+{
+	uint64_t value = __atomic_load_n(counter, __ATOMIC_RELAXED);
+	// A uint64_t has at most 20 digits
+	if (width - 1 < 20) {
+		uint64_t max = 1;
+		for (int i = 0; i < width - 1; i++) {
+			max *= 10;
+		}
+		if (value >= max) {
+			value = max - 1;
+		}
+	}
+	report_add(r, " %*lu", width - 1, value);
+}
+
+size_t stats_format(const fs_stats *stats, char *buf, size_t size)
+{
+	report r = { .buf = buf, .size = size, .len = 0 };
+
+	report_add(&r, "# a1fs statistics; write to or truncate this file to reset"
+	               "\n# latency histogram columns start at the given number "
+	               "of microseconds\n");
+	report_add(&r, "%-10s %12s %12s %14s", "op", "calls", "errors",
+	           "total_us");
+	for (unsigned int b = 0; b < STATS_BUCKETS; b++) {
+		report_add(&r, " %9lu", b ? 1UL << (b - 1) : 0);
+	}
+	report_add(&r, "\n");
+
+	for (int op = 0; op < STATS_NOPS; op++) {
+		const stats_op_counters *c = &stats->ops[op];
+		report_add(&r, "%-10s", op_names[op]);
+		report_counter(&r, 13, &c->calls);
+		report_counter(&r, 13, &c->errors);
+		uint64_t total_us = __atomic_load_n(&c->total_ns, __ATOMIC_RELAXED)
+		                  / 1000;
+		report_counter(&r, 15, &total_us);
+		for (unsigned int b = 0; b < STATS_BUCKETS; b++) {
+			report_counter(&r, 10, &c->hist[b]);
+		}
+		report_add(&r, "\n");
+	}
+
+	report_add(&r, "%-17s", "bytes_read");
+	report_counter(&r, 21, &stats->bytes_read);
+	report_add(&r, "\n%-17s", "bytes_written");
+	report_counter(&r, 21, &stats->bytes_written);
+	report_add(&r, "\n%-17s", "blocks_allocated");
+	report_counter(&r, 21, &stats->blocks_allocated);
+	report_add(&r, "\n%-17s", "dentries_scanned");
+	report_counter(&r, 21, &stats->dentries_scanned);
+	report_add(&r, "\n");
+	return r.len;
+}
@@ -0,0 +1,120 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - File system statistics header file.
+ *
+ * Counts the calls, errors and latencies of every file system operation, and
+ * a few totals of the work done by them. The counters are updated with relaxed
+ * atomic adds and never take a lock, so they can be updated outside of the
+ * file system lock (e.g. to include the time spent waiting for it) and read
+ * at any time. A snapshot taken while operations are running is not
+ * consistent across counters, but each counter is.
+ *
+ * Latencies are kept in log2 histograms: bucket 0 counts operations that took
+ * less than 1 us, and bucket b > 0 the ones that took [2^(b-1), 2^b) us; the
+ * last bucket also counts everything slower.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** Apply X to the name of every file system operation (see fs_ops.h). */
+#define STATS_OPS(X)                                                        \
+	X(lookup) X(statfs) X(getattr) X(readdir) X(mkdir) X(rmdir) X(create)   \
+	X(unlink) X(rename) X(utimens) X(truncate) X(open) X(read) X(write)     \
+	X(release) X(fsync) X(fallocate) X(ioctl)
+
+/** File system operation whose calls are counted. */
+typedef enum stats_op {
+#define STATS_OP_ENUM(name) STATS_OP_##name,
+	STATS_OPS(STATS_OP_ENUM)
+#undef STATS_OP_ENUM
+	STATS_NOPS
+} stats_op;
+
+/** Number of latency histogram buckets; the last one is for >= ~1 s. */
+#define STATS_BUCKETS 22
+
+/** Counters of one file system operation. */
+typedef struct stats_op_counters {
+	/** Number of calls. */
+	uint64_t calls;
+	/** Calls that returned an error. */
+	uint64_t errors;
+	/** Total time spent in the calls in nanoseconds. */
+	uint64_t total_ns;
+	/** Latency histogram. */
+	uint64_t hist[STATS_BUCKETS];
+
+} stats_op_counters;
+
+/**
+ * File system statistics.
+ *
+ * NOTE: only has uint64_t counters; stats_reset() relies on that.
+ */
+typedef struct fs_stats {
+	/** Per-operation counters, indexed by stats_op. */
+	stats_op_counters ops[STATS_NOPS];
+	/** Bytes returned by read operations. */
+	uint64_t bytes_read;
+	/** Bytes accepted by write operations. */
+	uint64_t bytes_written;
+	/** Data blocks allocated. */
+	uint64_t blocks_allocated;
+	/** Directory entries looked at by lookups and readdir. */
+	uint64_t dentries_scanned;
+
+} fs_stats;
+
+/** Add n to a counter. */
+static inline void stats_add(uint64_t *counter, uint64_t n)
+{
+	__atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+/** Get the current time in nanoseconds for measuring operation latency. */
+uint64_t stats_now(void);
+
+/**
+ * Record a completed operation.
+ *
+ * @param stats  file system statistics.
+ * @param op     operation.
+ * @param start  time the operation started at, as returned by stats_now().
+ * @param ret    operation return value; negative if it failed.
+ */
+void stats_op_done(fs_stats *stats, stats_op op, uint64_t start, int ret);
+
+/** Reset all counters to 0. */
+void stats_reset(fs_stats *stats);
+
+/**
+ * Format a text report of the statistics.
+ *
+ * All numbers are printed with a fixed width (saturating if they don't fit),
+ * so the report always has the same length; the length of the virtual
+ * statistics file can then be known before its contents are generated.
+ *
+ * @param stats  file system statistics.
+ * @param buf    buffer that receives the report; may be NULL if size is 0.
+ * @param size   buffer size in bytes.
+ * @return       report length in bytes (excluding the terminating null); the
+ *               report is truncated if this is not less than size.
+ */
+size_t stats_format(const fs_stats *stats, char *buf, size_t size);
@@ -0,0 +1,279 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Image storage backend interface header file.
+ *
+ * A storage backend gives the file system access to the blocks of the image.
+ * The metadata region at the start of the image (everything before the first
+ * data block) is always resident and contiguous in memory, so that the
+ * superblock, bitmaps, inode table and extent blocks can be accessed directly
+ * through st->meta. Other blocks are accessed one at a time with
+ * storage_get().
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "a1fs.h"
+#include "map.h"
+
+
+/** Storage backend statistics. */
+typedef struct storage_stats {
+	/** Block lookups satisfied from memory. */
+	uint64_t hits;
+	/** Block lookups that had to read the block from the image file. */
+	uint64_t misses;
+	/** Blocks evicted from memory. */
+	uint64_t evictions;
+	/** Dirty blocks written back to the image file. */
+	uint64_t writebacks;
+	/** Blocks read ahead of use by prefetch(). */
+	uint64_t prefetched;
+	/** Blocks whose image file space was released by discard(). */
+	uint64_t discarded;
+
+} storage_stats;
+
+typedef struct storage storage;
+
+/** A run of consecutive image blocks. */
+typedef struct storage_range {
+	/** First block number in the image. */
+	a1fs_blk_t start;
+	/** Number of blocks. */
+	a1fs_blk_t count;
+
+} storage_range;
+
+/** Storage backend operations. */
+typedef struct storage_ops {
+	/** Backend name, as given in the backend= mount option. */
+	const char *name;
+
+	/**
+	 * Get a pointer to the contents of a block.
+	 *
+	 * Unless the block is in the metadata region, the pointer is only valid
+	 * until the next call to get().
+	 *
+	 * @param st     storage backend.
+	 * @param blk    block number in the image.
+	 * @param write  true if the caller will modify the block.
+	 * @return       pointer to the block contents; NULL on I/O error.
+	 */
+	void *(*get)(storage *st, a1fs_blk_t blk, bool write);
+
+	/**
+	 * Start bringing several runs of blocks into memory at once.
+	 *
+	 * This is only a hint: the backend may read fewer blocks than asked
+	 * (e.g. if they don't fit in the cache). Like get(), it invalidates the
+	 * pointers returned by earlier get() calls. NULL if not supported.
+	 *
+	 * @param st      storage backend.
+	 * @param ranges  runs of blocks to read.
+	 * @param n       number of runs.
+	 * @return        0 on success; -1 on I/O error.
+	 */
+	int (*prefetch)(storage *st, const storage_range *ranges, size_t n);
+
+	/**
+	 * Release the image file space behind runs of blocks whose contents are no
+	 * longer needed.
+	 *
+	 * The blocks read as zeros afterwards, and modified copies of them are
+	 * dropped instead of being written back. Must not be used on the metadata
+	 * region. NULL if not supported.
+	 *
+	 * @param st      storage backend.
+	 * @param ranges  runs of blocks to release.
+	 * @param n       number of runs.
+	 * @return        0 on success; -1 on failure (e.g. the host file system
+	 *                doesn't support punching holes).
+	 */
+	int (*discard)(storage *st, const storage_range *ranges, size_t n);
+
+	/**
+	 * Record that a range of the metadata region was modified.
+	 *
+	 * NULL if the backend doesn't need to track metadata changes.
+	 */
+	void (*meta_dirty)(storage *st, size_t offset, size_t len);
+
+	/**
+	 * Extend the image file to size bytes.
+	 *
+	 * The new blocks are appended to the end of the image; st->meta and the
+	 * pointers into the metadata region stay valid. NULL if not supported.
+	 *
+	 * @param st    storage backend.
+	 * @param size  new image size in bytes; a multiple of the block size.
+	 * @return      0 on success; -1 on failure (e.g. out of the address space
+	 *              reserved for the mapping).
+	 */
+	int (*grow)(storage *st, size_t size);
+
+	/** Write all modified blocks back to the image file. */
+	int (*sync)(storage *st);
+
+	/** Get backend statistics. */
+	void (*stats)(storage *st, storage_stats *stats);
+
+	/** Write back modified blocks and release all resources. */
+	void (*destroy)(storage *st);
+
+} storage_ops;
+
+/** Storage backend state common to all backends. */
+struct storage {
+	/** Backend operations. */
+	const storage_ops *ops;
+	/** Metadata region of the image; always resident. */
+	void *meta;
+	/** Size of the metadata region in bytes. */
+	size_t meta_size;
+	/** Image size in bytes. */
+	size_t size;
+	/** Largest useful prefetch in blocks; 0 if unlimited. */
+	size_t prefetch_max;
+};
+
+/** Block cache backend options. */
+typedef struct cache_opts {
+	/** Memory budget for cached data blocks in bytes. */
+	size_t budget;
+	/** Bypass the host page cache (O_DIRECT). */
+	bool direct;
+	/** Perform I/O through an io_uring instead of preadv()/pwritev(). */
+	bool uring;
+	/** io_uring submission queue depth. */
+	unsigned int uring_depth;
+	/** Compute the size of the metadata region; see map_opts. */
+	size_t (*meta_size)(const void *image, size_t size, void *arg);
+	/**
+	 * Compute the size of the part at the start of the metadata region that
+	 * is read at open and kept in memory; meta is the size of the region.
+	 * NULL to pin the whole region.
+	 */
+	size_t (*pin_size)(const void *image, size_t meta, void *arg);
+	/** Argument passed to meta_size() and pin_size(). */
+	void *arg;
+
+} cache_opts;
+
+/**
+ * Open an image with the mmap backend.
+ *
+ * The whole image is mapped with map_file(), and the kernel page cache decides
+ * which blocks stay resident. The image can only be grown up to the size that
+ * opts->max_size() returns.
+ *
+ * @param path  image file path.
+ * @param opts  mapping tuning options; must provide meta_size().
+ * @return      storage backend on success; NULL on failure.
+ */
+storage *storage_mmap_open(const char *path, const map_opts *opts);
+
+/**
+ * Open a striped volume (see A1FS_FEATURE_STRIPE) with the stripe backend.
+ *
+ * Each member image is mapped with map_file(), like with the mmap backend.
+ * The metadata region is at the start of the first member, and the data
+ * blocks are spread over the members chunk by chunk, so that a long run of
+ * blocks is read and written through all the image files (and the disks they
+ * are on) at once. The volume can't be grown.
+ *
+ * @param paths  member image file paths, in the order of the volume.
+ * @param count  number of members.
+ * @param opts   mapping tuning options; must provide meta_size().
+ * @return       storage backend on success; NULL on failure (e.g. the images
+ *               are not the members of one volume in this order).
+ */
+storage *storage_stripe_open(const char *const *paths, size_t count,
+                             const map_opts *opts);
+
+/**
+ * Open an image with the block cache backend.
+ *
+ * The metadata region is mapped copy-on-write from the image file. Its pinned
+ * part (see opts->pin_size()) is read into memory at open; the rest is read
+ * from the host page cache on first use, and only the blocks that were
+ * modified stay in memory for good. Data blocks are read and written through
+ * a cache with CLOCK eviction that holds at most opts->budget bytes of data
+ * blocks. The I/O itself is done by an I/O engine
+ * (see io.h): preadv()/pwritev(), or an io_uring that has the requests of a
+ * prefetch or a writeback in flight together.
+ *
+ * @param path  image file path.
+ * @param opts  cache options; must provide meta_size().
+ * @return      storage backend on success; NULL on failure.
+ */
+storage *storage_cache_open(const char *path, const cache_opts *opts);
+
+/** Get a pointer to the contents of a block; see storage_ops.get. */
+static inline void *storage_get(storage *st, a1fs_blk_t blk, bool write)
+{
+	return st->ops->get(st, blk, write);
+}
+
+/** Bring runs of blocks into memory; see storage_ops.prefetch. */
+static inline int storage_prefetch(storage *st, const storage_range *ranges,
+                                   size_t n)
+{
+	return st->ops->prefetch ? st->ops->prefetch(st, ranges, n) : 0;
+}
+
+/** Release the space of runs of unused blocks; see storage_ops.discard. */
+static inline int storage_discard(storage *st, const storage_range *ranges,
+                                  size_t n)
+{
+	return st->ops->discard ? st->ops->discard(st, ranges, n) : -1;
+}
+
+/** Record a modification of len bytes of metadata at ptr (inside st->meta). */
+static inline void storage_meta_dirty(storage *st, const void *ptr, size_t len)
+{
+	if (st->ops->meta_dirty) {
+		st->ops->meta_dirty(st, (const char*)ptr - (const char*)st->meta, len);
+	}
+}
+
+/** Extend the image file; see storage_ops.grow. */
+static inline int storage_grow(storage *st, size_t size)
+{
+	return st->ops->grow ? st->ops->grow(st, size) : -1;
+}
+
+/** Write all modified blocks back to the image file. */
+static inline int storage_sync(storage *st)
+{
+	return st->ops->sync(st);
+}
+
+/** Get backend statistics. */
+static inline void storage_stats_get(storage *st, storage_stats *stats)
+{
+	st->ops->stats(st, stats);
+}
+
+/** Write back modified blocks and release the backend. */
+static inline void storage_destroy(storage *st)
+{
+	st->ops->destroy(st);
+}
@@ -0,0 +1,244 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Storage backend throughput benchmark.
+ *
+ * Compares the mmap, cache (preadv/pwritev) and uring (io_uring) backends on
+ * an image file: a full write followed by a sync, then sequential and random
+ * block reads, both one block at a time and in prefetched batches. The image
+ * contents past the first block are overwritten, so use a scratch file.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "storage.h"
+
+
+/** Command line options. */
+typedef struct bench_opts {
+	/** Image file path. */
+	const char *img_path;
+	/** Backend to run, or NULL for all of them. */
+	const char *backend;
+	/** Block cache size in MiB. */
+	unsigned int cache_size;
+	/** Number of blocks in a prefetched batch. */
+	unsigned int batch;
+	/** Use O_DIRECT in the cache backends. */
+	bool direct;
+
+} bench_opts;
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, "Usage: %s [options] image\n\
+\n\
+Measure storage backend throughput on a scratch image file.\n\
+\n\
+    -b backend   run only this backend: mmap, cache or uring\n\
+    -c size      block cache size in MiB (default 16)\n\
+    -B blocks    prefetch batch size in blocks (default 32)\n\
+    -d           bypass the host page cache (cache backends)\n\
+    -h           print help and exit\n\
+", progname);
+}
+
+static bool parse_args(int argc, char *argv[], bench_opts *opts)
+{
+	char o;
+	while ((o = getopt(argc, argv, "b:c:B:dh")) != -1) {
+		switch (o) {
+			case 'b': opts->backend = optarg; break;
+			case 'c': opts->cache_size = strtoul(optarg, NULL, 10); break;
+			case 'B': opts->batch = strtoul(optarg, NULL, 10); break;
+			case 'd': opts->direct = true; break;
+			case 'h': print_help(stdout, argv[0]); exit(0);
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "Missing image path\n");
+		return false;
+	}
+	opts->img_path = argv[optind];
+	if (opts->cache_size == 0 || opts->batch == 0) {
+		fprintf(stderr, "Invalid cache or batch size\n");
+		return false;
+	}
+	return true;
+}
+
+/** Treat only the first block of the image as metadata. */
+static size_t bench_meta_size(const void *image, size_t size, void *arg)
+{
+	(void)image;
+	(void)size;
+	(void)arg;
+	return A1FS_BLOCK_SIZE;
+}
+
+static storage *open_backend(const char *name, const bench_opts *opts)
+{
+	if (strcmp(name, "mmap") == 0) {
+		map_opts mopts = { .meta_size = bench_meta_size };
+		return storage_mmap_open(opts->img_path, &mopts);
+	}
+	cache_opts copts = {
+		.budget    = (size_t)opts->cache_size << 20,
+		.direct    = opts->direct,
+		.uring     = strcmp(name, "uring") == 0,
+		.meta_size = bench_meta_size,
+	};
+	return storage_cache_open(opts->img_path, &copts);
+}
+
+/** Drop the image from the host page cache so that every run starts cold. */
+static void drop_cache(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Workload kinds. */
+enum workload { SEQ_WRITE, SEQ_READ, RAND_READ };
+
+static const char *workload_names[] = { "seq-write", "seq-read", "rand-read" };
+
+/** Block number of the i-th access; random order is a fixed permutation. */
+static a1fs_blk_t access_blk(enum workload w, size_t i, size_t nblocks)
+{
+	if (w != RAND_READ) {
+		return 1 + i;
+	}
+	// Multiplying by a prime that doesn't divide nblocks permutes the blocks
+	return 1 + (i * 2654435761u) % nblocks;
+}
+
+/**
+ * Run one workload.
+ *
+ * @return  throughput in MB/s; negative on I/O error.
+ */
+static double run(storage *st, enum workload w, unsigned int batch)
+{
+	size_t nblocks = st->size / A1FS_BLOCK_SIZE - 1;
+	storage_range *ranges = malloc(batch * sizeof(*ranges));
+	if (!ranges) {
+		return -1;
+	}
+	uint64_t sum = 0;
+	double start = now();
+	for (size_t i = 0; i < nblocks; i++) {
+		if (batch > 1 && i % batch == 0) {
+			size_t n = 0;
+			for (size_t j = i; j < i + batch && j < nblocks; j++) {
+				ranges[n++] = (storage_range){ access_blk(w, j, nblocks), 1 };
+			}
+			storage_prefetch(st, ranges, n);
+		}
+		unsigned char *data = storage_get(st, access_blk(w, i, nblocks),
+		                                  w == SEQ_WRITE);
+		if (!data) {
+			free(ranges);
+			return -1;
+		}
+		if (w == SEQ_WRITE) {
+			memset(data, (int)i, A1FS_BLOCK_SIZE);
+		} else {
+			for (size_t k = 0; k < A1FS_BLOCK_SIZE; k += 64) {
+				sum += data[k];
+			}
+		}
+	}
+	if (w == SEQ_WRITE && storage_sync(st) < 0) {
+		free(ranges);
+		return -1;
+	}
+	double elapsed = now() - start;
+	free(ranges);
+	// Keep the reads from being optimized away
+	if (sum == 1) {
+		fprintf(stderr, " ");
+	}
+	return nblocks * (double)A1FS_BLOCK_SIZE / elapsed / 1e6;
+}
+
+static bool bench_backend(const char *name, const bench_opts *opts)
+{
+	printf("%-6s", name);
+	for (int w = SEQ_WRITE; w <= RAND_READ; w++) {
+		unsigned int batches[] = { 1, opts->batch };
+		for (int b = 0; b < (w == SEQ_WRITE ? 1 : 2); b++) {
+			drop_cache(opts->img_path);
+			storage *st = open_backend(name, opts);
+			if (!st) {
+				return false;
+			}
+			double mbs = run(st, w, batches[b]);
+			storage_destroy(st);
+			if (mbs < 0) {
+				fprintf(stderr, "%s: I/O error\n", name);
+				return false;
+			}
+			printf(" %10.1f", mbs);
+		}
+	}
+	printf("\n");
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	bench_opts opts = { .cache_size = 16, .batch = 32 };
+	if (!parse_args(argc, argv, &opts)) {
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+
+	printf("MB/s   %10s %10s %10s %10s %10s\n", workload_names[SEQ_WRITE],
+	       workload_names[SEQ_READ], "+batch", workload_names[RAND_READ],
+	       "+batch");
+	const char *backends[] = { "mmap", "cache", "uring" };
+	for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+		if (opts.backend && strcmp(opts.backend, backends[i]) != 0) {
+			continue;
+		}
+		if (!bench_backend(backends[i], &opts)) {
+			return 1;
+		}
+	}
+	return 0;
+}
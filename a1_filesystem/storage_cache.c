@@ -0,0 +1,651 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Block cache storage backend implementation.
+ *
+ * Data blocks are cached in a fixed number of frames. Eviction uses the CLOCK
+ * algorithm: each frame has a reference bit that is set on access, and the
+ * clock hand clears reference bits until it finds a frame that hasn't been
+ * accessed since the last sweep. Dirty frames are written back on eviction
+ * and on sync. The metadata region is not cached in frames; it is mapped
+ * privately (copy-on-write) from the image file and written back block by
+ * block as it gets modified. Its pinned part (everything but the extent
+ * blocks) is read when the image is opened; the rest is only read from the
+ * host page cache when it's first used, and the kernel can drop the blocks
+ * that were not modified, so that the memory used for the extent blocks
+ * grows with the files in use rather than with the number of inodes.
+ *
+ * All reads and writes go through an I/O engine in batches: a prefetch reads
+ * all the missing blocks it was asked for in one batch, and a sync writes all
+ * dirty runs of data and metadata blocks in one batch.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/falloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "bitmap.h"
+#include "io.h"
+#include "log.h"
+#include "storage.h"
+#include "util.h"
+
+
+/** Smallest number of frames in the cache. */
+#define CACHE_MIN_FRAMES 16
+
+/** Cache frame descriptor. */
+typedef struct frame {
+	/** Image block number held by the frame. */
+	a1fs_blk_t blk;
+	/** Next frame in the hash chain; -1 if last. */
+	int next;
+	/** Frame holds a block. */
+	bool valid;
+	/** Block was modified since it was read or written back. */
+	bool dirty;
+	/** CLOCK reference bit. */
+	bool ref;
+	/** Frame is being filled and must not be evicted. */
+	bool pinned;
+
+} frame;
+
+/** Block cache state. */
+typedef struct cache {
+	/** Common backend state; must be the first field. */
+	storage st;
+	/** Image file descriptor. */
+	int fd;
+	/** I/O engine used for all reads and writes. */
+	io_engine *io;
+	/** Number of blocks in the metadata region. */
+	size_t meta_blocks;
+	/** Size of the part of the metadata region read at open in bytes. */
+	size_t meta_pinned;
+	/** Dirty bits of the metadata region blocks. */
+	unsigned char *meta_dirty;
+
+	/** Number of frames. */
+	size_t nframes;
+	/** Frame buffers, nframes * A1FS_BLOCK_SIZE bytes. */
+	char *buf;
+	/** Frame descriptors. */
+	frame *frames;
+	/** Hash table of frame chains, indexed by block number & mask. */
+	int *buckets;
+	/** Hash table size - 1 (size is a power of 2). */
+	size_t mask;
+	/** CLOCK hand. */
+	size_t hand;
+
+	/** Statistics. */
+	storage_stats stats;
+
+} cache;
+
+
+/** Read or write a single contiguous buffer through the I/O engine. */
+static int io_block(cache *c, void *buf, size_t len, off_t offset, bool write)
+{
+	struct iovec iov = { .iov_base = buf, .iov_len = len };
+	io_req req = { .iov = &iov, .iovcnt = 1, .offset = offset, .write = write };
+	return io_submit(c->io, &req, 1);
+}
+
+static char *frame_buf(cache *c, size_t f)
+{
+	return c->buf + f * A1FS_BLOCK_SIZE;
+}
+
+static int lookup(cache *c, a1fs_blk_t blk)
+{
+	int f = c->buckets[blk & c->mask];
+	while (f >= 0 && c->frames[f].blk != blk) {
+		f = c->frames[f].next;
+	}
+	return f;
+}
+
+static void hash_insert(cache *c, int f)
+{
+	int *head = &c->buckets[c->frames[f].blk & c->mask];
+	c->frames[f].next = *head;
+	*head = f;
+}
+
+static void hash_remove(cache *c, int f)
+{
+	int *p = &c->buckets[c->frames[f].blk & c->mask];
+	while (*p != f) {
+		p = &c->frames[*p].next;
+	}
+	*p = c->frames[f].next;
+}
+
+static int write_back(cache *c, int f)
+{
+	frame *fr = &c->frames[f];
+	if (io_block(c, frame_buf(c, f), A1FS_BLOCK_SIZE,
+	             (off_t)fr->blk * A1FS_BLOCK_SIZE, true) < 0)
+	{
+		return -1;
+	}
+	fr->dirty = false;
+	c->stats.writebacks++;
+	return 0;
+}
+
+/** Find a frame to reuse, writing back its block if needed. */
+static int evict(cache *c)
+{
+	for (;;) {
+		int f = c->hand;
+		frame *fr = &c->frames[f];
+		c->hand = (c->hand + 1) % c->nframes;
+
+		if (!fr->valid) {
+			return f;
+		}
+		if (fr->pinned) {
+			continue;
+		}
+		if (fr->ref) {
+			fr->ref = false;
+			continue;
+		}
+		if (fr->dirty && write_back(c, f) < 0) {
+			return -1;
+		}
+		hash_remove(c, f);
+		fr->valid = false;
+		c->stats.evictions++;
+		return f;
+	}
+}
+
+static void *cache_get(storage *st, a1fs_blk_t blk, bool write)
+{
+	cache *c = (cache*)st;
+	if (blk < c->meta_blocks) {
+		if (write) {
+			bitmap_set(c->meta_dirty, blk);
+		}
+		return (char*)st->meta + (size_t)blk * A1FS_BLOCK_SIZE;
+	}
+	if ((size_t)blk * A1FS_BLOCK_SIZE >= st->size) {
+		return NULL;
+	}
+
+	int f = lookup(c, blk);
+	if (f >= 0) {
+		c->stats.hits++;
+	} else {
+		c->stats.misses++;
+		f = evict(c);
+		if (f < 0 || io_block(c, frame_buf(c, f), A1FS_BLOCK_SIZE,
+		                      (off_t)blk * A1FS_BLOCK_SIZE, false) < 0)
+		{
+			return NULL;
+		}
+		c->frames[f] = (frame){ .blk = blk, .valid = true };
+		hash_insert(c, f);
+	}
+	c->frames[f].ref = true;
+	c->frames[f].dirty |= write;
+	return frame_buf(c, f);
+}
+
+/** Number of blocks that a single prefetch() may bring in. */
+static size_t prefetch_limit(cache *c)
+{
+	// Leave room so that the frames filled by a prefetch are never all pinned
+	return c->nframes / 2;
+}
+
+static int cache_prefetch(storage *st, const storage_range *ranges, size_t n)
+{
+	cache *c = (cache*)st;
+	size_t limit = prefetch_limit(c);
+	struct iovec *iov = malloc(limit * sizeof(*iov));
+	io_req *reqs = malloc(limit * sizeof(*reqs));
+	int *filled = malloc(limit * sizeof(*filled));
+	if (!iov || !reqs || !filled) {
+		free(iov);
+		free(reqs);
+		free(filled);
+		return -1;
+	}
+
+	// Claim a frame for every missing block; runs of consecutive missing
+	// blocks become a single vectored read
+	size_t nfilled = 0, nreqs = 0;
+	a1fs_blk_t prev = 0;
+	int ret = 0;
+	for (size_t i = 0; i < n && nfilled < limit; i++) {
+		for (a1fs_blk_t k = 0; k < ranges[i].count && nfilled < limit; k++) {
+			a1fs_blk_t blk = ranges[i].start + k;
+			if (blk < c->meta_blocks ||
+			    (size_t)blk * A1FS_BLOCK_SIZE >= st->size ||
+			    lookup(c, blk) >= 0)
+			{
+				continue;
+			}
+			int f = evict(c);
+			if (f < 0) {
+				ret = -1;
+				goto submit;
+			}
+			c->frames[f] = (frame){ .blk = blk, .valid = true, .ref = true,
+			                        .pinned = true };
+			hash_insert(c, f);
+
+			iov[nfilled] = (struct iovec){ frame_buf(c, f), A1FS_BLOCK_SIZE };
+			if (nreqs > 0 && blk == prev + 1 && reqs[nreqs - 1].iovcnt < IOV_MAX) {
+				reqs[nreqs - 1].iovcnt++;
+			} else {
+				reqs[nreqs++] = (io_req){ .iov = &iov[nfilled], .iovcnt = 1,
+				                          .offset = (off_t)blk * A1FS_BLOCK_SIZE };
+			}
+			filled[nfilled++] = f;
+			prev = blk;
+		}
+	}
+
+submit:
+	if (nreqs > 0 && io_submit(c->io, reqs, nreqs) < 0) {
+		ret = -1;
+	}
+	for (size_t i = 0; i < nfilled; i++) {
+		frame *fr = &c->frames[filled[i]];
+		fr->pinned = false;
+		if (ret < 0) {
+			hash_remove(c, filled[i]);
+			fr->valid = false;
+		}
+	}
+	if (ret == 0) {
+		c->stats.prefetched += nfilled;
+	}
+	free(iov);
+	free(reqs);
+	free(filled);
+	return ret;
+}
+
+/** Drop the cached copy of a block without writing it back. */
+static void drop_frame(cache *c, int f)
+{
+	hash_remove(c, f);
+	c->frames[f].valid = false;
+	c->frames[f].dirty = false;
+}
+
+static int cache_discard(storage *st, const storage_range *ranges, size_t n)
+{
+	cache *c = (cache*)st;
+	for (size_t i = 0; i < n; i++) {
+		a1fs_blk_t start = ranges[i].start, count = ranges[i].count;
+		assert(start >= c->meta_blocks);
+		if (count < c->nframes) {
+			for (a1fs_blk_t blk = start; blk < start + count; blk++) {
+				int f = lookup(c, blk);
+				if (f >= 0) {
+					drop_frame(c, f);
+				}
+			}
+		} else {
+			for (size_t f = 0; f < c->nframes; f++) {
+				frame *fr = &c->frames[f];
+				if (fr->valid && fr->blk >= start && fr->blk - start < count) {
+					drop_frame(c, f);
+				}
+			}
+		}
+		if (fallocate(c->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		              (off_t)start * A1FS_BLOCK_SIZE,
+		              (off_t)count * A1FS_BLOCK_SIZE) < 0)
+		{
+			perror("fallocate");
+			return -1;
+		}
+		c->stats.discarded += count;
+	}
+	return 0;
+}
+
+static void cache_meta_dirty(storage *st, size_t offset, size_t len)
+{
+	cache *c = (cache*)st;
+	if (len == 0) {
+		return;
+	}
+	size_t first = offset / A1FS_BLOCK_SIZE;
+	size_t last = (offset + len - 1) / A1FS_BLOCK_SIZE;
+	bitmap_set_range(c->meta_dirty, first, last - first + 1);
+}
+
+static int cmp_frame_blk(const void *a, const void *b, void *arg)
+{
+	const frame *frames = arg;
+	a1fs_blk_t x = frames[*(const int*)a].blk;
+	a1fs_blk_t y = frames[*(const int*)b].blk;
+	return (x > y) - (x < y);
+}
+
+/** Write back all dirty frames, coalescing runs of consecutive blocks. */
+static int sync_frames(cache *c)
+{
+	int *dirty = malloc(c->nframes * sizeof(int));
+	if (!dirty) {
+		return -1;
+	}
+	size_t n = 0;
+	for (size_t f = 0; f < c->nframes; f++) {
+		if (c->frames[f].valid && c->frames[f].dirty) {
+			dirty[n++] = f;
+		}
+	}
+	qsort_r(dirty, n, sizeof(int), cmp_frame_blk, c->frames);
+
+	struct iovec *iov = malloc((n ? n : 1) * sizeof(*iov));
+	io_req *reqs = malloc((n ? n : 1) * sizeof(*reqs));
+	if (!iov || !reqs) {
+		free(iov);
+		free(reqs);
+		free(dirty);
+		return -1;
+	}
+	size_t nreqs = 0;
+	for (size_t i = 0; i < n; i++) {
+		a1fs_blk_t blk = c->frames[dirty[i]].blk;
+		iov[i] = (struct iovec){ frame_buf(c, dirty[i]), A1FS_BLOCK_SIZE };
+		if (i > 0 && blk == c->frames[dirty[i - 1]].blk + 1 &&
+		    reqs[nreqs - 1].iovcnt < IOV_MAX)
+		{
+			reqs[nreqs - 1].iovcnt++;
+		} else {
+			reqs[nreqs++] = (io_req){ .iov = &iov[i], .iovcnt = 1,
+			                          .offset = (off_t)blk * A1FS_BLOCK_SIZE,
+			                          .write = true };
+		}
+	}
+
+	int ret = io_submit(c->io, reqs, nreqs);
+	if (ret == 0) {
+		for (size_t i = 0; i < n; i++) {
+			c->frames[dirty[i]].dirty = false;
+		}
+		c->stats.writebacks += n;
+	}
+	free(iov);
+	free(reqs);
+	free(dirty);
+	return ret;
+}
+
+/** Write back dirty blocks of the metadata region. */
+static int sync_meta(cache *c)
+{
+	// Every dirty run is at least one block and at most every other block
+	// starts a run
+	size_t max_runs = (c->meta_blocks + 1) / 2;
+	struct iovec *iov = malloc(max_runs * sizeof(*iov));
+	io_req *reqs = malloc(max_runs * sizeof(*reqs));
+	if (!iov || !reqs) {
+		free(iov);
+		free(reqs);
+		return -1;
+	}
+	size_t nreqs = 0, nblocks = 0;
+	size_t b = bitmap_find_one(c->meta_dirty, 0, c->meta_blocks);
+	while (b < c->meta_blocks) {
+		size_t end = bitmap_find_zero(c->meta_dirty, b, c->meta_blocks);
+		iov[nreqs] = (struct iovec){ (char*)c->st.meta + b * A1FS_BLOCK_SIZE,
+		                             (end - b) * A1FS_BLOCK_SIZE };
+		reqs[nreqs] = (io_req){ .iov = &iov[nreqs], .iovcnt = 1,
+		                        .offset = b * A1FS_BLOCK_SIZE, .write = true };
+		nreqs++;
+		nblocks += end - b;
+		b = bitmap_find_one(c->meta_dirty, end, c->meta_blocks);
+	}
+
+	int ret = io_submit(c->io, reqs, nreqs);
+	if (ret == 0) {
+		bitmap_clear_range(c->meta_dirty, 0, c->meta_blocks);
+		c->stats.writebacks += nblocks;
+	}
+	free(iov);
+	free(reqs);
+	return ret;
+}
+
+static int cache_sync(storage *st)
+{
+	cache *c = (cache*)st;
+	if (sync_frames(c) < 0 || sync_meta(c) < 0) {
+		return -1;
+	}
+	if (fdatasync(c->fd) < 0) {
+		perror("fdatasync");
+		return -1;
+	}
+	return 0;
+}
+
+static int cache_grow(storage *st, size_t size)
+{
+	cache *c = (cache*)st;
+	// Data blocks are only ever read and written by offset
+	if (ftruncate(c->fd, size) < 0) {
+		perror("ftruncate");
+		return -1;
+	}
+	st->size = size;
+	return 0;
+}
+
+static void cache_stats(storage *st, storage_stats *stats)
+{
+	*stats = ((cache*)st)->stats;
+}
+
+static void cache_destroy(storage *st)
+{
+	cache *c = (cache*)st;
+	cache_sync(st);
+	io_destroy(c->io);
+	close(c->fd);
+	free(c->meta_dirty);
+	free(c->buckets);
+	free(c->frames);
+	free(c->buf);
+	munmap(c->st.meta, c->st.meta_size);
+	free(c);
+}
+
+static const storage_ops cache_ops = {
+	.name       = "cache",
+	.get        = cache_get,
+	.prefetch   = cache_prefetch,
+	.discard    = cache_discard,
+	.meta_dirty = cache_meta_dirty,
+	.grow       = cache_grow,
+	.sync       = cache_sync,
+	.stats      = cache_stats,
+	.destroy    = cache_destroy,
+};
+
+/** Same as cache_ops, with I/O done through an io_uring. */
+static const storage_ops uring_cache_ops = {
+	.name       = "uring",
+	.get        = cache_get,
+	.prefetch   = cache_prefetch,
+	.discard    = cache_discard,
+	.meta_dirty = cache_meta_dirty,
+	.grow       = cache_grow,
+	.sync       = cache_sync,
+	.stats      = cache_stats,
+	.destroy    = cache_destroy,
+};
+
+/** Open the image file, falling back to buffered I/O if O_DIRECT fails. */
+static int open_image(const char *path, bool direct)
+{
+	int fd = open(path, O_RDWR | (direct ? O_DIRECT : 0));
+	if (fd < 0 && direct && errno == EINVAL) {
+		log_info("%s: O_DIRECT not supported, using buffered I/O\n", path);
+		fd = open(path, O_RDWR);
+	}
+	if (fd < 0) {
+		perror(path);
+	}
+	return fd;
+}
+
+/** Map the metadata region of the image and read its pinned part. */
+static bool load_meta(cache *c, const cache_opts *opts)
+{
+	void *sb = aligned_alloc(A1FS_BLOCK_SIZE, A1FS_BLOCK_SIZE);
+	if (!sb || io_block(c, sb, A1FS_BLOCK_SIZE, 0, false) < 0) {
+		free(sb);
+		return false;
+	}
+	size_t meta = opts->meta_size(sb, c->st.size, opts->arg);
+	size_t pinned = opts->pin_size ? opts->pin_size(sb, meta, opts->arg)
+	                               : meta;
+	free(sb);
+	meta = meta ? align_up(meta, A1FS_BLOCK_SIZE) : A1FS_BLOCK_SIZE;
+	pinned = pinned < meta ? align_up(pinned, A1FS_BLOCK_SIZE) : meta;
+
+	// Modified blocks become private copies that are written back with the
+	// I/O engine, like the cache frames; the file is never written through
+	// the mapping
+	void *addr = mmap(NULL, meta, PROT_READ | PROT_WRITE, MAP_PRIVATE, c->fd,
+	                  0);
+	if (addr == MAP_FAILED) {
+		perror("mmap");
+		return false;
+	}
+	c->st.meta = addr;
+	c->st.meta_size = meta;
+	c->meta_pinned = pinned;
+	c->meta_blocks = meta / A1FS_BLOCK_SIZE;
+	c->meta_dirty = calloc((c->meta_blocks + 7) / 8, 1);
+	if (!c->meta_dirty) {
+		perror("malloc");
+		return false;
+	}
+	return io_block(c, c->st.meta, pinned, 0, false) == 0;
+}
+
+/** Allocate the cache frames and the hash table. */
+static bool alloc_frames(cache *c, size_t budget)
+{
+	c->nframes = budget / A1FS_BLOCK_SIZE;
+	if (c->nframes < CACHE_MIN_FRAMES) {
+		c->nframes = CACHE_MIN_FRAMES;
+	}
+	size_t nbuckets = 1;
+	while (nbuckets < c->nframes) {
+		nbuckets *= 2;
+	}
+	c->mask = nbuckets - 1;
+
+	c->buf = aligned_alloc(A1FS_BLOCK_SIZE, c->nframes * A1FS_BLOCK_SIZE);
+	c->frames = calloc(c->nframes, sizeof(frame));
+	c->buckets = malloc(nbuckets * sizeof(int));
+	if (!c->buf || !c->frames || !c->buckets) {
+		perror("malloc");
+		return false;
+	}
+	memset(c->buckets, 0xff, nbuckets * sizeof(int));// all -1
+	return true;
+}
+
+storage *storage_cache_open(const char *path, const cache_opts *opts)
+{
+	cache *c = calloc(1, sizeof(*c));
+	if (!c) {
+		perror("calloc");
+		return NULL;
+	}
+	c->st.ops = &cache_ops;
+	c->fd = open_image(path, opts->direct);
+	if (c->fd < 0) {
+		free(c);
+		return NULL;
+	}
+
+	struct stat s;
+	if (fstat(c->fd, &s) < 0) {
+		perror("fstat");
+		goto fail;
+	}
+	if (s.st_size == 0 || s.st_size % A1FS_BLOCK_SIZE != 0) {
+		log_error("Image file size is not a multiple of block size\n");
+		goto fail;
+	}
+	c->st.size = s.st_size;
+
+	if (opts->uring) {
+		c->io = io_uring_open(c->fd, opts->uring_depth ? opts->uring_depth : 64);
+		if (c->io) {
+			c->st.ops = &uring_cache_ops;
+		} else {
+			log_info("io_uring not available, using preadv/pwritev\n");
+		}
+	}
+	if (!c->io && !(c->io = io_psync_open(c->fd))) {
+		goto fail;
+	}
+
+	if (!load_meta(c, opts) || !alloc_frames(c, opts->budget)) {
+		goto fail;
+	}
+	// Blocks prefetched ahead of a reader must stay cached until it gets
+	// to them, next to the blocks it is using now
+	c->st.prefetch_max = prefetch_limit(c) / 2;
+	log_info("%s: %zu KiB cache for data blocks, %zu KiB of metadata pinned "
+	         "(another %zu KiB read on use)\n", path,
+	         c->nframes * A1FS_BLOCK_SIZE >> 10, c->meta_pinned >> 10,
+	         (c->st.meta_size - c->meta_pinned) >> 10);
+	return &c->st;
+
+fail:
+	if (c->io) {
+		io_destroy(c->io);
+	}
+	close(c->fd);
+	free(c->meta_dirty);
+	free(c->buckets);
+	free(c->frames);
+	free(c->buf);
+	if (c->st.meta) {
+		munmap(c->st.meta, c->st.meta_size);
+	}
+	free(c);
+	return NULL;
+}
@@ -0,0 +1,158 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - mmap storage backend implementation.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "storage.h"
+
+
+/** mmap backend state. */
+typedef struct mmap_storage {
+	/** Common backend state; must be the first field. */
+	storage st;
+	/** Image file path, for growing the image. */
+	char *path;
+	/** Mapping options, applied again to the part added by growing. */
+	map_opts opts;
+	/** Size of the address space reserved for the mapping in bytes. */
+	size_t reserved;
+
+} mmap_storage;
+
+static void *mmap_get(storage *st, a1fs_blk_t blk, bool write)
+{
+	(void)write;// unused
+	if ((size_t)blk * A1FS_BLOCK_SIZE >= st->size) {
+		return NULL;
+	}
+	return (char*)st->meta + (size_t)blk * A1FS_BLOCK_SIZE;
+}
+
+static int mmap_prefetch(storage *st, const storage_range *ranges, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		size_t offset = (size_t)ranges[i].start * A1FS_BLOCK_SIZE;
+		size_t len = (size_t)ranges[i].count * A1FS_BLOCK_SIZE;
+		if (offset >= st->size) {
+			continue;
+		}
+		if (len > st->size - offset) {
+			len = st->size - offset;
+		}
+		// Let the kernel start reading the pages in the background
+		madvise((char*)st->meta + offset, len, MADV_WILLNEED);
+	}
+	return 0;
+}
+
+static int mmap_discard(storage *st, const storage_range *ranges, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		size_t offset = (size_t)ranges[i].start * A1FS_BLOCK_SIZE;
+		size_t len = (size_t)ranges[i].count * A1FS_BLOCK_SIZE;
+		assert(offset >= st->meta_size && offset + len <= st->size);
+		// Punches a hole in the image file behind the shared mapping
+		if (madvise((char*)st->meta + offset, len, MADV_REMOVE) < 0) {
+			perror("madvise");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int mmap_grow(storage *st, size_t size)
+{
+	mmap_storage *m = (mmap_storage*)st;
+	if (size > m->reserved) {
+		return -1;
+	}
+	if (!map_grow(m->path, st->meta, st->size, size, &m->opts)) {
+		return -1;
+	}
+	st->size = size;
+	return 0;
+}
+
+static int mmap_sync(storage *st)
+{
+	if (msync(st->meta, st->size, MS_SYNC) < 0) {
+		perror("msync");
+		return -1;
+	}
+	return 0;
+}
+
+static void mmap_stats(storage *st, storage_stats *stats)
+{
+	(void)st;// unused
+	// Page faults are handled by the kernel and not visible here
+	*stats = (storage_stats){0};
+}
+
+static void mmap_destroy(storage *st)
+{
+	mmap_storage *m = (mmap_storage*)st;
+	munmap(st->meta, m->reserved > st->size ? m->reserved : st->size);
+	free(m->path);
+	free(m);
+}
+
+static const storage_ops mmap_ops = {
+	.name       = "mmap",
+	.get        = mmap_get,
+	.prefetch   = mmap_prefetch,
+	.discard    = mmap_discard,
+	.meta_dirty = NULL,
+	.grow       = mmap_grow,
+	.sync       = mmap_sync,
+	.stats      = mmap_stats,
+	.destroy    = mmap_destroy,
+};
+
+storage *storage_mmap_open(const char *path, const map_opts *opts)
+{
+	mmap_storage *m = malloc(sizeof(*m));
+	char *path_copy = strdup(path);
+	if (!m || !path_copy) {
+		perror("malloc");
+		free(path_copy);
+		free(m);
+		return NULL;
+	}
+
+	storage *st = &m->st;
+	st->meta = map_file(path, A1FS_BLOCK_SIZE, &st->size, opts);
+	if (!st->meta) {
+		free(path_copy);
+		free(m);
+		return NULL;
+	}
+	st->ops = &mmap_ops;
+	st->prefetch_max = 0;
+	st->meta_size = opts->meta_size(st->meta, st->size, opts->arg);
+	m->path = path_copy;
+	m->opts = *opts;
+	// Same as what map_file() reserved
+	m->reserved = opts->max_size ? opts->max_size(st->meta, st->size, opts->arg)
+	                             : 0;
+	return st;
+}
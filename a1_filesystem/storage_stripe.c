@@ -0,0 +1,279 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Striped volume storage backend implementation.
+ *
+ * Block b of the data region (b = blk - start_data) is in chunk
+ * c = b / stripe_blocks, which is stored in member c % stripe_count as its
+ * (c / stripe_count)-th chunk. Every member is mapped as a whole, so a block
+ * pointer is valid as long as the volume is open, as with the mmap backend;
+ * hints and discards are split at chunk boundaries and go to the members that
+ * hold the blocks.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "log.h"
+#include "storage.h"
+
+
+/** A member image of the volume. */
+typedef struct stripe_member {
+	/** Start of the mapping of the image file. */
+	char *base;
+	/** Size of the image file in bytes. */
+	size_t size;
+	/** Block where the chunks of the member start. */
+	size_t start;
+
+} stripe_member;
+
+/** Stripe backend state. */
+typedef struct stripe {
+	/** Common backend state; must be the first field. */
+	storage st;
+	/** Member images. */
+	stripe_member members[A1FS_STRIPE_MAX];
+	/** Number of member images. */
+	size_t count;
+	/** First block of the data region. */
+	size_t start_data;
+	/** Chunk size in blocks. */
+	size_t chunk;
+
+} stripe;
+
+
+/**
+ * Find where a block of the volume is stored.
+ *
+ * @param s    stripe backend.
+ * @param blk  block number in the volume; must be less than st.size blocks.
+ * @param run  receives the number of blocks from blk that follow it in the
+ *             same member, up to the end of its chunk (or of the metadata
+ *             region).
+ * @return     pointer to the block contents.
+ */
+static char *locate(stripe *s, size_t blk, size_t *run)
+{
+	if (blk < s->start_data) {
+		*run = s->start_data - blk;
+		return s->members[0].base + blk * A1FS_BLOCK_SIZE;
+	}
+	size_t b = blk - s->start_data;
+	size_t c = b / s->chunk;
+	size_t off = b % s->chunk;
+	const stripe_member *m = &s->members[c % s->count];
+	*run = s->chunk - off;
+	return m->base + (m->start + c / s->count * s->chunk + off) *
+	                 A1FS_BLOCK_SIZE;
+}
+
+/**
+ * Apply madvise() to a run of blocks of the volume, one piece per chunk.
+ *
+ * @return  0 on success; -1 if madvise() failed.
+ */
+static int advise_range(stripe *s, size_t start, size_t count, int advice)
+{
+	size_t total = s->st.size / A1FS_BLOCK_SIZE;
+	if (start >= total) {
+		return 0;
+	}
+	if (count > total - start) {
+		count = total - start;
+	}
+	while (count > 0) {
+		size_t run;
+		char *addr = locate(s, start, &run);
+		if (run > count) {
+			run = count;
+		}
+		if (madvise(addr, run * A1FS_BLOCK_SIZE, advice) < 0) {
+			return -1;
+		}
+		start += run;
+		count -= run;
+	}
+	return 0;
+}
+
+static void *stripe_get(storage *st, a1fs_blk_t blk, bool write)
+{
+	(void)write;// unused
+	if ((size_t)blk * A1FS_BLOCK_SIZE >= st->size) {
+		return NULL;
+	}
+	size_t run;
+	return locate((stripe*)st, blk, &run);
+}
+
+static int stripe_prefetch(storage *st, const storage_range *ranges, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		// Each member reads its chunks in the background, in parallel
+		advise_range((stripe*)st, ranges[i].start, ranges[i].count,
+		             MADV_WILLNEED);
+	}
+	return 0;
+}
+
+static int stripe_discard(storage *st, const storage_range *ranges, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		assert((size_t)ranges[i].start * A1FS_BLOCK_SIZE >= st->meta_size);
+		if (advise_range((stripe*)st, ranges[i].start, ranges[i].count,
+		                 MADV_REMOVE) < 0)
+		{
+			perror("madvise");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int stripe_sync(storage *st)
+{
+	stripe *s = (stripe*)st;
+	int ret = 0;
+	for (size_t i = 0; i < s->count; i++) {
+		if (msync(s->members[i].base, s->members[i].size, MS_SYNC) < 0) {
+			perror("msync");
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+static void stripe_stats(storage *st, storage_stats *stats)
+{
+	(void)st;// unused
+	// Page faults are handled by the kernel and not visible here
+	*stats = (storage_stats){0};
+}
+
+static void stripe_destroy(storage *st)
+{
+	stripe *s = (stripe*)st;
+	for (size_t i = 0; i < s->count; i++) {
+		if (s->members[i].base) {
+			munmap(s->members[i].base, s->members[i].size);
+		}
+	}
+	free(s);
+}
+
+static const storage_ops stripe_ops = {
+	.name       = "stripe",
+	.get        = stripe_get,
+	.prefetch   = stripe_prefetch,
+	.discard    = stripe_discard,
+	.meta_dirty = NULL,
+	.grow       = NULL,
+	.sync       = stripe_sync,
+	.stats      = stripe_stats,
+	.destroy    = stripe_destroy,
+};
+
+/** Check that the mapped members are the members of one volume, in order. */
+static bool check_members(stripe *s, const char *const *paths)
+{
+	const a1fs_superblock *sb = (const a1fs_superblock*)s->members[0].base;
+	if (sb->magic != A1FS_MAGIC || !(sb->flags & A1FS_FEATURE_STRIPE) ||
+	    sb->stripe_blocks == 0 || sb->start_data <= 0 ||
+	    (size_t)sb->start_data * A1FS_BLOCK_SIZE > s->members[0].size)
+	{
+		log_error("%s: not a striped a1fs volume\n", paths[0]);
+		return false;
+	}
+	if (sb->stripe_count != s->count) {
+		log_error("%s: the volume has %u images, %zu given\n", paths[0],
+		          sb->stripe_count, s->count);
+		return false;
+	}
+	for (size_t i = 1; i < s->count; i++) {
+		const a1fs_stripe_header *hdr =
+			(const a1fs_stripe_header*)s->members[i].base;
+		if (hdr->magic != A1FS_STRIPE_MAGIC ||
+		    hdr->volume_id != sb->volume_id || hdr->index != i)
+		{
+			log_error("%s: not image %zu of the volume in %s\n",
+			          paths[i], i + 1, paths[0]);
+			return false;
+		}
+	}
+	return true;
+}
+
+storage *storage_stripe_open(const char *const *paths, size_t count,
+                             const map_opts *opts)
+{
+	if (count < 2 || count > A1FS_STRIPE_MAX) {
+		log_error("A striped volume has 2 to %d images\n", A1FS_STRIPE_MAX);
+		return NULL;
+	}
+	stripe *s = calloc(1, sizeof(*s));
+	if (!s) {
+		perror("calloc");
+		return NULL;
+	}
+	s->st.ops = &stripe_ops;
+	s->count = count;
+
+	// Only the first member has a metadata region; nothing is reserved for
+	// growing since a striped volume can't be grown
+	map_opts first_opts = *opts;
+	first_opts.max_size = NULL;
+	map_opts member_opts = first_opts;
+	member_opts.meta_size = NULL;
+	for (size_t i = 0; i < count; i++) {
+		stripe_member *m = &s->members[i];
+		m->base = map_file(paths[i], A1FS_BLOCK_SIZE, &m->size,
+		                   i == 0 ? &first_opts : &member_opts);
+		if (!m->base) {
+			goto fail;
+		}
+	}
+	if (!check_members(s, paths)) {
+		goto fail;
+	}
+
+	// The volume has as many rows of chunks as fit in all of its members
+	const a1fs_superblock *sb = (const a1fs_superblock*)s->members[0].base;
+	s->start_data = sb->start_data;
+	s->chunk = sb->stripe_blocks;
+	size_t rows = SIZE_MAX;
+	for (size_t i = 0; i < count; i++) {
+		stripe_member *m = &s->members[i];
+		m->start = a1fs_stripe_start(sb, i);
+		size_t blocks = m->size / A1FS_BLOCK_SIZE;
+		size_t fit = blocks > m->start ? (blocks - m->start) / s->chunk : 0;
+		rows = fit < rows ? fit : rows;
+	}
+	s->st.size = (s->start_data + rows * s->chunk * count) * A1FS_BLOCK_SIZE;
+	s->st.meta = s->members[0].base;
+	s->st.meta_size = opts->meta_size(s->st.meta, s->members[0].size,
+	                                  opts->arg);
+	s->st.prefetch_max = 0;
+	return &s->st;
+
+fail:
+	stripe_destroy(&s->st);
+	return NULL;
+}
@@ -0,0 +1,266 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Operation trace recorder implementation.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "stats.h"
+#include "trace.h"
+
+
+/** Ring buffer of records of one thread. */
+struct trace_ring {
+	/** Next ring in the list. */
+	trace_ring *next;
+	/** Thread the ring belongs to. */
+	pthread_t owner;
+	/** Thread number recorded in the records. */
+	uint16_t thread;
+	/** Total bytes ever appended; only moved by the owner thread. */
+	uint64_t head;
+	/** Total bytes ever drained; only moved by the drainer. */
+	uint64_t tail;
+	/** Buffer of TRACE_RING_SIZE bytes. */
+	unsigned char buf[];
+};
+
+/** Source of trace_log.id values; 0 is never used. */
+static uint64_t next_log_id = 1;
+
+/** Recorder whose ring the calling thread used last. */
+static __thread uint64_t thread_log_id;
+/** Ring of the calling thread in that recorder. */
+static __thread trace_ring *thread_ring;
+
+void trace_init(trace_log *t)
+{
+	memset(t, 0, sizeof(*t));
+	t->fd = -1;
+}
+
+bool trace_open(trace_log *t, const char *path)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		log_error("%s: %s\n", path, strerror(errno));
+		return false;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	a1fs_trace_header hdr = {
+		.magic      = A1FS_TRACE_MAGIC,
+		.version    = A1FS_TRACE_VERSION,
+		.rec_size   = sizeof(a1fs_trace_rec),
+		.start_time = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec,
+	};
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		log_error("%s: failed to write the trace header\n", path);
+		close(fd);
+		return false;
+	}
+
+	trace_init(t);
+	t->fd = fd;
+	t->id = __atomic_fetch_add(&next_log_id, 1, __ATOMIC_RELAXED);
+	t->start = stats_now();
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->cond, NULL);
+	return true;
+}
+
+/** Get the ring of the calling thread, creating it on first use. */
+static trace_ring *get_ring(trace_log *t)
+{
+	if (thread_log_id == t->id) {
+		return thread_ring;
+	}
+
+	pthread_mutex_lock(&t->lock);
+	trace_ring *r = t->rings;
+	while (r && !pthread_equal(r->owner, pthread_self())) {
+		r = r->next;
+	}
+	if (!r) {
+		r = malloc(sizeof(*r) + TRACE_RING_SIZE);
+		if (r) {
+			r->owner = pthread_self();
+			r->thread = t->nrings++;
+			r->head = 0;
+			r->tail = 0;
+			r->next = t->rings;
+			t->rings = r;
+		}
+	}
+	pthread_mutex_unlock(&t->lock);
+	if (r) {
+		thread_log_id = t->id;
+		thread_ring = r;
+	}
+	return r;
+}
+
+/** Copy data into a ring at a position, wrapping around its end. */
+static void ring_put(trace_ring *r, uint64_t pos, const void *data, size_t len)
+{
+	if (len == 0) {
+		return;
+	}
+	size_t off = pos & (TRACE_RING_SIZE - 1);
+	size_t n = TRACE_RING_SIZE - off < len ? TRACE_RING_SIZE - off : len;
+	memcpy(r->buf + off, data, n);
+	memcpy(r->buf, (const char*)data + n, len - n);
+}
+
+void trace_record(trace_log *t, a1fs_trace_rec *rec, const char *path,
+                  const char *path2)
+{
+	static const char zeros[8] = {0};
+	size_t len = sizeof(*rec) + rec->path_len + rec->path2_len;
+	size_t padded = (len + 7) & ~(size_t)7;
+
+	trace_ring *r = get_ring(t);
+	uint64_t head = r ? r->head : 0;
+	uint64_t tail = r ? __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) : 0;
+	if (!r || TRACE_RING_SIZE - (head - tail) < padded) {
+		__atomic_fetch_add(&t->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	rec->thread = r->thread;
+	ring_put(r, head, rec, sizeof(*rec));
+	ring_put(r, head + sizeof(*rec), path, rec->path_len);
+	ring_put(r, head + sizeof(*rec) + rec->path_len, path2, rec->path2_len);
+	ring_put(r, head + len, zeros, padded - len);
+	// Publish the record to the drainer
+	__atomic_store_n(&r->head, head + padded, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&t->records, 1, __ATOMIC_RELAXED);
+
+	if (head + padded - tail > TRACE_RING_SIZE / 2) {
+		pthread_cond_signal(&t->cond);
+	}
+}
+
+/** Write the whole buffer to the trace file. */
+static bool write_all(int fd, const unsigned char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+/** Write the records in all rings to the trace file. Called with the lock. */
+static void drain(trace_log *t)
+{
+	for (trace_ring *r = t->rings; r; r = r->next) {
+		uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		uint64_t tail = r->tail;
+		while (tail < head) {
+			size_t off = tail & (TRACE_RING_SIZE - 1);
+			size_t n = head - tail;
+			if (n > TRACE_RING_SIZE - off) {
+				n = TRACE_RING_SIZE - off;
+			}
+			if (!t->failed && !write_all(t->fd, r->buf + off, n)) {
+				log_error("Failed to write the trace: %s; tracing stopped\n",
+				          strerror(errno));
+				t->failed = true;
+			}
+			tail += n;
+		}
+		// Let the owner thread reuse the space
+		__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+	}
+}
+
+static void *drainer_main(void *arg)
+{
+	trace_log *t = (trace_log*)arg;
+	pthread_mutex_lock(&t->lock);
+	while (!t->stopping) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		// A ring holds some 10000 records; one that fills up faster than
+		// this wakes the drainer early (see trace_record())
+		deadline.tv_nsec += 100000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&t->cond, &t->lock, &deadline);
+		drain(t);
+	}
+	pthread_mutex_unlock(&t->lock);
+	return NULL;
+}
+
+void trace_start(trace_log *t)
+{
+	if (!trace_enabled(t)) {
+		return;
+	}
+	int ret = pthread_create(&t->drainer, NULL, drainer_main, t);
+	if (ret != 0) {
+		log_error("Failed to start the trace drainer: %s\n", strerror(ret));
+		return;
+	}
+	t->drainer_running = true;
+}
+
+void trace_close(trace_log *t)
+{
+	if (!trace_enabled(t)) {
+		return;
+	}
+	if (t->drainer_running) {
+		pthread_mutex_lock(&t->lock);
+		t->stopping = true;
+		pthread_cond_signal(&t->cond);
+		pthread_mutex_unlock(&t->lock);
+		pthread_join(t->drainer, NULL);
+		t->drainer_running = false;
+	}
+
+	pthread_mutex_lock(&t->lock);
+	drain(t);
+	pthread_mutex_unlock(&t->lock);
+	log_info("trace: %lu records, %lu dropped\n", t->records, t->dropped);
+
+	close(t->fd);
+	while (t->rings) {
+		trace_ring *r = t->rings;
+		t->rings = r->next;
+		free(r);
+	}
+	pthread_mutex_destroy(&t->lock);
+	pthread_cond_destroy(&t->cond);
+	trace_init(t);
+}
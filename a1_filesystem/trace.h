@@ -0,0 +1,167 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Operation trace recorder header file.
+ *
+ * With "-o trace=FILE", every file system operation is recorded in a trace
+ * file that a1fs-replay can replay against a copy of the image. Each thread
+ * that runs operations appends its records to a ring buffer of its own, with
+ * no locking: the thread only moves the head of its ring and a background
+ * drainer thread only moves the tail. The drainer writes the contents of all
+ * rings to the trace file in large chunks, so the operations never wait for
+ * the file. If a ring is full (the drainer can't keep up), records are dropped
+ * and counted instead of stalling the operation.
+ *
+ * Trace file format: an a1fs_trace_header followed by records. A record is an
+ * a1fs_trace_rec followed by its path and second path (not null-terminated),
+ * padded to a multiple of 8 bytes. Records of different threads are not in
+ * start time order.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** Trace file magic number ("A1FSTRC1"). */
+#define A1FS_TRACE_MAGIC 0x3143525453463141ULL
+/** Trace file format version. */
+#define A1FS_TRACE_VERSION 1
+
+/** Size of the ring buffer of each thread in bytes (a power of 2). */
+#define TRACE_RING_SIZE (1 << 20)
+
+/** Trace file header. */
+typedef struct a1fs_trace_header {
+	/** Must be A1FS_TRACE_MAGIC. */
+	uint64_t magic;
+	/** Must be A1FS_TRACE_VERSION. */
+	uint32_t version;
+	/** Size of a1fs_trace_rec. */
+	uint32_t rec_size;
+	/** Wall clock time the trace was started at, in ns since the epoch. */
+	uint64_t start_time;
+
+} a1fs_trace_header;
+
+/** Trace record of one operation. */
+typedef struct a1fs_trace_rec {
+	/** Time the operation was called at, in ns since the trace started. */
+	uint64_t start;
+	/** Time the operation returned at, in ns since the trace started. */
+	uint64_t end;
+	/** Offset (read, write, fallocate). */
+	uint64_t offset;
+	/** Size (read, write, fallocate) or new file size (truncate). */
+	uint64_t size;
+	/** Open file handle (read, release) or the one returned (open, create). */
+	uint64_t fh;
+	/** Inode number of the file; -1 if unknown (e.g. it doesn't exist). */
+	int32_t ino;
+	/** Operation return value. */
+	int32_t ret;
+	/** Mode (mkdir, create, fallocate), datasync (fsync) or command (ioctl). */
+	uint32_t arg;
+	/** Number of the thread that called the operation, from 0. */
+	uint16_t thread;
+	/** Operation (stats_op). */
+	uint8_t op;
+	/** Unused. */
+	uint8_t reserved;
+	/** Length of the path following the record; 0 if none. */
+	uint16_t path_len;
+	/** Length of the second path (rename target); 0 if none. */
+	uint16_t path2_len;
+	/** Unused. */
+	uint32_t padding;
+
+} a1fs_trace_rec;
+
+typedef struct trace_ring trace_ring;
+
+/** Trace recorder. */
+typedef struct trace_log {
+	/** Trace file descriptor; -1 if not tracing. */
+	int fd;
+	/** Unique id of this recorder, for finding the ring of a thread. */
+	uint64_t id;
+	/** stats_now() time the trace was started at. */
+	uint64_t start;
+	/** Ring buffers of the threads that recorded operations. */
+	trace_ring *rings;
+	/** Number of rings. */
+	uint16_t nrings;
+	/** Protects the list of rings and the trace file. */
+	pthread_mutex_t lock;
+	/** Signalled to wake the drainer up early (a ring is filling up). */
+	pthread_cond_t cond;
+	/** Background drainer thread. */
+	pthread_t drainer;
+	/** Background drainer thread is running. */
+	bool drainer_running;
+	/** Drainer thread must exit. */
+	bool stopping;
+	/** Writing the trace file failed; records are dropped. */
+	bool failed;
+	/** Records made. */
+	uint64_t records;
+	/** Records dropped because a ring was full. */
+	uint64_t dropped;
+
+} trace_log;
+
+/** Initialize a trace recorder that doesn't trace. */
+void trace_init(trace_log *t);
+
+/**
+ * Start recording a trace into a file.
+ *
+ * @param t     trace recorder initialized with trace_init().
+ * @param path  trace file path; the file is created or truncated.
+ * @return      true on success; false on failure.
+ */
+bool trace_open(trace_log *t, const char *path);
+
+/**
+ * Start the background drainer thread.
+ *
+ * Until it is started (e.g. in a program that never calls it), records stay
+ * in the rings until trace_close().
+ */
+void trace_start(trace_log *t);
+
+/** Stop the drainer, write out all remaining records and close the file. */
+void trace_close(trace_log *t);
+
+/** Check if operations are being traced. */
+static inline bool trace_enabled(const trace_log *t)
+{
+	return t->fd >= 0;
+}
+
+/**
+ * Record an operation in the ring of the calling thread.
+ *
+ * @param t      trace recorder.
+ * @param rec    record; path_len and path2_len must be set, thread is filled
+ *               in.
+ * @param path   path of the operation; may be NULL if rec->path_len is 0.
+ * @param path2  second path; may be NULL if rec->path2_len is 0.
+ */
+void trace_record(trace_log *t, a1fs_trace_rec *rec, const char *path,
+                  const char *path2);
@@ -0,0 +1,205 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - a1fs offline trim tool.
+ *
+ * Releases the image file space behind all free data blocks by punching holes
+ * in the image file, so that thin-provisioned hosts can reclaim it. This is
+ * the offline counterpart of the discard mount option.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "a1fs.h"
+#include "bitmap.h"
+#include "map.h"
+
+
+/** Command line options. */
+typedef struct trim_opts {
+	/** File system image file path. */
+	const char *img_path;
+	/** Shortest free run to trim, in blocks. */
+	size_t min_blocks;
+
+	/** Print help and exit. */
+	bool help;
+	/** Only report what would be trimmed. */
+	bool dry_run;
+
+} trim_opts;
+
+static const char *help_str = "\
+Usage: %s options image\n\
+\n\
+Release the space of the free data blocks of an a1fs image file by punching\n\
+holes in it. The image must not be mounted.\n\
+\n\
+Options:\n\
+    -m num  shortest free run to trim in blocks (default 1)\n\
+    -n      dry run - only report what would be trimmed\n\
+    -h      print help and exit\n\
+";
+
+static void print_help(FILE *f, const char *progname)
+{
+	fprintf(f, help_str, progname);
+}
+
+
+static bool parse_args(int argc, char *argv[], trim_opts *opts)
+{
+	char o;
+	while ((o = getopt(argc, argv, "m:nh")) != -1) {
+		switch (o) {
+			case 'm': opts->min_blocks = strtoul(optarg, NULL, 10); break;
+			case 'n': opts->dry_run = true; break;
+
+			case 'h': opts->help = true; return true;// skip other arguments
+
+			case '?': return false;
+			default : assert(false);
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "Missing image path\n");
+		return false;
+	}
+	opts->img_path = argv[optind];
+	if (opts->min_blocks == 0) {
+		opts->min_blocks = 1;
+	}
+	return true;
+}
+
+
+/** Read the superblock and the data bitmap of an image. */
+static unsigned char *read_data_map(int fd, a1fs_superblock *sb)
+{
+	if (pread(fd, sb, sizeof(*sb), 0) != sizeof(*sb)) {
+		perror("pread");
+		return NULL;
+	}
+	if (sb->magic != A1FS_MAGIC) {
+		fprintf(stderr, "Image doesn't contain a1fs\n");
+		return NULL;
+	}
+	if (sb->flags & A1FS_FEATURE_STRIPE) {
+		// Data block numbers are not offsets in the first image
+		fprintf(stderr, "Striped volumes are not supported\n");
+		return NULL;
+	}
+
+	size_t len = ((size_t)sb->blocks_count + 7) / 8;
+	unsigned char *map = malloc(len);
+	if (!map) {
+		perror("malloc");
+		return NULL;
+	}
+	off_t offset = (off_t)sb->start_data_map * A1FS_BLOCK_SIZE;
+	if (pread(fd, map, len, offset) != (ssize_t)len) {
+		perror("pread");
+		free(map);
+		return NULL;
+	}
+	return map;
+}
+
+/**
+ * Punch holes over the free data block runs.
+ *
+ * @return  number of blocks trimmed; -1 on failure.
+ */
+static long trim(int fd, const a1fs_superblock *sb, const unsigned char *map,
+                 const trim_opts *opts)
+{
+	size_t n = sb->blocks_count;
+	long trimmed = 0;
+	size_t b = bitmap_find_zero(map, 0, n);
+	while (b < n) {
+		size_t e = bitmap_find_one(map, b, n);
+		if (e - b >= opts->min_blocks) {
+			off_t offset = ((off_t)sb->start_data + b) * A1FS_BLOCK_SIZE;
+			off_t len = (off_t)(e - b) * A1FS_BLOCK_SIZE;
+			if (!opts->dry_run &&
+			    fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			              offset, len) < 0)
+			{
+				perror("fallocate");
+				return -1;
+			}
+			trimmed += e - b;
+		}
+		b = bitmap_find_zero(map, e, n);
+	}
+	return trimmed;
+}
+
+
+int main(int argc, char *argv[])
+{
+	trim_opts opts = {0};// defaults are all 0
+	if (!parse_args(argc, argv, &opts)) {
+		// Invalid arguments, print help to stderr
+		print_help(stderr, argv[0]);
+		return 1;
+	}
+	if (opts.help) {
+		// Help requested, print it to stdout
+		print_help(stdout, argv[0]);
+		return 0;
+	}
+
+	// A mounted image could allocate the blocks while they are discarded
+	int lock_fd = lock_file(opts.img_path, opts.dry_run);
+	if (lock_fd < 0) {
+		return 1;
+	}
+	int fd = open(opts.img_path, opts.dry_run ? O_RDONLY : O_RDWR);
+	if (fd < 0) {
+		perror(opts.img_path);
+		close(lock_fd);
+		return 1;
+	}
+
+	int ret = 1;
+	a1fs_superblock sb;
+	unsigned char *map = read_data_map(fd, &sb);
+	if (!map) {
+		goto end;
+	}
+	long trimmed = trim(fd, &sb, map, &opts);
+	free(map);
+	if (trimmed < 0) {
+		goto end;
+	}
+	printf("%s %ld blocks (%ld MiB) of %u free\n",
+	       opts.dry_run ? "Would trim" : "Trimmed", trimmed,
+	       trimmed * A1FS_BLOCK_SIZE >> 20, sb.free_blocks_count);
+	ret = 0;
+end:
+	close(fd);
+	close(lock_fd);
+	return ret;
+}
@@ -19,8 +19,10 @@
 #pragma once
 
 #include <assert.h>
+#include <errno.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdlib.h>
 
 
 /** Check if x is a power of 2. */
@@ -42,3 +44,32 @@ static inline size_t align_up(size_t x, size_t alignment)
 	assert(is_powerof2(alignment));
 	return (x + alignment - 1) & (~alignment + 1);
 }
+
+/**
+ * Parse a size in bytes with an optional K, M, G or T suffix (powers of 1024).
+ *
+ * @param str   string to parse.
+ * @param size  pointer to the variable that receives the result.
+ * @return      true on success; false if str is not a valid size.
+ */
+static inline bool parse_size(const char *str, size_t *size)
+{
+	char *end;
+	errno = 0;
+	unsigned long long n = strtoull(str, &end, 10);
+	if (end == str || *str == '-' || errno != 0) {
+		return false;
+	}
+	int shift = 0;
+	switch (*end) {
+		case 'K': case 'k': shift = 10; end++; break;
+		case 'M': case 'm': shift = 20; end++; break;
+		case 'G': case 'g': shift = 30; end++; break;
+		case 'T': case 't': shift = 40; end++; break;
+	}
+	if (*end != '\0' || ((size_t)n << shift) >> shift != n) {
+		return false;
+	}
+	*size = (size_t)n << shift;
+	return true;
+}
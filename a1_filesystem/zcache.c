@@ -0,0 +1,85 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Decompressed cluster cache implementation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "zcache.h"
+
+
+bool zcache_init(zcache *zc)
+{
+	zc->data = malloc((size_t)ZCACHE_SLOTS * A1FS_CLUSTER_SIZE);
+	if (!zc->data) {
+		perror("malloc");
+		return false;
+	}
+	for (int i = 0; i < ZCACHE_SLOTS; i++) {
+		zc->keys[i] = ZCACHE_EMPTY;
+		zc->used[i] = 0;
+	}
+	zc->clock = 0;
+	zc->hits = 0;
+	zc->misses = 0;
+	return true;
+}
+
+void zcache_destroy(zcache *zc)
+{
+	free(zc->data);
+	zc->data = NULL;
+}
+
+unsigned char *zcache_lookup(zcache *zc, a1fs_blk_t start)
+{
+	zc->clock++;
+	for (int i = 0; i < ZCACHE_SLOTS; i++) {
+		if (zc->keys[i] == start) {
+			zc->used[i] = zc->clock;
+			zc->hits++;
+			return zc->data + (size_t)i * A1FS_CLUSTER_SIZE;
+		}
+	}
+	zc->misses++;
+	return NULL;
+}
+
+unsigned char *zcache_insert(zcache *zc, a1fs_blk_t start)
+{
+	int victim = 0;
+	for (int i = 1; i < ZCACHE_SLOTS; i++) {
+		if (zc->used[i] < zc->used[victim]) {
+			victim = i;
+		}
+	}
+	zc->keys[victim] = start;
+	zc->used[victim] = zc->clock;
+	return zc->data + (size_t)victim * A1FS_CLUSTER_SIZE;
+}
+
+void zcache_invalidate(zcache *zc, a1fs_blk_t start, a1fs_blk_t count)
+{
+	for (int i = 0; i < ZCACHE_SLOTS; i++) {
+		if (zc->keys[i] != ZCACHE_EMPTY && zc->keys[i] >= start &&
+		    zc->keys[i] - start < count)
+		{
+			zc->keys[i] = ZCACHE_EMPTY;
+			zc->used[i] = 0;
+		}
+	}
+}
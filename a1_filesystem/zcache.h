@@ -0,0 +1,88 @@
+/*
+ * This code is provided solely for the personal and private use of students
+ * taking the CSC369H course at the University of Toronto. Copying for purposes
+ * other than this use is expressly prohibited. All forms of distribution of
+ * this code, including but not limited to public repositories on GitHub,
+ * GitLab, Bitbucket, or any other online platform, whether as given or with
+ * any changes, are expressly prohibited.
+ *
+ * Authors: Alexey Khrabrov, Karen Reid
+ *
+ * All of the files in this directory and all subdirectories are:
+ * Copyright (c) 2019, 2021 Karen Reid
+ */
+
+/**
+ * CSC369 Assignment 1 - Decompressed cluster cache header file.
+ *
+ * Reading a block of a compressed cluster requires decompressing the whole
+ * cluster, so the last few decompressed clusters are kept in memory to let a
+ * sequential reader go through a cluster with a single decompression. Entries
+ * are keyed by the first data block of the compressed cluster; since a
+ * compressed cluster is never modified in place, an entry only becomes stale
+ * when its blocks are freed (see zcache_invalidate()).
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "a1fs.h"
+
+
+/** Number of decompressed clusters kept in memory. */
+#define ZCACHE_SLOTS 8
+
+/** Decompressed cluster cache. */
+typedef struct zcache {
+	/** First data block of the cluster in each slot; ZCACHE_EMPTY if none. */
+	a1fs_blk_t keys[ZCACHE_SLOTS];
+	/** Value of clock at the last use of each slot, for LRU eviction. */
+	uint64_t used[ZCACHE_SLOTS];
+	/** Incremented on every lookup. */
+	uint64_t clock;
+	/** Decompressed clusters, A1FS_CLUSTER_SIZE bytes per slot. */
+	unsigned char *data;
+
+	/** Lookups that found the cluster in the cache. */
+	uint64_t hits;
+	/** Lookups that didn't. */
+	uint64_t misses;
+
+} zcache;
+
+/** Key of an empty slot. */
+#define ZCACHE_EMPTY ((a1fs_blk_t)-1)
+
+/**
+ * Initialize a cluster cache.
+ *
+ * @return  true on success; false if out of memory.
+ */
+bool zcache_init(zcache *zc);
+
+/** Release the memory of a cluster cache. */
+void zcache_destroy(zcache *zc);
+
+/**
+ * Find a decompressed cluster.
+ *
+ * @param start  first data block of the compressed cluster.
+ * @return       decompressed cluster data; NULL if not cached.
+ */
+unsigned char *zcache_lookup(zcache *zc, a1fs_blk_t start);
+
+/**
+ * Get a slot for a cluster, evicting the least recently used one.
+ *
+ * The caller must fill the returned buffer with the decompressed cluster, or
+ * drop it with zcache_invalidate() if that fails.
+ *
+ * @param start  first data block of the compressed cluster.
+ * @return       buffer of A1FS_CLUSTER_SIZE bytes.
+ */
+unsigned char *zcache_insert(zcache *zc, a1fs_blk_t start);
+
+/** Drop the clusters that start in a run of data blocks. */
+void zcache_invalidate(zcache *zc, a1fs_blk_t start, a1fs_blk_t count);